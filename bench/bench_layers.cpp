@@ -0,0 +1,324 @@
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include "phy_layer.h"
+#include "mac_layer.h"
+#include "mac_scheduler.h"
+#include "rlc_layer.h"
+#include "pdcp_layer.h"
+#include "crc.h"
+#include "nas_msgs.h"
+#include "rrc_msgs.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_heap_allocs{0};
+void* operator new(size_t n) {
+    g_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void  operator delete(void* p) noexcept         { std::free(p); }
+void  operator delete(void* p, size_t) noexcept { std::free(p); }
+
+using Clock = std::chrono::steady_clock;
+static inline uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static constexpr size_t BATCH = 256;
+static const size_t PDU_SIZES[] = {40, 64, 128, 256, 512, 1024, 1500, 4096, 9000};
+
+struct BenchResult {
+    std::string layer, mode, dir;
+    size_t   pdu_size = 0;
+    uint64_t pdus = 0;
+    double   ns_per_pdu = 0, pdus_per_s = 0, gbps = 0, allocs_per_pdu = 0;
+    uint64_t p50 = 0, p99 = 0, p999 = 0;
+};
+
+static size_t g_target_pdus = 20000;
+
+// Each batch is prepared untimed, then run twice: once timed in bulk for
+// throughput and once per PDU for the latency distribution.
+template <typename Prep, typename Run>
+BenchResult run_case(const char* layer, const char* mode, const char* dir, size_t size, Prep prep, Run run) {
+    BenchResult r;
+    r.layer = layer; r.mode = mode; r.dir = dir; r.pdu_size = size;
+    size_t total = std::max<size_t>(BATCH, g_target_pdus * 256 / std::max<size_t>(size, 256));
+    total = (total + BATCH - 1) / BATCH * BATCH;
+    std::vector<PduBuffer> batch(BATCH);
+    std::vector<uint64_t>  lat;
+    lat.reserve(total);
+    uint64_t bulk_ns = 0, allocs = 0;
+    for (size_t done = 0; done < total; done += BATCH) {
+        prep(batch.data(), BATCH, size);
+        uint64_t a0 = g_heap_allocs.load(std::memory_order_relaxed);
+        uint64_t t0 = now_ns();
+        for (size_t i = 0; i < BATCH; i++) run(batch[i]);
+        bulk_ns += now_ns() - t0;
+        allocs  += g_heap_allocs.load(std::memory_order_relaxed) - a0;
+        prep(batch.data(), BATCH, size);
+        for (size_t i = 0; i < BATCH; i++) {
+            uint64_t s = now_ns();
+            run(batch[i]);
+            lat.push_back(now_ns() - s);
+        }
+    }
+    std::sort(lat.begin(), lat.end());
+    r.pdus           = total;
+    r.ns_per_pdu     = (double)bulk_ns / total;
+    r.pdus_per_s     = r.ns_per_pdu > 0 ? 1e9 / r.ns_per_pdu : 0;
+    r.gbps           = r.ns_per_pdu > 0 ? size * 8.0 / r.ns_per_pdu : 0;
+    r.allocs_per_pdu = (double)allocs / total;
+    r.p50  = lat[lat.size() * 50 / 100];
+    r.p99  = lat[lat.size() * 99 / 100];
+    r.p999 = lat[lat.size() * 999 / 1000];
+    return r;
+}
+
+static void fill_sdus(PduBuffer* pdus, size_t n, size_t size) {
+    for (size_t i = 0; i < n; i++) {
+        pdus[i] = PduBuffer::alloc(size);
+        std::memset(pdus[i].data(), (int)(i & 0xFF), size);
+        if (size >= 20) pdus[i][0] = 0x45;
+    }
+}
+
+static void bench_pdcp(std::vector<BenchResult>& out, size_t size) {
+    PdcpLayer tx(PdcpBearerType::DRB), peer(PdcpBearerType::DRB), rx(PdcpBearerType::DRB);
+    out.push_back(run_case("PDCP", "DRB", "TX", size, fill_sdus, [&](PduBuffer& p) { tx.transmit_sdu(p); }));
+    out.push_back(run_case("PDCP", "DRB", "RX", size,
+        [&](PduBuffer* p, size_t n, size_t s) { fill_sdus(p, n, s); for (size_t i = 0; i < n; i++) peer.transmit_sdu(p[i]); },
+        [&](PduBuffer& p) { rx.receive_pdu(p); }));
+}
+
+// VoIP-like IPv4/UDP/RTP packets round-robin over 1000 flows (large CIDs),
+// 20 ms frames at 8 kHz: SN +1 and TS +160 per packet of each flow.
+static void bench_rohc(std::vector<BenchResult>& out, size_t size) {
+    if (size < 40) return;
+    constexpr uint32_t FLOWS = 1000;
+    RohcConfig cfg; cfg.max_cid = 2047;
+    PdcpLayer tx(PdcpBearerType::DRB, cfg), peer(PdcpBearerType::DRB, cfg), rx(PdcpBearerType::DRB, cfg);
+    uint64_t seq = 0;
+    auto fill_rtp = [&seq](PduBuffer* p, size_t n, size_t s) {
+        for (size_t i = 0; i < n; i++, seq++) {
+            uint32_t flow = (uint32_t)(seq % FLOWS), k = (uint32_t)(seq / FLOWS), ts = 160 * k;
+            uint16_t sn = (uint16_t)k, id = (uint16_t)(k + flow);
+            p[i] = PduBuffer::alloc(s);
+            uint8_t* h = p[i].data();
+            std::memset(h, 0x5A, s);
+            uint8_t hdr[40] = {0x45, 0xB8, (uint8_t)(s >> 8), (uint8_t)s, (uint8_t)(id >> 8), (uint8_t)id, 0x40, 0, 64, 17, 0, 0,
+                               10, 45, (uint8_t)(flow >> 8), (uint8_t)flow, 10, 0, 0, 1,
+                               0x40, 0x00, 0x4E, 0x20, (uint8_t)((s - 20) >> 8), (uint8_t)(s - 20), 0, 0,
+                               0x80, 0x08, (uint8_t)(sn >> 8), (uint8_t)sn, (uint8_t)(ts >> 24), (uint8_t)(ts >> 16),
+                               (uint8_t)(ts >> 8), (uint8_t)ts, 0xCA, 0xFE, (uint8_t)(flow >> 8), (uint8_t)flow};
+            uint32_t sum = 0;
+            for (int j = 0; j < 20; j += 2) sum += (uint32_t)(hdr[j] << 8 | hdr[j + 1]);
+            while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+            hdr[10] = (uint8_t)(~sum >> 8); hdr[11] = (uint8_t)~sum;
+            std::memcpy(h, hdr, sizeof(hdr));
+        }
+    };
+    out.push_back(run_case("PDCP", "ROHC", "TX", size, fill_rtp, [&](PduBuffer& p) { tx.transmit_sdu(p); }));
+    out.push_back(run_case("PDCP", "ROHC", "RX", size,
+        [&](PduBuffer* p, size_t n, size_t s) { fill_rtp(p, n, s); for (size_t i = 0; i < n; i++) peer.transmit_sdu(p[i]); },
+        [&](PduBuffer& p) { rx.receive_pdu(p); }));
+}
+
+static void bench_pdcp_sec(std::vector<BenchResult>& out, size_t size, AesImpl impl, const char* name) {
+    if (!aes128_select(impl)) return;
+    PdcpSecurityConfig cfg;
+    cfg.cipher = CipherAlg::NEA2; cfg.integ = IntegAlg::NIA2;
+    for (int i = 0; i < 16; i++) { cfg.k_enc[i] = (uint8_t)i; cfg.k_int[i] = (uint8_t)~i; }
+    PdcpLayer tx(PdcpBearerType::DRB), peer(PdcpBearerType::DRB), rx(PdcpBearerType::DRB);
+    tx.set_security(cfg);
+    peer.set_security(cfg);
+    cfg.direction = 1;
+    rx.set_security(cfg);
+    out.push_back(run_case("PDCP", name, "TX", size, fill_sdus, [&](PduBuffer& p) { tx.transmit_sdu(p); }));
+    out.push_back(run_case("PDCP", name, "RX", size,
+        [&](PduBuffer* p, size_t n, size_t s) { fill_sdus(p, n, s); for (size_t i = 0; i < n; i++) peer.transmit_sdu(p[i]); },
+        [&](PduBuffer& p) { rx.receive_pdu(p); }));
+    aes128_select(AesImpl::AUTO);
+}
+
+static void bench_rlc(std::vector<BenchResult>& out, size_t size, RlcMode mode, const char* name) {
+    RlcLayer tx(mode), peer(mode), rx(mode);
+    auto ack = [](RlcLayer& e) { if (e.get_mode() == RlcMode::AM) e.process_status_pdu(e.get_tx_sn(), {}); };
+    out.push_back(run_case("RLC", name, "TX", size,
+        [&](PduBuffer* p, size_t n, size_t s) { ack(tx); fill_sdus(p, n, s); },
+        [&](PduBuffer& p) { tx.transmit_sdu(p); }));
+    out.push_back(run_case("RLC", name, "RX", size,
+        [&](PduBuffer* p, size_t n, size_t s) { ack(peer); fill_sdus(p, n, s); for (size_t i = 0; i < n; i++) peer.transmit_sdu(p[i]); },
+        [&](PduBuffer& p) { rx.receive_pdu(p); }));
+}
+
+static void bench_mac(std::vector<BenchResult>& out, size_t size) {
+    MacLayer tx, peer, rx;
+    out.push_back(run_case("MAC", "HARQ", "TX", size, fill_sdus,
+        [&](PduBuffer& p) { tx.transmit_sdu(p); tx.harq_feedback(tx.get_last_harq_id(), true); }));
+    out.push_back(run_case("MAC", "HARQ", "RX", size,
+        [&](PduBuffer* p, size_t n, size_t s) {
+            fill_sdus(p, n, s);
+            for (size_t i = 0; i < n; i++) { peer.transmit_sdu(p[i]); peer.harq_feedback(peer.get_last_harq_id(), true); }
+        },
+        [&](PduBuffer& p) { rx.receive_pdu(p); }));
+    // Multiplexed TX: SDUs are packed into full-carrier grants; a TB goes out
+    // whenever the queue would fill one.
+    MacLayer mux;
+    PduBuffer tb;
+    uint32_t tbs = transport_block_size(MCS::QAM64_5_6, 255);
+    out.push_back(run_case("MAC", "MUX", "TX", size, fill_sdus,
+        [&](PduBuffer& p) {
+            mux.queue_sdu(LogicalChannel::DTCH, p);
+            if ((mux.queued_bytes() / size + 2) * (size + 3) > tbs) {
+                mux.transmit_tb(tbs, tb);
+                mux.harq_feedback(mux.get_last_harq_id(), true);
+            }
+        }));
+}
+
+static void bench_phy(std::vector<BenchResult>& out, size_t size) {
+    PhyConfig cfg; cfg.channel_snr_db = 30.0f;
+    PhyLayer tx(cfg), peer(cfg), rx(cfg);
+    auto with_crc = [&](PduBuffer* p, size_t n, size_t s) {
+        fill_sdus(p, n, s);
+        for (size_t i = 0; i < n; i++) peer.transmit_transport_block(p[i]);
+    };
+    out.push_back(run_case("PHY", "TB", "TX", size, fill_sdus, [&](PduBuffer& p) { tx.transmit_transport_block(p); }));
+    out.push_back(run_case("PHY", "TB", "RX", size, with_crc, [&](PduBuffer& p) { rx.receive_transport_block(p); }));
+    // Same TX path with the slicing-by-8 CRC kernel instead of PCLMUL.
+    crc_select(CrcImpl::TABLE);
+    out.push_back(run_case("PHY", "CRCSW", "TX", size, fill_sdus, [&](PduBuffer& p) { tx.transmit_transport_block(p); }));
+    crc_select(CrcImpl::AUTO);
+    // Near the 50% BLER point: half the TBs take the bit-error injection path.
+    cfg.channel_snr_db = 5.5f;
+    PhyLayer lossy(cfg);
+    out.push_back(run_case("PHY", "LOSSY", "RX", size, with_crc, [&](PduBuffer& p) { lossy.receive_transport_block(p); }));
+    // Link level, 64QAM: scramble, map, AWGN, LLR demap and descramble per TB.
+    // A 100-PRB cell carries 100 * 12 * 14 * 1000 = 16.8 M symbols/s.
+    cfg.link_level = true; cfg.mcs = MCS::QAM64_5_6; cfg.channel_snr_db = 30.0f;
+    PhyLayer link(cfg);
+    out.push_back(run_case("PHY", "LINK", "RX", size, with_crc, [&](PduBuffer& p) { link.receive_transport_block(p); }));
+}
+
+// One slot on a 273-PRB carrier with every UE backlogged; pdu_size holds the
+// number of UEs. A timed slot first applies that slot's reports (the UEs
+// served last slot refill their buffers, 1/80 of all UEs send a new SNR as
+// with an 80-slot CQI period), then makes the scheduling decision.
+static void bench_sched(std::vector<BenchResult>& out, size_t ues, SchedPolicy policy, const char* name) {
+    SchedConfig cfg; cfg.policy = policy; cfg.num_prbs = 273;
+    MacScheduler sched(cfg);
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    auto snr = [&seed]() { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return (float)((seed >> 40) % 300) / 10.0f; };
+    for (size_t r = 1; r <= ues; r++) { sched.add_ue((uint16_t)r); sched.update_channel((uint16_t)r, snr()); sched.update_buffer((uint16_t)r, 100000); }
+    SchedGrant g[16];
+    size_t cqi_next = 1, ngrants = 0;
+    auto refill = [&](PduBuffer*, size_t, size_t) {};
+    BenchResult r = run_case("SCHED", name, "DL", ues, refill, [&](PduBuffer&) {
+        for (size_t i = 0; i < ngrants; i++) sched.update_buffer(g[i].rnti, 100000);
+        for (size_t i = 0; i < ues / 80; i++, cqi_next = cqi_next % ues + 1) sched.update_channel((uint16_t)cqi_next, snr());
+        ngrants = sched.schedule(g, 16);
+    });
+    r.gbps = 0;
+    out.push_back(r);
+}
+
+// Signaling codecs: encode into / decode views out of a reused buffer, with
+// pdu_size the encoded length. AUTH_REQUEST is APER, the RRCReconfiguration
+// with a 64-byte NAS container UPER (its container unaligned).
+template <typename Msg, typename Enc, typename Dec>
+static void bench_codec_msg(std::vector<BenchResult>& out, const char* mode, const Msg& m, Enc enc, Dec dec) {
+    uint8_t buf[256];
+    size_t  n = enc(m, buf);
+    volatile size_t sink = 0;
+    auto none = [](PduBuffer*, size_t, size_t) {};
+    BenchResult e = run_case("CODEC", mode, "ENC", n, none, [&](PduBuffer&) { sink = sink + enc(m, buf); });
+    BenchResult d = run_case("CODEC", mode, "DEC", n, none, [&](PduBuffer&) { Msg v; sink = sink + (dec(buf, n, v) == Status::OK); });
+    out.push_back(e);
+    out.push_back(d);
+}
+static void bench_codec(std::vector<BenchResult>& out) {
+    static const uint8_t abba[2] = {}, rnd[16] = {1}, autn[16] = {2}, nas[64] = {3};
+    NasAuthRequestMsg ar;
+    ar.abba = PerView::of(abba, sizeof(abba));
+    ar.rand = PerView::of(rnd, sizeof(rnd));
+    ar.autn = PerView::of(autn, sizeof(autn));
+    bench_codec_msg(out, "NAS", ar,
+                    [](const NasAuthRequestMsg& m, uint8_t* b) { return nas_encode(m, 0, b, 256); },
+                    [](const uint8_t* b, size_t n, NasAuthRequestMsg& m) { return nas_decode(b, n, m); });
+    RrcReconfigMsg rc;
+    rc.dedicated_nas = PerView::of(nas, sizeof(nas));
+    bench_codec_msg(out, "RRC", rc,
+                    [](const RrcReconfigMsg& m, uint8_t* b) { return rrc_encode(m, b, 256); },
+                    [](const uint8_t* b, size_t n, RrcReconfigMsg& m) { return rrc_decode(b, n, m); });
+}
+
+static void write_json(const std::vector<BenchResult>& res, const std::string& path) {
+    std::ofstream f(path);
+    f << "{\n  \"unit_latency\": \"ns\",\n  \"results\": [\n";
+    for (size_t i = 0; i < res.size(); i++) {
+        const BenchResult& r = res[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    {\"layer\": \"%s\", \"mode\": \"%s\", \"dir\": \"%s\", \"pdu_size\": %zu, \"pdus\": %llu, "
+            "\"ns_per_pdu\": %.2f, \"pdus_per_s\": %.0f, \"gbps\": %.3f, \"allocs_per_pdu\": %.3f, "
+            "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}%s\n",
+            r.layer.c_str(), r.mode.c_str(), r.dir.c_str(), r.pdu_size, (unsigned long long)r.pdus,
+            r.ns_per_pdu, r.pdus_per_s, r.gbps, r.allocs_per_pdu,
+            (unsigned long long)r.p50, (unsigned long long)r.p99, (unsigned long long)r.p999,
+            i + 1 < res.size() ? "," : "");
+        f << line;
+    }
+    f << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    std::string json_path = "bench_results.json";
+    std::string filter;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if      (!std::strcmp(argv[i], "--json"))   json_path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--pdus"))   g_target_pdus = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--filter")) filter = argv[i + 1];
+    }
+    Logger::instance().set_level(LogLevel::ERR);
+    std::vector<BenchResult> res;
+    auto want = [&](const char* layer) { return filter.empty() || filter == layer; };
+    for (size_t size : PDU_SIZES) {
+        if (want("PDCP")) {
+            bench_pdcp(res, size);
+            bench_rohc(res, size);
+            bench_pdcp_sec(res, size, AesImpl::AESNI, "SEC");
+            bench_pdcp_sec(res, size, AesImpl::SCALAR, "SECSW");
+        }
+        if (want("RLC"))  { bench_rlc(res, size, RlcMode::TM, "TM"); bench_rlc(res, size, RlcMode::UM, "UM"); bench_rlc(res, size, RlcMode::AM, "AM"); }
+        if (want("MAC"))  bench_mac(res, size);
+        if (want("PHY"))  bench_phy(res, size);
+    }
+    if (want("SCHED"))
+        for (size_t ues : {1000, 10000, 50000}) {
+            bench_sched(res, ues, SchedPolicy::RR, "RR");
+            bench_sched(res, ues, SchedPolicy::PF, "PF");
+            bench_sched(res, ues, SchedPolicy::MAX_CI, "MAXCI");
+        }
+    if (want("CODEC")) bench_codec(res);
+    std::printf("%-5s %-5s %-3s %6s %10s %12s %9s %8s %8s %8s %9s\n",
+                "layer", "mode", "dir", "bytes", "ns/PDU", "PDU/s", "Gbit/s", "allocs", "p50", "p99", "p99.9");
+    for (const BenchResult& r : res)
+        std::printf("%-5s %-5s %-3s %6zu %10.1f %12.0f %9.3f %8.3f %8llu %8llu %9llu\n",
+                    r.layer.c_str(), r.mode.c_str(), r.dir.c_str(), r.pdu_size, r.ns_per_pdu, r.pdus_per_s,
+                    r.gbps, r.allocs_per_pdu, (unsigned long long)r.p50, (unsigned long long)r.p99,
+                    (unsigned long long)r.p999);
+    write_json(res, json_path);
+    std::printf("\nJSON written to %s\n", json_path.c_str());
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// AES-128 encryption core shared by the PDCP security algorithms and AKA.
+// Kernels: AES-NI (8 blocks in flight, one key per lane) and a portable
+// T-table fallback, selected once at startup from CPUID.
+enum class AesImpl { AUTO, SCALAR, AESNI };
+
+struct alignas(16) Aes128Key {
+    uint8_t rk[176];
+};
+
+// CMAC key: expanded cipher key plus the K1/K2 subkeys of RFC 4493.
+struct alignas(16) Aes128Cmac {
+    Aes128Key key;
+    uint8_t   k1[16];
+    uint8_t   k2[16];
+};
+
+static constexpr size_t AES_LANES = 8;
+
+void aes128_expand(const uint8_t key[16], Aes128Key& out);
+void aes128_cmac_init(const uint8_t key[16], Aes128Cmac& out);
+void aes128_encrypt(const Aes128Key& key, const uint8_t in[16], uint8_t out[16]);
+// Encrypts n <= AES_LANES independent blocks in place, block i under keys[i].
+void aes128_encrypt_lanes(const Aes128Key* const* keys, uint8_t (*blocks)[16], size_t n);
+// CBC-MAC chaining: x = E(x ^ block) over n contiguous 16-byte blocks.
+void aes128_cbc_mac(const Aes128Key& key, uint8_t x[16], const uint8_t* blocks, size_t n);
+// n <= AES_LANES independent CBC-MAC chains advanced nblocks each; chain i
+// reads contiguous blocks from data[i] under keys[i].
+void aes128_cbc_mac_lanes(const Aes128Key* const* keys, uint8_t (*x)[16], const uint8_t* const* data,
+                          size_t n, size_t nblocks);
+// CTR keystream XOR over nblocks full blocks. The low 64 bits of iv are a
+// big-endian block counter, starting at first_block.
+void aes128_ctr_xor(const Aes128Key& key, const uint8_t iv[16], uint64_t first_block, uint8_t* data, size_t nblocks);
+void aes128_cmac(const Aes128Cmac& key, const uint8_t* msg, size_t len, uint8_t mac[16]);
+
+// Returns false if the requested kernel is not supported by this CPU.
+bool        aes128_select(AesImpl impl);
+const char* aes128_impl_name();
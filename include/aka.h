@@ -0,0 +1,105 @@
+#pragma once
+#include "aes128.h"
+#include "common_types.h"
+#include "rng.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Milenage (TS 35.205/35.206) and 5G-AKA key derivation (TS 33.501 Annex A,
+// KDF of TS 33.220 B.2). Milenage runs eight subscribers per AES-lane batch.
+struct MilenageOut {
+    uint8_t mac_a[8];
+    uint8_t mac_s[8];
+    uint8_t res[8];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[6];
+    uint8_t ak_star[6];
+};
+
+struct MilenageJob {
+    const Aes128Key* k;
+    const uint8_t*   opc;
+    const uint8_t*   rand;
+    const uint8_t*   sqn;    // 6 bytes
+    const uint8_t*   amf;    // 2 bytes
+    MilenageOut*     out;
+};
+
+void milenage_opc(const uint8_t k[16], const uint8_t op[16], uint8_t opc[16]);
+void milenage(const Aes128Key& k, const uint8_t opc[16], const uint8_t rand[16],
+              const uint8_t sqn[6], const uint8_t amf[2], MilenageOut& out);
+void milenage_batch(const MilenageJob* jobs, size_t n);
+
+// 5G HE AV as the AUSF keeps it, plus the SEAF anchor key.
+struct AkaVector {
+    uint8_t rand[16];
+    uint8_t autn[16];
+    uint8_t xres_star[16];
+    uint8_t hxres_star[16];
+    uint8_t k_seaf[32];
+};
+
+struct AkaKdfParam {
+    const uint8_t* data;
+    size_t         len;
+};
+void aka_kdf(const uint8_t* key, size_t key_len, uint8_t fc, const AkaKdfParam* params, size_t n, uint8_t out[32]);
+void aka_res_star(const uint8_t ck[16], const uint8_t ik[16], const std::string& snn,
+                  const uint8_t rand[16], const uint8_t res[8], uint8_t res_star[16]);
+void aka_hres_star(const uint8_t rand[16], const uint8_t res_star[16], uint8_t hres_star[16]);
+void aka_k_ausf(const uint8_t ck[16], const uint8_t ik[16], const std::string& snn,
+                const uint8_t sqn_xor_ak[6], uint8_t k_ausf[32]);
+void aka_k_seaf(const uint8_t k_ausf[32], const std::string& snn, uint8_t k_seaf[32]);
+
+enum class AkaResult : uint8_t { OK, MAC_FAILURE, SYNC_FAILURE };
+
+// UE (USIM + ME) side: checks AUTN's MAC and freshness against sqn_ms, the
+// highest SQN accepted so far (updated on success), and derives RES*.
+// k_seaf may be null.
+AkaResult aka_ue_authenticate(const uint8_t k[16], const uint8_t opc[16], const uint8_t rand[16],
+                              const uint8_t autn[16], const std::string& snn, uint8_t sqn_ms[6],
+                              uint8_t res_star[16], uint8_t* k_seaf);
+
+struct AkaConfig {
+    std::string snn         = "5G:mnc260.mcc310.3gppnetwork.org";
+    uint8_t     amf[2]      = {0x80, 0x00};   // separation bit set
+    size_t      cache_depth = 2;              // vectors kept per subscriber
+};
+
+struct alignas(CACHE_LINE_SIZE) AkaStats {
+    std::atomic<uint64_t> generated{0};
+    std::atomic<uint64_t> cache_hits{0};
+    std::atomic<uint64_t> cache_misses{0};
+};
+
+// Home network (UDM/ARPF + AUSF) for a set of subscribers. Each subscriber
+// has a bounded FIFO of pre-generated vectors; get_vector() takes the
+// oldest or, on a miss, generates one on the spot. prefill() tops every
+// cache up in batches of AES_LANES subscribers. Single-threaded.
+class AkaAuc {
+public:
+    explicit AkaAuc(AkaConfig cfg = {}, uint64_t rng_stream_id = 0);
+    uint32_t add_subscriber(const uint8_t k[16], const uint8_t opc[16]);
+    void     get_vector(uint32_t sub, AkaVector& out);
+    size_t   prefill();
+    size_t   num_subscribers() const { return subs_.size(); }
+    size_t   cached(uint32_t sub) const { return subs_[sub].count; }
+    const AkaConfig& config() const { return cfg_; }
+    const AkaStats&  stats()  const { return stats_; }
+private:
+    struct Subscriber {
+        uint8_t k[16];
+        uint8_t opc[16];
+        uint8_t sqn[6] = {};
+        uint8_t head   = 0;
+        uint8_t count  = 0;
+    };
+    AkaConfig               cfg_;
+    std::vector<Subscriber> subs_;
+    std::vector<AkaVector>  cache_;   // cache_depth slots per subscriber
+    Philox4x32              rng_;
+    AkaStats                stats_;
+    void generate(const uint32_t* subs, AkaVector* const* out, size_t n);
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include "ring_buffer.h"
+#include "phy_layer.h"
+#include "mac_layer.h"
+#include "rlc_layer.h"
+#include "pdcp_layer.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+enum class PipelineMode : uint8_t { RUN_TO_COMPLETION, PIPELINED };
+
+enum PipeStage : uint8_t { PIPE_PDCP, PIPE_RLC, PIPE_MACPHY, PIPE_STAGES };
+
+struct PipelineConfig {
+    PipelineMode   mode          = PipelineMode::RUN_TO_COMPLETION;
+    size_t         ring_depth    = 1024;   // per ring, in each direction
+    size_t         batch         = 32;     // PDUs a stage takes per pass (max 256)
+    int            first_cpu     = -1;     // stage i pinned to CPU first_cpu + i; -1: unpinned
+    RlcMode        rlc_mode      = RlcMode::AM;
+    PdcpBearerType bearer        = PdcpBearerType::DRB;
+    PhyConfig      phy;
+    bool           auto_harq_ack = true;
+    bool           auto_rlc_ack  = true;
+};
+
+// A PDU handle on the rings. Going down it carries the SDU; coming back up,
+// the transmitted TB with its outcome and the RLC SN that acknowledges it.
+struct PipeItem {
+    PduBuffer pdu;
+    Status    status = Status::OK;
+    uint16_t  rlc_sn = 0;
+    uint32_t  bytes  = 0;   // SDU size
+};
+
+struct PipelineStats {
+    uint64_t submitted = 0, completed = 0, tx_bytes = 0, errors = 0, refused = 0;
+    uint64_t stalls[PIPE_STAGES] = {};   // passes held up by a full ring or the RLC window
+};
+
+// Downlink user plane of one bearer, PDCP -> RLC -> MAC -> PHY.
+//
+// RUN_TO_COMPLETION runs each submitted burst through every layer on the
+// caller's thread. PIPELINED gives PDCP, RLC and MAC+PHY a thread each,
+// joined by SPSC rings of PipeItem: SDUs flow down, finished TBs flow back
+// up so RLC can take its acknowledgement and the caller, which allocated the
+// SDU, frees it into its own PduPool. A full ring holds its producer back,
+// so congestion reaches submit() as BUFFER_FULL. Single submitting thread.
+class BearerPipeline {
+public:
+    explicit BearerPipeline(PipelineConfig cfg = {});
+    ~BearerPipeline();
+    BearerPipeline(const BearerPipeline&) = delete;
+    BearerPipeline& operator=(const BearerPipeline&) = delete;
+    void   start();
+    void   stop();   // in-flight PDUs are dropped; drain() first to finish them
+    // Takes the SDU, or returns BUFFER_FULL and leaves it with the caller.
+    Status submit(PduBuffer& sdu);
+    // Takes sdus[0..k) and returns k; the rest were refused.
+    size_t submit_burst(PduBuffer* sdus, size_t n);
+    size_t reap();   // frees completed PDUs; returns how many
+    void   drain();  // reaps until every submitted SDU has completed (PIPELINED: once started)
+    PipelineStats stats() const;
+    const PipelineConfig& config() const { return cfg_; }
+    // Only safe to look at once drained or stopped.
+    const PdcpLayer& pdcp() const { return pdcp_; }
+    const RlcLayer&  rlc()  const { return rlc_; }
+    const MacLayer&  mac()  const { return mac_; }
+private:
+    // A stage's batch in flight, SoA so layer bursts run over it directly:
+    // [head, done) is processed and waits for ring space, [done, n) is not.
+    struct Lane {
+        std::vector<PduBuffer> pdu;
+        std::vector<Status>    st;
+        std::vector<uint16_t>  sn;
+        std::vector<uint32_t>  bytes;
+        size_t head = 0, done = 0, n = 0;
+        explicit Lane(size_t cap) : pdu(cap), st(cap), sn(cap), bytes(cap) {}
+    };
+    using Ring = SpscRing<PipeItem>;
+
+    PipelineConfig cfg_;
+    PdcpLayer      pdcp_;
+    RlcLayer       rlc_;
+    MacLayer       mac_;
+    PhyLayer       phy_;
+    // down_[s] feeds stage s; up_[s] carries completions out of stage s,
+    // up_[PIPE_PDCP] to the caller.
+    std::unique_ptr<Ring>    down_[PIPE_STAGES];
+    std::unique_ptr<Ring>    up_[PIPE_STAGES];
+    std::thread              workers_[PIPE_STAGES];
+    std::atomic<bool>        running_{false};
+    struct alignas(CACHE_LINE_SIZE) StageStats { std::atomic<uint64_t> stalls{0}; };
+    StageStats               stage_stats_[PIPE_STAGES];
+    Lane                     rtc_;
+    uint64_t submitted_ = 0, completed_ = 0, tx_bytes_ = 0, errors_ = 0, refused_ = 0;
+
+    size_t process(size_t s, Lane& l, size_t from, size_t n);
+    void   ack_rlc(const Lane& l, size_t from, size_t n);
+    void   account(Status st, uint32_t bytes);
+    size_t settle(Lane& l, size_t n);
+    void   run_to_completion(PduBuffer* sdus, size_t n);
+    bool   flush(size_t s, Lane& l, bool up);
+    bool   pass(size_t s, Lane& down, Lane& up);
+    void   stage_loop(size_t s);
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "common_types.h"
+#include "modulation.h"
+#include "pdu_buffer.h"
+#include "rng.h"
+#include <vector>
+
+enum class MCS : uint8_t;
+
+// AWGN link abstraction: TB error rate from per-MCS BLER-vs-SNR curves
+// (tabulated once, 0.1 dB steps) and bit errors injected into failed TBs at
+// the uncoded bit error rate. Each instance draws from its own Philox stream.
+class ChannelModel {
+public:
+    static constexpr float SNR_MIN_DB  = -10.0f;
+    static constexpr float SNR_MAX_DB  = 40.0f;
+    static constexpr float SNR_STEP_DB = 0.1f;
+
+    explicit ChannelModel(uint64_t stream = 0, uint64_t seed = rng_seed());
+    static float bler(MCS mcs, float snr_db);
+    static float raw_ber(MCS mcs, float snr_db);
+
+    // True if the TB decodes; a failed TB is corrupted in place.
+    bool   decode(PduBuffer& tb, MCS mcs, float snr_db);
+    // Status OK / RETRY per TB; returns the number that decoded.
+    size_t decode_batch(PduBuffer* tbs, size_t n, MCS mcs, float snr_db, Status* status);
+    // Flips each bit of p[0, len) with probability ber; returns bits flipped.
+    size_t inject_bit_errors(uint8_t* p, size_t len, float ber);
+    // Link-level path: scramble with c_init, map, add AWGN at snr_db, max-log
+    // demap, hard decision, descramble. There is no channel decoder, so the
+    // TB sees the uncoded symbol error rate. Returns bits flipped.
+    size_t transmit_symbols(PduBuffer& tb, MCS mcs, float snr_db, uint32_t c_init);
+    uint64_t get_bit_errors() const { return bit_errors_; }
+private:
+    Philox4x32           rng_;
+    uint64_t             bit_errors_ = 0;
+    std::vector<cf32>    sym_;
+    std::vector<float>   llr_;
+    std::vector<uint8_t> ref_;
+};
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include "logger.h"
 
 using Bytes = std::vector<uint8_t>;
 
@@ -34,23 +35,6 @@ inline const char* status_str(Status s) {
     return "UNKNOWN";
 }
 
-enum class LogLevel { DEBUG, INFO, WARN, ERR };
-
-class Logger {
-public:
-    static Logger& instance() { static Logger inst; return inst; }
-    void log(LogLevel lvl, const std::string& layer, const std::string& msg) {
-        const char* lvl_str[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
-        std::cout << "[" << lvl_str[(int)lvl] << "][" 
-                  << std::setw(5) << layer << "] " << msg << "\n";
-    }
-};
-
-#define LOG_DEBUG(layer, msg) Logger::instance().log(LogLevel::DEBUG, layer, msg)
-#define LOG_INFO(layer, msg)  Logger::instance().log(LogLevel::INFO,  layer, msg)
-#define LOG_WARN(layer, msg)  Logger::instance().log(LogLevel::WARN,  layer, msg)
-#define LOG_ERR(layer, msg)   Logger::instance().log(LogLevel::ERR,   layer, msg)
-
 inline std::string hex_dump(const Bytes& b, size_t max_bytes = 32) {
     std::ostringstream ss;
     size_t n = std::min(b.size(), max_bytes);
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 3GPP CRCs, TS 38.212 5.1: MSB-first, zero init, no final XOR. CRC24A
+// protects transport blocks above 3824 bits, CRC16 smaller ones, CRC24B
+// each LDPC code block and CRC24C the DCI.
+// Kernels: PCLMULQDQ folding (64 bytes per iteration) and a portable
+// slicing-by-8 table fallback, selected once at startup from CPUID.
+enum class CrcType : uint8_t { CRC24A, CRC24B, CRC24C, CRC16 };
+enum class CrcImpl { AUTO, TABLE, PCLMUL };
+
+uint32_t crc_compute(CrcType type, const uint8_t* data, size_t len);
+// Bit-serial reference, used to cross-check the fast kernels.
+uint32_t crc_compute_bitwise(CrcType type, const uint8_t* data, size_t len);
+size_t   crc_bytes(CrcType type);
+// Writes the CRC of data[0, len) big-endian at data + len.
+void     crc_attach(CrcType type, uint8_t* data, size_t len);
+// True if the trailing crc_bytes(type) of data[0, len) match.
+bool     crc_check(CrcType type, const uint8_t* data, size_t len);
+
+bool        crc_select(CrcImpl impl);
+const char* crc_impl_name();
+
+// ROHC CRCs, RFC 3095 5.9.1: LSB-first, all-ones init.
+uint8_t rohc_crc3(const uint8_t* data, size_t len);
+uint8_t rohc_crc7(const uint8_t* data, size_t len);
+uint8_t rohc_crc8(const uint8_t* data, size_t len);
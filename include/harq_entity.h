@@ -0,0 +1,69 @@
+#pragma once
+#include "common_types.h"
+#include "metrics.h"
+#include "pdu_buffer.h"
+#include <array>
+
+// HARQ process counts: LTE FDD, NR (TS 38.321) and NR NTN (Rel-17).
+static constexpr int HARQ_PROCS_LTE     = 8;
+static constexpr int HARQ_PROCS_NR      = 16;
+static constexpr int HARQ_PROCS_NTN     = 32;
+static constexpr int HARQ_MAX_PROCESSES = HARQ_PROCS_NTN;
+static constexpr int MAX_HARQ_RETX      = 4;
+static constexpr uint32_t HARQ_RTT_TTI  = 8;
+
+struct HarqConfig {
+    uint8_t  num_procs = HARQ_PROCS_LTE;
+    uint8_t  max_retx  = MAX_HARQ_RETX;
+    // Feedback is due rtt_tti TTIs after a (re)transmission; a process still
+    // unanswered then is treated as NACKed (DTX).
+    uint32_t rtt_tti   = HARQ_RTT_TTI;
+};
+
+enum class HarqState { IDLE, WAITING_ACK, NACKED };
+struct HarqProcess {
+    uint8_t   id;
+    HarqState state = HarqState::IDLE;
+    uint8_t   retx_count = 0;
+    uint32_t  tx_tti = 0;
+    PduBuffer buffer;   // reference to the transmitted TB, no copy
+};
+
+// Process state lives in three bitmasks (free / waiting / NACKed); allocation
+// and retransmission pick the lowest set bit.
+class HarqEntity {
+public:
+    explicit HarqEntity(HarqConfig cfg = {});
+    bool   has_free() const { return free_ != 0; }
+    // Stores a reference to tb in a free process; BUFFER_FULL if none is free.
+    Status transmit(const PduBuffer& tb, uint8_t& id);
+    // Next NACKed process, moved back to waiting; false if none.
+    bool   next_retx(PduBuffer& tb, uint8_t& id);
+    void   feedback(uint8_t id, bool ack);
+    void   tick(uint32_t ttis = 1);
+
+    uint8_t  num_procs()   const { return cfg_.num_procs; }
+    uint32_t busy()        const { return (uint32_t)__builtin_popcount(all_ & ~free_); }
+    uint32_t retx_ready()  const { return (uint32_t)__builtin_popcount(nacked_); }
+    uint32_t get_retx()    const { return retx_; }
+    uint32_t get_failures() const { return failures_; }
+    uint32_t get_dtx()     const { return dtx_; }
+    const HarqProcess& process(uint8_t id) const { return procs_[id]; }
+    // Retransmissions, failures and, per finished TB, how many transmissions
+    // it took (the last bucket: dropped after max_retx).
+    void bind_metrics(const MetricLabels& labels);
+private:
+    HarqConfig cfg_;
+    std::array<HarqProcess, HARQ_MAX_PROCESSES> procs_;
+    uint32_t all_     = 0;
+    uint32_t free_    = 0;
+    uint32_t waiting_ = 0;
+    uint32_t nacked_  = 0;
+    uint32_t now_     = 0;
+    uint32_t retx_     = 0;
+    uint32_t failures_ = 0;
+    uint32_t dtx_      = 0;
+    struct { MetricCounter retx, failures, dtx; MetricHistogram tx_per_tb; } metrics_;
+    void nack(uint8_t id);
+    void release(uint8_t id);
+};
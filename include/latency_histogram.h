@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// HDR-style latency histogram: below 128 every value has its own bucket,
+// above that each power of two is split into 64 linear sub-buckets, so a
+// recorded value is known to within 1/64 of itself over the whole 64-bit
+// range. Fixed memory, O(1) record, no allocation; merge() adds histograms
+// bucket by bucket, so per-thread or per-run copies can be combined.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 7;
+    static constexpr unsigned HALF     = 1u << (SUB_BITS - 1);
+    static constexpr size_t   BUCKETS  = (64 - SUB_BITS + 1) * HALF + HALF;
+
+    void record(uint64_t v, uint64_t n = 1) {
+        counts_[index_of(v)] += n;
+        count_ += n;
+        sum_   += v * n;
+        if (v < min_) min_ = v;
+        if (v > max_) max_ = v;
+    }
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < BUCKETS; i++) counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_   += o.sum_;
+        if (o.min_ < min_) min_ = o.min_;
+        if (o.max_ > max_) max_ = o.max_;
+    }
+    void reset() { *this = LatencyHistogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t min()   const { return count_ ? min_ : 0; }
+    uint64_t max()   const { return max_; }
+    double   mean()  const { return count_ ? (double)sum_ / count_ : 0.0; }
+    // Smallest bucket bound at or below which pct percent of the values lie,
+    // capped at max().
+    uint64_t percentile(double pct) const {
+        if (!count_) return 0;
+        uint64_t want = (uint64_t)std::ceil(pct / 100.0 * count_);
+        if (want == 0) return min();
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if (seen >= want) return upper_of(i) < max_ ? upper_of(i) : max_;
+        }
+        return max_;
+    }
+
+    static size_t index_of(uint64_t v) {
+        if (v < 2 * HALF) return (size_t)v;
+        unsigned shift = 63 - (unsigned)__builtin_clzll(v) - (SUB_BITS - 1);
+        return (size_t)shift * HALF + (size_t)(v >> shift);
+    }
+    static uint64_t upper_of(size_t i) {
+        if (i < 2 * HALF) return i;
+        unsigned shift = (unsigned)(i / HALF) - 1;
+        uint64_t top   = HALF + i % HALF;
+        return ((top + 1) << shift) - 1;
+    }
+private:
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_   = 0;
+    uint64_t min_   = UINT64_MAX;
+    uint64_t max_   = 0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include "ring_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel { DEBUG, INFO, WARN, ERR };
+
+// Statements below this level are discarded at compile time and their
+// arguments are never evaluated. Override with -DLOG_COMPILE_LEVEL=<n>.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+static constexpr size_t LOG_MAX_ARGS     = 8;
+static constexpr size_t LOG_TEXT_BYTES   = 160;
+static constexpr size_t LOG_RING_RECORDS = 4096;
+
+enum class LogArgType : uint8_t { I64, U64, F64, STR };
+
+// Fixed-size binary record. Arguments are stored raw and only formatted by the
+// drain thread; strings are copied into the trailing text area.
+struct LogRecord {
+    const char* layer;
+    const char* fmt;
+    LogLevel    level;
+    uint8_t     nargs;
+    uint16_t    text_len;
+    LogArgType  types[LOG_MAX_ARGS];
+    union { int64_t i; uint64_t u; double f; uint32_t str_off; } args[LOG_MAX_ARGS];
+    char        text[LOG_TEXT_BYTES];
+};
+
+struct LogThreadRing {
+    SpscRing<LogRecord>   ring{LOG_RING_RECORDS};
+    std::atomic<uint64_t> dropped{0};
+};
+
+class Logger {
+public:
+    static Logger& instance() { static Logger inst; return inst; }
+    ~Logger();
+
+    bool enabled(LogLevel lvl) const { return (int)lvl >= level_.load(std::memory_order_relaxed); }
+    void set_level(LogLevel lvl)     { level_.store((int)lvl, std::memory_order_relaxed); }
+    void set_async(bool async);
+    void set_output(std::ostream* out);
+    void flush();
+    uint64_t dropped() const;
+
+    void log(LogLevel lvl, const char* layer, const std::string& msg);
+    template <typename... Args>
+    void logf(LogLevel lvl, const char* layer, const char* fmt, const Args&... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+        LogRecord* r = begin_record(lvl, layer, fmt);
+        if (!r) return;
+        (encode_arg(*r, args), ...);
+        commit_record(r);
+    }
+private:
+    Logger() = default;
+    std::atomic<int>  level_{(int)LogLevel::DEBUG};
+    std::atomic<bool> async_{true};
+    std::atomic<bool> running_{false};
+    mutable std::mutex rings_mu_;
+    std::mutex        drain_mu_;
+    std::vector<std::shared_ptr<LogThreadRing>> rings_;
+    std::thread       drainer_;
+    std::ostream*     out_ = nullptr;
+    LogRecord         sync_rec_;
+
+    LogThreadRing& local_ring();
+    LogRecord* begin_record(LogLevel lvl, const char* layer, const char* fmt);
+    void       commit_record(LogRecord* r);
+    void       start_drainer();
+    size_t     drain_locked(std::string& out);
+    void       write_locked(const std::string& text);
+    static void format(const LogRecord& r, std::string& out);
+
+    static void encode_str(LogRecord& r, const char* s, size_t n) {
+        size_t room = LOG_TEXT_BYTES - r.text_len;
+        if (room == 0) { n = 0; room = 1; r.text_len = LOG_TEXT_BYTES - 1; }
+        if (n > room - 1) n = room - 1;
+        r.types[r.nargs] = LogArgType::STR;
+        r.args[r.nargs].str_off = r.text_len;
+        std::memcpy(r.text + r.text_len, s, n);
+        r.text[r.text_len + n] = '\0';
+        r.text_len = (uint16_t)(r.text_len + n + 1);
+        r.nargs++;
+    }
+    static void encode_arg(LogRecord& r, const std::string& s) { encode_str(r, s.data(), s.size()); }
+    static void encode_arg(LogRecord& r, const char* s)        { encode_str(r, s, std::strlen(s)); }
+    template <typename T>
+    static void encode_arg(LogRecord& r, const T& v) {
+        if constexpr (std::is_floating_point<T>::value) {
+            r.types[r.nargs] = LogArgType::F64; r.args[r.nargs].f = (double)v;
+        } else if constexpr (std::is_enum<T>::value) {
+            r.types[r.nargs] = LogArgType::I64; r.args[r.nargs].i = (int64_t)v;
+        } else if constexpr (std::is_signed<T>::value) {
+            r.types[r.nargs] = LogArgType::I64; r.args[r.nargs].i = (int64_t)v;
+        } else {
+            static_assert(std::is_integral<T>::value, "unsupported log argument type");
+            r.types[r.nargs] = LogArgType::U64; r.args[r.nargs].u = (uint64_t)v;
+        }
+        r.nargs++;
+    }
+};
+
+#define LOG_AT(lvl, layer, msg) do { \
+    if constexpr ((int)(lvl) >= LOG_COMPILE_LEVEL) \
+        if (Logger::instance().enabled(lvl)) Logger::instance().log(lvl, layer, msg); \
+} while (0)
+#define LOGF_AT(lvl, layer, ...) do { \
+    if constexpr ((int)(lvl) >= LOG_COMPILE_LEVEL) \
+        if (Logger::instance().enabled(lvl)) Logger::instance().logf(lvl, layer, __VA_ARGS__); \
+} while (0)
+
+#define LOG_DEBUG(layer, msg) LOG_AT(LogLevel::DEBUG, layer, msg)
+#define LOG_INFO(layer, msg)  LOG_AT(LogLevel::INFO,  layer, msg)
+#define LOG_WARN(layer, msg)  LOG_AT(LogLevel::WARN,  layer, msg)
+#define LOG_ERR(layer, msg)   LOG_AT(LogLevel::ERR,   layer, msg)
+
+// Deferred-format variants: "{}" placeholders, "{x}" for hex.
+#define LOGF_DEBUG(layer, ...) LOGF_AT(LogLevel::DEBUG, layer, __VA_ARGS__)
+#define LOGF_INFO(layer, ...)  LOGF_AT(LogLevel::INFO,  layer, __VA_ARGS__)
+#define LOGF_WARN(layer, ...)  LOGF_AT(LogLevel::WARN,  layer, __VA_ARGS__)
+#define LOGF_ERR(layer, ...)   LOGF_AT(LogLevel::ERR,   layer, __VA_ARGS__)
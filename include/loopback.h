@@ -0,0 +1,132 @@
+#pragma once
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include "latency_histogram.h"
+#include "phy_layer.h"
+#include "mac_layer.h"
+#include "rlc_layer.h"
+#include "pdcp_layer.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Where an SDU was last seen on its way from the UE's PDCP to the peer's:
+// each boundary stamps it once.
+enum LoopStamp : uint8_t {
+    STAMP_SUBMIT,     // handed to the UE's PDCP
+    STAMP_PDCP_TX,    // PDCP PDU queued in RLC
+    STAMP_RLC_TX,     // last byte pulled into a TB
+    STAMP_MAC_RX,     // last byte demultiplexed by the peer's MAC
+    STAMP_RLC_RX,     // reassembled and in order, handed to the peer's PDCP
+    STAMP_PDCP_RX,    // delivered by the peer's PDCP
+    STAMP_COUNT,
+};
+// Stage s spans stamps s and s + 1; LOOP_E2E spans them all.
+enum LoopStage : uint8_t { LOOP_PDCP_TX, LOOP_RLC_TX, LOOP_MAC_PHY, LOOP_RLC_RX, LOOP_PDCP_RX, LOOP_E2E, LOOP_STAGES };
+const char* loop_stage_str(LoopStage s);
+
+struct LoopbackConfig {
+    PhyConfig      phy;                 // both directions
+    HarqConfig     harq;
+    RlcMode        rlc_mode      = RlcMode::AM;
+    uint32_t       slot_us       = 1000;
+    uint32_t       harq_k1       = 4;      // slots from a TB to its ACK/NACK; below harq.rtt_tti
+    size_t         max_in_flight = 1024;   // SDUs submitted but not yet delivered or lost (max 2048)
+    // Add the stack's own processing time to the simulated slot clock.
+    bool           measure_cpu   = true;
+    // Bind both sides' layers to MetricsRegistry (labels: rnti, DTCH) and
+    // record the stage latencies as loop_latency_ns histograms too.
+    bool           metrics       = false;
+    // Feed the peer's MAC/RLC/PDCP PDUs to PcapCapture: the bearer's data
+    // as uplink, STATUS PDUs as downlink.
+    bool           capture       = false;
+    uint16_t       rnti          = 0x4601;
+};
+
+struct LoopbackStats {
+    uint64_t slots = 0, submitted = 0, refused = 0, delivered = 0, lost = 0, rx_bytes = 0;
+    uint64_t tbs = 0, tb_errors = 0, harq_retx = 0, harq_failures = 0;
+    uint64_t rlc_retx = 0, status_pdus = 0;
+    double   goodput_mbps = 0;   // delivered SDU bytes over simulated time
+};
+
+using LoopbackSink = std::function<void(const PduBuffer& sdu)>;
+
+// A UE stack looped to a peer stack through the PHY channel, one bearer,
+// data from the UE to the peer. Every slot each side sends at most one TB,
+// a HARQ retransmission first; the receiver's PHY decides its fate and the
+// ACK/NACK reaches the sender harq_k1 slots later. The peer's RLC STATUS
+// PDUs travel back the same way, ahead of any data on the bearer.
+//
+// Time is simulated: a TB sent in slot n is received at the start of slot
+// n + 1. With measure_cpu the wall-clock time spent inside the stack is
+// added on top, so the PDCP stages show processing cost and the rest shows
+// queueing, HARQ and ARQ. Each SDU is stamped at every layer boundary and
+// its stage latencies go into one histogram per stage.
+class LoopbackLink {
+public:
+    explicit LoopbackLink(LoopbackConfig cfg = {});
+    ~LoopbackLink();
+    LoopbackLink(const LoopbackLink&) = delete;
+    LoopbackLink& operator=(const LoopbackLink&) = delete;
+    // Takes the SDU, or returns BUFFER_FULL once max_in_flight are in flight.
+    Status submit(PduBuffer& sdu);
+    void   run_slot();
+    // Runs slots until every submitted SDU is delivered or lost; false if
+    // max_slots went by first.
+    bool   drain(uint64_t max_slots = 100000);
+    void   set_sink(LoopbackSink sink) { sink_ = std::move(sink); }
+    void   set_snr(float snr_db);
+    size_t in_flight() const { return (size_t)(submitted_ - rx_deliv_); }
+    uint64_t now_ns() const;
+    LoopbackStats stats() const;
+    const LatencyHistogram& latency(LoopStage s) const { return hist_[s]; }
+    const LoopbackConfig&   config() const { return cfg_; }
+    const PdcpLayer& ue_pdcp()   const;
+    const RlcLayer&  ue_rlc()    const;
+    const MacLayer&  ue_mac()    const;
+    const RlcLayer&  peer_rlc()  const;
+    const PhyLayer&  peer_phy()  const;
+private:
+    struct Side;
+    struct Feedback {
+        uint64_t due;
+        uint8_t  harq_id;
+        bool     ack;
+    };
+    struct SduTrace {
+        uint64_t t[STAMP_COUNT];
+        uint8_t  seen = 0;   // bit per stamp
+    };
+
+    LoopbackConfig          cfg_;
+    std::unique_ptr<Side>   ue_;
+    std::unique_ptr<Side>   peer_;
+    std::vector<SduTrace>   trace_;   // by COUNT modulo the ring
+    LatencyHistogram        hist_[LOOP_STAGES];
+    MetricHistogram         hist_metrics_[LOOP_STAGES];
+    LoopbackSink            sink_;
+    std::vector<MacSdu>     rx_sdus_;
+    uint64_t slot_         = 0;
+    uint64_t base_ns_      = 0;
+    uint64_t phase_wall_   = 0;
+    uint32_t timer_us_     = 0;
+    uint64_t submitted_    = 0, refused_ = 0, delivered_ = 0, lost_ = 0, rx_bytes_ = 0;
+    uint64_t tbs_          = 0, status_pdus_ = 0;
+    uint64_t rx_deliv_     = 0;   // COUNTs below this were delivered or lost
+
+    void      begin_phase(uint64_t base_ns);
+    SduTrace& trace(uint32_t count) { return trace_[count & (trace_.size() - 1)]; }
+    void      stamp(uint32_t count, LoopStamp s);
+    uint32_t  count_of(uint16_t sn12) const;
+    size_t    pull(Side& s, uint32_t budget, PduBuffer* out, size_t max);
+    bool      has_data(const Side& s) const;
+    bool      transmit(Side& tx, PduBuffer& tb, uint8_t& harq_id);
+    void      receive(Side& rx, Side& tx, PduBuffer& tb, uint8_t harq_id);
+    void      to_pdcp(PduBuffer& pdu);
+    void      deliver(PduBuffer& sdu);
+    void      deliver_ready();
+    void      settle();
+    void      record(unsigned stage, uint64_t from, uint64_t to);
+    void      feedback(Side& tx);
+};
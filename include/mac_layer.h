@@ -1,35 +1,106 @@
 #pragma once
 #include "common_types.h"
+#include "harq_entity.h"
+#include "pcap_capture.h"
 #include "phy_layer.h"
+#include "pdu_buffer.h"
 #include <queue>
 #include <array>
-static constexpr int MAX_HARQ_PROCESSES = 8;
-static constexpr int MAX_HARQ_RETX      = 4;
-enum class HarqState { IDLE, WAITING_ACK, NACKED };
-struct HarqProcess {
-    uint8_t id;
-    HarqState state = HarqState::IDLE;
-    uint8_t retx_count = 0;
-    Bytes buffer;
-    bool ack_received = false;
+#include <functional>
+#include <vector>
+// Values are the LCIDs carried in the MAC subheader (TS 38.321 6.2.1):
+// CCCH, SRB1 and the first DRB.
+enum class LogicalChannel : uint8_t { CCCH=0, DCCH=1, DTCH=4 };
+static constexpr int     MAC_NUM_LC          = 3;
+static constexpr uint8_t MAC_LCID_PHR        = 57;
+static constexpr uint8_t MAC_LCID_CRNTI      = 58;
+static constexpr uint8_t MAC_LCID_SHORT_BSR  = 61;
+static constexpr uint8_t MAC_LCID_PADDING    = 63;
+
+// Demultiplexed SDU; sdu is a slice of the received transport block.
+struct MacSdu {
+    LogicalChannel lc;
+    PduBuffer      sdu;
 };
-enum class LogicalChannel : uint8_t { CCCH=0, DCCH=1, DTCH=2 };
+// Control elements found in a received transport block.
+struct MacCeReport {
+    bool     has_bsr   = false;
+    uint8_t  bsr_lcg   = 0;
+    uint8_t  bsr_index = 0;
+    bool     has_crnti = false;
+    uint16_t crnti     = 0;
+    bool     has_phr   = false;
+    uint8_t  ph        = 0;
+    uint8_t  pcmax     = 0;
+};
+// Pulls up to max PDUs of at most budget bytes in total from an upper layer,
+// e.g. RlcLayer::pull_pdus.
+using MacLcPull = std::function<size_t(uint32_t budget, PduBuffer* out, size_t max)>;
+// Short BSR buffer size index for a byte count, TS 38.321 Table 6.1.3.1-1.
+uint8_t mac_bsr_index(size_t bytes);
 class MacLayer {
 public:
-    MacLayer();
+    explicit MacLayer(HarqConfig harq = {});
     Status receive_pdu(const Bytes& phy_pdu, Bytes& rlc_sdu);
     Status transmit_sdu(const Bytes& rlc_sdu, Bytes& phy_pdu);
-    void harq_feedback(uint8_t process_id, bool ack);
-    uint8_t get_next_harq_process();
+    Status receive_pdu(PduBuffer& pdu);
+    Status transmit_sdu(PduBuffer& pdu);
+    size_t receive_burst(PduBuffer* pdus, size_t n, Status* status);
+    size_t transmit_burst(PduBuffer* pdus, size_t n, Status* status, uint8_t* harq_ids = nullptr);
+    // Multiplexing: SDUs are queued per logical channel and packed into a
+    // transport block of the granted size (PhyLayer::tbs_bytes()). CCCH goes
+    // first, then DCCH/DTCH by priority (lower value first).
+    Status queue_sdu(LogicalChannel lc, PduBuffer& sdu);
+    void   set_lc_priority(LogicalChannel lc, uint8_t priority);
+    void   set_lc_pull(LogicalChannel lc, MacLcPull pull);
+    void   send_crnti_ce(uint16_t rnti);
+    void   report_phr(uint8_t ph, uint8_t pcmax);
+    size_t build_tb(uint32_t tbs, PduBuffer& tb);
+    Status transmit_tb(uint32_t tbs, PduBuffer& tb);
+    size_t demux_tb(const PduBuffer& tb, MacSdu* out, size_t max, MacCeReport* ces = nullptr);
+    size_t queued_bytes() const;
+    // New data is refused with BUFFER_FULL while every HARQ process is busy.
+    // retransmit() hands out the next NACKed TB (PENDING if there is none).
+    void   harq_feedback(uint8_t process_id, bool ack);
+    Status retransmit(PduBuffer& tb);
+    void   tick(uint32_t ttis = 1) { harq_.tick(ttis); }
+    const HarqEntity& harq() const { return harq_; }
     uint32_t get_tx_pdus()   const { return tx_pdus_; }
     uint32_t get_rx_pdus()   const { return rx_pdus_; }
-    uint32_t get_harq_retx() const { return harq_retx_count_; }
+    uint32_t get_harq_retx() const { return harq_.get_retx(); }
+    uint8_t  get_last_harq_id() const { return last_harq_id_; }
+    void     bind_metrics(uint32_t ue = METRIC_NO_UE);
+    // MAC PDUs and TBs, as sent and as received (before demultiplexing), go
+    // to PcapCapture when it is running.
+    void     bind_capture(const PcapContext& ctx) { cap_ = ctx; cap_.on = true; }
 private:
-    std::array<HarqProcess, MAX_HARQ_PROCESSES> harq_procs_;
-    uint8_t  next_harq_id_    = 0;
+    struct LcState {
+        LogicalChannel         lc;
+        uint8_t                priority;
+        std::vector<PduBuffer> q;
+        size_t                 head  = 0;
+        size_t                 bytes = 0;
+        MacLcPull              pull;
+    };
+    std::array<LcState, MAC_NUM_LC> lcs_;
+    std::array<uint8_t, MAC_NUM_LC> lc_order_;
+    bool     bsr_pending_   = false;
+    bool     crnti_pending_ = false;
+    uint16_t crnti_         = 0;
+    bool     phr_pending_   = false;
+    uint8_t  ph_            = 0;
+    uint8_t  pcmax_         = 0;
+    HarqEntity harq_;
+    uint8_t  last_harq_id_    = 0;
     uint32_t tx_pdus_         = 0;
     uint32_t rx_pdus_         = 0;
-    uint32_t harq_retx_count_ = 0;
-    Bytes build_mac_pdu(LogicalChannel lc, const Bytes& payload);
-    bool  parse_mac_pdu(const Bytes& pdu, LogicalChannel& lc, Bytes& payload);
+    struct { MetricCounter tx_pdus, rx_pdus; } metrics_;
+    PcapContext cap_;
+    void capture(bool tx, const PduBuffer& pdu, uint8_t harq_id = 0xFF) const {
+        if (pcap_wants(cap_, PCAP_MAC)) PcapCapture::instance().mac(cap_, tx, pdu.data(), pdu.size(), harq_id);
+    }
+    Status tx_one(PduBuffer& pdu, bool framed = false);
+    LcState* lc_state(LogicalChannel lc);
+    void build_mac_pdu(LogicalChannel lc, PduBuffer& pdu);
+    bool parse_mac_pdu(PduBuffer& pdu, LogicalChannel& lc);
 };
@@ -0,0 +1,81 @@
+#pragma once
+#include "common_types.h"
+#include "phy_layer.h"
+#include <vector>
+
+// Per-slot downlink scheduler. UEs with data wait in an indexed binary
+// max-heap ordered by the policy metric (ties go to the UE served longest
+// ago); a slot pops the best UEs, gives each the PRBs its buffer needs at its
+// MCS until the carrier is full, and pushes them back. Buffer and channel
+// reports and each grant cost O(log n) whatever the number of UEs.
+enum class SchedPolicy : uint8_t { RR, PF, MAX_CI };
+
+struct SchedConfig {
+    SchedPolicy policy           = SchedPolicy::PF;
+    uint16_t    num_prbs         = 25;      // PhyConfig::num_prbs
+    uint8_t     max_ues_per_slot = 16;      // PDCCH budget
+    float       target_bler      = 0.1f;    // link adaptation: highest MCS at or below
+    float       pf_alpha         = 0.01f;   // PF throughput average, ~100 slots
+};
+
+struct SchedGrant {
+    uint16_t rnti;
+    uint16_t prb_start;
+    uint16_t num_prbs;
+    MCS      mcs;
+    uint32_t tbs;   // bytes
+};
+
+struct SchedUe {
+    bool     active   = false;
+    MCS      mcs      = MCS::QPSK_1_3;
+    uint32_t buffer   = 0;
+    float    snr_db   = 0.0f;
+    float    rate     = 0.0f;   // bytes per PRB at mcs
+    double   avg      = 0.0;    // PF served bytes per slot, times decay_
+    double   key      = 0.0;
+    uint64_t last_served = 0;
+    int32_t  heap_pos = -1;
+};
+
+class MacScheduler {
+public:
+    explicit MacScheduler(SchedConfig cfg = {});
+    Status add_ue(uint16_t rnti);
+    Status remove_ue(uint16_t rnti);
+    // Bytes waiting (e.g. MacLayer::queued_bytes() or a BSR) and channel
+    // quality (PhyLayer::get_snr()); the SNR picks the UE's MCS.
+    Status update_buffer(uint16_t rnti, uint32_t bytes);
+    Status update_channel(uint16_t rnti, float snr_db);
+    // Runs one slot and writes up to max grants, PRBs allocated contiguously
+    // from 0. The granted bytes are taken off each UE's buffer estimate.
+    size_t schedule(SchedGrant* out, size_t max);
+    void   set_policy(SchedPolicy policy);
+    SchedPolicy get_policy() const { return cfg_.policy; }
+    size_t num_ues()    const { return num_ues_; }
+    size_t backlogged() const { return heap_.size(); }
+    uint64_t get_slot() const { return slot_; }
+    const SchedUe* ue(uint16_t rnti) const { return rnti < ues_.size() && ues_[rnti].active ? &ues_[rnti] : nullptr; }
+    double avg_rate(uint16_t rnti) const;
+private:
+    SchedConfig           cfg_;
+    std::vector<SchedUe>  ues_;    // indexed by RNTI
+    std::vector<uint16_t> heap_;   // RNTIs of UEs with data
+    size_t   num_ues_ = 0;
+    uint64_t slot_    = 0;
+    uint64_t served_seq_ = 0;
+    // PF averages decay every slot. Rather than touching every UE, stored
+    // averages are scaled by decay_ = (1 - alpha)^-slot, which grows instead;
+    // rate / avg keeps its order for UEs not served, so their keys stay valid.
+    double   decay_ = 1.0;
+    float    rate_[8] = {};   // bytes per PRB per MCS level
+    double   key_of(const SchedUe& u) const;
+    bool     before(uint16_t a, uint16_t b) const;
+    void     heap_set(size_t pos, uint16_t rnti) { heap_[pos] = rnti; ues_[rnti].heap_pos = (int32_t)pos; }
+    void     sift_up(size_t pos);
+    void     sift_down(size_t pos);
+    void     heap_push(uint16_t rnti);
+    void     heap_erase(uint16_t rnti);
+    void     heap_fix(uint16_t rnti);
+    void     renormalize();
+};
@@ -0,0 +1,204 @@
+#pragma once
+#include "ring_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static constexpr uint32_t METRIC_NO_UE      = 0xFFFFFFFFu;
+static constexpr uint8_t  METRIC_NO_BEARER  = 0xFF;
+static constexpr uint32_t METRIC_INVALID    = 0xFFFFFFFFu;
+static constexpr size_t   METRIC_CHUNK_CELLS = 512;
+static constexpr size_t   METRIC_MAX_CHUNKS  = 4096;   // 2M cells
+static constexpr size_t   METRIC_MAX_THREADS = 256;
+static constexpr size_t   METRIC_META_CHUNK  = 1024;
+
+enum class MetricKind : uint8_t { COUNTER, GAUGE, HISTOGRAM };
+enum class MetricsFormat : uint8_t { PROMETHEUS, JSON };
+
+// Who a metric belongs to. UE and bearer are optional: a metric registered
+// without them is shared by every entity that binds it, e.g. one per cell.
+struct MetricLabels {
+    const char* layer  = "";
+    uint32_t    ue     = METRIC_NO_UE;
+    uint8_t     bearer = METRIC_NO_BEARER;
+};
+
+// Every thread that updates a metric owns a shard of cells, allocated in
+// cache-line-aligned chunks on first touch, so no two threads ever write the
+// same line. Each cell has a single writer and is updated with a relaxed
+// load/store pair (no locked RMW); snapshots add the shards up.
+struct alignas(CACHE_LINE_SIZE) MetricChunk {
+    std::atomic<uint64_t> v[METRIC_CHUNK_CELLS];
+    MetricChunk() { for (auto& c : v) c.store(0, std::memory_order_relaxed); }
+};
+struct alignas(CACHE_LINE_SIZE) MetricShard {
+    std::atomic<MetricChunk*> chunks[METRIC_MAX_CHUNKS] = {};
+    ~MetricShard() { for (auto& c : chunks) delete c.load(std::memory_order_relaxed); }
+};
+
+extern thread_local MetricShard* metric_tls_shard;
+MetricShard*           metric_attach_thread();
+std::atomic<uint64_t>& metric_grow(MetricShard& sh, uint32_t cell);
+
+inline std::atomic<uint64_t>& metric_cell(uint32_t cell) {
+    MetricShard* sh = metric_tls_shard;
+    if (__builtin_expect(!sh, 0)) sh = metric_attach_thread();
+    MetricChunk* ch = sh->chunks[cell / METRIC_CHUNK_CELLS].load(std::memory_order_relaxed);
+    if (__builtin_expect(!ch, 0)) return metric_grow(*sh, cell);
+    return ch->v[cell % METRIC_CHUNK_CELLS];
+}
+inline void metric_add(uint32_t cell, uint64_t n) {
+    std::atomic<uint64_t>& c = metric_cell(cell);
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Handles are plain values; a default-constructed one is unbound and every
+// update on it is a no-op.
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) const { if (cell_ != METRIC_INVALID) metric_add(cell_, n); }
+    bool bound() const { return cell_ != METRIC_INVALID; }
+private:
+    friend class MetricsRegistry;
+    uint32_t cell_ = METRIC_INVALID;
+};
+// Gauges are kept as deltas, so one series can be shared by many entities
+// and moved between threads; the snapshot value is the sum of all of them.
+class MetricGauge {
+public:
+    void add(int64_t d) const { if (cell_ != METRIC_INVALID) metric_add(cell_, (uint64_t)d); }
+    bool bound() const { return cell_ != METRIC_INVALID; }
+private:
+    friend class MetricsRegistry;
+    uint32_t cell_ = METRIC_INVALID;
+};
+// Fixed buckets: cells hold one count per upper bound (inclusive), one for
+// +Inf and the sum of the recorded values.
+class MetricHistogram {
+public:
+    void record(uint64_t v) const {
+        if (cell_ == METRIC_INVALID) return;
+        uint32_t b = (uint32_t)(std::lower_bound(bounds_, bounds_ + n_, v) - bounds_);
+        metric_add(cell_ + b, 1);
+        metric_add(cell_ + n_ + 1, v);
+    }
+    bool bound() const { return cell_ != METRIC_INVALID; }
+private:
+    friend class MetricsRegistry;
+    uint32_t        cell_   = METRIC_INVALID;
+    uint32_t        n_      = 0;
+    const uint64_t* bounds_ = nullptr;
+};
+// A gauge owned by one entity: set() publishes the change since the last
+// value, and the contribution is withdrawn when the entity goes away.
+class TrackedGauge {
+public:
+    TrackedGauge() = default;
+    explicit TrackedGauge(MetricGauge g) : g_(g) {}
+    TrackedGauge(TrackedGauge&& o) noexcept : g_(o.g_), v_(o.v_) { o.v_ = 0; }
+    TrackedGauge& operator=(TrackedGauge&& o) noexcept {
+        if (this != &o) { set(0); g_ = o.g_; v_ = o.v_; o.v_ = 0; }
+        return *this;
+    }
+    ~TrackedGauge() { set(0); }
+    void set(int64_t v) { if (v != v_) { g_.add(v - v_); v_ = v; } }
+private:
+    MetricGauge g_;
+    int64_t     v_ = 0;
+};
+
+struct MetricSample {
+    std::string           name;
+    std::string           layer;
+    uint32_t              ue     = METRIC_NO_UE;
+    uint8_t               bearer = METRIC_NO_BEARER;
+    MetricKind            kind   = MetricKind::COUNTER;
+    int64_t               value  = 0;   // counter or gauge
+    std::vector<uint64_t> bounds;       // histogram
+    std::vector<uint64_t> buckets;      // bounds.size() + 1, the last is +Inf
+    uint64_t              sum    = 0;
+    uint64_t              count  = 0;
+};
+
+struct MetricsSnapshot {
+    uint64_t                  taken_ns = 0;
+    std::vector<MetricSample> samples;
+    // Sum of every series of that name (histograms: their counts).
+    int64_t total(const std::string& name) const;
+    const MetricSample* find(const std::string& name, uint32_t ue = METRIC_NO_UE,
+                             uint8_t bearer = METRIC_NO_BEARER) const;
+    // Every histogram series of that name merged into one.
+    MetricSample merged(const std::string& name) const;
+    void write(std::ostream& out, MetricsFormat fmt) const;
+    void write_prometheus(std::ostream& out) const;
+    void write_json(std::ostream& out) const;
+};
+
+// Process-wide registry of counters, gauges and histograms. Registering is
+// idempotent (same name and labels, same series) and takes a lock; updates
+// and snapshots do not.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance() { static MetricsRegistry inst; return inst; }
+    ~MetricsRegistry();
+    MetricCounter   counter(const char* name, const MetricLabels& labels = {});
+    MetricGauge     gauge(const char* name, const MetricLabels& labels = {});
+    MetricHistogram histogram(const char* name, const std::vector<uint64_t>& bounds,
+                              const MetricLabels& labels = {});
+    MetricsSnapshot snapshot() const;
+    size_t num_series() const { return num_metas_.load(std::memory_order_acquire); }
+    // Writes a snapshot to path through a temporary file and a rename, so
+    // readers never see a partial dump.
+    bool write(const std::string& path, MetricsFormat fmt) const;
+    // Dumps every interval_ms from a background thread until stop_dump(),
+    // which writes a last one.
+    void start_dump(const std::string& path, MetricsFormat fmt, uint32_t interval_ms);
+    void stop_dump();
+    // Buckets start, start * factor, ... (n of them).
+    static std::vector<uint64_t> exp_buckets(uint64_t start, double factor, size_t n);
+private:
+    friend MetricShard* metric_attach_thread();
+    friend struct MetricThreadGuard;
+    struct Meta {
+        std::string                 name;
+        std::string                 layer;
+        uint32_t                    ue;
+        uint8_t                     bearer;
+        MetricKind                  kind;
+        uint32_t                    cell;
+        std::unique_ptr<uint64_t[]> bounds;
+        uint32_t                    nbounds = 0;
+    };
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    std::mutex                                 reg_mu_;
+    std::unordered_map<std::string, uint32_t>  index_;
+    std::atomic<Meta*>                         metas_[METRIC_MAX_CHUNKS] = {};
+    std::atomic<uint32_t>                      num_metas_{0};
+    uint32_t                                   next_cell_ = 0;
+    std::atomic<MetricShard*>                  shards_[METRIC_MAX_THREADS] = {};
+    std::atomic<uint32_t>                      num_shards_{0};
+    std::vector<MetricShard*>                  free_shards_;
+    std::mutex                                 dump_mu_;
+    std::condition_variable                    dump_cv_;
+    std::thread                                dumper_;
+    bool                                       dump_stop_ = false;
+
+    const Meta* meta(uint32_t i) const {
+        return &metas_[i / METRIC_META_CHUNK].load(std::memory_order_acquire)[i % METRIC_META_CHUNK];
+    }
+    const Meta* add(const char* name, const MetricLabels& labels, MetricKind kind,
+                    const std::vector<uint64_t>* bounds);
+    MetricShard* attach_thread();
+    void         release_thread(MetricShard* sh);
+};
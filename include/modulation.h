@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "rng.h"
+
+// Link-level modem, TS 38.211 5.1 / 5.2.1. Bits are MSB-first within a byte;
+// bit i of a symbol is b(i) of the standard mapping tables.
+struct cf32 {
+    float re, im;
+};
+// Demapper kernels: AVX-512, AVX2 and a scalar reference, selected once at
+// startup from CPUID. The mapper is table-driven for every kernel.
+enum class ModImpl { AUTO, SCALAR, AVX2, AVX512 };
+
+// Length-31 Gold sequence c(n) with Nc = 1600, packed MSB-first.
+void   gold_sequence(uint32_t c_init, uint8_t* out, size_t nbytes);
+void   scramble(uint8_t* data, size_t nbytes, uint32_t c_init);
+// Qm = 2, 4, 6 or 8. A trailing partial symbol is padded with zero bits.
+size_t num_symbols(uint8_t qm, size_t nbits);
+size_t modulate(uint8_t qm, const uint8_t* bits, size_t nbits, cf32* sym);
+// Max-log LLRs, qm per symbol, positive for bit 0; n0 is the noise power per
+// complex symbol (unit-energy constellation).
+void   demodulate_llr(uint8_t qm, const cf32* sym, size_t nsym, float n0, float* llr);
+// Packs hard decisions (llr < 0 -> 1) MSB-first into nbits bits.
+void   llr_to_bits(const float* llr, size_t nbits, uint8_t* bits);
+// Adds complex Gaussian noise of power n0 per symbol.
+void   awgn(cf32* sym, size_t n, float n0, Philox4x32& rng);
+// Standard normal variate (ziggurat, 128 layers).
+float  gaussian(Philox4x32& rng);
+
+bool        modulation_select(ModImpl impl);
+const char* modulation_impl_name();
@@ -0,0 +1,86 @@
+#pragma once
+#include "nas_layer.h"
+#include "ring_buffer.h"
+#include <thread>
+#include <vector>
+
+struct NasEngineConfig {
+    size_t   num_ues     = 1000;
+    size_t   num_workers = 4;
+    size_t   queue_depth = 4096;
+    size_t   batch       = 256;          // events run between inbox polls
+    uint32_t ip_first    = 0x0A2D0001;   // 10.45.0.1
+    uint32_t ip_count    = 1u << 20;     // split evenly between shards
+    size_t   aka_cache_depth = 2;        // pre-generated AKA vectors per UE
+};
+
+static constexpr uint32_t NAS_ALL_UES = 0xFFFFFFFF;
+
+enum class NasCmdType : uint8_t { EVENT, PREFILL_AKA, BARRIER };
+
+struct NasCommand {
+    NasCmdType           type = NasCmdType::EVENT;
+    NasEvent             ev   = NasEvent::REGISTER;
+    uint32_t             ue   = 0;       // or NAS_ALL_UES of the shard
+    bool                 flag = false;   // REGISTER: set up a PDU session too
+    std::atomic<size_t>* done = nullptr;
+};
+
+struct NasEngineStats {
+    uint64_t ues = 0, events = 0, registrations = 0, auth_failures = 0, sessions = 0,
+             session_rejects = 0, deregistrations = 0, unexpected = 0, rejected_cmds = 0,
+             aka_generated = 0, aka_cache_hits = 0, aka_cache_misses = 0;
+};
+
+// Runs NAS procedures for many UEs. UEs are sharded by ID over worker
+// threads; each shard owns its contexts, a NasMachine and a slice of the
+// address pool, so workers share nothing but their MPSC command rings.
+// Inside a shard, procedures of all its UEs interleave through the
+// machine's queue.
+class NasEngine {
+public:
+    explicit NasEngine(NasEngineConfig cfg = {});
+    ~NasEngine();
+    void   start();
+    void   stop();
+    Status register_ue(uint32_t ue, bool with_session = true);
+    Status request_session(uint32_t ue);
+    Status deregister_ue(uint32_t ue);
+    // One command per shard, fanned out to its UEs by the worker.
+    Status register_all(bool with_session = true);
+    Status deregister_all();
+    // Core outage: the network drops every UE context and address, and each
+    // registered UE registers again, re-establishing its PDU session. Call
+    // on a drained engine.
+    Status core_restart();
+    // Fills every UE's AKA vector cache, all shards in parallel, so the next
+    // storm skips Milenage and the KDF chain on the network side.
+    Status prefill_auth_vectors();
+    void   drain();
+    size_t num_ues()     const { return cfg_.num_ues; }
+    size_t num_workers() const { return shards_.size(); }
+    size_t shard_of(uint32_t ue) const { return ue % shards_.size(); }
+    // Only stable once drain() has returned.
+    const NasContext* context(uint32_t ue) const;
+    NasEngineStats stats() const;
+private:
+    struct Shard {
+        MpscRing<NasCommand>    inbox;
+        std::vector<NasContext> ues;
+        NasIpPool               pool;
+        AkaAuc                  auc;
+        NasMachine              fsm;
+        std::thread             worker;
+        Shard(const NasEngineConfig& cfg, size_t index, size_t num_shards);
+    };
+    NasEngineConfig                     cfg_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool>                   running_{false};
+    std::atomic<uint64_t>               rejected_{0};
+
+    Status submit(NasCommand&& cmd);
+    Status broadcast(NasCmdType type, NasEvent ev, bool flag = false);
+    void   worker_loop(Shard& sh);
+    void   execute(Shard& sh, NasCommand& cmd);
+    void   trigger(Shard& sh, uint32_t slot, NasEvent ev, bool flag);
+};
@@ -1,22 +1,51 @@
 #pragma once
+#include "aka.h"
 #include "common_types.h"
+#include "ring_buffer.h"
+#include "rng.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <string>
-enum class NasRegistrationState { DEREGISTERED, REGISTERING, REGISTERED, DEREGISTERING };
-enum class NasSessionState { INACTIVE, ACTIVATING, ACTIVE };
+#include <vector>
+enum class NasRegistrationState : uint8_t { DEREGISTERED, REGISTERING, REGISTERED, DEREGISTERING };
+enum class NasSessionState : uint8_t { INACTIVE, ACTIVATING, ACTIVE };
 enum class NasMsgType : uint8_t {
     REGISTRATION_REQUEST=0x41, REGISTRATION_ACCEPT=0x42,
     REGISTRATION_COMPLETE=0x43, REGISTRATION_REJECT=0x44,
-    DEREGISTRATION_REQUEST=0x45, AUTH_REQUEST=0x56, AUTH_RESPONSE=0x57,
+    DEREGISTRATION_REQUEST=0x45, DEREGISTRATION_ACCEPT=0x46,
+    AUTH_REQUEST=0x56, AUTH_RESPONSE=0x57, AUTH_FAILURE=0x59,
     SECURITY_MODE_CMD=0x5D, SECURITY_MODE_COMPLETE=0x5E,
     PDU_SESSION_ESTAB_REQ=0xC1, PDU_SESSION_ESTAB_ACC=0xC2,
-    PDU_SESSION_RELEASE_CMD=0xD4,
+    PDU_SESSION_ESTAB_REJ=0xC3, PDU_SESSION_RELEASE_CMD=0xD4,
 };
+// Inputs of the NAS state machine: local triggers that start a procedure,
+// then one event per message of the simulated N1 exchange (UE and AMF/SMF
+// ends both live in the machine).
+enum class NasEvent : uint8_t {
+    REGISTER, SESSION, DEREGISTER, CORE_RESTART,
+    REG_REQUEST, AUTH_REQUEST, AUTH_RESPONSE, AUTH_FAILURE, SMC, SMC_COMPLETE,
+    REG_ACCEPT, REG_COMPLETE, REG_REJECT,
+    SESSION_REQUEST, SESSION_ACCEPT, SESSION_REJECT,
+    DEREG_REQUEST, DEREG_ACCEPT,
+};
+static constexpr size_t NAS_NUM_EVENTS = (size_t)NasEvent::DEREG_ACCEPT + 1;
+static constexpr size_t NAS_NUM_STATES = (size_t)NasRegistrationState::DEREGISTERING + 1;
+
+NasMsgType  nas_msg_of(NasEvent ev);            // 0 for local triggers
+bool        nas_event_of(NasMsgType type, NasEvent& ev);
+const char* nas_event_name(NasEvent ev);
+std::string nas_ip_to_string(uint32_t ip);
+
 struct UeIdentity {
     std::string imsi = "310260123456789";
     std::string supi = "imsi-310260123456789";
     uint32_t    tmsi = 0;
     uint8_t     key[16] = {0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,
                            0x88,0x99,0xAA,0xBB,0xCC,0xDD,0xEE,0xFF};
+    uint8_t     op[16]  = {0xCD,0xC2,0x02,0xD5,0x12,0x3E,0x20,0xF6,
+                           0x2B,0x6D,0x67,0x6A,0xC7,0x2C,0xB3,0x18};
 };
 struct PduSession {
     uint8_t     pdu_session_id = 1;
@@ -24,23 +53,120 @@ struct PduSession {
     std::string ip_address     = "10.0.0.1";
     NasSessionState state      = NasSessionState::INACTIVE;
 };
+
+// O(1) IPv4 address pool over [first, first + count). Released addresses
+// are reused LIFO before fresh ones are handed out; a bitmap catches double
+// frees. alloc() returns 0 when the pool is exhausted.
+class NasIpPool {
+public:
+    NasIpPool(uint32_t first, uint32_t count);
+    uint32_t alloc();
+    Status   release(uint32_t ip);
+    size_t   in_use()   const { return in_use_; }
+    size_t   capacity() const { return count_; }
+private:
+    uint32_t              first_;
+    uint32_t              count_;
+    uint32_t              next_   = 0;   // offsets below next_ have been handed out
+    size_t                in_use_ = 0;
+    std::vector<uint32_t> free_;
+    std::vector<uint64_t> used_;
+};
+
+// One UE's registration and PDU session, as seen by both the UE and the
+// network stub.
+struct NasContext {
+    NasRegistrationState reg_state = NasRegistrationState::DEREGISTERED;
+    NasSessionState      session   = NasSessionState::INACTIVE;
+    bool     want_session = false;   // (re-)establish a session once registered
+    uint32_t tmsi    = 0;
+    uint32_t ip      = 0;
+    // USIM
+    uint8_t  k[16]   = {};
+    uint8_t  opc[16] = {};
+    uint8_t  sqn_ms[6] = {};
+    // Authentication exchange
+    uint8_t  rand[16] = {};
+    uint8_t  autn[16] = {};
+    uint8_t  res_star[16] = {};
+    // AUSF / SEAF
+    uint8_t  xres_star[16]  = {};
+    uint8_t  hxres_star[16] = {};
+    uint8_t  k_seaf[32]     = {};
+};
+
+struct alignas(CACHE_LINE_SIZE) NasStats {
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> registrations{0};
+    std::atomic<uint64_t> auth_failures{0};
+    std::atomic<uint64_t> sessions{0};
+    std::atomic<uint64_t> session_rejects{0};
+    std::atomic<uint64_t> deregistrations{0};
+    std::atomic<uint64_t> unexpected{0};   // no transition for (state, event)
+};
+
+// Table-driven NAS state machine. Events are queued FIFO and run one at a
+// time; a transition's action posts the peer's reply to the back of the
+// queue instead of handling it in place, so procedures of every UE in the
+// queue interleave and nothing recurses. Contexts are indexed by the
+// event's ue field, which is also the UE's subscriber ID in the AkaAuc.
+// Single-threaded: NasEngine runs one machine per shard.
+class NasMachine {
+public:
+    using SendHook = std::function<void(uint32_t ue, NasEvent ev)>;
+    NasMachine(NasIpPool* pool, AkaAuc* auc, uint32_t first_tmsi);
+    void   post(uint32_t ue, NasEvent ev) { queue_.push_back({ue, ev}); }
+    // Runs up to max queued events; returns how many ran.
+    size_t run(NasContext* ues, size_t max = SIZE_MAX);
+    // Runs one event now. False if the state has no transition for it.
+    bool   dispatch(NasContext& ctx, uint32_t ue, NasEvent ev);
+    bool   idle()    const { return queue_.empty(); }
+    size_t pending() const { return queue_.size(); }
+    void   set_send_hook(SendHook hook) { on_send_ = std::move(hook); }
+    const NasStats& stats() const { return stats_; }
+private:
+    struct Queued { uint32_t ue; NasEvent ev; };
+    std::deque<Queued> queue_;
+    NasIpPool*         pool_;
+    AkaAuc*            auc_;
+    uint32_t           next_tmsi_;
+    NasStats           stats_;
+    SendHook           on_send_;
+    void send(uint32_t ue, NasEvent ev) {
+        if (on_send_) on_send_(ue, ev);
+        post(ue, ev);
+    }
+};
+
 class NasLayer {
 public:
-    explicit NasLayer(UeIdentity ue_id = {});
+    // Session addresses come from pool when given (shared by the caller's
+    // UEs), otherwise from a private 10.45.0.1-254 pool.
+    explicit NasLayer(UeIdentity ue_id = {}, NasIpPool* pool = nullptr);
+    ~NasLayer();
+    NasLayer(const NasLayer&) = delete;
+    NasLayer& operator=(const NasLayer&) = delete;
     Status initiate_registration();
     Status receive_message(const Bytes& nas_pdu, Bytes& response);
     Status request_pdu_session(const std::string& apn = "internet");
     Status initiate_deregistration();
-    NasRegistrationState get_reg_state()     const { return reg_state_; }
-    NasSessionState      get_session_state() const { return session_.state; }
+    NasRegistrationState get_reg_state()     const { return ctx_.reg_state; }
+    NasSessionState      get_session_state() const { return ctx_.session; }
     std::string          get_ip_address()    const { return session_.ip_address; }
+    uint32_t             get_tmsi()          const { return ctx_.tmsi; }
     std::string          get_reg_state_str() const;
+    const NasStats&      stats()             const { return fsm_.stats(); }
 private:
-    UeIdentity           ue_id_;
-    NasRegistrationState reg_state_ = NasRegistrationState::DEREGISTERED;
-    PduSession           session_;
-    uint8_t              nas_seq_   = 0;
-    Bytes build_nas_msg(NasMsgType type, const Bytes& payload = {});
-    bool  parse_nas_msg(const Bytes& pdu, NasMsgType& type, Bytes& payload);
-    bool  authenticate(const Bytes& rand, const Bytes& autn, Bytes& res);
+    UeIdentity                 ue_id_;
+    PduSession                 session_;
+    NasContext                 ctx_;
+    std::unique_ptr<NasIpPool> own_pool_;
+    NasIpPool*                 pool_;
+    AkaAuc                     auc_;
+    NasMachine                 fsm_;
+    uint8_t                    nas_seq_   = 0;
+    bool                       capture_   = false;
+    Bytes                      reply_;
+    Status run(NasEvent ev);
+    void  on_send(NasEvent ev);
 };
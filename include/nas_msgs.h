@@ -0,0 +1,191 @@
+#pragma once
+#include "nas_layer.h"
+#include "per_codec.h"
+
+// 5GS NAS messages. The plain header keeps the TS 24.501 octets (EPD,
+// security header type, message type) plus our sequence number; bodies are
+// APER-coded from the field lists below, a reduced set of the real IEs.
+static constexpr uint8_t NAS_EPD_5GMM = 0x7E;
+static constexpr size_t  NAS_MAX_MSG  = 160;
+
+struct NasHeader {
+    uint8_t epd  = NAS_EPD_5GMM;
+    uint8_t sht  = 0;
+    uint8_t type = 0;
+    uint8_t seq  = 0;
+    using Fields = PerFields<PerField<&NasHeader::epd,  PerInt<0, 255>>,
+                             PerField<&NasHeader::sht,  PerInt<0, 255>>,
+                             PerField<&NasHeader::type, PerInt<0, 255>>,
+                             PerField<&NasHeader::seq,  PerInt<0, 255>>>;
+};
+
+struct NasRegistrationRequestMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::REGISTRATION_REQUEST;
+    uint8_t reg_type  = 1;   // initial registration
+    uint8_t ngksi     = 7;   // no key available
+    bool    follow_on = false;
+    PerView supi;            // IMSI digits
+    using Fields = PerFields<PerField<&NasRegistrationRequestMsg::reg_type,  PerInt<0, 7>>,
+                             PerField<&NasRegistrationRequestMsg::ngksi,     PerInt<0, 7>>,
+                             PerField<&NasRegistrationRequestMsg::follow_on, PerBool>,
+                             PerField<&NasRegistrationRequestMsg::supi,      PerOctets<1, 32>>>;
+};
+struct NasRegistrationAcceptMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::REGISTRATION_ACCEPT;
+    uint8_t  result = 1;     // 3GPP access
+    uint32_t tmsi   = 0;
+    using Fields = PerFields<PerField<&NasRegistrationAcceptMsg::result, PerInt<0, 7>>,
+                             PerField<&NasRegistrationAcceptMsg::tmsi,   PerInt<0, 0xFFFFFFFF>>>;
+};
+struct NasRegistrationCompleteMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::REGISTRATION_COMPLETE;
+    using Fields = PerFields<>;
+};
+struct NasRegistrationRejectMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::REGISTRATION_REJECT;
+    uint8_t cause = 0;
+    using Fields = PerFields<PerField<&NasRegistrationRejectMsg::cause, PerInt<0, 255>>>;
+};
+struct NasDeregistrationRequestMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::DEREGISTRATION_REQUEST;
+    bool    switch_off  = false;
+    uint8_t access_type = 1;
+    uint8_t ngksi       = 0;
+    using Fields = PerFields<PerField<&NasDeregistrationRequestMsg::switch_off,  PerBool>,
+                             PerField<&NasDeregistrationRequestMsg::access_type, PerInt<1, 3>>,
+                             PerField<&NasDeregistrationRequestMsg::ngksi,       PerInt<0, 7>>>;
+};
+struct NasDeregistrationAcceptMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::DEREGISTRATION_ACCEPT;
+    using Fields = PerFields<>;
+};
+struct NasAuthRequestMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::AUTH_REQUEST;
+    uint8_t ngksi = 0;
+    PerView abba;
+    PerView rand;
+    PerView autn;
+    using Fields = PerFields<PerField<&NasAuthRequestMsg::ngksi, PerInt<0, 7>>,
+                             PerField<&NasAuthRequestMsg::abba,  PerOctets<2, 16>>,
+                             PerField<&NasAuthRequestMsg::rand,  PerOctets<16, 16>>,
+                             PerField<&NasAuthRequestMsg::autn,  PerOctets<16, 16>>>;
+};
+struct NasAuthResponseMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::AUTH_RESPONSE;
+    PerView res_star;
+    using Fields = PerFields<PerField<&NasAuthResponseMsg::res_star, PerOctets<16, 16>>>;
+};
+struct NasAuthFailureMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::AUTH_FAILURE;
+    uint8_t cause = 20;      // MAC failure
+    PerView auts;            // only with synch failure
+    using Fields = PerFields<PerField<&NasAuthFailureMsg::cause, PerInt<0, 255>>,
+                             PerField<&NasAuthFailureMsg::auts,  PerOctets<0, 14>>>;
+};
+struct NasSecurityModeCmdMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::SECURITY_MODE_CMD;
+    uint8_t ciphering = 1;   // 5G-EA1
+    uint8_t integrity = 1;   // 5G-IA1
+    uint8_t ngksi     = 0;
+    using Fields = PerFields<PerField<&NasSecurityModeCmdMsg::ciphering, PerInt<0, 15>>,
+                             PerField<&NasSecurityModeCmdMsg::integrity, PerInt<0, 15>>,
+                             PerField<&NasSecurityModeCmdMsg::ngksi,     PerInt<0, 7>>>;
+};
+struct NasSecurityModeCompleteMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::SECURITY_MODE_COMPLETE;
+    PerView imeisv;
+    using Fields = PerFields<PerField<&NasSecurityModeCompleteMsg::imeisv, PerOctets<0, 8>>>;
+};
+struct NasPduSessionEstabReqMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::PDU_SESSION_ESTAB_REQ;
+    uint8_t session_id = 1;
+    uint8_t pti        = 0;
+    PerView dnn;
+    using Fields = PerFields<PerField<&NasPduSessionEstabReqMsg::session_id, PerInt<1, 15>>,
+                             PerField<&NasPduSessionEstabReqMsg::pti,        PerInt<0, 255>>,
+                             PerField<&NasPduSessionEstabReqMsg::dnn,        PerOctets<1, 100>>>;
+};
+struct NasPduSessionEstabAccMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::PDU_SESSION_ESTAB_ACC;
+    uint8_t  session_id = 1;
+    uint8_t  pti        = 0;
+    uint8_t  ssc_mode   = 1;
+    uint32_t ipv4       = 0;
+    using Fields = PerFields<PerField<&NasPduSessionEstabAccMsg::session_id, PerInt<1, 15>>,
+                             PerField<&NasPduSessionEstabAccMsg::pti,        PerInt<0, 255>>,
+                             PerField<&NasPduSessionEstabAccMsg::ssc_mode,   PerInt<1, 3>>,
+                             PerField<&NasPduSessionEstabAccMsg::ipv4,       PerInt<0, 0xFFFFFFFF>>>;
+};
+struct NasPduSessionEstabRejMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::PDU_SESSION_ESTAB_REJ;
+    uint8_t session_id = 1;
+    uint8_t pti        = 0;
+    uint8_t cause      = 26;   // insufficient resources
+    using Fields = PerFields<PerField<&NasPduSessionEstabRejMsg::session_id, PerInt<1, 15>>,
+                             PerField<&NasPduSessionEstabRejMsg::pti,        PerInt<0, 255>>,
+                             PerField<&NasPduSessionEstabRejMsg::cause,      PerInt<0, 255>>>;
+};
+struct NasPduSessionReleaseCmdMsg {
+    static constexpr NasMsgType TYPE = NasMsgType::PDU_SESSION_RELEASE_CMD;
+    uint8_t session_id = 1;
+    uint8_t pti        = 0;
+    uint8_t cause      = 36;   // regular deactivation
+    using Fields = PerFields<PerField<&NasPduSessionReleaseCmdMsg::session_id, PerInt<1, 15>>,
+                             PerField<&NasPduSessionReleaseCmdMsg::pti,        PerInt<0, 255>>,
+                             PerField<&NasPduSessionReleaseCmdMsg::cause,      PerInt<0, 255>>>;
+};
+
+using NasMsgSet = PerMsgSet<NasMsgType,
+    NasRegistrationRequestMsg, NasRegistrationAcceptMsg, NasRegistrationCompleteMsg,
+    NasRegistrationRejectMsg, NasDeregistrationRequestMsg, NasDeregistrationAcceptMsg,
+    NasAuthRequestMsg, NasAuthResponseMsg, NasAuthFailureMsg, NasSecurityModeCmdMsg,
+    NasSecurityModeCompleteMsg, NasPduSessionEstabReqMsg, NasPduSessionEstabAccMsg,
+    NasPduSessionEstabRejMsg, NasPduSessionReleaseCmdMsg>;
+static_assert(NasMsgSet::covers({
+    NasMsgType::REGISTRATION_REQUEST, NasMsgType::REGISTRATION_ACCEPT, NasMsgType::REGISTRATION_COMPLETE,
+    NasMsgType::REGISTRATION_REJECT, NasMsgType::DEREGISTRATION_REQUEST, NasMsgType::DEREGISTRATION_ACCEPT,
+    NasMsgType::AUTH_REQUEST, NasMsgType::AUTH_RESPONSE, NasMsgType::AUTH_FAILURE,
+    NasMsgType::SECURITY_MODE_CMD, NasMsgType::SECURITY_MODE_COMPLETE,
+    NasMsgType::PDU_SESSION_ESTAB_REQ, NasMsgType::PDU_SESSION_ESTAB_ACC,
+    NasMsgType::PDU_SESSION_ESTAB_REJ, NasMsgType::PDU_SESSION_RELEASE_CMD}), "NasMsgSet misses a message");
+
+// Encodes into buf; returns the encoded length, 0 if it does not fit.
+template <typename Msg>
+size_t nas_encode(const Msg& m, uint8_t seq, uint8_t* buf, size_t cap) {
+    PerWriter w(buf, cap);
+    NasHeader h;
+    h.type = (uint8_t)Msg::TYPE;
+    h.seq  = seq;
+    per_encode<PerMode::ALIGNED>(w, h);
+    per_encode<PerMode::ALIGNED>(w, m);
+    return w.ok() ? w.bytes() : 0;
+}
+// Checks the header and the type; seq may be null.
+inline bool nas_peek_type(const uint8_t* pdu, size_t len, NasMsgType& type, uint8_t* seq = nullptr) {
+    PerReader r(pdu, len);
+    NasHeader h;
+    per_decode<PerMode::ALIGNED>(r, h);
+    size_t i = 0;
+    if (!r.ok() || h.epd != NAS_EPD_5GMM || !NasMsgSet::index_of((NasMsgType)h.type, i)) return false;
+    type = (NasMsgType)h.type;
+    if (seq) *seq = h.seq;
+    return true;
+}
+// Octet fields of m are views into pdu.
+template <typename Msg>
+Status nas_decode(const uint8_t* pdu, size_t len, Msg& m) {
+    PerReader r(pdu, len);
+    NasHeader h;
+    per_decode<PerMode::ALIGNED>(r, h);
+    if (!r.ok() || h.epd != NAS_EPD_5GMM || h.type != (uint8_t)Msg::TYPE) return Status::ERROR;
+    per_decode<PerMode::ALIGNED>(r, m);
+    return r.ok() && r.bits_left() < 8 ? Status::OK : Status::ERROR;
+}
+// Decodes whatever message pdu holds, to validate it.
+inline Status nas_validate(const uint8_t* pdu, size_t len) {
+    NasMsgType type;
+    if (!nas_peek_type(pdu, len, type)) return Status::ERROR;
+    Status s = Status::ERROR;
+    NasMsgSet::visit(type, [&](auto m) { s = nas_decode(pdu, len, m); });
+    return s;
+}
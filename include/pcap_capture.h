@@ -0,0 +1,112 @@
+#pragma once
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include "ring_buffer.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum PcapLayer : uint8_t { PCAP_MAC = 1, PCAP_RLC = 2, PCAP_PDCP = 4, PCAP_ALL = 7 };
+enum class PcapDirection : uint8_t { UPLINK = 0, DOWNLINK = 1 };
+
+// Frames are IPv4/UDP datagrams to port 9999 carrying Wireshark's NR
+// framing: the "mac-nr", "rlc-nr" or "pdcp-nr" signature, the context
+// fields and tags, then the PDU. Enable the mac_nr_udp, rlc_nr_udp and
+// pdcp_nr_udp heuristics to decode them.
+static constexpr uint16_t PCAP_UDP_PORT      = 9999;
+static constexpr uint32_t PCAP_LINKTYPE_IPV4 = 228;
+static constexpr uint32_t PCAP_FLUSH_MS      = 50;
+// RLC modes as the rlc-nr framing numbers them.
+static constexpr uint8_t  PCAP_RLC_TM = 1, PCAP_RLC_UM = 2, PCAP_RLC_AM = 4;
+
+struct PcapConfig {
+    std::string           path;
+    uint8_t               layers      = PCAP_ALL;
+    std::vector<uint16_t> ues;                     // UE IDs to capture; empty: all
+    size_t                ring_bytes  = 4 << 20;   // per producing thread
+    size_t                write_bytes = 1 << 20;   // writer batch
+    uint32_t              snaplen     = 65535;
+};
+
+struct PcapStats {
+    uint64_t frames = 0, dropped = 0, bytes_written = 0, writes = 0;
+};
+
+// What a layer instance stamps on its frames. RX frames get the opposite
+// of tx_dir.
+struct PcapContext {
+    bool          on      = false;
+    uint16_t      ueid    = 0;
+    uint16_t      rnti    = 0;
+    uint8_t       bearer  = 1;   // DRB or SRB identity
+    bool          srb     = false;
+    PcapDirection tx_dir  = PcapDirection::DOWNLINK;
+};
+
+// Variable-length SPSC byte ring of finished pcap records, one per
+// producing thread. A record never wraps: a zero length prefix sends the
+// reader back to the start.
+struct PcapThreadRing {
+    std::unique_ptr<uint8_t[]> buf;
+    size_t                     cap;
+    uint32_t                   gen;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+    size_t                     head_cache = 0;
+    size_t                     claimed    = 0;
+    std::atomic<uint64_t>      frames{0};
+    std::atomic<uint64_t>      dropped{0};
+    PcapThreadRing(size_t bytes, uint32_t gen);
+    // Room for a len-byte record, or nullptr when the ring is full.
+    uint8_t* claim(size_t len);
+    void     publish() { tail.store(claimed, std::memory_order_release); }
+};
+
+// Capture is process-wide and off until start(). Producers format the
+// record straight into their thread's ring and never block: a full ring
+// drops the frame. A writer thread gathers the rings into write_bytes
+// batches and appends them to the file.
+class PcapCapture {
+public:
+    static PcapCapture& instance() { static PcapCapture inst; return inst; }
+    ~PcapCapture();
+    // ERROR if the file cannot be created, INVALID_STATE if already running.
+    Status start(const PcapConfig& cfg);
+    void   stop();
+    bool   running() const { return layers_.load(std::memory_order_relaxed) != 0; }
+    bool   wants(PcapLayer layer, uint16_t ueid) const {
+        return (layers_.load(std::memory_order_acquire) & layer) &&
+               ((ue_mask_[ueid >> 6].load(std::memory_order_relaxed) >> (ueid & 63)) & 1);
+    }
+    void mac(const PcapContext& ctx, bool tx, const uint8_t* pdu, size_t len, uint8_t harq_id = 0xFF);
+    void rlc(const PcapContext& ctx, bool tx, uint8_t rlc_mode, uint8_t sn_bits, const uint8_t* pdu, size_t len);
+    void pdcp(const PcapContext& ctx, bool tx, uint8_t sn_bits, const uint8_t* pdu, size_t len);
+    PcapStats stats() const;
+private:
+    PcapCapture() = default;
+    std::atomic<uint8_t>  layers_{0};
+    std::atomic<uint64_t> ue_mask_[65536 / 64] = {};
+    std::atomic<bool>     stopping_{false};
+    uint32_t              gen_ = 0;        // bumped by start(): rings of a previous run are dropped
+    mutable std::mutex    rings_mu_;
+    std::vector<std::shared_ptr<PcapThreadRing>> rings_;
+    PcapConfig            cfg_;
+    FILE*                 file_ = nullptr;
+    std::thread           writer_;
+    std::atomic<uint64_t> bytes_written_{0}, writes_{0};
+
+    PcapThreadRing& local_ring();
+    void   frame(uint8_t layer, const PcapContext& ctx, const uint8_t* hdr, size_t hdr_len,
+                 const uint8_t* pdu, size_t len);
+    size_t drain(std::vector<uint8_t>& out);
+    void   flush(std::vector<uint8_t>& out);
+};
+
+// Layer-side check: bound and selected.
+inline bool pcap_wants(const PcapContext& ctx, PcapLayer layer) {
+    return ctx.on && PcapCapture::instance().wants(layer, ctx.ueid);
+}
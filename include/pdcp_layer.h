@@ -1,35 +1,129 @@
 #pragma once
 #include "common_types.h"
+#include "metrics.h"
+#include "pcap_capture.h"
+#include "pdu_buffer.h"
+#include "rohc.h"
+#include "security.h"
 #include <map>
+#include <memory>
+#include <vector>
 enum class PdcpBearerType { SRB, DRB };
-struct RohcContext {
-    uint32_t src_ip   = 0;
-    uint32_t dst_ip   = 0;
-    uint16_t src_port = 0;
-    uint16_t dst_port = 0;
-    uint32_t last_sn  = 0;
-    bool     established = false;
+enum class PdcpSnLen : uint8_t { SN12 = 12, SN18 = 18 };
+static constexpr size_t PDCP_MAC_I_LEN   = 4;
+static constexpr size_t PDCP_SEC_BATCH   = 32;
+static constexpr uint32_t PDCP_T_REORDERING_MS = 100;
+struct PdcpSecurityConfig {
+    CipherAlg cipher    = CipherAlg::NEA0;
+    IntegAlg  integ     = IntegAlg::NIA0;
+    uint8_t   k_enc[16] = {};
+    uint8_t   k_int[16] = {};
+    uint8_t   bearer    = 0;
+    uint8_t   direction = 0;   // TX direction (0 = UL); RX expects the opposite
 };
 struct PdcpHeader {
     bool     data_ctrl;
-    uint16_t sn;
+    uint32_t sn;
 };
 class PdcpLayer {
 public:
-    explicit PdcpLayer(PdcpBearerType type = PdcpBearerType::DRB);
+    explicit PdcpLayer(PdcpBearerType type = PdcpBearerType::DRB, RohcConfig rohc = {},
+                       PdcpSnLen sn_len = PdcpSnLen::SN12);
     Status receive_pdu(const Bytes& rlc_pdu, Bytes& sdu_out);
     Status transmit_sdu(const Bytes& sdu_in, Bytes& rlc_pdu);
+    Status receive_pdu(PduBuffer& pdu);
+    Status transmit_sdu(PduBuffer& pdu);
+    size_t receive_burst(PduBuffer* pdus, size_t n, Status* status);
+    size_t transmit_burst(PduBuffer* pdus, size_t n, Status* status);
+    // Enables ciphering and integrity protection. SRBs always carry a MAC-I
+    // once security is on; DRBs only when an integrity algorithm is set.
+    void     set_security(const PdcpSecurityConfig& cfg);
     uint32_t compute_integrity(const Bytes& msg, uint32_t count, uint32_t key);
     bool     verify_integrity(const Bytes& msg, uint32_t count, uint32_t key, uint32_t expected_mac);
-    uint16_t get_tx_sn() const { return tx_sn_; }
+    // Reordering (TS 38.323 5.2.2): receive_pdu returns OK with the SDU in
+    // place when the PDU is next in sequence, PENDING when it was buffered or
+    // discarded as a duplicate. SDUs released behind it wait for pop_sdu.
+    bool     pop_sdu(PduBuffer& sdu);
+    bool     pop_sdu(Bytes& sdu);
+    void     tick(uint32_t ms);
+    void     set_t_reordering(uint32_t ms) { t_reordering_ms_ = ms; }
+    size_t   pending_sdus() const { return rx_ready_.size() - rx_ready_head_; }
+    uint8_t  get_sn_bits()  const { return sn_bits_; }
+    uint32_t get_tx_sn() const { return tx_count_ & sn_mask(); }
+    uint32_t get_tx_count() const { return tx_count_; }
+    uint32_t get_rx_count() const { return rx_next_; }
+    uint32_t get_rx_deliv() const { return rx_deliv_; }
+    uint32_t get_rx_duplicates() const { return rx_duplicates_; }
+    uint32_t get_rx_lost()       const { return rx_lost_; }
+    uint32_t get_integrity_failures() const { return integrity_failures_; }
+    const RohcCompressor&   rohc_tx() const { return rohc_tx_; }
+    const RohcDecompressor& rohc_rx() const { return rohc_rx_; }
+    // PDUs, discards (duplicates, integrity and decompression failures),
+    // losses to t-Reordering and bytes into and out of the ROHC compressor.
+    void     bind_metrics(uint32_t ue = METRIC_NO_UE, uint8_t bearer = METRIC_NO_BEARER);
+    // Protected PDUs as handed to RLC and as received.
+    void     bind_capture(const PcapContext& ctx) {
+        cap_ = ctx; cap_.on = true; cap_.srb = type_ == PdcpBearerType::SRB;
+    }
 private:
     PdcpBearerType type_;
-    uint16_t       tx_sn_ = 0;
-    uint16_t       rx_sn_ = 0;
-    RohcContext    rohc_;
-    Bytes compress_ip_header(const Bytes& ip_packet);
-    Bytes decompress_ip_header(const Bytes& compressed, bool full_header);
-    Bytes    build_pdcp_pdu(const PdcpHeader& hdr, const Bytes& payload);
-    bool     parse_pdcp_pdu(const Bytes& pdu, PdcpHeader& hdr, Bytes& payload);
-    uint16_t next_sn(uint16_t sn) { return (sn + 1) & 0x0FFF; }
+    uint8_t        sn_bits_;
+    size_t         hdr_len_;
+    uint32_t       tx_count_ = 0;
+    // RX window state as COUNTs: next expected, first not yet delivered and
+    // the one that started t-Reordering. Out-of-order SDUs sit in a ring of
+    // Window_Size slots indexed by COUNT, with a bitmap of occupied slots;
+    // both are allocated on the first gap.
+    uint32_t       rx_next_  = 0;
+    uint32_t       rx_deliv_ = 0;
+    uint32_t       rx_reord_ = 0;
+    int32_t        t_reordering_left_ = -1;
+    uint32_t       t_reordering_ms_   = PDCP_T_REORDERING_MS;
+    uint32_t       rx_duplicates_ = 0;
+    uint32_t       rx_lost_       = 0;
+    std::vector<uint64_t>        rx_bitmap_;
+    std::unique_ptr<PduBuffer[]> rx_ring_;
+    std::vector<PduBuffer>       rx_ready_;
+    size_t                       rx_ready_head_ = 0;
+    RohcCompressor   rohc_tx_;
+    RohcDecompressor rohc_rx_;
+    bool               sec_on_ = false;
+    PdcpSecurityConfig sec_cfg_;
+    Aes128Key          k_enc_;
+    Aes128Cmac         k_int_;
+    uint32_t           integrity_failures_ = 0;
+    struct {
+        MetricCounter tx_pdus, rx_pdus, rx_duplicates, rx_integrity_failures, rx_rohc_failures, rx_lost;
+        MetricCounter rohc_in_bytes, rohc_out_bytes;
+    } metrics_;
+    PcapContext cap_;
+    void capture(bool tx, const PduBuffer& pdu) const {
+        if (pcap_wants(cap_, PCAP_PDCP)) PcapCapture::instance().pdcp(cap_, tx, sn_bits_, pdu.data(), pdu.size());
+    }
+    bool     has_mac_i() const { return sec_on_ && (type_ == PdcpBearerType::SRB || sec_cfg_.integ != IntegAlg::NIA0); }
+    void     protect(PduBuffer* pdus, uint32_t first_count, size_t n);
+    void     unprotect(PduBuffer* pdus, const uint32_t* counts, size_t n, Status* status);
+    uint32_t sn_mask() const { return (1u << sn_bits_) - 1; }
+    uint32_t window()  const { return 1u << (sn_bits_ - 1); }
+    uint32_t sn_of(const uint8_t* h) const {
+        return sn_bits_ == 12 ? ((uint32_t)(h[0] & 0x0F) << 8) | h[1]
+                              : ((uint32_t)(h[0] & 0x03) << 16) | ((uint32_t)h[1] << 8) | h[2];
+    }
+    bool rx_has(uint32_t count) const {
+        uint32_t i = count & (window() - 1);
+        return !rx_bitmap_.empty() && ((rx_bitmap_[i >> 6] >> (i & 63)) & 1);
+    }
+    void rx_mark(uint32_t count, bool on) {
+        uint32_t i = count & (window() - 1);
+        if (on) rx_bitmap_[i >> 6] |= (1ULL << (i & 63)); else rx_bitmap_[i >> 6] &= ~(1ULL << (i & 63));
+    }
+    uint32_t rx_find_stored(uint32_t from, uint32_t end) const;
+    uint32_t rx_count_of(uint32_t sn, uint32_t deliv) const;
+    Status   rx_decompress(PduBuffer& pdu, uint32_t count);
+    void     rx_deliver_in_order();
+    void     rx_update_reordering_timer();
+    void     tx_one(PduBuffer& pdu, uint32_t sn);
+    Status   rx_one(PduBuffer& pdu, PdcpHeader& hdr, uint32_t count);
+    void     build_pdcp_pdu(const PdcpHeader& hdr, PduBuffer& pdu);
+    bool     parse_pdcp_pdu(PduBuffer& pdu, PdcpHeader& hdr);
 };
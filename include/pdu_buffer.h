@@ -0,0 +1,78 @@
+#pragma once
+#include "common_types.h"
+#include <atomic>
+#include <cstring>
+
+static constexpr uint32_t PDU_DEFAULT_HEADROOM = 128;
+static constexpr uint32_t PDU_DEFAULT_TAILROOM = 64;
+
+// Shared backing store. claimed_lo/claimed_hi track the byte range handed out
+// to views so a header can be written into headroom in place only by the view
+// that owns the front of the buffer (same rule as skb headroom in Linux).
+struct PduStorage {
+    std::atomic<uint32_t> refcnt;
+    uint32_t capacity;
+    uint32_t claimed_lo;
+    uint32_t claimed_hi;
+    uint8_t  size_class;
+    uint8_t* bytes() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+struct PduPoolStats {
+    uint64_t allocs      = 0;
+    uint64_t heap_allocs = 0;
+    uint64_t copies      = 0;
+    uint64_t copy_bytes  = 0;
+};
+
+class PduPool {
+public:
+    static PduStorage*  acquire(size_t capacity);
+    static void         release(PduStorage* st);
+    static void         reserve(size_t count, size_t capacity = 2048);
+    static PduPoolStats stats();
+    static void         reset_stats();
+};
+
+// Reference-counted view over a PduStorage. TX paths prepend headers into the
+// headroom and RX paths strip them, so payload bytes never move between layers.
+class PduBuffer {
+public:
+    PduBuffer() = default;
+    PduBuffer(const PduBuffer& o) : st_(o.st_), off_(o.off_), len_(o.len_) { if (st_) st_->refcnt.fetch_add(1, std::memory_order_relaxed); }
+    PduBuffer(PduBuffer&& o) noexcept : st_(o.st_), off_(o.off_), len_(o.len_) { o.st_ = nullptr; o.off_ = o.len_ = 0; }
+    PduBuffer& operator=(const PduBuffer& o) { PduBuffer tmp(o); swap(tmp); return *this; }
+    PduBuffer& operator=(PduBuffer&& o) noexcept { PduBuffer tmp(std::move(o)); swap(tmp); return *this; }
+    ~PduBuffer() { reset(); }
+
+    static PduBuffer alloc(size_t len, size_t headroom = PDU_DEFAULT_HEADROOM,
+                           size_t tailroom = PDU_DEFAULT_TAILROOM);
+    static PduBuffer from(const uint8_t* p, size_t len, size_t headroom = PDU_DEFAULT_HEADROOM);
+    static PduBuffer from(const Bytes& b, size_t headroom = PDU_DEFAULT_HEADROOM) { return from(b.data(), b.size(), headroom); }
+
+    uint8_t*       data()           { return st_ ? st_->bytes() + off_ : nullptr; }
+    const uint8_t* data()     const { return st_ ? st_->bytes() + off_ : nullptr; }
+    size_t         size()     const { return len_; }
+    bool           empty()    const { return len_ == 0; }
+    bool           valid()    const { return st_ != nullptr; }
+    bool           shared()   const { return st_ && st_->refcnt.load(std::memory_order_acquire) > 1; }
+    size_t         headroom() const { return off_; }
+    size_t         tailroom() const { return st_ ? st_->capacity - off_ - len_ : 0; }
+    uint8_t&       operator[](size_t i)       { return data()[i]; }
+    const uint8_t& operator[](size_t i) const { return data()[i]; }
+
+    uint8_t* prepend(size_t n);
+    uint8_t* append(size_t n);
+    bool     strip(size_t n) { if (n > len_) return false; off_ += (uint32_t)n; len_ -= (uint32_t)n; return true; }
+    bool     trim(size_t n)  { if (n > len_) return false; len_ -= (uint32_t)n; return true; }
+    PduBuffer slice(size_t off, size_t len) const;
+    void     make_writable();
+    void     reset();
+    Bytes    to_bytes() const { return len_ ? Bytes(data(), data() + len_) : Bytes(); }
+    void     swap(PduBuffer& o) noexcept { std::swap(st_, o.st_); std::swap(off_, o.off_); std::swap(len_, o.len_); }
+private:
+    PduStorage* st_  = nullptr;
+    uint32_t    off_ = 0;
+    uint32_t    len_ = 0;
+    void realloc_copy(size_t headroom, size_t tailroom);
+};
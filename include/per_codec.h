@@ -0,0 +1,237 @@
+#pragma once
+#include "common_types.h"
+#include <cstring>
+#include <initializer_list>
+
+// Packed Encoding Rules (X.691) for control-plane messages. A message is a
+// plain struct plus a compile-time field list; per_encode/per_decode fold
+// over that list, so every message gets a specialised codec with no tables
+// or virtual calls. UNALIGNED is UPER; ALIGNED is the APER subset we need:
+// values of range 256 or above and octet strings longer than two octets
+// start on an octet boundary. Ranges above 64K are sent as whole octets
+// without a length determinant, extension markers and OPTIONAL bitmaps are
+// not modelled.
+enum class PerMode : uint8_t { UNALIGNED, ALIGNED };
+
+// Octets of a received message, left in the input buffer. Under UPER an
+// octet string need not start on an octet boundary, so the view keeps a bit
+// offset; data() is only non-null when it does.
+struct PerView {
+    const uint8_t* base    = nullptr;
+    size_t         bit_off = 0;
+    size_t         len     = 0;
+    static PerView of(const void* p, size_t n) { return {static_cast<const uint8_t*>(p), 0, n}; }
+    size_t         size()    const { return len; }
+    bool           aligned() const { return (bit_off & 7) == 0; }
+    const uint8_t* data()    const { return aligned() ? base + bit_off / 8 : nullptr; }
+    uint8_t operator[](size_t i) const {
+        size_t bit = bit_off + i * 8, sh = bit & 7;
+        const uint8_t* p = base + bit / 8;
+        return sh ? (uint8_t)((p[0] << sh) | (p[1] >> (8 - sh))) : p[0];
+    }
+    // False (and nothing copied) unless the view is exactly n octets.
+    bool copy_to(uint8_t* out, size_t n) const {
+        if (n != len) return false;
+        if (aligned()) { if (n) std::memcpy(out, data(), n); }
+        else for (size_t i = 0; i < n; i++) out[i] = (*this)[i];
+        return true;
+    }
+    bool equals(const void* p, size_t n) const {
+        if (n != len) return false;
+        if (aligned()) return n == 0 || std::memcmp(data(), p, n) == 0;
+        for (size_t i = 0; i < n; i++) if ((*this)[i] != static_cast<const uint8_t*>(p)[i]) return false;
+        return true;
+    }
+};
+
+// Writes MSB-first into a caller buffer. Running past the end, or a value
+// its field cannot carry, sets a sticky error; bytes() is then meaningless.
+class PerWriter {
+public:
+    PerWriter(uint8_t* buf, size_t cap) : buf_(buf), cap_bits_(cap * 8) {}
+    void put_bits(uint64_t v, unsigned n) {
+        if (pos_ + n > cap_bits_) { error_ = true; return; }
+        while (n) {
+            unsigned used = pos_ & 7, take = 8 - used < n ? 8 - used : n;
+            uint8_t& b = buf_[pos_ >> 3];
+            if (!used) b = 0;
+            b |= (uint8_t)(((v >> (n - take)) & ((1u << take) - 1)) << (8 - used - take));
+            pos_ += take; n -= take;
+        }
+    }
+    void align() { if (pos_ & 7) put_bits(0, 8 - (unsigned)(pos_ & 7)); }
+    void put_octets(const PerView& v) {
+        if (pos_ + v.len * 8 > cap_bits_) { error_ = true; return; }
+        if (!(pos_ & 7) && v.aligned()) {
+            if (v.len) std::memcpy(buf_ + (pos_ >> 3), v.data(), v.len);
+            pos_ += v.len * 8;
+        } else if (v.aligned()) {   // shift-merge, carrying into the next octet
+            unsigned       sh    = pos_ & 7;
+            uint8_t*       d     = buf_ + (pos_ >> 3);
+            const uint8_t* src   = v.data();
+            uint8_t        carry = d[0];
+            size_t         i     = 0;
+            for (; i + 8 <= v.len; i += 8) {   // eight octets per big-endian word
+                uint64_t x;
+                std::memcpy(&x, src + i, 8);
+                x = __builtin_bswap64(x);
+                uint64_t y = __builtin_bswap64(((uint64_t)carry << 56) | (x >> sh));
+                std::memcpy(d + i, &y, 8);
+                carry = (uint8_t)(x << (8 - sh));
+            }
+            for (; i < v.len; i++) {
+                d[i]  = carry | (uint8_t)(src[i] >> sh);
+                carry = (uint8_t)(src[i] << (8 - sh));
+            }
+            d[v.len] = carry;
+            pos_ += v.len * 8;
+        } else {
+            for (size_t i = 0; i < v.len; i++) put_bits(v[i], 8);
+        }
+    }
+    void   fail()        { error_ = true; }
+    bool   ok()    const { return !error_; }
+    size_t bits()  const { return pos_; }
+    size_t bytes() const { return (pos_ + 7) >> 3; }
+private:
+    uint8_t* buf_;
+    size_t   cap_bits_;
+    size_t   pos_      = 0;
+    bool     error_ = false;
+};
+
+// Every read is bounds-checked; reading past the end sets a sticky error
+// and yields zeros / empty views.
+class PerReader {
+public:
+    PerReader(const uint8_t* buf, size_t len) : buf_(buf), len_bits_(len * 8) {}
+    uint64_t get_bits(unsigned n) {
+        if (pos_ + n > len_bits_) { error_ = true; return 0; }
+        uint64_t v = 0;
+        while (n) {
+            unsigned used = pos_ & 7, take = 8 - used < n ? 8 - used : n;
+            v = (v << take) | ((buf_[pos_ >> 3] >> (8 - used - take)) & ((1u << take) - 1));
+            pos_ += take; n -= take;
+        }
+        return v;
+    }
+    void align() { if (pos_ & 7) get_bits(8 - (unsigned)(pos_ & 7)); }
+    PerView get_octets(size_t n) {
+        if (pos_ + n * 8 > len_bits_) { error_ = true; return {}; }
+        PerView v{buf_, pos_, n};
+        pos_ += n * 8;
+        return v;
+    }
+    void   fail()            { error_ = true; }
+    bool   ok()        const { return !error_; }
+    size_t bits_left() const { return len_bits_ - pos_; }
+private:
+    const uint8_t* buf_;
+    size_t         len_bits_;
+    size_t         pos_   = 0;
+    bool           error_ = false;
+};
+
+constexpr unsigned per_bits_for(uint64_t range) {   // bits for [0, range)
+    unsigned n = 0;
+    while (n < 64 && (range - 1) >> n) n++;
+    return n;
+}
+
+// Constrained whole number in [Lo, Hi] (X.691 10.5).
+template <int64_t Lo, int64_t Hi>
+struct PerInt {
+    static_assert(Lo <= Hi, "empty range");
+    static constexpr uint64_t RANGE = (uint64_t)(Hi - Lo) + 1;
+    static constexpr unsigned BITS  = per_bits_for(RANGE);
+    template <PerMode M>
+    static constexpr unsigned width() {
+        if (M == PerMode::UNALIGNED || RANGE <= 255) return BITS;
+        return RANGE <= 256 ? 8 : RANGE <= 65536 ? 16 : (BITS + 7) / 8 * 8;
+    }
+    template <PerMode M> static constexpr bool aligned() { return M == PerMode::ALIGNED && RANGE > 255; }
+    template <PerMode M, typename T>
+    static void encode(PerWriter& w, T v) {
+        if ((int64_t)v < Lo || (int64_t)v > Hi) { w.fail(); return; }
+        if (aligned<M>()) w.align();
+        w.put_bits((uint64_t)((int64_t)v - Lo), width<M>());
+    }
+    template <PerMode M, typename T>
+    static void decode(PerReader& r, T& v) {
+        if (aligned<M>()) r.align();
+        uint64_t u = r.get_bits(width<M>());
+        if (u >= RANGE) { r.fail(); u = 0; }
+        v = (T)((int64_t)u + Lo);
+    }
+};
+
+struct PerBool {
+    template <PerMode M> static void encode(PerWriter& w, bool v) { w.put_bits(v, 1); }
+    template <PerMode M> static void decode(PerReader& r, bool& v) { v = r.get_bits(1); }
+};
+
+// OCTET STRING (SIZE(Min..Max)); fixed sizes carry no length (X.691 17).
+template <size_t Min, size_t Max>
+struct PerOctets {
+    static_assert(Min <= Max, "empty size range");
+    using Len = PerInt<(int64_t)Min, (int64_t)Max>;
+    template <PerMode M> static constexpr bool aligned() { return M == PerMode::ALIGNED && Max > 2; }
+    template <PerMode M>
+    static void encode(PerWriter& w, const PerView& v) {
+        if (v.len < Min || v.len > Max) { w.fail(); return; }
+        if (Min != Max) Len::template encode<M>(w, v.len);
+        if (aligned<M>()) w.align();
+        w.put_octets(v);
+    }
+    template <PerMode M>
+    static void decode(PerReader& r, PerView& v) {
+        size_t n = Min;
+        if (Min != Max) Len::template decode<M>(r, n);
+        if (aligned<M>()) r.align();
+        v = r.get_octets(n);
+    }
+};
+
+template <auto Member, typename Codec>
+struct PerField {
+    template <PerMode M, typename Msg> static void encode(PerWriter& w, const Msg& m) { Codec::template encode<M>(w, m.*Member); }
+    template <PerMode M, typename Msg> static void decode(PerReader& r, Msg& m)       { Codec::template decode<M>(r, m.*Member); }
+};
+
+template <typename... F>
+struct PerFields {
+    template <PerMode M, typename Msg> static void encode(PerWriter& w, const Msg& m) { (F::template encode<M>(w, m), ...); }
+    template <PerMode M, typename Msg> static void decode(PerReader& r, Msg& m)       { (F::template decode<M>(r, m), ...); }
+};
+
+template <PerMode M, typename Msg> void per_encode(PerWriter& w, const Msg& m) { Msg::Fields::template encode<M>(w, m); }
+template <PerMode M, typename Msg> void per_decode(PerReader& r, Msg& m)       { Msg::Fields::template decode<M>(r, m); }
+
+// A protocol's messages; each has TYPE and Fields. The position in the list
+// is the CHOICE index.
+template <typename Enum, typename... Msgs>
+struct PerMsgSet {
+    static constexpr size_t SIZE = sizeof...(Msgs);
+    static constexpr Enum   TYPES[SIZE] = {Msgs::TYPE...};
+    using Index = PerInt<0, (int64_t)SIZE - 1>;
+    static constexpr bool index_of(Enum t, size_t& i) {
+        for (i = 0; i < SIZE; i++) if (TYPES[i] == t) return true;
+        return false;
+    }
+    template <typename Msg> static constexpr size_t index() {
+        size_t i = 0;
+        index_of(Msg::TYPE, i);
+        return i;
+    }
+    // Calls f(Msg{}) for the message whose TYPE is t; false if none.
+    template <typename F>
+    static bool visit(Enum t, F&& f) {
+        bool found = false;
+        ((!found && Msgs::TYPE == t ? (found = true, f(Msgs{}), 0) : 0), ...);
+        return found;
+    }
+    static constexpr bool covers(std::initializer_list<Enum> all) {
+        for (Enum e : all) { size_t i = 0; if (!index_of(e, i)) return false; }
+        return all.size() == SIZE;
+    }
+};
@@ -1,33 +1,76 @@
 #pragma once
+#include "channel_model.h"
 #include "common_types.h"
+#include "metrics.h"
+#include "pdu_buffer.h"
 
 enum class MCS : uint8_t {
-    QPSK_1_3  = 0,
-    QPSK_1_2  = 5,
-    QAM16_1_2 = 10,
-    QAM64_2_3 = 20,
-    QAM64_5_6 = 28,
+    QPSK_1_3   = 0,
+    QPSK_1_2   = 5,
+    QAM16_1_2  = 10,
+    QAM64_2_3  = 20,
+    QAM64_5_6  = 28,
+    QAM256_3_4 = 24,
 };
 
+struct McsParams {
+    uint8_t qm;     // bits per modulation symbol
+    float   rate;   // code rate
+};
+McsParams mcs_params(MCS mcs);
+// Transport block size in bytes for one layer over one slot, TS 38.214
+// 5.1.3.2: 12 data symbols per PRB after control and DMRS overhead.
+uint32_t transport_block_size(MCS mcs, uint32_t num_prbs);
+
+// TB CRC (CRC16 up to 3824 bits, else CRC24A) and, above the LDPC base graph
+// 1 code block size, one CRC24B per code block, TS 38.212 7.2.1 / 5.2.2.
+// Transmit appends [TB CRC][CB CRC x C] after the TB; receive verifies and
+// strips them.
+static constexpr uint32_t PHY_CRC16_MAX_BITS = 3824;
+static constexpr uint32_t PHY_CB_MAX_BITS    = 8448;
+uint32_t phy_num_code_blocks(size_t tb_bytes);
+size_t   phy_crc_overhead(size_t tb_bytes);
+
 struct PhyConfig {
-    MCS     mcs             = MCS::QAM16_1_2;
-    uint8_t num_prbs        = 25;
-    float   channel_snr_db  = 15.0f;
-    bool    harq_enabled    = true;
+    MCS      mcs             = MCS::QAM16_1_2;
+    uint8_t  num_prbs        = 25;
+    float    channel_snr_db  = 15.0f;
+    bool     harq_enabled    = true;
+    // Run TBs through the symbol-level modem and AWGN instead of the BLER
+    // abstraction; the scrambling identity is (stream << 15) | cell_id.
+    bool     link_level      = false;
+    uint16_t cell_id         = 0;
 };
 
 class PhyLayer {
 public:
-    explicit PhyLayer(PhyConfig cfg = {});
+    // stream selects this entity's channel-model random stream (e.g. the RNTI).
+    explicit PhyLayer(PhyConfig cfg = {}, uint64_t stream = 0);
     Status receive_transport_block(const Bytes& tb_in, Bytes& tb_out);
     Status transmit_transport_block(const Bytes& tb_in, Bytes& tb_out);
+    Status receive_transport_block(PduBuffer& tb);
+    Status transmit_transport_block(PduBuffer& tb);
+    size_t receive_burst(PduBuffer* tbs, size_t n, Status* status);
+    size_t transmit_burst(PduBuffer* tbs, size_t n, Status* status);
     void set_snr(float snr_db) { cfg_.channel_snr_db = snr_db; }
     float get_snr() const { return cfg_.channel_snr_db; }
     float estimate_throughput_mbps() const;
+    float bler() const { return ChannelModel::bler(cfg_.mcs, cfg_.channel_snr_db); }
+    uint32_t get_rx_errors() const { return rx_errors_; }
+    uint32_t get_rx_total()  const { return rx_total_; }
+    uint32_t get_cb_errors() const { return cb_errors_; }
+    uint32_t tbs_bytes() const { return transport_block_size(cfg_.mcs, cfg_.num_prbs); }
+    // Reports received TBs and TB/code-block CRC failures to the metrics
+    // registry; BLER is phy_rx_tb_errors_total / phy_rx_tbs_total.
+    void bind_metrics(uint32_t ue = METRIC_NO_UE);
 private:
-    PhyConfig cfg_;
-    uint32_t  rx_errors_ = 0;
-    uint32_t  rx_total_  = 0;
-    bool simulate_crc_pass() const;
-    Bytes apply_noise(const Bytes& data) const;
+    PhyConfig    cfg_;
+    ChannelModel channel_;
+    uint32_t     c_init_;
+    uint32_t     rx_errors_ = 0;
+    uint32_t     rx_total_  = 0;
+    uint32_t     cb_errors_ = 0;
+    struct { MetricCounter tbs, tb_errors, cb_errors; } metrics_;
+    void attach_crc(PduBuffer& tb);
+    bool check_crc(PduBuffer& tb);
 };
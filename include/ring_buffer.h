@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Bounded single-producer/single-consumer ring. Capacity is rounded up to a
+// power of two; each side caches the other's index to avoid touching the
+// shared cache line on every operation.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        mask_  = cap - 1;
+        slots_ = std::unique_ptr<T[]>(new T[cap]);
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    T* try_claim() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) return nullptr;
+        }
+        return &slots_[tail & mask_];
+    }
+    void publish() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    bool push(T&& v) {
+        T* slot = try_claim();
+        if (!slot) return false;
+        *slot = std::move(v);
+        publish();
+        return true;
+    }
+    bool push(const T& v) { T tmp(v); return push(std::move(tmp)); }
+
+    T* front() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return nullptr;
+        }
+        return &slots_[head & mask_];
+    }
+    void pop_front() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    bool pop(T& out) {
+        T* slot = front();
+        if (!slot) return false;
+        out = std::move(*slot);
+        pop_front();
+        return true;
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool   empty()    const { return size() == 0; }
+    size_t capacity() const { return mask_ + 1; }
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;
+    alignas(CACHE_LINE_SIZE) size_t mask_ = 0;
+    std::unique_ptr<T[]> slots_;
+};
+
+// Bounded multi-producer/single-consumer ring (Vyukov sequence-per-slot
+// scheme). Producers claim a slot with one CAS; the consumer never locks.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        mask_  = cap - 1;
+        cells_ = std::unique_ptr<Cell[]>(new Cell[cap]);
+        for (size_t i = 0; i < cap; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    bool push(T&& v) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& out) {
+        Cell* cell = &cells_[dequeue_pos_ & mask_];
+        if (cell->seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) return false;
+        out = std::move(cell->value);
+        cell->seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        dequeue_pos_++;
+        return true;
+    }
+    size_t capacity() const { return mask_ + 1; }
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T                   value;
+    };
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos_{0};
+    alignas(CACHE_LINE_SIZE) size_t dequeue_pos_ = 0;
+    size_t mask_ = 0;
+    std::unique_ptr<Cell[]> cells_;
+};
@@ -1,46 +1,188 @@
 #pragma once
 #include "common_types.h"
-#include <deque>
-#include <map>
+#include "metrics.h"
+#include "pcap_capture.h"
+#include "pdu_buffer.h"
+#include <memory>
 enum class RlcMode { TM, UM, AM };
 static constexpr uint16_t RLC_AM_WINDOW_SIZE = 512;
 static constexpr uint8_t  RLC_MAX_RETX       = 4;
+static constexpr uint16_t RLC_SN_MOD         = 4096;
+static constexpr uint32_t RLC_T_REASSEMBLY_MS = 35;
+static constexpr uint32_t RLC_T_POLL_RETRANSMIT_MS = 45;
+static constexpr uint32_t RLC_POLL_PDU       = 16;
+static constexpr uint32_t RLC_POLL_BYTE      = 25000;
+static constexpr uint16_t RLC_SO_END         = 0xFFFF;
+// SI field: 0 = full SDU, 1 = first, 2 = last, 3 = middle segment.
+// Last and middle segments carry a 16-bit SO after the SN.
 struct RlcAmHeader {
     bool     data_ctrl;
     bool     poll_bit;
     uint8_t  seg_info;
     uint16_t sn;
+    uint16_t so = 0;
+};
+// One NACK of a STATUS PDU. so_start/so_end (inclusive, RLC_SO_END = up to
+// the end of the SDU) narrow it to part of the SDU; range covers that many
+// consecutive SNs starting at sn.
+struct RlcNack {
+    uint16_t sn;
+    uint16_t so_start = 0;
+    uint16_t so_end   = RLC_SO_END;
+    uint8_t  range    = 1;
+};
+struct RlcStatusPdu {
+    uint16_t             ack_sn = 0;
+    std::vector<RlcNack> nacks;
 };
 struct RlcTxBuffer {
-    Bytes    sdu;
+    PduBuffer sdu;
+    uint16_t sn = 0;
+    uint8_t  retx_count  = 0;
+    bool     retx_queued = false;
+};
+struct RlcRetxSeg {
     uint16_t sn;
-    uint8_t  retx_count = 0;
-    bool     acked      = false;
+    uint16_t so_start;
+    uint16_t so_end;
+};
+struct RlcRxSegment {
+    uint16_t  so;
+    PduBuffer data;
 };
+// A partly received SDU keeps its segments as a scatter list of views into
+// the received PDUs, sorted by SO and trimmed so they never overlap; they are
+// gathered into payload once the last byte is in.
 struct RlcRxBuffer {
-    Bytes    payload;
-    uint16_t sn;
+    PduBuffer payload;
+    uint16_t sn = 0;
     bool     received = false;
+    std::vector<RlcRxSegment> segs;
+    uint32_t seg_bytes = 0;
+    uint32_t seg_total = 0;   // SDU length, known once the last segment arrived
 };
 class RlcLayer {
 public:
     explicit RlcLayer(RlcMode mode = RlcMode::AM);
     Status receive_pdu(const Bytes& mac_pdu, Bytes& pdcp_sdu);
     Status transmit_sdu(const Bytes& pdcp_sdu, Bytes& mac_pdu);
-    void process_status_pdu(uint16_t ack_sn, const std::vector<uint16_t>& nack_sns);
+    Status receive_pdu(PduBuffer& pdu);
+    Status transmit_sdu(PduBuffer& pdu);
+    size_t receive_burst(PduBuffer* pdus, size_t n, Status* status);
+    size_t transmit_burst(PduBuffer* pdus, size_t n, Status* status);
+    // Grant-driven TX: SDUs are queued, then pull_pdus fills up to max PDUs
+    // within budget bytes, serving the retransmission queue before new data.
+    // In AM and UM an SDU or retransmission that does not fit is segmented.
+    Status enqueue_sdu(PduBuffer& sdu);
+    size_t pull_pdus(uint32_t budget, PduBuffer* out, size_t max);
+    void   process_status(const RlcStatusPdu& status);
+    void   process_status_pdu(uint16_t ack_sn, const std::vector<uint16_t>& nack_sns);
     Status retransmit_nacked(Bytes& mac_pdu);
+    Status retransmit_nacked(PduBuffer& mac_pdu);
+    bool   status_required() const { return rx_status_required_; }
+    void   build_status_report(RlcStatusPdu& status);
+    void   build_status_pdu(PduBuffer& pdu);
+    static void encode_status_pdu(const RlcStatusPdu& status, PduBuffer& pdu);
+    static bool decode_status_pdu(const uint8_t* p, size_t len, RlcStatusPdu& status);
+    bool   pop_sdu(PduBuffer& sdu);
+    bool   pop_sdu(Bytes& sdu);
+    void   tick(uint32_t ms);
+    void   set_t_reassembly(uint32_t ms) { t_reassembly_ms_ = ms; }
+    void   set_t_poll_retransmit(uint32_t ms) { t_poll_retx_ms_ = ms; }
+    size_t pending_sdus()      const { return rx_ready_.size() - rx_ready_head_; }
+    size_t queued_sdus()       const { return tx_sdus_.size() - tx_sdus_head_; }
+    size_t retx_pending()      const { return retx_q_.size() - retx_head_; }
+    uint16_t tx_in_flight()    const { return (tx_sn_ - tx_next_ack_) & (RLC_SN_MOD - 1); }
+    uint32_t get_rx_duplicates() const { return rx_duplicates_; }
+    uint32_t get_rx_lost()       const { return rx_lost_; }
+    uint32_t get_tx_retx()       const { return tx_retx_pdus_; }
+    uint32_t get_tx_max_retx()   const { return tx_max_retx_; }
     uint16_t get_tx_sn() const { return tx_sn_; }
-    uint16_t get_rx_sn() const { return rx_sn_; }
+    uint16_t get_tx_next_ack() const { return tx_next_ack_; }
+    uint16_t get_rx_sn() const { return rx_next_; }
     RlcMode  get_mode()  const { return mode_; }
+    // PDUs, retransmissions, losses and STATUS PDUs sent, plus the TX window
+    // (SNs awaiting ACK) and RX window (RX_Next to RX_Next_Highest) as gauges.
+    void     bind_metrics(uint32_t ue = METRIC_NO_UE, uint8_t bearer = METRIC_NO_BEARER);
+    // PDUs as handed to MAC (STATUS PDUs included) and as received.
+    void     bind_capture(const PcapContext& ctx) { cap_ = ctx; cap_.on = true; }
 private:
     RlcMode  mode_;
     uint16_t tx_sn_ = 0;
-    uint16_t rx_sn_ = 0;
-    std::deque<RlcTxBuffer>         tx_window_;
-    std::map<uint16_t, RlcRxBuffer> rx_window_;
-    std::deque<uint16_t>            nack_list_;
-    Bytes    build_am_pdu(const RlcAmHeader& hdr, const Bytes& payload);
-    bool     parse_am_pdu(const Bytes& pdu, RlcAmHeader& hdr, Bytes& payload);
-    Bytes    build_status_pdu(uint16_t ack_sn);
+    // TX window: SN-modulo ring (allocated on first AM PDU) plus a bitmap of
+    // unacknowledged SNs, so status processing only touches changed SNs.
+    uint16_t tx_next_ack_      = 0;
+    uint16_t poll_sn_          = 0;
+    uint32_t pdu_without_poll_ = 0;
+    uint32_t byte_without_poll_ = 0;
+    bool     poll_pending_     = false;
+    int32_t  t_poll_retx_left_ = -1;
+    uint32_t t_poll_retx_ms_   = RLC_T_POLL_RETRANSMIT_MS;
+    uint32_t tx_retx_pdus_     = 0;
+    uint32_t tx_max_retx_      = 0;
+    uint64_t tx_bitmap_[RLC_AM_WINDOW_SIZE / 64] = {};
+    std::unique_ptr<RlcTxBuffer[]> tx_ring_;
+    std::vector<RlcRetxSeg>        retx_q_;
+    size_t                         retx_head_ = 0;
+    std::vector<PduBuffer>         tx_sdus_;
+    size_t                         tx_sdus_head_ = 0;
+    uint16_t                       tx_seg_so_ = 0;   // bytes of the head SDU already sent
+    uint16_t                       tx_seg_sn_ = 0;
+    // RX window: SN-modulo ring (allocated on first out-of-order PDU) plus a
+    // bitmap of buffered SNs. rx_ready_ holds in-order SDUs awaiting pop_sdu.
+    uint16_t rx_next_         = 0;
+    uint16_t rx_next_highest_ = 0;
+    uint16_t rx_reassembly_sn_ = 0;
+    int32_t  t_reassembly_left_ = -1;
+    uint32_t t_reassembly_ms_ = RLC_T_REASSEMBLY_MS;
+    uint32_t rx_duplicates_   = 0;
+    uint32_t rx_lost_         = 0;
+    bool     rx_status_required_ = false;
+    uint64_t rx_bitmap_[RLC_AM_WINDOW_SIZE / 64] = {};
+    std::unique_ptr<RlcRxBuffer[]> rx_ring_;
+    std::vector<PduBuffer>         rx_ready_;
+    size_t                         rx_ready_head_ = 0;
+    struct {
+        MetricCounter tx_pdus, retx_pdus, max_retx, rx_duplicates, rx_lost, status_pdus;
+        TrackedGauge  tx_window, rx_window;
+    } metrics_;
+    PcapContext cap_;
+    // UM PDUs carry the AM data header in this implementation, so they are
+    // framed as AM to decode.
+    void capture(bool tx, const PduBuffer& pdu) const {
+        if (pcap_wants(cap_, PCAP_RLC))
+            PcapCapture::instance().rlc(cap_, tx, mode_ == RlcMode::TM ? PCAP_RLC_TM : PCAP_RLC_AM, 12,
+                                        pdu.data(), pdu.size());
+    }
+    void update_window_metrics() {
+        metrics_.tx_window.set(tx_in_flight());
+        metrics_.rx_window.set(rx_offset(rx_next_highest_));
+    }
+    bool rx_has(uint16_t sn) const { uint16_t i = sn % RLC_AM_WINDOW_SIZE; return (rx_bitmap_[i >> 6] >> (i & 63)) & 1; }
+    void rx_mark(uint16_t sn, bool on) {
+        uint16_t i = sn % RLC_AM_WINDOW_SIZE;
+        if (on) rx_bitmap_[i >> 6] |= (1ULL << (i & 63)); else rx_bitmap_[i >> 6] &= ~(1ULL << (i & 63));
+    }
+    bool tx_has(uint16_t sn) const { uint16_t i = sn % RLC_AM_WINDOW_SIZE; return (tx_bitmap_[i >> 6] >> (i & 63)) & 1; }
+    void rx_deliver_in_order();
+    void rx_update_reassembly_timer();
+    void rx_tick(uint32_t ms);
+    void tx_tick(uint32_t ms);
+    bool     tx_window_full() const { return mode_ == RlcMode::AM && tx_in_flight() >= RLC_AM_WINDOW_SIZE; }
+    void     tx_one(PduBuffer& pdu, bool last);
+    void     tx_store(const PduBuffer& sdu);
+    bool     tx_pull_new(uint32_t& budget, PduBuffer& out);
+    bool     tx_poll(size_t bytes, bool new_data, bool last);
+    void     tx_ack_range(uint16_t from, uint16_t to);
+    // more: a further byte range of an SN already counted in this STATUS.
+    void     tx_queue_retx(uint16_t sn, uint16_t so_start, uint16_t so_end, bool more = false);
+    size_t   tx_pull_retx(uint32_t& budget, PduBuffer* out, size_t max);
+    Status   rx_one(PduBuffer& pdu, RlcAmHeader& hdr);
+    bool     rx_add_segment(RlcRxBuffer& slot, PduBuffer& pdu, const RlcAmHeader& hdr);
+    void     rx_drop_segments(uint16_t sn);
+    void     build_am_pdu(const RlcAmHeader& hdr, PduBuffer& pdu);
+    bool     parse_am_pdu(PduBuffer& pdu, RlcAmHeader& hdr);
     uint16_t next_sn(uint16_t sn) { return (sn + 1) & 0x0FFF; }
+    uint16_t rx_offset(uint16_t sn) const { return (sn - rx_next_) & (RLC_SN_MOD - 1); }
+    uint16_t tx_offset(uint16_t sn) const { return (sn - tx_next_ack_) & (RLC_SN_MOD - 1); }
 };
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11). Output is a
+// pure function of (key, counter), so each entity owns an independent,
+// reproducible stream selected by (seed, stream id) with no shared state.
+class Philox4x32 {
+public:
+    explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0);
+    static void block(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+
+    uint32_t next_u32() {
+        if (idx_ == 4) refill();
+        return buf_[idx_++];
+    }
+    // Uniform in [0, 1) with 24 bits of resolution.
+    float    next_float() { return (float)(next_u32() >> 8) * (1.0f / 16777216.0f); }
+    // Uniform in (0, 1], safe as a log() argument.
+    float    next_float_nz() { return (float)((next_u32() >> 8) + 1) * (1.0f / 16777216.0f); }
+    void     fill(uint32_t* out, size_t n);
+    void     seek(uint64_t block_index);
+private:
+    uint32_t key_[2];
+    uint32_t ctr_[4];
+    uint32_t buf_[4];
+    uint32_t idx_ = 4;
+    void refill();
+};
+
+// Stream ids per subsystem so that e.g. the PHY and RRC of the same UE never
+// share a stream.
+enum class RngDomain : uint32_t { PHY = 1, RRC = 2, NAS = 3, TEST = 0xFF };
+uint64_t rng_stream(RngDomain domain, uint64_t id);
+
+// Process-wide seed applied to entities constructed afterwards.
+void     rng_set_seed(uint64_t seed);
+uint64_t rng_seed();
@@ -0,0 +1,131 @@
+#pragma once
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include <vector>
+
+// Robust Header Compression, RFC 3095 U-mode, for IPv4: profile 0x0001
+// (IP/UDP/RTP), 0x0002 (IP/UDP) and 0x0000 (uncompressed) for everything
+// else. Packet formats are IR, IR-DYN, UO-0, UO-1 and UOR-2; the UOR-2
+// extension is a single fixed layout (SN, TS and IP-ID bytes) rather than
+// the four RFC extensions.
+enum class RohcProfile : uint8_t { UNCOMPRESSED = 0, RTP = 1, UDP = 2 };
+enum class RohcCompState : uint8_t { IR, FO, SO };
+enum class RohcDecompState : uint8_t { NC, SC, FC };
+
+static constexpr uint16_t ROHC_MAX_SMALL_CID = 15;
+static constexpr uint16_t ROHC_MAX_LARGE_CID = 16383;
+
+struct RohcConfig {
+    uint16_t max_cid      = ROHC_MAX_SMALL_CID;   // above 15: large CIDs
+    uint16_t rtp_port_min = 16384;                // UDP dst ports carrying RTP
+    uint16_t rtp_port_max = 32767;
+    uint8_t  ir_repeat    = 3;      // IR / IR-DYN sent this often before moving up
+    uint8_t  window       = 4;      // W-LSB references kept per flow
+    uint16_t ir_refresh   = 256;    // U-mode periodic IR, in packets
+    uint16_t fo_refresh   = 64;     // periodic IR-DYN, in packets
+    uint8_t  crc_fail_k   = 3;      // consecutive failures before the
+                                    // decompressor drops a state
+};
+
+struct RohcFlowKey {
+    uint32_t src   = 0;
+    uint32_t dst   = 0;
+    uint16_t sport = 0;
+    uint16_t dport = 0;
+    uint8_t  proto = 0;
+    bool operator==(const RohcFlowKey& o) const {
+        return src == o.src && dst == o.dst && sport == o.sport && dport == o.dport && proto == o.proto;
+    }
+};
+
+struct RohcStats {
+    uint64_t packets   = 0;
+    uint64_t ir        = 0;
+    uint64_t ir_dyn    = 0;
+    uint64_t uo0       = 0;
+    uint64_t uo1       = 0;
+    uint64_t uor2      = 0;
+    uint64_t normal    = 0;   // profile 0 packets sent as-is
+    uint64_t evictions = 0;
+    uint64_t bytes_in  = 0;
+    uint64_t bytes_out = 0;
+};
+
+// One W-LSB reference: the values a decompressor may hold after a packet.
+struct RohcRef {
+    uint16_t sn;
+    uint16_t ipid_off;   // IP-ID - SN
+    uint32_t ts_scaled;
+};
+
+struct RohcTxContext {
+    RohcFlowKey   key;
+    RohcProfile   profile  = RohcProfile::UNCOMPRESSED;
+    RohcCompState state    = RohcCompState::IR;
+    bool          in_use   = false;
+    uint8_t       reps     = 0;
+    uint16_t      since_ir = 0;
+    uint16_t      since_fo = 0;
+    uint64_t      last_used = 0;
+    // Dynamic fields as last sent.
+    uint8_t  tos = 0, ttl = 0;
+    bool     df = false, rnd = false, udp_csum = false, marker = false;
+    uint8_t  pt = 0;
+    uint16_t sn = 0, ip_id = 0;
+    uint32_t ts = 0, ts_stride = 0, ts_offset = 0, ssrc = 0;
+    RohcRef  win[8];
+    uint8_t  win_n = 0, win_head = 0;
+};
+
+struct RohcRxContext {
+    RohcDecompState state   = RohcDecompState::NC;
+    RohcProfile     profile = RohcProfile::UNCOMPRESSED;
+    RohcFlowKey     key;
+    uint8_t  tos = 0, ttl = 0;
+    bool     df = false, rnd = false, udp_csum = false;
+    uint8_t  pt = 0;
+    uint32_t ts_stride = 0, ts_offset = 0, ssrc = 0;
+    RohcRef  ref{}, prev{};   // prev is kept for context repair
+    uint8_t  failures = 0;
+};
+
+// Flow contexts live in a vector indexed by CID; the 5-tuple maps to a CID
+// through an open-addressing hash (linear probing, backward-shift delete).
+// When all CIDs are taken the least recently used flow is evicted.
+class RohcCompressor {
+public:
+    explicit RohcCompressor(RohcConfig cfg = {});
+    // Replaces the IP header of pkt with a ROHC header in place.
+    void   compress(PduBuffer& pkt);
+    size_t num_flows() const { return flows_; }
+    const RohcStats& stats() const { return stats_; }
+    const RohcTxContext* context(uint16_t cid) const { return cid < ctx_.size() ? &ctx_[cid] : nullptr; }
+private:
+    RohcConfig                 cfg_;
+    std::vector<RohcTxContext> ctx_;
+    std::vector<int32_t>       table_;   // CID per slot, -1 if empty
+    std::vector<uint16_t>      free_cids_;
+    size_t                     flows_ = 0;
+    uint64_t                   clock_ = 0;
+    RohcStats                  stats_;
+    uint16_t lookup(const RohcFlowKey& key, RohcProfile profile);
+    void     erase(const RohcFlowKey& key);
+    size_t   slot_of(const RohcFlowKey& key) const;
+};
+
+class RohcDecompressor {
+public:
+    explicit RohcDecompressor(RohcConfig cfg = {});
+    // Restores the original packet in place. ERROR if the packet is
+    // malformed, names an unknown context or fails its CRC after repair.
+    Status decompress(PduBuffer& pkt);
+    uint64_t get_crc_failures() const { return crc_failures_; }
+    uint64_t get_repairs()      const { return repairs_; }
+    const RohcRxContext* context(uint16_t cid) const { return cid < ctx_.size() ? &ctx_[cid] : nullptr; }
+private:
+    RohcConfig                 cfg_;
+    std::vector<RohcRxContext> ctx_;
+    uint64_t                   crc_failures_ = 0;
+    uint64_t                   repairs_      = 0;
+    void crc_failed(RohcRxContext& c);
+};
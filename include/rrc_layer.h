@@ -1,5 +1,6 @@
 #pragma once
 #include "common_types.h"
+#include "rng.h"
 #include <functional>
 #include <string>
 enum class RrcState { IDLE, CONNECTED, INACTIVE };
@@ -21,9 +22,12 @@ struct CellConfig {
 using RrcStateChangeCb = std::function<void(RrcState, RrcState)>;
 class RrcLayer {
 public:
-    explicit RrcLayer(CellConfig cell = {});
+    explicit RrcLayer(CellConfig cell = {}, uint64_t stream = 0);
     Status initiate_connection();
     Status receive_message(const Bytes& pdu, Bytes& response);
+    // Allocation-free form: the response is encoded into resp (resp_len 0
+    // when there is none).
+    Status receive_message(const uint8_t* pdu, size_t len, uint8_t* resp, size_t cap, size_t& resp_len);
     Status release_connection();
     Status suspend_connection();
     Status resume_connection();
@@ -37,7 +41,7 @@ private:
     RrcStateChangeCb state_cb_;
     uint32_t         rnti_      = 0;
     uint32_t         msg_count_ = 0;
+    Philox4x32       rng_;
     void transition(RrcState new_state);
-    Bytes build_rrc_msg(RrcMsgType type, const Bytes& payload = {});
-    bool  parse_rrc_msg(const Bytes& pdu, RrcMsgType& type, Bytes& payload);
+    template <typename Msg> Status deliver(const Msg& m);
 };
@@ -0,0 +1,134 @@
+#pragma once
+#include "per_codec.h"
+#include "rrc_layer.h"
+
+// RRC messages, UPER-coded as in TS 38.331: a CHOICE index over RrcMsgSet
+// followed by the message's fields. Fields are a reduced set of the real IEs.
+static constexpr size_t RRC_MAX_MSG = 128;   // largest message without a container
+
+enum RrcCause : uint8_t {   // EstablishmentCause / ResumeCause subset
+    RRC_CAUSE_MT_ACCESS = 2, RRC_CAUSE_MO_SIGNALLING = 3, RRC_CAUSE_MO_DATA = 4,
+};
+
+struct RrcSetupRequestMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_SETUP_REQUEST;
+    uint16_t ue_identity = 0;
+    uint8_t  cause       = RRC_CAUSE_MO_SIGNALLING;
+    using Fields = PerFields<PerField<&RrcSetupRequestMsg::ue_identity, PerInt<0, 0xFFFF>>,
+                             PerField<&RrcSetupRequestMsg::cause,       PerInt<0, 15>>>;
+};
+struct RrcSetupMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_SETUP;
+    uint8_t  transaction_id = 0;
+    uint16_t num_prbs       = 106;
+    uint8_t  srb_id         = 1;
+    using Fields = PerFields<PerField<&RrcSetupMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcSetupMsg::num_prbs,       PerInt<1, 275>>,
+                             PerField<&RrcSetupMsg::srb_id,         PerInt<1, 3>>>;
+};
+struct RrcSetupCompleteMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_SETUP_COMPLETE;
+    uint8_t transaction_id = 0;
+    uint8_t selected_plmn  = 1;
+    PerView dedicated_nas;
+    using Fields = PerFields<PerField<&RrcSetupCompleteMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcSetupCompleteMsg::selected_plmn,  PerInt<1, 12>>,
+                             PerField<&RrcSetupCompleteMsg::dedicated_nas,  PerOctets<0, 8192>>>;
+};
+struct RrcReconfigMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_RECONFIG;
+    uint8_t transaction_id = 0;
+    uint8_t drb_id         = 1;
+    PerView dedicated_nas;
+    using Fields = PerFields<PerField<&RrcReconfigMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcReconfigMsg::drb_id,         PerInt<1, 32>>,
+                             PerField<&RrcReconfigMsg::dedicated_nas,  PerOctets<0, 8192>>>;
+};
+struct RrcReconfigCompleteMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_RECONFIG_COMPLETE;
+    uint8_t transaction_id = 0;
+    using Fields = PerFields<PerField<&RrcReconfigCompleteMsg::transaction_id, PerInt<0, 3>>>;
+};
+struct RrcReleaseMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::RRC_RELEASE;
+    uint8_t transaction_id = 0;
+    bool    suspend        = false;
+    using Fields = PerFields<PerField<&RrcReleaseMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcReleaseMsg::suspend,        PerBool>>;
+};
+struct RrcMeasurementReportMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::MEASUREMENT_REPORT;
+    uint8_t meas_id = 1;
+    int16_t rsrp    = -140;   // dBm
+    int16_t rsrq    = -20;    // dB
+    using Fields = PerFields<PerField<&RrcMeasurementReportMsg::meas_id, PerInt<1, 64>>,
+                             PerField<&RrcMeasurementReportMsg::rsrp,    PerInt<-156, -31>>,
+                             PerField<&RrcMeasurementReportMsg::rsrq,    PerInt<-43, 20>>>;
+};
+struct RrcUeCapabilityInfoMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::UE_CAPABILITY_INFO;
+    uint8_t transaction_id = 0;
+    PerView container;
+    using Fields = PerFields<PerField<&RrcUeCapabilityInfoMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcUeCapabilityInfoMsg::container,      PerOctets<0, 65535>>>;
+};
+struct RrcSecurityModeCmdMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::SECURITY_MODE_CMD;
+    uint8_t transaction_id = 0;
+    uint8_t ciphering      = 2;   // nea2
+    uint8_t integrity      = 2;   // nia2
+    using Fields = PerFields<PerField<&RrcSecurityModeCmdMsg::transaction_id, PerInt<0, 3>>,
+                             PerField<&RrcSecurityModeCmdMsg::ciphering,      PerInt<0, 3>>,
+                             PerField<&RrcSecurityModeCmdMsg::integrity,      PerInt<0, 3>>>;
+};
+struct RrcSecurityModeCompleteMsg {
+    static constexpr RrcMsgType TYPE = RrcMsgType::SECURITY_MODE_COMPLETE;
+    uint8_t transaction_id = 0;
+    using Fields = PerFields<PerField<&RrcSecurityModeCompleteMsg::transaction_id, PerInt<0, 3>>>;
+};
+
+using RrcMsgSet = PerMsgSet<RrcMsgType,
+    RrcSetupRequestMsg, RrcSetupMsg, RrcSetupCompleteMsg, RrcReconfigMsg, RrcReconfigCompleteMsg,
+    RrcReleaseMsg, RrcMeasurementReportMsg, RrcUeCapabilityInfoMsg, RrcSecurityModeCmdMsg,
+    RrcSecurityModeCompleteMsg>;
+static_assert(RrcMsgSet::covers({
+    RrcMsgType::RRC_SETUP_REQUEST, RrcMsgType::RRC_SETUP, RrcMsgType::RRC_SETUP_COMPLETE,
+    RrcMsgType::RRC_RECONFIG, RrcMsgType::RRC_RECONFIG_COMPLETE, RrcMsgType::RRC_RELEASE,
+    RrcMsgType::MEASUREMENT_REPORT, RrcMsgType::UE_CAPABILITY_INFO,
+    RrcMsgType::SECURITY_MODE_CMD, RrcMsgType::SECURITY_MODE_COMPLETE}), "RrcMsgSet misses a message");
+
+// Encodes into buf; returns the encoded length, 0 if it does not fit.
+template <typename Msg>
+size_t rrc_encode(const Msg& m, uint8_t* buf, size_t cap) {
+    PerWriter w(buf, cap);
+    RrcMsgSet::Index::encode<PerMode::UNALIGNED>(w, RrcMsgSet::index<Msg>());
+    per_encode<PerMode::UNALIGNED>(w, m);
+    return w.ok() ? w.bytes() : 0;
+}
+inline bool rrc_peek_type(const uint8_t* pdu, size_t len, RrcMsgType& type) {
+    PerReader r(pdu, len);
+    size_t i = 0;
+    RrcMsgSet::Index::decode<PerMode::UNALIGNED>(r, i);
+    if (!r.ok()) return false;
+    type = RrcMsgSet::TYPES[i];
+    return true;
+}
+// Octet fields of m are views into pdu.
+template <typename Msg>
+Status rrc_decode(const uint8_t* pdu, size_t len, Msg& m) {
+    PerReader r(pdu, len);
+    size_t i = 0;
+    RrcMsgSet::Index::decode<PerMode::UNALIGNED>(r, i);
+    if (!r.ok() || i != RrcMsgSet::index<Msg>()) return Status::ERROR;
+    per_decode<PerMode::UNALIGNED>(r, m);
+    // UPER pads to the octet; anything beyond that is a framing error.
+    return r.ok() && r.bits_left() < 8 ? Status::OK : Status::ERROR;
+}
+// Decodes whatever message pdu holds, to validate it.
+inline Status rrc_validate(const uint8_t* pdu, size_t len) {
+    RrcMsgType type;
+    if (!rrc_peek_type(pdu, len, type)) return Status::ERROR;
+    Status s = Status::ERROR;
+    RrcMsgSet::visit(type, [&](auto m) { s = rrc_decode(pdu, len, m); });
+    return s;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "aes128.h"
+#include <cstddef>
+#include <cstdint>
+
+// 3GPP ciphering (NEA) and integrity (NIA) algorithms, TS 33.401 Annex B /
+// TS 33.501. Inputs are COUNT, the 5-bit BEARER and DIRECTION (0 = UL).
+enum class CipherAlg : uint8_t { NEA0 = 0, NEA2 = 2 };
+enum class IntegAlg  : uint8_t { NIA0 = 0, NIA2 = 2 };
+
+// Keystream XOR over bits [0, bits) of data, in place. Trailing bits of a
+// partial last byte are left untouched.
+struct CipherJob {
+    const Aes128Key* key;
+    uint32_t         count;
+    uint8_t          bearer;
+    uint8_t          direction;
+    uint8_t*         data;
+    size_t           bits;
+};
+
+// MAC-I over bits [0, bits) of data; result written to mac.
+struct IntegJob {
+    const Aes128Cmac* key;
+    uint32_t          count;
+    uint8_t           bearer;
+    uint8_t           direction;
+    const uint8_t*    data;
+    size_t            bits;
+    uint32_t          mac;
+};
+
+// Multi-buffer entry points: jobs may mix keys, bearers and lengths; blocks
+// from several jobs are interleaved across the AES lanes.
+void cipher_batch(CipherAlg alg, CipherJob* jobs, size_t n);
+void integ_batch(IntegAlg alg, IntegJob* jobs, size_t n);
+
+void     nea2(const Aes128Key& key, uint32_t count, uint8_t bearer, uint8_t direction, uint8_t* data, size_t bits);
+uint32_t nia2(const Aes128Cmac& key, uint32_t count, uint8_t bearer, uint8_t direction, const uint8_t* data, size_t bits);
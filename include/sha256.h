@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 (FIPS 180-4) and HMAC-SHA-256 (RFC 2104) for the 3GPP key
+// derivation function. Kernels: SHA-NI and portable C, selected once at
+// startup from CPUID.
+enum class ShaImpl { AUTO, SCALAR, SHANI };
+
+struct Sha256Ctx {
+    uint32_t h[8];
+    uint8_t  buf[64];
+    uint64_t len;    // bytes absorbed
+};
+
+void sha256_init(Sha256Ctx& ctx);
+void sha256_update(Sha256Ctx& ctx, const uint8_t* data, size_t len);
+void sha256_final(Sha256Ctx& ctx, uint8_t out[32]);
+void sha256(const uint8_t* data, size_t len, uint8_t out[32]);
+void hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* msg, size_t len, uint8_t out[32]);
+
+// Returns false if the requested kernel is not supported by this CPU.
+bool        sha256_select(ShaImpl impl);
+const char* sha256_impl_name();
@@ -0,0 +1,118 @@
+#pragma once
+#include "common_types.h"
+#include "pdu_buffer.h"
+#include "ring_buffer.h"
+#include "phy_layer.h"
+#include "mac_layer.h"
+#include "rlc_layer.h"
+#include "pdcp_layer.h"
+#include "rrc_layer.h"
+#include "nas_layer.h"
+#include <functional>
+#include <thread>
+#include <vector>
+
+using TbSink = std::function<void(uint16_t rnti, PduBuffer& tb)>;
+class UeTraceRecorder;
+
+// Layer counters in MetricsRegistry: none, one series per cell, or one per
+// UE and bearer.
+enum class UeMetrics : uint8_t { OFF, CELL, PER_UE };
+
+struct UeManagerConfig {
+    size_t         num_workers   = 4;
+    size_t         queue_depth   = 65536;
+    RlcMode        rlc_mode      = RlcMode::AM;
+    PdcpBearerType bearer        = PdcpBearerType::DRB;
+    PhyConfig      phy;
+    bool           auto_harq_ack = true;
+    bool           auto_rlc_ack  = true;
+    UeMetrics      metrics       = UeMetrics::OFF;
+    // Feed MAC/RLC/PDCP PDUs to PcapCapture (UE ID: rnti; sent PDUs are
+    // downlink).
+    bool           capture       = false;
+    // Records every executed command (see ue_trace.h).
+    UeTraceRecorder* trace       = nullptr;
+    TbSink         tb_sink;
+};
+
+// Per-UE protocol entities. Owned and touched only by the worker of its shard.
+struct UeContext {
+    uint16_t  rnti;
+    NasLayer  nas;
+    RrcLayer  rrc;
+    PdcpLayer pdcp;
+    RlcLayer  rlc;
+    MacLayer  mac;
+    PhyLayer  phy;
+    UeContext(uint16_t rnti, const UeManagerConfig& cfg, NasIpPool* ip_pool);
+};
+
+enum class UeCmdType : uint8_t { ADD_UE, REMOVE_UE, ATTACH, TX_SDU, HARQ_FEEDBACK, RLC_STATUS, SET_SNR, BARRIER };
+
+struct UeCommand {
+    UeCmdType             type = UeCmdType::BARRIER;
+    uint16_t              rnti = 0;
+    uint16_t              arg  = 0;
+    bool                  flag = false;
+    float                 value = 0.0f;
+    uint64_t              ts_ns = 0;       // submit time, when tracing
+    PduBuffer             pdu;
+    std::vector<uint16_t> sns;
+    std::atomic<size_t>*  done = nullptr;
+};
+
+struct alignas(CACHE_LINE_SIZE) UeShardStats {
+    std::atomic<uint64_t> ues{0};
+    std::atomic<uint64_t> tx_sdus{0};
+    std::atomic<uint64_t> tx_bytes{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> unknown_ue{0};
+};
+
+struct UeManagerStats {
+    uint64_t ues = 0, tx_sdus = 0, tx_bytes = 0, errors = 0, unknown_ue = 0, rejected_cmds = 0;
+};
+
+// Creates and runs many UEs. UEs are sharded by RNTI over a fixed pool of
+// worker threads; each shard owns its contexts and is fed through a lock-free
+// MPSC command ring, so the data path shares no mutable state across shards.
+class UeManager {
+public:
+    explicit UeManager(UeManagerConfig cfg = {});
+    ~UeManager();
+    void   start();
+    void   stop();
+    Status add_ue(uint16_t rnti);
+    Status remove_ue(uint16_t rnti);
+    Status attach_ue(uint16_t rnti);
+    Status inject_sdu(uint16_t rnti, PduBuffer sdu);
+    Status inject_harq_feedback(uint16_t rnti, uint8_t harq_id, bool ack);
+    Status inject_rlc_status(uint16_t rnti, uint16_t ack_sn, std::vector<uint16_t> nack_sns);
+    Status inject_snr(uint16_t rnti, float snr_db);
+    void   drain();
+    size_t shard_of(uint16_t rnti) const { return rnti % shards_.size(); }
+    size_t num_workers() const { return shards_.size(); }
+    UeManagerStats stats() const;
+private:
+    struct Shard {
+        MpscRing<UeCommand>                     queue;
+        NasIpPool                               ip_pool;   // this shard's slice of 10.45.0.0/16
+        std::vector<std::unique_ptr<UeContext>> ues;
+        UeShardStats                            stats;
+        std::thread                             worker;
+        Shard(size_t depth, uint32_t ip_first, uint32_t ip_count) : queue(depth), ip_pool(ip_first, ip_count) {}
+    };
+    UeManagerConfig                     cfg_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool>                   running_{false};
+    std::atomic<uint64_t>               rejected_{0};
+
+    Status submit(UeCommand&& cmd);
+    void   worker_loop(Shard& sh);
+    void   execute(Shard& sh, UeCommand& cmd);
+    UeContext* find(Shard& sh, uint16_t rnti) {
+        size_t slot = rnti / shards_.size();
+        return slot < sh.ues.size() ? sh.ues[slot].get() : nullptr;
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "common_types.h"
+#include "ue_manager.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Append-only binary trace of the commands a UeManager executes: UE
+// add/remove, attach (NAS registration, PDU session, RRC connection), SDUs,
+// HARQ feedback, RLC STATUS and SNR changes, each stamped with the time it
+// was submitted.
+//
+// Layout, little-endian:
+//   header  "UETRACE1", u16 version, u16 workers, u8 rlc_mode, u8 bearer,
+//           u8 flags, u8 mcs, u8 num_prbs, u8 0, u16 cell_id, f32 snr_db,
+//           u64 start (Unix ns)                                    32 bytes
+//   chunk   u32 "CHNK", u32 bytes, u32 records, u16 shard, u16 0,
+//           u64 base_ns, then the records                          24 bytes
+//   record  u8 type, zigzag varint ns since the shard's previous record,
+//           u16 rnti, then per type: SDU varint len + bytes; HARQ u8 id,
+//           u8 ack; STATUS u16 ack_sn, varint n, n x u16; SNR f32
+// Each shard's records are in execution order; a chunk holds one shard's.
+static constexpr char     UE_TRACE_MAGIC[8]    = {'U', 'E', 'T', 'R', 'A', 'C', 'E', '1'};
+static constexpr uint16_t UE_TRACE_VERSION     = 1;
+static constexpr size_t   UE_TRACE_HEADER      = 32;
+static constexpr size_t   UE_TRACE_CHUNK_HDR   = 24;
+static constexpr uint32_t UE_TRACE_CHUNK_MAGIC = 0x4B4E4843;   // "CHNK"
+static constexpr size_t   UE_TRACE_CHUNK_BYTES = 256 << 10;
+
+// Records from the shard workers into per-shard buffers, written out a
+// chunk at a time. Set UeManagerConfig::trace to it before the manager
+// starts and close() it after the manager has drained or stopped.
+class UeTraceRecorder {
+public:
+    ~UeTraceRecorder() { close(); }
+    // ERROR if the file cannot be created.
+    Status   open(const std::string& path, const UeManagerConfig& cfg);
+    void     close();
+    bool     is_open() const { return file_ != nullptr; }
+    uint64_t now_ns() const;
+    void     record(size_t shard, const UeCommand& cmd);
+    uint64_t records() const;
+    uint64_t bytes_written() const { return bytes_written_.load(std::memory_order_relaxed); }
+private:
+    struct alignas(CACHE_LINE_SIZE) ShardBuf {
+        std::vector<uint8_t> buf;
+        uint64_t             base_ns = 0, last_ns = 0, records = 0, total = 0;
+    };
+    FILE*                       file_ = nullptr;
+    std::mutex                  file_mu_;
+    std::unique_ptr<ShardBuf[]> shards_;
+    size_t                      num_shards_ = 0;
+    uint64_t                    t0_ns_      = 0;
+    std::atomic<uint64_t>       bytes_written_{0};
+    void flush(size_t shard, ShardBuf& sb);
+};
+
+enum class TracePacing : uint8_t { MAX_SPEED, RECORDED };
+
+struct UeTraceReplayStats {
+    uint64_t records = 0, sdus = 0, sdu_bytes = 0, elapsed_ns = 0, stalls = 0;
+};
+
+// Maps a trace and feeds it to a UeManager. Shards are merged by timestamp,
+// each in its own recorded order, so a manager built from config() executes
+// exactly the recorded command sequence per shard.
+class UeTraceReplayer {
+public:
+    ~UeTraceReplayer();
+    // ERROR if the file cannot be mapped or is not a trace. A torn last
+    // chunk (recorder killed mid-write) is ignored and flagged.
+    Status open(const std::string& path);
+    // The recorded manager configuration: workers, bearer and PHY setup.
+    UeManagerConfig config() const { return cfg_; }
+    uint64_t records()     const { return records_; }
+    bool     truncated()   const { return truncated_; }
+    // Injects every record, then drains the manager. RECORDED waits for each
+    // record's submit time; MAX_SPEED does not wait at all. ERROR on a
+    // malformed record, after replaying what precedes it.
+    Status replay(UeManager& mgr, TracePacing pacing, UeTraceReplayStats& stats) const;
+private:
+    struct Chunk {
+        const uint8_t* p;
+        size_t         len;
+        uint32_t       records;
+        uint64_t       base_ns;
+    };
+    const uint8_t*                  map_  = nullptr;
+    size_t                          size_ = 0;
+    UeManagerConfig                 cfg_;
+    std::vector<std::vector<Chunk>> chunks_;   // per shard, in file order
+    uint64_t                        records_   = 0;
+    bool                            truncated_ = false;
+};
+
+// Order-sensitive digest of the TBs a manager hands to tb_sink, per UE;
+// equal digests mean byte-identical output. Each RNTI is only touched by
+// the worker that owns it, so the sink needs no lock.
+class UeTbDigest {
+public:
+    UeTbDigest() : h_(65536, 0xcbf29ce484222325ull) {}
+    TbSink   sink();
+    uint64_t of(uint16_t rnti) const { return h_[rnti]; }
+    // Every UE's digest folded in RNTI order.
+    uint64_t combined() const;
+private:
+    std::vector<uint64_t> h_;
+};
@@ -0,0 +1,279 @@
+#include "aes128.h"
+#include <cstring>
+#include <immintrin.h>
+namespace {
+struct AesTables {
+    uint8_t  sbox[256];
+    uint32_t te[4][256];
+    AesTables() {
+        auto rotl8 = [](uint8_t x, int s) { return (uint8_t)((x << s) | (x >> (8 - s))); };
+        uint8_t p = 1, q = 1;
+        do {
+            p = p ^ (uint8_t)(p << 1) ^ ((p & 0x80) ? 0x1B : 0);
+            q ^= q << 1; q ^= q << 2; q ^= q << 4;
+            if (q & 0x80) q ^= 0x09;
+            sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63;
+        } while (p != 1);
+        sbox[0] = 0x63;
+        for (int x = 0; x < 256; x++) {
+            uint32_t s = sbox[x];
+            uint32_t s2 = ((s << 1) ^ ((s & 0x80) ? 0x1B : 0)) & 0xFF;
+            uint32_t w = (s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s);
+            for (int t = 0; t < 4; t++) te[t][x] = t ? (w >> (8 * t)) | (w << (32 - 8 * t)) : w;
+        }
+    }
+};
+const AesTables& tables() { static const AesTables t; return t; }
+inline uint32_t load_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+inline void store_be32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+void scalar_encrypt(const Aes128Key& key, const uint8_t in[16], uint8_t out[16]) {
+    const AesTables& T = tables();
+    const uint8_t* rk = key.rk;
+    uint32_t s0 = load_be32(in) ^ load_be32(rk),          s1 = load_be32(in + 4) ^ load_be32(rk + 4);
+    uint32_t s2 = load_be32(in + 8) ^ load_be32(rk + 8),  s3 = load_be32(in + 12) ^ load_be32(rk + 12);
+    for (int r = 1; r < 10; r++) {
+        rk += 16;
+        uint32_t t0 = T.te[0][s0 >> 24] ^ T.te[1][(s1 >> 16) & 0xFF] ^ T.te[2][(s2 >> 8) & 0xFF] ^ T.te[3][s3 & 0xFF] ^ load_be32(rk);
+        uint32_t t1 = T.te[0][s1 >> 24] ^ T.te[1][(s2 >> 16) & 0xFF] ^ T.te[2][(s3 >> 8) & 0xFF] ^ T.te[3][s0 & 0xFF] ^ load_be32(rk + 4);
+        uint32_t t2 = T.te[0][s2 >> 24] ^ T.te[1][(s3 >> 16) & 0xFF] ^ T.te[2][(s0 >> 8) & 0xFF] ^ T.te[3][s1 & 0xFF] ^ load_be32(rk + 8);
+        uint32_t t3 = T.te[0][s3 >> 24] ^ T.te[1][(s0 >> 16) & 0xFF] ^ T.te[2][(s1 >> 8) & 0xFF] ^ T.te[3][s2 & 0xFF] ^ load_be32(rk + 12);
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    rk += 16;
+    const uint8_t* S = T.sbox;
+    auto last = [S](uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        return ((uint32_t)S[a >> 24] << 24) | ((uint32_t)S[(b >> 16) & 0xFF] << 16) | ((uint32_t)S[(c >> 8) & 0xFF] << 8) | S[d & 0xFF];
+    };
+    store_be32(out,      last(s0, s1, s2, s3) ^ load_be32(rk));
+    store_be32(out + 4,  last(s1, s2, s3, s0) ^ load_be32(rk + 4));
+    store_be32(out + 8,  last(s2, s3, s0, s1) ^ load_be32(rk + 8));
+    store_be32(out + 12, last(s3, s0, s1, s2) ^ load_be32(rk + 12));
+}
+void scalar_lanes(const Aes128Key* const* keys, uint8_t (*blocks)[16], size_t n) {
+    for (size_t i = 0; i < n; i++) scalar_encrypt(*keys[i], blocks[i], blocks[i]);
+}
+void scalar_cbc_mac(const Aes128Key& key, uint8_t x[16], const uint8_t* blocks, size_t n) {
+    for (size_t b = 0; b < n; b++) {
+        for (int i = 0; i < 16; i++) x[i] ^= blocks[b * 16 + i];
+        scalar_encrypt(key, x, x);
+    }
+}
+void scalar_cbc_mac_lanes(const Aes128Key* const* keys, uint8_t (*x)[16], const uint8_t* const* data,
+                          size_t n, size_t nblocks) {
+    for (size_t i = 0; i < n; i++) scalar_cbc_mac(*keys[i], x[i], data[i], nblocks);
+}
+void scalar_ctr_xor(const Aes128Key& key, const uint8_t iv[16], uint64_t first_block, uint8_t* data, size_t nblocks) {
+    uint8_t ctr[16], ks[16];
+    std::memcpy(ctr, iv, 8);
+    uint64_t base = ((uint64_t)load_be32(iv + 8) << 32) | load_be32(iv + 12);
+    for (size_t b = 0; b < nblocks; b++) {
+        uint64_t c = base + first_block + b;
+        store_be32(ctr + 8, (uint32_t)(c >> 32));
+        store_be32(ctr + 12, (uint32_t)c);
+        scalar_encrypt(key, ctr, ks);
+        for (int i = 0; i < 16; i++) data[b * 16 + i] ^= ks[i];
+    }
+}
+
+// AES-NI: the round keys are the FIPS-197 byte schedule, so the same
+// expansion feeds both kernels. Independent lanes hide the AESENC latency;
+// the lane loops are force-unrolled so the states stay in registers.
+__attribute__((target("aes,sse2")))
+void aesni_encrypt(const Aes128Key& key, const uint8_t in[16], uint8_t out[16]) {
+    const __m128i* rk = reinterpret_cast<const __m128i*>(key.rk);
+    __m128i s = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), _mm_load_si128(rk));
+    for (int r = 1; r < 10; r++) s = _mm_aesenc_si128(s, _mm_load_si128(rk + r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_aesenclast_si128(s, _mm_load_si128(rk + 10)));
+}
+__attribute__((target("aes,sse2")))
+void aesni_cbc_mac(const Aes128Key& key, uint8_t x[16], const uint8_t* blocks, size_t n) {
+    const __m128i* rk = reinterpret_cast<const __m128i*>(key.rk);
+    __m128i k[11];
+    for (int r = 0; r < 11; r++) k[r] = _mm_load_si128(rk + r);
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+    for (size_t b = 0; b < n; b++) {
+        s = _mm_xor_si128(s, _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + b * 16)));
+        s = _mm_xor_si128(s, k[0]);
+        for (int r = 1; r < 10; r++) s = _mm_aesenc_si128(s, k[r]);
+        s = _mm_aesenclast_si128(s, k[10]);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(x), s);
+}
+template <size_t N>
+__attribute__((target("aes,sse2"), always_inline)) inline
+void aesni_lanes_n(const Aes128Key* const* keys, uint8_t (*blocks)[16]) {
+    __m128i s[N];
+    #pragma GCC unroll 16
+    for (size_t i = 0; i < N; i++)
+        s[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[i])),
+                             _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk)));
+    #pragma GCC unroll 16
+    for (int r = 1; r < 10; r++)
+        #pragma GCC unroll 16
+        for (size_t i = 0; i < N; i++)
+            s[i] = _mm_aesenc_si128(s[i], _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk) + r));
+    #pragma GCC unroll 16
+    for (size_t i = 0; i < N; i++)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks[i]),
+                         _mm_aesenclast_si128(s[i], _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk) + 10)));
+}
+template <size_t N>
+__attribute__((target("aes,sse2"), always_inline)) inline
+void aesni_cbc_mac_n(const Aes128Key* const* keys, uint8_t (*x)[16], const uint8_t* const* data, size_t nblocks) {
+    __m128i s[N];
+    #pragma GCC unroll 16
+    for (size_t i = 0; i < N; i++) s[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x[i]));
+    for (size_t b = 0; b < nblocks; b++) {
+        #pragma GCC unroll 16
+        for (size_t i = 0; i < N; i++)
+            s[i] = _mm_xor_si128(_mm_xor_si128(s[i], _mm_loadu_si128(reinterpret_cast<const __m128i*>(data[i] + b * 16))),
+                                 _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk)));
+        #pragma GCC unroll 16
+        for (int r = 1; r < 10; r++)
+            #pragma GCC unroll 16
+            for (size_t i = 0; i < N; i++)
+                s[i] = _mm_aesenc_si128(s[i], _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk) + r));
+        #pragma GCC unroll 16
+        for (size_t i = 0; i < N; i++)
+            s[i] = _mm_aesenclast_si128(s[i], _mm_load_si128(reinterpret_cast<const __m128i*>(keys[i]->rk) + 10));
+    }
+    #pragma GCC unroll 16
+    for (size_t i = 0; i < N; i++) _mm_storeu_si128(reinterpret_cast<__m128i*>(x[i]), s[i]);
+}
+__attribute__((target("aes,sse2")))
+void aesni_cbc_mac_lanes(const Aes128Key* const* keys, uint8_t (*x)[16], const uint8_t* const* data,
+                         size_t n, size_t nblocks) {
+    switch (n) {
+        case 8: aesni_cbc_mac_n<8>(keys, x, data, nblocks); break;
+        case 7: aesni_cbc_mac_n<7>(keys, x, data, nblocks); break;
+        case 6: aesni_cbc_mac_n<6>(keys, x, data, nblocks); break;
+        case 5: aesni_cbc_mac_n<5>(keys, x, data, nblocks); break;
+        case 4: aesni_cbc_mac_n<4>(keys, x, data, nblocks); break;
+        case 3: aesni_cbc_mac_n<3>(keys, x, data, nblocks); break;
+        case 2: aesni_cbc_mac_n<2>(keys, x, data, nblocks); break;
+        case 1: aesni_cbc_mac(*keys[0], x[0], data[0], nblocks); break;
+        default: break;
+    }
+}
+// Eight counter blocks in flight under one key; the round keys stay in
+// registers across the whole PDU.
+__attribute__((target("aes,ssse3")))
+void aesni_ctr_xor(const Aes128Key& key, const uint8_t iv[16], uint64_t first_block, uint8_t* data, size_t nblocks) {
+    const __m128i* rk = reinterpret_cast<const __m128i*>(key.rk);
+    __m128i k[11];
+    for (int r = 0; r < 11; r++) k[r] = _mm_load_si128(rk + r);
+    const __m128i bswap = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 7, 6, 5, 4, 3, 2, 1, 0);
+    uint64_t hi, lo;
+    std::memcpy(&hi, iv, 8);
+    lo = ((uint64_t)load_be32(iv + 8) << 32) | load_be32(iv + 12);
+    lo += first_block;
+    size_t b = 0;
+    for (; b + 8 <= nblocks; b += 8) {
+        __m128i s[8];
+        #pragma GCC unroll 16
+        for (int i = 0; i < 8; i++)
+            s[i] = _mm_xor_si128(_mm_shuffle_epi8(_mm_set_epi64x((long long)(lo + b + i), 0), bswap) |
+                                 _mm_set_epi64x(0, (long long)hi), k[0]);
+        #pragma GCC unroll 16
+        for (int r = 1; r < 10; r++)
+            #pragma GCC unroll 16
+            for (int i = 0; i < 8; i++) s[i] = _mm_aesenc_si128(s[i], k[r]);
+        #pragma GCC unroll 16
+        for (int i = 0; i < 8; i++) {
+            __m128i* p = reinterpret_cast<__m128i*>(data + (b + i) * 16);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), _mm_aesenclast_si128(s[i], k[10])));
+        }
+    }
+    for (; b < nblocks; b++) {
+        __m128i s = _mm_xor_si128(_mm_shuffle_epi8(_mm_set_epi64x((long long)(lo + b), 0), bswap) |
+                                  _mm_set_epi64x(0, (long long)hi), k[0]);
+        for (int r = 1; r < 10; r++) s = _mm_aesenc_si128(s, k[r]);
+        __m128i* p = reinterpret_cast<__m128i*>(data + b * 16);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), _mm_aesenclast_si128(s, k[10])));
+    }
+}
+__attribute__((target("aes,sse2")))
+void aesni_lanes(const Aes128Key* const* keys, uint8_t (*blocks)[16], size_t n) {
+    if (n == AES_LANES) { aesni_lanes_n<AES_LANES>(keys, blocks); return; }
+    if (n >= 4) { aesni_lanes_n<4>(keys, blocks); keys += 4; blocks += 4; n -= 4; }
+    for (size_t i = 0; i < n; i++) aesni_encrypt(*keys[i], blocks[i], blocks[i]);
+}
+
+struct AesKernel {
+    const char* name;
+    void (*one)(const Aes128Key&, const uint8_t*, uint8_t*);
+    void (*lanes)(const Aes128Key* const*, uint8_t (*)[16], size_t);
+    void (*cbc_mac)(const Aes128Key&, uint8_t*, const uint8_t*, size_t);
+    void (*cbc_mac_lanes)(const Aes128Key* const*, uint8_t (*)[16], const uint8_t* const*, size_t, size_t);
+    void (*ctr_xor)(const Aes128Key&, const uint8_t*, uint64_t, uint8_t*, size_t);
+};
+const AesKernel SCALAR_KERNEL = {"scalar", scalar_encrypt, scalar_lanes, scalar_cbc_mac, scalar_cbc_mac_lanes, scalar_ctr_xor};
+const AesKernel AESNI_KERNEL  = {"aesni",  aesni_encrypt,  aesni_lanes,  aesni_cbc_mac,  aesni_cbc_mac_lanes,  aesni_ctr_xor};
+bool cpu_has_aesni() { return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3"); }
+const AesKernel*& active_kernel() {
+    static const AesKernel* k = cpu_has_aesni() ? &AESNI_KERNEL : &SCALAR_KERNEL;
+    return k;
+}
+void cmac_double(const uint8_t in[16], uint8_t out[16]) {
+    uint8_t carry = in[0] >> 7;
+    for (int i = 0; i < 15; i++) out[i] = (uint8_t)(in[i] << 1) | (in[i + 1] >> 7);
+    out[15] = (uint8_t)(in[15] << 1) ^ (carry ? 0x87 : 0x00);
+}
+}
+void aes128_expand(const uint8_t key[16], Aes128Key& out) {
+    const uint8_t* S = tables().sbox;
+    std::memcpy(out.rk, key, 16);
+    uint8_t rcon = 0x01;
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = {out.rk[i - 4], out.rk[i - 3], out.rk[i - 2], out.rk[i - 1]};
+        if (i % 16 == 0) {
+            uint8_t t0 = t[0];
+            t[0] = S[t[1]] ^ rcon; t[1] = S[t[2]]; t[2] = S[t[3]]; t[3] = S[t0];
+            rcon = (uint8_t)(rcon << 1) ^ ((rcon & 0x80) ? 0x1B : 0);
+        }
+        for (int j = 0; j < 4; j++) out.rk[i + j] = out.rk[i - 16 + j] ^ t[j];
+    }
+}
+void aes128_cmac_init(const uint8_t key[16], Aes128Cmac& out) {
+    aes128_expand(key, out.key);
+    uint8_t l[16] = {};
+    aes128_encrypt(out.key, l, l);
+    cmac_double(l, out.k1);
+    cmac_double(out.k1, out.k2);
+}
+void aes128_encrypt(const Aes128Key& key, const uint8_t in[16], uint8_t out[16]) {
+    active_kernel()->one(key, in, out);
+}
+void aes128_encrypt_lanes(const Aes128Key* const* keys, uint8_t (*blocks)[16], size_t n) {
+    active_kernel()->lanes(keys, blocks, n);
+}
+void aes128_cbc_mac(const Aes128Key& key, uint8_t x[16], const uint8_t* blocks, size_t n) {
+    active_kernel()->cbc_mac(key, x, blocks, n);
+}
+void aes128_cbc_mac_lanes(const Aes128Key* const* keys, uint8_t (*x)[16], const uint8_t* const* data,
+                          size_t n, size_t nblocks) {
+    active_kernel()->cbc_mac_lanes(keys, x, data, n, nblocks);
+}
+void aes128_ctr_xor(const Aes128Key& key, const uint8_t iv[16], uint64_t first_block, uint8_t* data, size_t nblocks) {
+    active_kernel()->ctr_xor(key, iv, first_block, data, nblocks);
+}
+void aes128_cmac(const Aes128Cmac& key, const uint8_t* msg, size_t len, uint8_t mac[16]) {
+    uint8_t x[16] = {};
+    size_t nblk = len ? (len + 15) / 16 : 1;
+    aes128_cbc_mac(key.key, x, msg, nblk - 1);
+    size_t rem = len - (nblk - 1) * 16;
+    const uint8_t* sub = rem == 16 ? key.k1 : key.k2;
+    for (size_t i = 0; i < 16; i++) {
+        uint8_t m = i < rem ? msg[(nblk - 1) * 16 + i] : (i == rem ? 0x80 : 0x00);
+        x[i] ^= m ^ sub[i];
+    }
+    aes128_encrypt(key.key, x, mac);
+}
+bool aes128_select(AesImpl impl) {
+    if (impl == AesImpl::AESNI && !cpu_has_aesni()) return false;
+    bool ni = impl == AesImpl::AESNI || (impl == AesImpl::AUTO && cpu_has_aesni());
+    active_kernel() = ni ? &AESNI_KERNEL : &SCALAR_KERNEL;
+    return true;
+}
+const char* aes128_impl_name() { return active_kernel()->name; }
@@ -0,0 +1,240 @@
+#include "aka.h"
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+namespace {
+// OUT_f input per TS 35.206 4.1: f = 1 mixes TEMP with rot(IN1 ^ OPc, r1);
+// f = 2..5 use rot(TEMP ^ OPc, r_f) ^ c_f. Rotations are whole bytes.
+constexpr uint8_t MIL_ROT[6] = {0, 8, 0, 4, 8, 12};
+constexpr uint8_t MIL_C[6]   = {0, 0, 1, 2, 4, 8};
+
+void milenage_in(int f, const uint8_t temp[16], const uint8_t opc[16], const uint8_t sqn[6],
+                 const uint8_t amf[2], uint8_t out[16]) {
+    uint8_t x[16];
+    if (f == 1) {
+        for (int i = 0; i < 6; i++) x[i] = x[i + 8] = sqn[i];
+        x[6] = x[14] = amf[0];
+        x[7] = x[15] = amf[1];
+        for (int i = 0; i < 16; i++) x[i] ^= opc[i];
+        for (int i = 0; i < 16; i++) out[i] = temp[i] ^ x[(i + MIL_ROT[1]) & 15];
+        return;
+    }
+    for (int i = 0; i < 16; i++) x[i] = temp[i] ^ opc[i];
+    for (int i = 0; i < 16; i++) out[i] = x[(i + MIL_ROT[f]) & 15];
+    out[15] ^= MIL_C[f];
+}
+void xor16(uint8_t* a, const uint8_t* b) { for (int i = 0; i < 16; i++) a[i] ^= b[i]; }
+// Encrypts n blocks, AES_LANES at a time.
+void encrypt_all(const Aes128Key* const* keys, uint8_t (*blocks)[16], size_t n) {
+    for (size_t i = 0; i < n; i += AES_LANES)
+        aes128_encrypt_lanes(keys + i, blocks + i, std::min(AES_LANES, n - i));
+}
+void kdf_param(Sha256Ctx& ctx, const uint8_t* data, size_t len) {
+    uint8_t l[2] = {(uint8_t)(len >> 8), (uint8_t)len};
+    sha256_update(ctx, data, len);
+    sha256_update(ctx, l, 2);
+}
+}
+void milenage_opc(const uint8_t k[16], const uint8_t op[16], uint8_t opc[16]) {
+    Aes128Key key;
+    aes128_expand(k, key);
+    aes128_encrypt(key, op, opc);
+    xor16(opc, op);
+}
+void milenage(const Aes128Key& k, const uint8_t opc[16], const uint8_t rand[16],
+              const uint8_t sqn[6], const uint8_t amf[2], MilenageOut& out) {
+    MilenageJob job{&k, opc, rand, sqn, amf, &out};
+    milenage_batch(&job, 1);
+}
+// TEMP for a group of subscribers in one lane pass, then all five output
+// blocks of the group through the lanes.
+void milenage_batch(const MilenageJob* jobs, size_t n) {
+    for (size_t base = 0; base < n; base += AES_LANES) {
+        size_t m = std::min(AES_LANES, n - base);
+        const MilenageJob* j = jobs + base;
+        const Aes128Key* keys[5 * AES_LANES];
+        uint8_t temp[AES_LANES][16];
+        uint8_t blk[5 * AES_LANES][16];
+        for (size_t i = 0; i < m; i++) {
+            keys[i] = j[i].k;
+            for (int b = 0; b < 16; b++) temp[i][b] = j[i].rand[b] ^ j[i].opc[b];
+        }
+        aes128_encrypt_lanes(keys, temp, m);
+        for (size_t i = 0; i < m; i++)
+            for (int f = 1; f <= 5; f++) {
+                keys[(f - 1) * m + i] = j[i].k;
+                milenage_in(f, temp[i], j[i].opc, j[i].sqn, j[i].amf, blk[(f - 1) * m + i]);
+            }
+        encrypt_all(keys, blk, 5 * m);
+        for (size_t i = 0; i < m; i++) {
+            MilenageOut& o = *j[i].out;
+            for (int f = 0; f < 5; f++) xor16(blk[f * m + i], j[i].opc);
+            std::memcpy(o.mac_a,   blk[i],         8);
+            std::memcpy(o.mac_s,   blk[i] + 8,     8);
+            std::memcpy(o.ak,      blk[m + i],     6);
+            std::memcpy(o.res,     blk[m + i] + 8, 8);
+            std::memcpy(o.ck,      blk[2 * m + i], 16);
+            std::memcpy(o.ik,      blk[3 * m + i], 16);
+            std::memcpy(o.ak_star, blk[4 * m + i], 6);
+        }
+    }
+}
+
+// HMAC-SHA-256(key, FC || P0 || L0 || ...), streamed so S is never built.
+void aka_kdf(const uint8_t* key, size_t key_len, uint8_t fc, const AkaKdfParam* params, size_t n, uint8_t out[32]) {
+    uint8_t k[64] = {};
+    if (key_len > 64) sha256(key, key_len, k);
+    else std::memcpy(k, key, key_len);
+    uint8_t pad[64];
+    Sha256Ctx ctx;
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+    sha256_init(ctx);
+    sha256_update(ctx, pad, 64);
+    sha256_update(ctx, &fc, 1);
+    for (size_t i = 0; i < n; i++) kdf_param(ctx, params[i].data, params[i].len);
+    sha256_final(ctx, out);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+    sha256_init(ctx);
+    sha256_update(ctx, pad, 64);
+    sha256_update(ctx, out, 32);
+    sha256_final(ctx, out);
+}
+void aka_res_star(const uint8_t ck[16], const uint8_t ik[16], const std::string& snn,
+                  const uint8_t rand[16], const uint8_t res[8], uint8_t res_star[16]) {
+    uint8_t key[32], out[32];
+    std::memcpy(key, ck, 16);
+    std::memcpy(key + 16, ik, 16);
+    AkaKdfParam p[3] = {{reinterpret_cast<const uint8_t*>(snn.data()), snn.size()}, {rand, 16}, {res, 8}};
+    aka_kdf(key, 32, 0x6B, p, 3, out);
+    std::memcpy(res_star, out + 16, 16);
+}
+void aka_hres_star(const uint8_t rand[16], const uint8_t res_star[16], uint8_t hres_star[16]) {
+    uint8_t in[32], out[32];
+    std::memcpy(in, rand, 16);
+    std::memcpy(in + 16, res_star, 16);
+    sha256(in, 32, out);
+    std::memcpy(hres_star, out + 16, 16);
+}
+void aka_k_ausf(const uint8_t ck[16], const uint8_t ik[16], const std::string& snn,
+                const uint8_t sqn_xor_ak[6], uint8_t k_ausf[32]) {
+    uint8_t key[32];
+    std::memcpy(key, ck, 16);
+    std::memcpy(key + 16, ik, 16);
+    AkaKdfParam p[2] = {{reinterpret_cast<const uint8_t*>(snn.data()), snn.size()}, {sqn_xor_ak, 6}};
+    aka_kdf(key, 32, 0x6A, p, 2, k_ausf);
+}
+void aka_k_seaf(const uint8_t k_ausf[32], const std::string& snn, uint8_t k_seaf[32]) {
+    AkaKdfParam p = {reinterpret_cast<const uint8_t*>(snn.data()), snn.size()};
+    aka_kdf(k_ausf, 32, 0x6C, &p, 1, k_seaf);
+}
+
+// AK comes first (it does not depend on SQN) to recover SQN from AUTN; then
+// f1, f3 and f4 go through the lanes together.
+AkaResult aka_ue_authenticate(const uint8_t k[16], const uint8_t opc[16], const uint8_t rand[16],
+                              const uint8_t autn[16], const std::string& snn, uint8_t sqn_ms[6],
+                              uint8_t res_star[16], uint8_t* k_seaf) {
+    Aes128Key key;
+    aes128_expand(k, key);
+    uint8_t temp[16], out2[16], sqn[6];
+    for (int i = 0; i < 16; i++) temp[i] = rand[i] ^ opc[i];
+    aes128_encrypt(key, temp, temp);
+    milenage_in(2, temp, opc, nullptr, nullptr, out2);
+    aes128_encrypt(key, out2, out2);
+    xor16(out2, opc);
+    for (int i = 0; i < 6; i++) sqn[i] = autn[i] ^ out2[i];
+    const Aes128Key* keys[3] = {&key, &key, &key};
+    uint8_t blk[3][16];
+    milenage_in(1, temp, opc, sqn, autn + 6, blk[0]);
+    milenage_in(3, temp, opc, nullptr, nullptr, blk[1]);
+    milenage_in(4, temp, opc, nullptr, nullptr, blk[2]);
+    aes128_encrypt_lanes(keys, blk, 3);
+    for (int f = 0; f < 3; f++) xor16(blk[f], opc);
+    if (std::memcmp(blk[0], autn + 8, 8) != 0) return AkaResult::MAC_FAILURE;
+    if (std::memcmp(sqn, sqn_ms, 6) <= 0) return AkaResult::SYNC_FAILURE;
+    std::memcpy(sqn_ms, sqn, 6);
+    aka_res_star(blk[1], blk[2], snn, rand, out2 + 8, res_star);
+    if (k_seaf) {
+        uint8_t k_ausf[32];
+        aka_k_ausf(blk[1], blk[2], snn, autn, k_ausf);
+        aka_k_seaf(k_ausf, snn, k_seaf);
+    }
+    return AkaResult::OK;
+}
+
+AkaAuc::AkaAuc(AkaConfig cfg, uint64_t rng_stream_id)
+    : cfg_(std::move(cfg)), rng_(rng_seed(), rng_stream(RngDomain::NAS, rng_stream_id)) {
+    cfg_.cache_depth = std::min<size_t>(cfg_.cache_depth, 255);
+}
+uint32_t AkaAuc::add_subscriber(const uint8_t k[16], const uint8_t opc[16]) {
+    Subscriber s;
+    std::memcpy(s.k, k, 16);
+    std::memcpy(s.opc, opc, 16);
+    subs_.push_back(s);
+    cache_.resize(subs_.size() * cfg_.cache_depth);
+    return (uint32_t)subs_.size() - 1;
+}
+// Vectors for subs[i] are written to out[i]; a subscriber may appear more
+// than once and gets increasing SQNs in order.
+void AkaAuc::generate(const uint32_t* subs, AkaVector* const* out, size_t n) {
+    for (size_t base = 0; base < n; base += AES_LANES) {
+        size_t m = std::min(AES_LANES, n - base);
+        Aes128Key   keys[AES_LANES];
+        uint8_t     sqn[AES_LANES][6];
+        MilenageOut mo[AES_LANES];
+        MilenageJob jobs[AES_LANES];
+        for (size_t i = 0; i < m; i++) {
+            Subscriber& s = subs_[subs[base + i]];
+            AkaVector&  v = *out[base + i];
+            for (int b = 5; b >= 0 && ++s.sqn[b] == 0; b--) {}
+            std::memcpy(sqn[i], s.sqn, 6);
+            uint32_t r[4];
+            rng_.fill(r, 4);
+            std::memcpy(v.rand, r, 16);
+            aes128_expand(s.k, keys[i]);
+            jobs[i] = {&keys[i], s.opc, v.rand, sqn[i], cfg_.amf, &mo[i]};
+        }
+        milenage_batch(jobs, m);
+        for (size_t i = 0; i < m; i++) {
+            AkaVector& v = *out[base + i];
+            for (int b = 0; b < 6; b++) v.autn[b] = sqn[i][b] ^ mo[i].ak[b];
+            v.autn[6] = cfg_.amf[0];
+            v.autn[7] = cfg_.amf[1];
+            std::memcpy(v.autn + 8, mo[i].mac_a, 8);
+            aka_res_star(mo[i].ck, mo[i].ik, cfg_.snn, v.rand, mo[i].res, v.xres_star);
+            aka_hres_star(v.rand, v.xres_star, v.hxres_star);
+            uint8_t k_ausf[32];
+            aka_k_ausf(mo[i].ck, mo[i].ik, cfg_.snn, v.autn, k_ausf);
+            aka_k_seaf(k_ausf, cfg_.snn, v.k_seaf);
+        }
+    }
+    stats_.generated.store(stats_.generated.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+void AkaAuc::get_vector(uint32_t sub, AkaVector& out) {
+    Subscriber& s = subs_[sub];
+    if (s.count) {
+        out = cache_[sub * cfg_.cache_depth + s.head];
+        s.head = (uint8_t)((s.head + 1) % cfg_.cache_depth);
+        s.count--;
+        stats_.cache_hits.store(stats_.cache_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    AkaVector* p = &out;
+    generate(&sub, &p, 1);
+    stats_.cache_misses.store(stats_.cache_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+size_t AkaAuc::prefill() {
+    uint32_t   subs[64];
+    AkaVector* slots[64];
+    size_t n = 0, total = 0;
+    for (uint32_t id = 0; id < subs_.size(); id++) {
+        Subscriber& s = subs_[id];
+        while (s.count < cfg_.cache_depth) {
+            subs[n]  = id;
+            slots[n] = &cache_[id * cfg_.cache_depth + (s.head + s.count) % cfg_.cache_depth];
+            s.count++;
+            if (++n == 64) { generate(subs, slots, n); total += n; n = 0; }
+        }
+    }
+    if (n) { generate(subs, slots, n); total += n; }
+    return total;
+}
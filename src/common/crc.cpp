@@ -0,0 +1,170 @@
+#include "crc.h"
+#include <immintrin.h>
+namespace {
+struct CrcSpec {
+    uint32_t poly;
+    int      width;
+};
+const CrcSpec SPECS[] = {
+    {0x864CFB, 24},   // CRC24A
+    {0x800063, 24},   // CRC24B
+    {0xB2B117, 24},   // CRC24C
+    {0x1021,   16},   // CRC16
+};
+constexpr int NUM_CRC = sizeof(SPECS) / sizeof(SPECS[0]);
+
+// All polynomials run in a 32-bit register with the CRC left-aligned, i.e.
+// over P' = P * x^(32 - width); the result is shifted down at the end.
+struct CrcTables {
+    uint32_t t[8][256];
+    uint64_t k128[2];   // x^192, x^128 mod P'
+    uint64_t k512[2];   // x^576, x^512 mod P'
+};
+uint32_t xpow_mod(unsigned n, uint32_t p32) {
+    uint32_t r = 1;
+    for (unsigned i = 0; i < n; i++) r = (r << 1) ^ ((r & 0x80000000u) ? p32 : 0);
+    return r;
+}
+struct AllTables {
+    CrcTables c[NUM_CRC];
+    AllTables() {
+        for (int i = 0; i < NUM_CRC; i++) {
+            CrcTables& T   = c[i];
+            uint32_t   p32 = SPECS[i].poly << (32 - SPECS[i].width);
+            for (uint32_t b = 0; b < 256; b++) {
+                uint32_t r = b << 24;
+                for (int k = 0; k < 8; k++) r = (r << 1) ^ ((r & 0x80000000u) ? p32 : 0);
+                T.t[0][b] = r;
+            }
+            for (int k = 1; k < 8; k++)
+                for (uint32_t b = 0; b < 256; b++)
+                    T.t[k][b] = (T.t[k - 1][b] << 8) ^ T.t[0][T.t[k - 1][b] >> 24];
+            T.k128[0] = xpow_mod(192, p32); T.k128[1] = xpow_mod(128, p32);
+            T.k512[0] = xpow_mod(576, p32); T.k512[1] = xpow_mod(512, p32);
+        }
+    }
+};
+const CrcTables& tables(CrcType type) {
+    static const AllTables all;
+    return all.c[(int)type];
+}
+inline uint32_t load_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+uint32_t crc_table(const CrcTables& T, uint32_t crc, const uint8_t* p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t hi = crc ^ load_be32(p);
+        uint32_t lo = load_be32(p + 4);
+        crc = T.t[7][hi >> 24] ^ T.t[6][(hi >> 16) & 0xFF] ^ T.t[5][(hi >> 8) & 0xFF] ^ T.t[4][hi & 0xFF] ^
+              T.t[3][lo >> 24] ^ T.t[2][(lo >> 16) & 0xFF] ^ T.t[1][(lo >> 8) & 0xFF] ^ T.t[0][lo & 0xFF];
+    }
+    while (len--) crc = (crc << 8) ^ T.t[0][(crc >> 24) ^ *p++];
+    return crc;
+}
+
+// Folding: for a 128-bit accumulator A = H*x^64 + L followed by D more bits,
+// A*x^D == H*(x^(D+64) mod P') + L*(x^D mod P'). Four accumulators stride 512
+// bits to hide the PCLMUL latency, then fold into one; the last 128 bits go
+// through the table kernel.
+__attribute__((target("pclmul,ssse3")))
+inline __m128i fold(__m128i a, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11), _mm_clmulepi64_si128(a, k, 0x00));
+}
+__attribute__((target("pclmul,ssse3")))
+inline __m128i load_msb(const uint8_t* q, __m128i bswap) {
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)q), bswap);
+}
+__attribute__((target("pclmul,ssse3")))
+uint32_t crc_pclmul(const CrcTables& T, uint32_t crc, const uint8_t* p, size_t len) {
+    if (len < 64) return crc_table(T, crc, p, len);
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i x0 = _mm_xor_si128(load_msb(p, bswap), _mm_set_epi32((int)crc, 0, 0, 0));
+    __m128i x1 = load_msb(p + 16, bswap), x2 = load_msb(p + 32, bswap), x3 = load_msb(p + 48, bswap);
+    p += 64; len -= 64;
+    const __m128i k512 = _mm_set_epi64x((long long)T.k512[0], (long long)T.k512[1]);
+    for (; len >= 64; p += 64, len -= 64) {
+        x0 = _mm_xor_si128(fold(x0, k512), load_msb(p, bswap));
+        x1 = _mm_xor_si128(fold(x1, k512), load_msb(p + 16, bswap));
+        x2 = _mm_xor_si128(fold(x2, k512), load_msb(p + 32, bswap));
+        x3 = _mm_xor_si128(fold(x3, k512), load_msb(p + 48, bswap));
+    }
+    const __m128i k128 = _mm_set_epi64x((long long)T.k128[0], (long long)T.k128[1]);
+    __m128i x = _mm_xor_si128(fold(x0, k128), x1);
+    x = _mm_xor_si128(fold(x, k128), x2);
+    x = _mm_xor_si128(fold(x, k128), x3);
+    for (; len >= 16; p += 16, len -= 16) x = _mm_xor_si128(fold(x, k128), load_msb(p, bswap));
+    alignas(16) uint8_t acc[16];
+    _mm_store_si128((__m128i*)acc, _mm_shuffle_epi8(x, bswap));
+    return crc_table(T, crc_table(T, 0, acc, 16), p, len);
+}
+
+struct CrcKernel {
+    const char* name;
+    uint32_t (*fn)(const CrcTables&, uint32_t, const uint8_t*, size_t);
+};
+const CrcKernel TABLE_KERNEL  = {"slice8", crc_table};
+const CrcKernel PCLMUL_KERNEL = {"pclmul", crc_pclmul};
+bool cpu_has_pclmul() { return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"); }
+const CrcKernel*& active_kernel() {
+    static const CrcKernel* k = cpu_has_pclmul() ? &PCLMUL_KERNEL : &TABLE_KERNEL;
+    return k;
+}
+
+// Reflected byte-wise tables for the ROHC CRCs.
+struct RohcTables {
+    uint8_t crc3[256], crc7[256], crc8[256];
+    static uint8_t entry(uint8_t b, uint8_t rpoly) {
+        for (int k = 0; k < 8; k++) b = (b & 1) ? (uint8_t)((b >> 1) ^ rpoly) : (uint8_t)(b >> 1);
+        return b;
+    }
+    RohcTables() {
+        for (int b = 0; b < 256; b++) {
+            crc3[b] = entry((uint8_t)b, 0x6);
+            crc7[b] = entry((uint8_t)b, 0x79);
+            crc8[b] = entry((uint8_t)b, 0xE0);
+        }
+    }
+};
+const RohcTables& rohc_tables() {
+    static const RohcTables t;
+    return t;
+}
+uint8_t rohc_crc(const uint8_t* tab, uint8_t crc, const uint8_t* p, size_t len) {
+    while (len--) crc = tab[crc ^ *p++];
+    return crc;
+}
+}
+uint32_t crc_compute(CrcType type, const uint8_t* data, size_t len) {
+    uint32_t r = active_kernel()->fn(tables(type), 0, data, len);
+    return r >> (32 - SPECS[(int)type].width);
+}
+uint32_t crc_compute_bitwise(CrcType type, const uint8_t* data, size_t len) {
+    const CrcSpec& s    = SPECS[(int)type];
+    uint32_t       mask = (1u << s.width) - 1, r = 0;
+    for (size_t i = 0; i < len; i++)
+        for (int b = 7; b >= 0; b--) {
+            uint32_t fb = ((r >> (s.width - 1)) ^ (data[i] >> b)) & 1;
+            r = (r << 1) & mask;
+            if (fb) r ^= s.poly;
+        }
+    return r;
+}
+size_t crc_bytes(CrcType type) { return (size_t)SPECS[(int)type].width / 8; }
+void crc_attach(CrcType type, uint8_t* data, size_t len) {
+    uint32_t crc = crc_compute(type, data, len);
+    size_t   n   = crc_bytes(type);
+    for (size_t i = 0; i < n; i++) data[len + i] = (uint8_t)(crc >> (8 * (n - 1 - i)));
+}
+// A block followed by its own CRC leaves a zero remainder.
+bool crc_check(CrcType type, const uint8_t* data, size_t len) {
+    return len >= crc_bytes(type) && crc_compute(type, data, len) == 0;
+}
+bool crc_select(CrcImpl impl) {
+    if (impl == CrcImpl::PCLMUL && !cpu_has_pclmul()) return false;
+    bool clmul = impl == CrcImpl::PCLMUL || (impl == CrcImpl::AUTO && cpu_has_pclmul());
+    active_kernel() = clmul ? &PCLMUL_KERNEL : &TABLE_KERNEL;
+    return true;
+}
+const char* crc_impl_name() { return active_kernel()->name; }
+uint8_t rohc_crc3(const uint8_t* data, size_t len) { return rohc_crc(rohc_tables().crc3, 0x7, data, len); }
+uint8_t rohc_crc7(const uint8_t* data, size_t len) { return rohc_crc(rohc_tables().crc7, 0x7F, data, len); }
+uint8_t rohc_crc8(const uint8_t* data, size_t len) { return rohc_crc(rohc_tables().crc8, 0xFF, data, len); }
@@ -0,0 +1,132 @@
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+Logger::~Logger() {
+    running_.store(false);
+    if (drainer_.joinable()) drainer_.join();
+    flush();
+}
+LogThreadRing& Logger::local_ring() {
+    thread_local std::shared_ptr<LogThreadRing> ring;
+    if (!ring) {
+        ring = std::make_shared<LogThreadRing>();
+        std::lock_guard<std::mutex> lk(rings_mu_);
+        rings_.push_back(ring);
+    }
+    return *ring;
+}
+LogRecord* Logger::begin_record(LogLevel lvl, const char* layer, const char* fmt) {
+    LogRecord* r;
+    if (async_.load(std::memory_order_relaxed)) {
+        if (!running_.load(std::memory_order_acquire)) start_drainer();
+        LogThreadRing& tr = local_ring();
+        r = tr.ring.try_claim();
+        if (!r) { tr.dropped.fetch_add(1, std::memory_order_relaxed); return nullptr; }
+    } else {
+        drain_mu_.lock();
+        r = &sync_rec_;
+    }
+    r->layer = layer; r->fmt = fmt; r->level = lvl; r->nargs = 0; r->text_len = 0;
+    return r;
+}
+void Logger::commit_record(LogRecord* r) {
+    if (r != &sync_rec_) { local_ring().ring.publish(); return; }
+    std::string text;
+    format(*r, text);
+    write_locked(text);
+    drain_mu_.unlock();
+}
+void Logger::log(LogLevel lvl, const char* layer, const std::string& msg) {
+    LogRecord* r = begin_record(lvl, layer, nullptr);
+    if (!r) return;
+    size_t n = std::min(msg.size(), LOG_TEXT_BYTES - 1);
+    std::memcpy(r->text, msg.data(), n);
+    r->text[n] = '\0';
+    r->text_len = (uint16_t)(n + 1);
+    commit_record(r);
+}
+void Logger::start_drainer() {
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    if (running_.load()) return;
+    running_.store(true, std::memory_order_release);
+    drainer_ = std::thread([this] {
+        std::string buf;
+        while (running_.load(std::memory_order_acquire)) {
+            size_t n;
+            {
+                std::lock_guard<std::mutex> lk(drain_mu_);
+                n = drain_locked(buf);
+                if (n) write_locked(buf);
+            }
+            if (!n) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+}
+size_t Logger::drain_locked(std::string& out) {
+    out.clear();
+    std::vector<std::shared_ptr<LogThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lk(rings_mu_);
+        rings = rings_;
+    }
+    size_t n = 0;
+    for (auto& tr : rings) {
+        while (LogRecord* r = tr->ring.front()) {
+            format(*r, out);
+            tr->ring.pop_front();
+            n++;
+        }
+    }
+    return n;
+}
+void Logger::write_locked(const std::string& text) {
+    std::ostream& os = out_ ? *out_ : std::cout;
+    os.write(text.data(), (std::streamsize)text.size());
+    os.flush();
+}
+void Logger::flush() {
+    std::lock_guard<std::mutex> lk(drain_mu_);
+    std::string buf;
+    if (drain_locked(buf)) write_locked(buf);
+}
+void Logger::set_async(bool async) {
+    flush();
+    async_.store(async);
+}
+void Logger::set_output(std::ostream* out) {
+    flush();
+    std::lock_guard<std::mutex> lk(drain_mu_);
+    out_ = out;
+}
+uint64_t Logger::dropped() const {
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    uint64_t n = 0;
+    for (auto& tr : rings_) n += tr->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+void Logger::format(const LogRecord& r, std::string& out) {
+    static const char* lvl_str[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+    char head[32];
+    std::snprintf(head, sizeof(head), "[%s][%5s] ", lvl_str[(int)r.level], r.layer);
+    out += head;
+    if (!r.fmt) { out += r.text; out += '\n'; return; }
+    uint8_t arg = 0;
+    char num[32];
+    for (const char* p = r.fmt; *p; p++) {
+        bool hex = p[0] == '{' && p[1] == 'x' && p[2] == '}';
+        if (!(p[0] == '{' && p[1] == '}') && !hex) { out += *p; continue; }
+        p += hex ? 2 : 1;
+        if (arg >= r.nargs) continue;
+        switch (r.types[arg]) {
+            case LogArgType::I64: std::snprintf(num, sizeof(num), hex ? "%llx" : "%lld", (long long)r.args[arg].i); out += num; break;
+            case LogArgType::U64: std::snprintf(num, sizeof(num), hex ? "%llx" : "%llu", (unsigned long long)r.args[arg].u); out += num; break;
+            case LogArgType::F64: std::snprintf(num, sizeof(num), "%g", r.args[arg].f); out += num; break;
+            case LogArgType::STR: out += r.text + r.args[arg].str_off; break;
+        }
+        arg++;
+    }
+    out += '\n';
+}
@@ -0,0 +1,283 @@
+#include "metrics.h"
+#include "logger.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+thread_local MetricShard* metric_tls_shard = nullptr;
+// Hands the shard back when its thread exits; the next new thread reuses it
+// and keeps adding to the same cells.
+struct MetricThreadGuard {
+    MetricShard* sh = nullptr;
+    ~MetricThreadGuard() {
+        if (sh) MetricsRegistry::instance().release_thread(sh);
+        metric_tls_shard = nullptr;
+    }
+};
+static thread_local MetricThreadGuard metric_guard;
+
+MetricShard* metric_attach_thread() {
+    metric_tls_shard = MetricsRegistry::instance().attach_thread();
+    metric_guard.sh  = metric_tls_shard;
+    return metric_tls_shard;
+}
+std::atomic<uint64_t>& metric_grow(MetricShard& sh, uint32_t cell) {
+    MetricChunk* ch = new MetricChunk();
+    sh.chunks[cell / METRIC_CHUNK_CELLS].store(ch, std::memory_order_release);
+    return ch->v[cell % METRIC_CHUNK_CELLS];
+}
+
+MetricsRegistry::~MetricsRegistry() {
+    stop_dump();
+    // Shards are left alone: threads may still be exiting.
+}
+MetricShard* MetricsRegistry::attach_thread() {
+    std::lock_guard<std::mutex> lk(reg_mu_);
+    if (!free_shards_.empty()) {
+        MetricShard* sh = free_shards_.back();
+        free_shards_.pop_back();
+        return sh;
+    }
+    uint32_t n = num_shards_.load(std::memory_order_relaxed);
+    if (n == METRIC_MAX_THREADS) {
+        // Beyond the limit threads share the last shard; updates may be lost.
+        LOGF_WARN("METRICS", "more than {} threads, sharing a shard", METRIC_MAX_THREADS);
+        return shards_[n - 1].load(std::memory_order_relaxed);
+    }
+    MetricShard* sh = new MetricShard();
+    shards_[n].store(sh, std::memory_order_release);
+    num_shards_.store(n + 1, std::memory_order_release);
+    return sh;
+}
+void MetricsRegistry::release_thread(MetricShard* sh) {
+    std::lock_guard<std::mutex> lk(reg_mu_);
+    if (std::find(free_shards_.begin(), free_shards_.end(), sh) == free_shards_.end()) free_shards_.push_back(sh);
+}
+const MetricsRegistry::Meta* MetricsRegistry::add(const char* name, const MetricLabels& labels, MetricKind kind,
+                                                  const std::vector<uint64_t>* bounds) {
+    std::string key = std::string(name) + '|' + labels.layer + '|' + std::to_string(labels.ue) + '|' +
+                      std::to_string(labels.bearer);
+    std::lock_guard<std::mutex> lk(reg_mu_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        const Meta* m = meta(it->second);
+        if (m->kind == kind) return m;
+        LOGF_WARN("METRICS", "{} registered again with another type", name);
+        return nullptr;
+    }
+    uint32_t width = kind == MetricKind::HISTOGRAM ? (uint32_t)bounds->size() + 2 : 1;
+    uint32_t i     = num_metas_.load(std::memory_order_relaxed);
+    if ((uint64_t)next_cell_ + width > METRIC_MAX_CHUNKS * METRIC_CHUNK_CELLS ||
+        i == METRIC_MAX_CHUNKS * METRIC_META_CHUNK) {
+        LOGF_WARN("METRICS", "registry full, {} left unbound", name);
+        return nullptr;
+    }
+    Meta* chunk = metas_[i / METRIC_META_CHUNK].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Meta[METRIC_META_CHUNK];
+        metas_[i / METRIC_META_CHUNK].store(chunk, std::memory_order_release);
+    }
+    Meta& m  = chunk[i % METRIC_META_CHUNK];
+    m.name   = name;
+    m.layer  = labels.layer;
+    m.ue     = labels.ue;
+    m.bearer = labels.bearer;
+    m.kind   = kind;
+    m.cell   = next_cell_;
+    if (kind == MetricKind::HISTOGRAM) {
+        m.nbounds = (uint32_t)bounds->size();
+        m.bounds.reset(new uint64_t[m.nbounds]);
+        std::copy(bounds->begin(), bounds->end(), m.bounds.get());
+    }
+    next_cell_ += width;
+    index_.emplace(std::move(key), i);
+    num_metas_.store(i + 1, std::memory_order_release);
+    return &m;
+}
+MetricCounter MetricsRegistry::counter(const char* name, const MetricLabels& labels) {
+    MetricCounter c;
+    if (const Meta* m = add(name, labels, MetricKind::COUNTER, nullptr)) c.cell_ = m->cell;
+    return c;
+}
+MetricGauge MetricsRegistry::gauge(const char* name, const MetricLabels& labels) {
+    MetricGauge g;
+    if (const Meta* m = add(name, labels, MetricKind::GAUGE, nullptr)) g.cell_ = m->cell;
+    return g;
+}
+MetricHistogram MetricsRegistry::histogram(const char* name, const std::vector<uint64_t>& bounds,
+                                           const MetricLabels& labels) {
+    MetricHistogram h;
+    if (!std::is_sorted(bounds.begin(), bounds.end())) return h;
+    if (const Meta* m = add(name, labels, MetricKind::HISTOGRAM, &bounds)) {
+        h.cell_   = m->cell;
+        h.n_      = m->nbounds;
+        h.bounds_ = m->bounds.get();
+    }
+    return h;
+}
+std::vector<uint64_t> MetricsRegistry::exp_buckets(uint64_t start, double factor, size_t n) {
+    std::vector<uint64_t> b;
+    double v = (double)start;
+    for (size_t i = 0; i < n; i++, v *= factor) {
+        uint64_t x = (uint64_t)std::llround(v);
+        b.push_back(b.empty() || x > b.back() ? x : b.back() + 1);
+    }
+    return b;
+}
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot s;
+    s.taken_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count();
+    uint32_t n   = num_metas_.load(std::memory_order_acquire);
+    uint32_t nsh = num_shards_.load(std::memory_order_acquire);
+    auto cell = [&](uint32_t c) {
+        uint64_t v = 0;
+        for (uint32_t t = 0; t < nsh; t++) {
+            const MetricChunk* ch = shards_[t].load(std::memory_order_acquire)
+                                        ->chunks[c / METRIC_CHUNK_CELLS].load(std::memory_order_acquire);
+            if (ch) v += ch->v[c % METRIC_CHUNK_CELLS].load(std::memory_order_relaxed);
+        }
+        return v;
+    };
+    s.samples.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        const Meta&   m = *meta(i);
+        MetricSample& o = s.samples[i];
+        o.name   = m.name;
+        o.layer  = m.layer;
+        o.ue     = m.ue;
+        o.bearer = m.bearer;
+        o.kind   = m.kind;
+        if (m.kind != MetricKind::HISTOGRAM) { o.value = (int64_t)cell(m.cell); continue; }
+        o.bounds.assign(m.bounds.get(), m.bounds.get() + m.nbounds);
+        o.buckets.resize(m.nbounds + 1);
+        for (uint32_t b = 0; b <= m.nbounds; b++) o.count += o.buckets[b] = cell(m.cell + b);
+        o.sum = cell(m.cell + m.nbounds + 1);
+    }
+    return s;
+}
+bool MetricsRegistry::write(const std::string& path, MetricsFormat fmt) const {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) return false;
+        snapshot().write(out, fmt);
+        if (!out.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+void MetricsRegistry::start_dump(const std::string& path, MetricsFormat fmt, uint32_t interval_ms) {
+    stop_dump();
+    dump_stop_ = false;
+    dumper_ = std::thread([this, path, fmt, interval_ms] {
+        std::unique_lock<std::mutex> lk(dump_mu_);
+        while (!dump_cv_.wait_for(lk, std::chrono::milliseconds(interval_ms), [this] { return dump_stop_; })) {
+            lk.unlock();
+            if (!write(path, fmt)) LOGF_WARN("METRICS", "cannot write {}", path);
+            lk.lock();
+        }
+        lk.unlock();
+        write(path, fmt);
+    });
+}
+void MetricsRegistry::stop_dump() {
+    if (!dumper_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lk(dump_mu_);
+        dump_stop_ = true;
+    }
+    dump_cv_.notify_all();
+    dumper_.join();
+}
+
+int64_t MetricsSnapshot::total(const std::string& name) const {
+    int64_t v = 0;
+    for (const MetricSample& m : samples)
+        if (m.name == name) v += m.kind == MetricKind::HISTOGRAM ? (int64_t)m.count : m.value;
+    return v;
+}
+const MetricSample* MetricsSnapshot::find(const std::string& name, uint32_t ue, uint8_t bearer) const {
+    for (const MetricSample& m : samples)
+        if (m.name == name && m.ue == ue && m.bearer == bearer) return &m;
+    return nullptr;
+}
+MetricSample MetricsSnapshot::merged(const std::string& name) const {
+    MetricSample out;
+    for (const MetricSample& m : samples) {
+        if (m.name != name || m.kind != MetricKind::HISTOGRAM) continue;
+        if (out.buckets.empty()) { out = m; out.ue = METRIC_NO_UE; out.bearer = METRIC_NO_BEARER; continue; }
+        if (m.bounds != out.bounds) continue;
+        for (size_t b = 0; b < out.buckets.size(); b++) out.buckets[b] += m.buckets[b];
+        out.sum   += m.sum;
+        out.count += m.count;
+    }
+    return out;
+}
+void MetricsSnapshot::write(std::ostream& out, MetricsFormat fmt) const {
+    if (fmt == MetricsFormat::JSON) write_json(out);
+    else                            write_prometheus(out);
+}
+static const char* kind_str(MetricKind k) {
+    switch (k) {
+        case MetricKind::COUNTER:   return "counter";
+        case MetricKind::GAUGE:     return "gauge";
+        case MetricKind::HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+// {layer="MAC",ue="17921",bearer="4"} plus an optional le label.
+static void write_labels(std::ostream& out, const MetricSample& m, const char* le = nullptr) {
+    out << "{layer=\"" << m.layer << '"';
+    if (m.ue != METRIC_NO_UE)         out << ",ue=\"" << m.ue << '"';
+    if (m.bearer != METRIC_NO_BEARER) out << ",bearer=\"" << (int)m.bearer << '"';
+    if (le) out << ",le=\"" << le << '"';
+    out << '}';
+}
+void MetricsSnapshot::write_prometheus(std::ostream& out) const {
+    // Series of one metric have to be contiguous.
+    std::vector<const MetricSample*> order;
+    for (const MetricSample& m : samples) order.push_back(&m);
+    std::stable_sort(order.begin(), order.end(),
+                     [](const MetricSample* a, const MetricSample* b) { return a->name < b->name; });
+    const std::string* last = nullptr;
+    for (const MetricSample* m : order) {
+        if (!last || *last != m->name) out << "# TYPE " << m->name << ' ' << kind_str(m->kind) << '\n';
+        last = &m->name;
+        if (m->kind != MetricKind::HISTOGRAM) {
+            out << m->name;
+            write_labels(out, *m);
+            out << ' ' << m->value << '\n';
+            continue;
+        }
+        uint64_t cum = 0;
+        for (size_t b = 0; b < m->buckets.size(); b++) {
+            cum += m->buckets[b];
+            std::string le = b < m->bounds.size() ? std::to_string(m->bounds[b]) : "+Inf";
+            out << m->name << "_bucket";
+            write_labels(out, *m, le.c_str());
+            out << ' ' << cum << '\n';
+        }
+        out << m->name << "_sum";
+        write_labels(out, *m);
+        out << ' ' << m->sum << '\n' << m->name << "_count";
+        write_labels(out, *m);
+        out << ' ' << m->count << '\n';
+    }
+}
+void MetricsSnapshot::write_json(std::ostream& out) const {
+    out << "{\"timestamp_ms\":" << taken_ns / 1000000 << ",\"metrics\":[";
+    for (size_t i = 0; i < samples.size(); i++) {
+        const MetricSample& m = samples[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << m.name << "\",\"layer\":\"" << m.layer << '"';
+        if (m.ue != METRIC_NO_UE)         out << ",\"ue\":" << m.ue;
+        if (m.bearer != METRIC_NO_BEARER) out << ",\"bearer\":" << (int)m.bearer;
+        out << ",\"type\":\"" << kind_str(m.kind) << '"';
+        if (m.kind != MetricKind::HISTOGRAM) { out << ",\"value\":" << m.value << '}'; continue; }
+        out << ",\"bounds\":[";
+        for (size_t b = 0; b < m.bounds.size(); b++) out << (b ? "," : "") << m.bounds[b];
+        out << "],\"counts\":[";
+        for (size_t b = 0; b < m.buckets.size(); b++) out << (b ? "," : "") << m.buckets[b];
+        out << "],\"sum\":" << m.sum << ",\"count\":" << m.count << '}';
+    }
+    out << "\n]}\n";
+}
@@ -0,0 +1,240 @@
+#include "pcap_capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+namespace {
+constexpr size_t   IP_UDP_LEN   = 28;
+constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+inline size_t pad4(size_t n) { return (n + 3) & ~(size_t)3; }
+inline uint8_t* put16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; return p + 2; }
+inline uint8_t* put_str(uint8_t* p, const char* s) { size_t n = std::strlen(s); std::memcpy(p, s, n); return p + n; }
+uint16_t ip_checksum(const uint8_t* h) {
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2) sum += (uint32_t)((h[i] << 8) | h[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+// IPv4 127.0.0.1 -> 127.0.0.2, UDP PCAP_UDP_PORT both ways, no UDP checksum.
+void put_ip_udp(uint8_t* p, size_t payload) {
+    size_t ip_len = std::min(IP_UDP_LEN + payload, (size_t)0xFFFF);
+    std::memset(p, 0, IP_UDP_LEN);
+    p[0] = 0x45;
+    put16(p + 2, (uint16_t)ip_len);
+    p[6] = 0x40;                       // DF
+    p[8] = 64;
+    p[9] = 17;
+    p[12] = 127; p[15] = 1;
+    p[16] = 127; p[19] = 2;
+    put16(p + 10, ip_checksum(p));
+    put16(p + 20, PCAP_UDP_PORT);
+    put16(p + 22, PCAP_UDP_PORT);
+    put16(p + 24, (uint16_t)(ip_len - 20));
+}
+inline uint8_t dir_of(const PcapContext& ctx, bool tx) {
+    return (uint8_t)(tx ? ctx.tx_dir
+                        : ctx.tx_dir == PcapDirection::DOWNLINK ? PcapDirection::UPLINK : PcapDirection::DOWNLINK);
+}
+}
+
+PcapThreadRing::PcapThreadRing(size_t bytes, uint32_t gen)
+    : buf(new uint8_t[pad4(bytes)]), cap(pad4(bytes)), gen(gen) {}
+// Offsets stay in [0, cap]; a record that does not fit before the end goes
+// to the start, behind a zero length prefix when there is room for one. The
+// reader also wraps when fewer than 4 bytes are left.
+uint8_t* PcapThreadRing::claim(size_t len) {
+    size_t need = 4 + pad4(len);
+    size_t t    = tail.load(std::memory_order_relaxed);
+    for (int pass = 0; pass < 2; pass++) {
+        size_t h = head_cache;
+        if (t >= h) {
+            if (t + need <= cap) { claimed = t + need; break; }
+            if (need < h) {
+                if (t + 4 <= cap) std::memset(buf.get() + t, 0, 4);
+                t = 0;
+                claimed = need;
+                break;
+            }
+        } else if (t + need < h) {
+            claimed = t + need;
+            break;
+        }
+        if (pass) { dropped.fetch_add(1, std::memory_order_relaxed); return nullptr; }
+        head_cache = head.load(std::memory_order_acquire);
+    }
+    uint32_t l = (uint32_t)len;
+    std::memcpy(buf.get() + t, &l, 4);
+    frames.fetch_add(1, std::memory_order_relaxed);
+    return buf.get() + t + 4;
+}
+
+PcapCapture::~PcapCapture() { stop(); }
+PcapThreadRing& PcapCapture::local_ring() {
+    thread_local std::shared_ptr<PcapThreadRing> ring;
+    if (!ring || ring->gen != gen_) {
+        ring = std::make_shared<PcapThreadRing>(cfg_.ring_bytes, gen_);
+        std::lock_guard<std::mutex> lk(rings_mu_);
+        rings_.push_back(ring);
+    }
+    return *ring;
+}
+Status PcapCapture::start(const PcapConfig& cfg) {
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    if (file_) return Status::INVALID_STATE;
+    FILE* f = std::fopen(cfg.path.c_str(), "wb");
+    if (!f) return Status::ERROR;
+    uint8_t  gh[24];
+    uint32_t magic = PCAP_MAGIC_NS, snap = cfg.snaplen, link = PCAP_LINKTYPE_IPV4, zero = 0;
+    uint16_t major = 2, minor = 4;
+    std::memcpy(gh, &magic, 4);
+    std::memcpy(gh + 4, &major, 2);
+    std::memcpy(gh + 6, &minor, 2);
+    std::memcpy(gh + 8, &zero, 4);
+    std::memcpy(gh + 12, &zero, 4);
+    std::memcpy(gh + 16, &snap, 4);
+    std::memcpy(gh + 20, &link, 4);
+    std::fwrite(gh, 1, sizeof(gh), f);
+    cfg_  = cfg;
+    file_ = f;
+    rings_.clear();
+    gen_++;
+    bytes_written_.store(sizeof(gh));
+    writes_.store(1);
+    for (auto& w : ue_mask_) w.store(cfg.ues.empty() ? ~0ull : 0, std::memory_order_relaxed);
+    for (uint16_t ue : cfg.ues) ue_mask_[ue >> 6].fetch_or(1ull << (ue & 63), std::memory_order_relaxed);
+    stopping_.store(false);
+    writer_ = std::thread([this] {
+        // Batches go out once half full, or when their oldest frame is
+        // PCAP_FLUSH_MS old.
+        std::vector<uint8_t> out;
+        out.reserve(cfg_.write_bytes);
+        auto last = std::chrono::steady_clock::now();
+        while (!stopping_.load(std::memory_order_acquire)) {
+            size_t n   = drain(out);
+            auto   now = std::chrono::steady_clock::now();
+            if (out.empty()) last = now;
+            if (out.size() >= cfg_.write_bytes / 2 || now - last >= std::chrono::milliseconds(PCAP_FLUSH_MS)) {
+                if (!out.empty()) flush(out);
+                last = now;
+            }
+            if (n < cfg_.write_bytes / 4) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!out.empty()) flush(out);
+    });
+    layers_.store(cfg.layers, std::memory_order_release);
+    return Status::OK;
+}
+void PcapCapture::stop() {
+    if (!running()) return;
+    layers_.store(0, std::memory_order_release);
+    stopping_.store(true, std::memory_order_release);
+    if (writer_.joinable()) writer_.join();
+    // A producer that passed wants() just before layers_ went to zero may
+    // still publish afterwards; that frame is lost.
+    std::vector<uint8_t> out;
+    while (drain(out)) flush(out);
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+// Appends whole records from every ring to out while it holds less than
+// write_bytes (an empty out takes at least one). Returns the bytes added.
+size_t PcapCapture::drain(std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    std::vector<std::shared_ptr<PcapThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lk(rings_mu_);
+        rings = rings_;
+    }
+    for (auto& r : rings) {
+        size_t h = r->head.load(std::memory_order_relaxed);
+        size_t t = r->tail.load(std::memory_order_acquire);
+        while (h != t) {
+            uint32_t len = 0;
+            if (h + 4 <= r->cap) std::memcpy(&len, r->buf.get() + h, 4);
+            if (len == 0) { h = 0; continue; }
+            if (!out.empty() && out.size() + len > cfg_.write_bytes) break;
+            out.insert(out.end(), r->buf.get() + h + 4, r->buf.get() + h + 4 + len);
+            h += 4 + pad4(len);
+        }
+        r->head.store(h, std::memory_order_release);
+        if (out.size() >= cfg_.write_bytes) break;
+    }
+    return out.size() - start;
+}
+void PcapCapture::flush(std::vector<uint8_t>& out) {
+    std::fwrite(out.data(), 1, out.size(), file_);
+    bytes_written_.fetch_add(out.size(), std::memory_order_relaxed);
+    writes_.fetch_add(1, std::memory_order_relaxed);
+    out.clear();
+}
+PcapStats PcapCapture::stats() const {
+    PcapStats s;
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    for (auto& r : rings_) {
+        s.frames  += r->frames.load(std::memory_order_relaxed);
+        s.dropped += r->dropped.load(std::memory_order_relaxed);
+    }
+    s.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+    s.writes        = writes_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void PcapCapture::frame(uint8_t layer, const PcapContext& ctx, const uint8_t* hdr, size_t hdr_len,
+                        const uint8_t* pdu, size_t len) {
+    if (!wants((PcapLayer)layer, ctx.ueid)) return;
+    size_t orig   = IP_UDP_LEN + hdr_len + len;
+    size_t caplen = std::min(orig, (size_t)cfg_.snaplen);
+    PcapThreadRing& r = local_ring();
+    uint8_t* p = r.claim(16 + caplen);
+    if (!p) return;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::system_clock::now().time_since_epoch()).count();
+    uint32_t rh[4] = { (uint32_t)(ns / 1000000000), (uint32_t)(ns % 1000000000),
+                       (uint32_t)caplen, (uint32_t)orig };
+    std::memcpy(p, rh, 16);
+    put_ip_udp(p + 16, hdr_len + len);
+    uint8_t* q    = p + 16 + IP_UDP_LEN;
+    size_t   room = caplen - IP_UDP_LEN;
+    size_t   h    = std::min(hdr_len, room);
+    std::memcpy(q, hdr, h);
+    if (room > h) std::memcpy(q + h, pdu, std::min(len, room - h));
+    r.publish();
+}
+// mac-nr: radioType, direction, rntiType, then RNTI, UEID and HARQ ID tags.
+void PcapCapture::mac(const PcapContext& ctx, bool tx, const uint8_t* pdu, size_t len, uint8_t harq_id) {
+    uint8_t hdr[32], *p = put_str(hdr, "mac-nr");
+    *p++ = 1;                          // FDD
+    *p++ = dir_of(ctx, tx);
+    *p++ = 3;                          // C-RNTI
+    *p++ = 0x02; p = put16(p, ctx.rnti);
+    *p++ = 0x03; p = put16(p, ctx.ueid);
+    if (harq_id != 0xFF) { *p++ = 0x06; *p++ = harq_id; }
+    *p++ = 0x01;
+    frame(PCAP_MAC, ctx, hdr, (size_t)(p - hdr), pdu, len);
+}
+// rlc-nr: mode, SN length, then direction, UEID, bearer type and ID tags.
+void PcapCapture::rlc(const PcapContext& ctx, bool tx, uint8_t rlc_mode, uint8_t sn_bits,
+                      const uint8_t* pdu, size_t len) {
+    uint8_t hdr[32], *p = put_str(hdr, "rlc-nr");
+    *p++ = rlc_mode;
+    *p++ = rlc_mode == PCAP_RLC_TM ? 0 : sn_bits;
+    *p++ = 0x02; *p++ = dir_of(ctx, tx);
+    *p++ = 0x03; p = put16(p, ctx.ueid);
+    *p++ = 0x04; *p++ = ctx.srb ? 4 : 5;
+    *p++ = 0x05; *p++ = ctx.bearer;
+    *p++ = 0x01;
+    frame(PCAP_RLC, ctx, hdr, (size_t)(p - hdr), pdu, len);
+}
+// pdcp-nr: plane, then SN length, direction, bearer type (SRBs), bearer ID
+// and UEID tags.
+void PcapCapture::pdcp(const PcapContext& ctx, bool tx, uint8_t sn_bits, const uint8_t* pdu, size_t len) {
+    uint8_t hdr[32], *p = put_str(hdr, "pdcp-nr");
+    *p++ = ctx.srb ? 1 : 2;            // signalling or user plane
+    *p++ = 0x02; *p++ = sn_bits;
+    *p++ = 0x03; *p++ = dir_of(ctx, tx);
+    if (ctx.srb) { *p++ = 0x04; *p++ = 1; }   // DCCH
+    *p++ = 0x05; *p++ = ctx.bearer;
+    *p++ = 0x06; p = put16(p, ctx.ueid);
+    *p++ = 0x01;
+    frame(PCAP_PDCP, ctx, hdr, (size_t)(p - hdr), pdu, len);
+}
@@ -0,0 +1,128 @@
+#include "pdu_buffer.h"
+#include <new>
+namespace {
+constexpr size_t   POOL_CLASS_SIZE[] = {2048, 16384};
+constexpr size_t   POOL_NUM_CLASSES  = sizeof(POOL_CLASS_SIZE) / sizeof(POOL_CLASS_SIZE[0]);
+constexpr size_t   POOL_MAX_CACHED   = 8192;
+constexpr uint8_t  HEAP_CLASS        = 0xFF;
+struct FreeList {
+    PduStorage* head  = nullptr;
+    size_t      count = 0;
+    ~FreeList() {
+        while (head) { PduStorage* n = *reinterpret_cast<PduStorage**>(head->bytes()); ::operator delete(head); head = n; }
+    }
+};
+struct ThreadPool {
+    FreeList     lists[POOL_NUM_CLASSES];
+    PduPoolStats stats;
+};
+ThreadPool& local_pool() { thread_local ThreadPool pool; return pool; }
+size_t class_capacity(size_t cls) { return POOL_CLASS_SIZE[cls] - sizeof(PduStorage); }
+}
+PduStorage* PduPool::acquire(size_t capacity) {
+    ThreadPool& tp = local_pool();
+    tp.stats.allocs++;
+    for (size_t cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+        if (capacity > class_capacity(cls)) continue;
+        FreeList& fl = tp.lists[cls];
+        PduStorage* st = fl.head;
+        if (st) {
+            fl.head = *reinterpret_cast<PduStorage**>(st->bytes());
+            fl.count--;
+        } else {
+            tp.stats.heap_allocs++;
+            st = static_cast<PduStorage*>(::operator new(POOL_CLASS_SIZE[cls]));
+        }
+        new (st) PduStorage{{1}, (uint32_t)class_capacity(cls), 0, 0, (uint8_t)cls};
+        return st;
+    }
+    tp.stats.heap_allocs++;
+    PduStorage* st = static_cast<PduStorage*>(::operator new(sizeof(PduStorage) + capacity));
+    new (st) PduStorage{{1}, (uint32_t)capacity, 0, 0, HEAP_CLASS};
+    return st;
+}
+void PduPool::release(PduStorage* st) {
+    if (st->size_class != HEAP_CLASS) {
+        FreeList& fl = local_pool().lists[st->size_class];
+        if (fl.count < POOL_MAX_CACHED) {
+            *reinterpret_cast<PduStorage**>(st->bytes()) = fl.head;
+            fl.head = st;
+            fl.count++;
+            return;
+        }
+    }
+    st->~PduStorage();
+    ::operator delete(st);
+}
+void PduPool::reserve(size_t count, size_t capacity) {
+    std::vector<PduStorage*> tmp;
+    tmp.reserve(count);
+    for (size_t i = 0; i < count; i++) tmp.push_back(acquire(capacity));
+    for (PduStorage* st : tmp) release(st);
+}
+PduPoolStats PduPool::stats()       { return local_pool().stats; }
+void         PduPool::reset_stats() { local_pool().stats = PduPoolStats(); }
+
+PduBuffer PduBuffer::alloc(size_t len, size_t headroom, size_t tailroom) {
+    PduBuffer b;
+    b.st_  = PduPool::acquire(headroom + len + tailroom);
+    b.off_ = (uint32_t)headroom;
+    b.len_ = (uint32_t)len;
+    b.st_->claimed_lo = b.off_;
+    b.st_->claimed_hi = b.off_ + b.len_;
+    return b;
+}
+PduBuffer PduBuffer::from(const uint8_t* p, size_t len, size_t headroom) {
+    PduBuffer b = alloc(len, headroom);
+    if (len) std::memcpy(b.data(), p, len);
+    return b;
+}
+void PduBuffer::reset() {
+    if (st_ && st_->refcnt.fetch_sub(1, std::memory_order_acq_rel) == 1) PduPool::release(st_);
+    st_ = nullptr; off_ = len_ = 0;
+}
+void PduBuffer::realloc_copy(size_t headroom, size_t tailroom) {
+    PduBuffer b = alloc(len_, headroom, tailroom);
+    if (len_) std::memcpy(b.data(), data(), len_);
+    PduPoolStats& s = local_pool().stats;
+    s.copies++;
+    s.copy_bytes += len_;
+    swap(b);
+}
+uint8_t* PduBuffer::prepend(size_t n) {
+    if (!st_) { *this = alloc(n); return data(); }
+    bool sole = !shared();
+    if (off_ < n || (!sole && st_->claimed_lo != off_)) {
+        realloc_copy(std::max<size_t>(n, PDU_DEFAULT_HEADROOM), std::max<size_t>(tailroom(), PDU_DEFAULT_TAILROOM));
+        sole = true;
+    }
+    off_ -= (uint32_t)n;
+    len_ += (uint32_t)n;
+    if (sole || off_ < st_->claimed_lo) st_->claimed_lo = off_;
+    if (sole) st_->claimed_hi = off_ + len_;
+    return data();
+}
+uint8_t* PduBuffer::append(size_t n) {
+    if (!st_) { *this = alloc(0, PDU_DEFAULT_HEADROOM, n); }
+    bool sole = !shared();
+    if (tailroom() < n || (!sole && st_->claimed_hi != off_ + len_)) {
+        realloc_copy(off_, std::max<size_t>(n, PDU_DEFAULT_TAILROOM));
+        sole = true;
+    }
+    uint8_t* p = data() + len_;
+    len_ += (uint32_t)n;
+    if (sole || off_ + len_ > st_->claimed_hi) st_->claimed_hi = off_ + len_;
+    if (sole) st_->claimed_lo = off_;
+    return p;
+}
+PduBuffer PduBuffer::slice(size_t off, size_t len) const {
+    PduBuffer b(*this);
+    if (off > len_) off = len_;
+    if (len > len_ - off) len = len_ - off;
+    b.off_ += (uint32_t)off;
+    b.len_  = (uint32_t)len;
+    return b;
+}
+void PduBuffer::make_writable() {
+    if (shared()) realloc_copy(off_, tailroom());
+}
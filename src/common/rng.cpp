@@ -0,0 +1,129 @@
+#include "rng.h"
+#include <immintrin.h>
+#include <atomic>
+namespace {
+constexpr uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;
+std::atomic<uint64_t> g_seed{0x5EEDC0DE5EEDC0DEull};
+}
+Philox4x32::Philox4x32(uint64_t seed, uint64_t stream) {
+    key_[0] = (uint32_t)seed;
+    key_[1] = (uint32_t)(seed >> 32);
+    ctr_[0] = ctr_[1] = 0;
+    ctr_[2] = (uint32_t)stream;
+    ctr_[3] = (uint32_t)(stream >> 32);
+}
+void Philox4x32::block(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+void Philox4x32::refill() {
+    block(ctr_, key_, buf_);
+    if (++ctr_[0] == 0) ctr_[1]++;
+    idx_ = 0;
+}
+namespace {
+// Eight blocks per register, lane j holding counter ctr + j; the 32x32->64
+// bit products come from the even and odd lanes of VPMULUDQ.
+__attribute__((target("avx2")))
+inline void mulhilo8(__m256i a, __m256i m, __m256i& hi, __m256i& lo) {
+    __m256i even = _mm256_mul_epu32(a, m);
+    __m256i odd  = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+// Two groups of eight blocks per call so the dependent multiply chains of
+// one group hide the latency of the other.
+__attribute__((target("avx2")))
+void philox16_avx2(const uint32_t ctr[4], const uint32_t key[2], uint32_t* out) {
+    constexpr int G = 2;
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN), base = _mm256_set1_epi32((int)ctr[0]);
+    __m256i c0[G], c1[G], c2[G], c3[G];
+    for (int g = 0; g < G; g++) {
+        c0[g] = _mm256_add_epi32(base, _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        c0[g] = _mm256_add_epi32(c0[g], _mm256_set1_epi32(8 * g));
+        // Carry into ctr[1] for lanes whose low word wrapped.
+        __m256i wrap = _mm256_cmpgt_epi32(_mm256_xor_si256(base, bias), _mm256_xor_si256(c0[g], bias));
+        c1[g] = _mm256_sub_epi32(_mm256_set1_epi32((int)ctr[1]), wrap);
+        c2[g] = _mm256_set1_epi32((int)ctr[2]);
+        c3[g] = _mm256_set1_epi32((int)ctr[3]);
+    }
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0), m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++) {
+        const __m256i vk0 = _mm256_set1_epi32((int)k0), vk1 = _mm256_set1_epi32((int)k1);
+        for (int g = 0; g < G; g++) {
+            __m256i hi0, lo0, hi1, lo1;
+            mulhilo8(c0[g], m0, hi0, lo0);
+            mulhilo8(c2[g], m1, hi1, lo1);
+            c0[g] = _mm256_xor_si256(_mm256_xor_si256(hi1, c1[g]), vk0);
+            c2[g] = _mm256_xor_si256(_mm256_xor_si256(hi0, c3[g]), vk1);
+            c1[g] = lo1;
+            c3[g] = lo0;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    // 4x8 transpose into block order.
+    for (int g = 0; g < G; g++) {
+        __m256i t0 = _mm256_unpacklo_epi32(c0[g], c1[g]), t1 = _mm256_unpackhi_epi32(c0[g], c1[g]);
+        __m256i t2 = _mm256_unpacklo_epi32(c2[g], c3[g]), t3 = _mm256_unpackhi_epi32(c2[g], c3[g]);
+        __m256i b0 = _mm256_unpacklo_epi64(t0, t2), b1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i b2 = _mm256_unpacklo_epi64(t1, t3), b3 = _mm256_unpackhi_epi64(t1, t3);
+        uint32_t* o = out + 32 * g;
+        _mm256_storeu_si256((__m256i*)o,        _mm256_permute2x128_si256(b0, b1, 0x20));
+        _mm256_storeu_si256((__m256i*)(o + 8),  _mm256_permute2x128_si256(b2, b3, 0x20));
+        _mm256_storeu_si256((__m256i*)(o + 16), _mm256_permute2x128_si256(b0, b1, 0x31));
+        _mm256_storeu_si256((__m256i*)(o + 24), _mm256_permute2x128_si256(b2, b3, 0x31));
+    }
+}
+bool cpu_has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+}
+void Philox4x32::fill(uint32_t* out, size_t n) {
+    size_t i = 0;
+    while (i < n && idx_ < 4) out[i++] = buf_[idx_++];
+    if (cpu_has_avx2())
+        for (; i + 64 <= n; i += 64) {
+            philox16_avx2(ctr_, key_, out + i);
+            uint32_t prev = ctr_[0];
+            ctr_[0] += 16;
+            if (ctr_[0] < prev) ctr_[1]++;
+        }
+    // Remaining whole blocks straight into the output; blocks are independent
+    // so the compiler can overlap the multiply chains.
+    for (; i + 4 <= n; i += 4) {
+        block(ctr_, key_, out + i);
+        if (++ctr_[0] == 0) ctr_[1]++;
+    }
+    while (i < n) out[i++] = next_u32();
+}
+void Philox4x32::seek(uint64_t block_index) {
+    ctr_[0] = (uint32_t)block_index;
+    ctr_[1] = (uint32_t)(block_index >> 32);
+    idx_ = 4;
+}
+uint64_t rng_stream(RngDomain domain, uint64_t id) {
+    // splitmix64 finaliser over (domain, id).
+    uint64_t z = id + 0x9E3779B97F4A7C15ull * ((uint64_t)domain + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+void     rng_set_seed(uint64_t seed) { g_seed.store(seed, std::memory_order_relaxed); }
+uint64_t rng_seed() { return g_seed.load(std::memory_order_relaxed); }
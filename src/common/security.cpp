@@ -0,0 +1,163 @@
+#include "security.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+namespace {
+inline void store_be32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+inline uint32_t load_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+// COUNT || BEARER || DIRECTION || 0^26: the first 64 bits of both the NEA2
+// counter block and the NIA2 message.
+inline void put_iv(uint8_t* p, uint32_t count, uint8_t bearer, uint8_t direction) {
+    store_be32(p, count);
+    p[4] = (uint8_t)(((bearer & 0x1F) << 3) | ((direction & 0x01) << 2));
+    p[5] = p[6] = p[7] = 0;
+}
+inline void xor_block(uint8_t* dst, const uint8_t* ks, size_t n, uint8_t last_mask) {
+    if (n == 16 && last_mask == 0xFF) {
+        uint64_t d[2], k[2];
+        std::memcpy(d, dst, 16); std::memcpy(k, ks, 16);
+        d[0] ^= k[0]; d[1] ^= k[1];
+        std::memcpy(dst, d, 16);
+        return;
+    }
+    for (size_t i = 0; i + 1 < n; i++) dst[i] ^= ks[i];
+    dst[n - 1] ^= ks[n - 1] & last_mask;
+}
+
+// NEA2 = AES-CTR. Long PDUs run whole groups of AES_LANES blocks through the
+// same-key CTR kernel; the leftover and short-PDU blocks from all jobs are
+// packed AES_LANES at a time so short PDUs still keep every lane busy.
+void nea2_batch(CipherJob* jobs, size_t n) {
+    const Aes128Key* keys[AES_LANES];
+    alignas(16) uint8_t ks[AES_LANES][16];
+    uint8_t* dst[AES_LANES];
+    size_t   len[AES_LANES];
+    uint8_t  mask[AES_LANES];
+    size_t   lanes = 0;
+    auto flush = [&]() {
+        aes128_encrypt_lanes(keys, ks, lanes);
+        for (size_t l = 0; l < lanes; l++) xor_block(dst[l], ks[l], len[l], mask[l]);
+        lanes = 0;
+    };
+    for (size_t j = 0; j < n; j++) {
+        const CipherJob& job = jobs[j];
+        size_t  bytes     = (job.bits + 7) / 8;
+        uint8_t tail_mask = (job.bits & 7) ? (uint8_t)(0xFF << (8 - (job.bits & 7))) : 0xFF;
+        size_t  bulk      = (bytes / 16) / AES_LANES * AES_LANES;
+        if (bulk && (bytes % 16 || tail_mask == 0xFF)) {
+            uint8_t iv[16] = {};
+            put_iv(iv, job.count, job.bearer, job.direction);
+            aes128_ctr_xor(*job.key, iv, 0, job.data, bulk);
+        } else {
+            bulk = 0;
+        }
+        for (size_t off = bulk * 16, blk = bulk; off < bytes; off += 16, blk++) {
+            uint8_t* c = ks[lanes];
+            put_iv(c, job.count, job.bearer, job.direction);
+            store_be32(c + 8, (uint32_t)((uint64_t)blk >> 32));
+            store_be32(c + 12, (uint32_t)blk);
+            keys[lanes] = job.key;
+            dst[lanes]  = job.data + off;
+            len[lanes]  = std::min<size_t>(16, bytes - off);
+            mask[lanes] = off + 16 >= bytes ? tail_mask : 0xFF;
+            if (++lanes == AES_LANES) flush();
+        }
+    }
+    if (lanes) flush();
+}
+
+// NIA2 = AES-CMAC over IV || message, truncated to 32 bits. CMAC is serial
+// within a message, so up to AES_LANES messages are chained side by side and a
+// lane is refilled from the job list as soon as its message finishes.
+struct MacLane {
+    IntegJob* job;
+    size_t    blk;
+    size_t    nblk;
+};
+inline size_t nia2_blocks(size_t bits) { return (64 + bits + 127) / 128; }
+void nia2_absorb(const MacLane& lane, uint8_t x[16]) {
+    const IntegJob& job = *lane.job;
+    uint8_t m[16];
+    if (lane.blk + 1 < lane.nblk) {
+        if (lane.blk == 0) { put_iv(m, job.count, job.bearer, job.direction); std::memcpy(m + 8, job.data, 8); }
+        else std::memcpy(m, job.data + lane.blk * 16 - 8, 16);
+        for (int i = 0; i < 16; i++) x[i] ^= m[i];
+        return;
+    }
+    uint8_t iv[8];
+    put_iv(iv, job.count, job.bearer, job.direction);
+    size_t data_bytes = (job.bits + 7) / 8;
+    for (size_t i = 0; i < 16; i++) {
+        size_t v = lane.blk * 16 + i;
+        m[i] = v < 8 ? iv[v] : (v - 8 < data_bytes ? job.data[v - 8] : 0);
+    }
+    size_t rem = 64 + job.bits - lane.blk * 128;
+    const uint8_t* sub = job.key->k1;
+    if (rem < 128) {
+        size_t byte = rem / 8, bit = rem % 8;
+        m[byte] = (uint8_t)((m[byte] & (0xFF00 >> bit)) | (0x80 >> bit));
+        std::memset(m + byte + 1, 0, 15 - byte);
+        sub = job.key->k2;
+    }
+    for (int i = 0; i < 16; i++) x[i] ^= m[i] ^ sub[i];
+}
+void nia2_batch(IntegJob* jobs, size_t n) {
+    MacLane          lane[AES_LANES];
+    const Aes128Key* keys[AES_LANES];
+    alignas(16) uint8_t x[AES_LANES][16];
+    size_t active = 0, next = 0;
+    auto load = [&](size_t l) {
+        if (next == n) return false;
+        lane[l] = {&jobs[next], 0, nia2_blocks(jobs[next].bits)};
+        keys[l] = &jobs[next].key->key;
+        std::memset(x[l], 0, 16);
+        next++;
+        return true;
+    };
+    while (active < AES_LANES && load(active)) active++;
+    while (active) {
+        // While every lane is inside its message body, advance all of them
+        // together with the state held in registers.
+        size_t run = SIZE_MAX;
+        for (size_t l = 0; l < active && run; l++) {
+            const MacLane& ln = lane[l];
+            run = (ln.blk == 0 || ln.blk + 1 >= ln.nblk) ? 0 : std::min(run, ln.nblk - 1 - ln.blk);
+        }
+        if (run) {
+            const uint8_t* ptr[AES_LANES];
+            for (size_t l = 0; l < active; l++) ptr[l] = lane[l].job->data + lane[l].blk * 16 - 8;
+            aes128_cbc_mac_lanes(keys, x, ptr, active, run);
+            for (size_t l = 0; l < active; l++) lane[l].blk += run;
+            continue;
+        }
+        for (size_t l = 0; l < active; l++) nia2_absorb(lane[l], x[l]);
+        aes128_encrypt_lanes(keys, x, active);
+        for (size_t l = 0; l < active;) {
+            if (++lane[l].blk < lane[l].nblk) { l++; continue; }
+            lane[l].job->mac = load_be32(x[l]);
+            if (load(l)) { l++; continue; }
+            if (l != --active) {
+                lane[l] = lane[active];
+                keys[l] = keys[active];
+                std::memcpy(x[l], x[active], 16);
+            }
+        }
+    }
+}
+}
+void cipher_batch(CipherAlg alg, CipherJob* jobs, size_t n) {
+    if (alg == CipherAlg::NEA2) nea2_batch(jobs, n);
+}
+void integ_batch(IntegAlg alg, IntegJob* jobs, size_t n) {
+    if (alg == IntegAlg::NIA2) { nia2_batch(jobs, n); return; }
+    for (size_t i = 0; i < n; i++) jobs[i].mac = 0;
+}
+void nea2(const Aes128Key& key, uint32_t count, uint8_t bearer, uint8_t direction, uint8_t* data, size_t bits) {
+    CipherJob job{&key, count, bearer, direction, data, bits};
+    nea2_batch(&job, 1);
+}
+uint32_t nia2(const Aes128Cmac& key, uint32_t count, uint8_t bearer, uint8_t direction, const uint8_t* data, size_t bits) {
+    IntegJob job{&key, count, bearer, direction, data, bits, 0};
+    nia2_batch(&job, 1);
+    return job.mac;
+}
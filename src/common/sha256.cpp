@@ -0,0 +1,153 @@
+#include "sha256.h"
+#include <cstring>
+#include <immintrin.h>
+namespace {
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+inline uint32_t load_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+inline void store_be32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+void scalar_compress(uint32_t h[8], const uint8_t* data, size_t nblocks) {
+    for (; nblocks; nblocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = load_be32(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+}
+
+// SHA-NI keeps the state as ABEF/CDGH halves; each SHA256RNDS2 does two
+// rounds and MSG1/MSG2 extend the schedule four words at a time.
+__attribute__((target("sha,sse4.1")))
+void shani_compress(uint32_t h[8], const uint8_t* data, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)), 0xB1);
+    __m128i st1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + 4)), 0x1B);
+    __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);
+    st1 = _mm_blend_epi16(st1, tmp, 0xF0);
+    for (; nblocks; nblocks--, data += 64) {
+        __m128i save0 = st0, save1 = st1;
+        __m128i w[4];
+        #pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            __m128i m;
+            if (i < 4) {
+                m = w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), bswap);
+            } else {
+                __m128i x = _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+                                          _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                m = w[i & 3] = _mm_sha256msg2_epu32(x, w[(i + 3) & 3]);
+            }
+            m   = _mm_add_epi32(m, _mm_load_si128(reinterpret_cast<const __m128i*>(K + 4 * i)));
+            st1 = _mm_sha256rnds2_epu32(st1, st0, m);
+            st0 = _mm_sha256rnds2_epu32(st0, st1, _mm_shuffle_epi32(m, 0x0E));
+        }
+        st0 = _mm_add_epi32(st0, save0);
+        st1 = _mm_add_epi32(st1, save1);
+    }
+    tmp = _mm_shuffle_epi32(st0, 0x1B);
+    st1 = _mm_shuffle_epi32(st1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm_blend_epi16(tmp, st1, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 4), _mm_alignr_epi8(st1, tmp, 8));
+}
+
+struct ShaKernel {
+    const char* name;
+    void (*compress)(uint32_t*, const uint8_t*, size_t);
+};
+const ShaKernel SCALAR_KERNEL = {"scalar", scalar_compress};
+const ShaKernel SHANI_KERNEL  = {"shani",  shani_compress};
+bool cpu_has_shani() { return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"); }
+const ShaKernel*& active_kernel() {
+    static const ShaKernel* k = cpu_has_shani() ? &SHANI_KERNEL : &SCALAR_KERNEL;
+    return k;
+}
+}
+void sha256_init(Sha256Ctx& ctx) {
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    std::memcpy(ctx.h, iv, sizeof(iv));
+    ctx.len = 0;
+}
+void sha256_update(Sha256Ctx& ctx, const uint8_t* data, size_t len) {
+    size_t fill = ctx.len % 64;
+    ctx.len += len;
+    if (fill) {
+        size_t take = len < 64 - fill ? len : 64 - fill;
+        std::memcpy(ctx.buf + fill, data, take);
+        data += take; len -= take;
+        if (fill + take < 64) return;
+        active_kernel()->compress(ctx.h, ctx.buf, 1);
+    }
+    if (len >= 64) {
+        active_kernel()->compress(ctx.h, data, len / 64);
+        data += len & ~(size_t)63;
+        len  &= 63;
+    }
+    std::memcpy(ctx.buf, data, len);
+}
+void sha256_final(Sha256Ctx& ctx, uint8_t out[32]) {
+    uint64_t bits = ctx.len * 8;
+    size_t   fill = ctx.len % 64;
+    ctx.buf[fill++] = 0x80;
+    if (fill > 56) {
+        std::memset(ctx.buf + fill, 0, 64 - fill);
+        active_kernel()->compress(ctx.h, ctx.buf, 1);
+        fill = 0;
+    }
+    std::memset(ctx.buf + fill, 0, 56 - fill);
+    store_be32(ctx.buf + 56, (uint32_t)(bits >> 32));
+    store_be32(ctx.buf + 60, (uint32_t)bits);
+    active_kernel()->compress(ctx.h, ctx.buf, 1);
+    for (int i = 0; i < 8; i++) store_be32(out + 4 * i, ctx.h[i]);
+}
+void sha256(const uint8_t* data, size_t len, uint8_t out[32]) {
+    Sha256Ctx ctx;
+    sha256_init(ctx);
+    sha256_update(ctx, data, len);
+    sha256_final(ctx, out);
+}
+void hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* msg, size_t len, uint8_t out[32]) {
+    uint8_t k[64] = {};
+    if (key_len > 64) sha256(key, key_len, k);
+    else std::memcpy(k, key, key_len);
+    uint8_t pad[64];
+    Sha256Ctx ctx;
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+    sha256_init(ctx);
+    sha256_update(ctx, pad, 64);
+    sha256_update(ctx, msg, len);
+    sha256_final(ctx, out);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+    sha256_init(ctx);
+    sha256_update(ctx, pad, 64);
+    sha256_update(ctx, out, 32);
+    sha256_final(ctx, out);
+}
+bool sha256_select(ShaImpl impl) {
+    if (impl == ShaImpl::SHANI && !cpu_has_shani()) return false;
+    bool ni = impl == ShaImpl::SHANI || (impl == ShaImpl::AUTO && cpu_has_shani());
+    active_kernel() = ni ? &SHANI_KERNEL : &SCALAR_KERNEL;
+    return true;
+}
+const char* sha256_impl_name() { return active_kernel()->name; }
@@ -0,0 +1,79 @@
+#include "harq_entity.h"
+HarqEntity::HarqEntity(HarqConfig cfg) : cfg_(cfg) {
+    if (cfg_.num_procs == 0 || cfg_.num_procs > HARQ_MAX_PROCESSES) cfg_.num_procs = HARQ_PROCS_LTE;
+    for (int i = 0; i < HARQ_MAX_PROCESSES; i++) procs_[i].id = (uint8_t)i;
+    all_  = cfg_.num_procs == 32 ? 0xFFFFFFFFu : (1u << cfg_.num_procs) - 1;
+    free_ = all_;
+}
+Status HarqEntity::transmit(const PduBuffer& tb, uint8_t& id) {
+    if (!free_) return Status::BUFFER_FULL;
+    id = (uint8_t)__builtin_ctz(free_);
+    free_    &= free_ - 1;
+    waiting_ |= 1u << id;
+    HarqProcess& p = procs_[id];
+    p.state      = HarqState::WAITING_ACK;
+    p.retx_count = 0;
+    p.tx_tti     = now_;
+    p.buffer     = tb;
+    return Status::OK;
+}
+bool HarqEntity::next_retx(PduBuffer& tb, uint8_t& id) {
+    if (!nacked_) return false;
+    id = (uint8_t)__builtin_ctz(nacked_);
+    nacked_  &= nacked_ - 1;
+    waiting_ |= 1u << id;
+    HarqProcess& p = procs_[id];
+    p.state  = HarqState::WAITING_ACK;
+    p.tx_tti = now_;
+    p.retx_count++;
+    retx_++;
+    metrics_.retx.add();
+    tb = p.buffer;
+    return true;
+}
+void HarqEntity::bind_metrics(const MetricLabels& labels) {
+    MetricsRegistry&      reg = MetricsRegistry::instance();
+    std::vector<uint64_t> bounds;
+    for (uint64_t n = 1; n <= cfg_.max_retx + 1u; n++) bounds.push_back(n);
+    metrics_.retx      = reg.counter("mac_harq_retx_total", labels);
+    metrics_.failures  = reg.counter("mac_harq_failures_total", labels);
+    metrics_.dtx       = reg.counter("mac_harq_dtx_total", labels);
+    metrics_.tx_per_tb = reg.histogram("mac_harq_tx_per_tb", bounds, labels);
+}
+void HarqEntity::release(uint8_t id) {
+    uint32_t bit = 1u << id;
+    waiting_ &= ~bit;
+    nacked_  &= ~bit;
+    free_    |= bit;
+    procs_[id].state = HarqState::IDLE;
+    procs_[id].buffer.reset();
+}
+void HarqEntity::nack(uint8_t id) {
+    HarqProcess& p = procs_[id];
+    if (p.retx_count >= cfg_.max_retx) {
+        failures_++;
+        metrics_.failures.add();
+        metrics_.tx_per_tb.record(p.retx_count + 2u);
+        LOGF_WARN("MAC", "HARQ proc={} max retx reached, TB dropped", id);
+        release(id);
+        return;
+    }
+    waiting_ &= ~(1u << id);
+    nacked_  |= 1u << id;
+    p.state   = HarqState::NACKED;
+}
+void HarqEntity::feedback(uint8_t id, bool ack) {
+    if (id >= cfg_.num_procs || !(waiting_ & (1u << id))) return;
+    if (ack) { metrics_.tx_per_tb.record(procs_[id].retx_count + 1u); release(id); }
+    else     nack(id);
+}
+void HarqEntity::tick(uint32_t ttis) {
+    now_ += ttis;
+    for (uint32_t m = waiting_; m; m &= m - 1) {
+        uint8_t id = (uint8_t)__builtin_ctz(m);
+        if (now_ - procs_[id].tx_tti < cfg_.rtt_tti) continue;
+        dtx_++;
+        metrics_.dtx.add();
+        nack(id);
+    }
+}
@@ -1,67 +1,282 @@
 #include "mac_layer.h"
+#include <algorithm>
+#include <cstring>
 #include <sstream>
-MacLayer::MacLayer() {
-    for (int i = 0; i < MAX_HARQ_PROCESSES; i++) harq_procs_[i].id = (uint8_t)i;
-}
-Bytes MacLayer::build_mac_pdu(LogicalChannel lc, const Bytes& payload) {
-    Bytes pdu;
-    pdu.push_back((uint8_t)lc);
-    uint16_t len = (uint16_t)payload.size();
-    pdu.push_back((len >> 8) & 0xFF);
-    pdu.push_back(len & 0xFF);
-    pdu.insert(pdu.end(), payload.begin(), payload.end());
-    return pdu;
-}
-bool MacLayer::parse_mac_pdu(const Bytes& pdu, LogicalChannel& lc, Bytes& payload) {
-    if (pdu.size() < 3) return false;
-    lc = (LogicalChannel)pdu[0];
-    uint16_t len = ((uint16_t)pdu[1] << 8) | pdu[2];
-    if (pdu.size() < (size_t)(3 + len)) return false;
-    payload = Bytes(pdu.begin() + 3, pdu.begin() + 3 + len);
-    return true;
-}
-uint8_t MacLayer::get_next_harq_process() {
-    for (int i = 0; i < MAX_HARQ_PROCESSES; i++) {
-        uint8_t id = next_harq_id_;
-        next_harq_id_ = (next_harq_id_ + 1) % MAX_HARQ_PROCESSES;
-        if (harq_procs_[id].state == HarqState::IDLE) return id;
+namespace {
+// R/F/LCID/L subheader: 8-bit L below 256 bytes, 16-bit L (F=1) above.
+inline size_t subhdr_len(size_t len) { return len < 256 ? 2 : 3; }
+inline size_t put_subhdr(uint8_t* p, uint8_t lcid, size_t len) {
+    if (len < 256) { p[0] = lcid; p[1] = (uint8_t)len; return 2; }
+    p[0] = 0x40 | lcid;
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)len;
+    return 3;
+}
+inline bool is_data_lcid(uint8_t lcid) {
+    return lcid == (uint8_t)LogicalChannel::CCCH || lcid == (uint8_t)LogicalChannel::DCCH ||
+           lcid == (uint8_t)LogicalChannel::DTCH;
+}
+// Parses the subheader at p; returns its length (0 if malformed) and the
+// payload length. Padding runs to the end of the transport block.
+size_t parse_subhdr(const uint8_t* p, size_t n, uint8_t& lcid, size_t& len) {
+    if (n < 1) return 0;
+    lcid = p[0] & 0x3F;
+    size_t hl = 1;
+    switch (lcid) {
+        case MAC_LCID_PADDING:   len = n - 1; break;
+        case MAC_LCID_SHORT_BSR: len = 1; break;
+        case MAC_LCID_CRNTI:
+        case MAC_LCID_PHR:       len = 2; break;
+        default:
+            if (!is_data_lcid(lcid)) return 0;
+            if (p[0] & 0x40) {
+                if (n < 3) return 0;
+                len = ((size_t)p[1] << 8) | p[2];
+                hl  = 3;
+            } else {
+                if (n < 2) return 0;
+                len = p[1];
+                hl  = 2;
+            }
     }
-    return 0;
+    return hl + len <= n ? hl : 0;
 }
-Status MacLayer::transmit_sdu(const Bytes& rlc_sdu, Bytes& phy_pdu) {
-    uint8_t proc_id = get_next_harq_process();
-    HarqProcess& proc = harq_procs_[proc_id];
-    Bytes mac_pdu = build_mac_pdu(LogicalChannel::DTCH, rlc_sdu);
-    if (proc.state == HarqState::NACKED && proc.buffer.size() > 0) {
-        mac_pdu = proc.buffer;
-        proc.retx_count++;
-        harq_retx_count_++;
-        LOG_INFO("MAC", "HARQ RETX proc=" + std::to_string(proc_id));
-        if (proc.retx_count >= MAX_HARQ_RETX) {
-            proc = HarqProcess(); proc.id = proc_id;
-            return Status::ERROR;
+const uint32_t BSR_LEVELS[31] = {
+    0,     10,    14,    20,    28,    38,    53,     74,     102,    142,   198,
+    276,   384,   535,   745,   1038,  1446,  2014,   2806,   3909,   5446,  7587,
+    10570, 14726, 20516, 28581, 39818, 55474, 77284,  107669, 150000,
+};
+}
+uint8_t mac_bsr_index(size_t bytes) {
+    return (uint8_t)(std::lower_bound(std::begin(BSR_LEVELS), std::end(BSR_LEVELS), bytes) - std::begin(BSR_LEVELS));
+}
+MacLayer::MacLayer(HarqConfig harq) : harq_(harq) {
+    lcs_[0].lc = LogicalChannel::CCCH; lcs_[0].priority = 0;
+    lcs_[1].lc = LogicalChannel::DCCH; lcs_[1].priority = 1;
+    lcs_[2].lc = LogicalChannel::DTCH; lcs_[2].priority = 2;
+    lc_order_ = {0, 1, 2};
+}
+void MacLayer::build_mac_pdu(LogicalChannel lc, PduBuffer& pdu) {
+    size_t len = pdu.size();
+    put_subhdr(pdu.prepend(subhdr_len(len)), (uint8_t)lc, len);
+}
+bool MacLayer::parse_mac_pdu(PduBuffer& pdu, LogicalChannel& lc) {
+    size_t off = 0;
+    while (off < pdu.size()) {
+        uint8_t lcid;
+        size_t  len;
+        size_t  hl = parse_subhdr(pdu.data() + off, pdu.size() - off, lcid, len);
+        if (hl == 0 || lcid == MAC_LCID_PADDING) return false;
+        if (is_data_lcid(lcid)) {
+            lc = (LogicalChannel)lcid;
+            pdu.strip(off + hl);
+            pdu.trim(pdu.size() - len);
+            return true;
         }
-    } else {
-        proc.buffer = mac_pdu;
-        proc.state  = HarqState::WAITING_ACK;
-        proc.retx_count = 0;
+        off += hl + len;
     }
-    phy_pdu = mac_pdu;
+    return false;
+}
+MacLayer::LcState* MacLayer::lc_state(LogicalChannel lc) {
+    for (LcState& s : lcs_) if (s.lc == lc) return &s;
+    return nullptr;
+}
+Status MacLayer::queue_sdu(LogicalChannel lc, PduBuffer& sdu) {
+    LcState* s = lc_state(lc);
+    if (!s || sdu.size() == 0 || sdu.size() > 0xFFFF) return Status::ERROR;
+    // Regular BSR: data arrives while nothing was buffered.
+    if (queued_bytes() == 0) bsr_pending_ = true;
+    s->bytes += sdu.size();
+    s->q.push_back(std::move(sdu));
+    return Status::OK;
+}
+size_t MacLayer::queued_bytes() const {
+    size_t n = 0;
+    for (const LcState& s : lcs_) n += s.bytes;
+    return n;
+}
+void MacLayer::set_lc_priority(LogicalChannel lc, uint8_t priority) {
+    LcState* s = lc_state(lc);
+    if (!s || lc == LogicalChannel::CCCH) return;
+    s->priority = priority;
+    std::stable_sort(lc_order_.begin() + 1, lc_order_.end(),
+                     [&](uint8_t a, uint8_t b) { return lcs_[a].priority < lcs_[b].priority; });
+}
+void MacLayer::set_lc_pull(LogicalChannel lc, MacLcPull pull) {
+    if (LcState* s = lc_state(lc)) s->pull = std::move(pull);
+}
+void MacLayer::send_crnti_ce(uint16_t rnti) { crnti_ = rnti; crnti_pending_ = true; }
+void MacLayer::report_phr(uint8_t ph, uint8_t pcmax) { ph_ = ph; pcmax_ = pcmax; phr_pending_ = true; }
+
+// Logical channel prioritisation, TS 38.321 5.4.3.1.3: C-RNTI CE, CCCH, BSR,
+// PHR, then DCCH/DTCH by priority, then padding (with a padding BSR if it
+// fits). Only the SDU bytes are copied, straight into the transport block.
+size_t MacLayer::build_tb(uint32_t tbs, PduBuffer& tb) {
+    tb = PduBuffer::alloc(tbs, 0, phy_crc_overhead(tbs));
+    uint8_t* p    = tb.data();
+    size_t   off  = 0, nsdu = 0;
+    size_t   bsr_at = SIZE_MAX;
+    auto room = [&]() { return tbs - off; };
+    auto put = [&](uint8_t lcid, const PduBuffer& sdu) {
+        off += put_subhdr(p + off, lcid, sdu.size());
+        std::memcpy(p + off, sdu.data(), sdu.size());
+        off += sdu.size();
+        nsdu++;
+    };
+    auto pack = [&](LcState& s) {
+        while (s.head < s.q.size()) {
+            PduBuffer& sdu = s.q[s.head];
+            if (subhdr_len(sdu.size()) + sdu.size() > room()) break;
+            put((uint8_t)s.lc, sdu);
+            s.bytes -= sdu.size();
+            sdu.reset();
+            s.head++;
+        }
+        if (s.head == s.q.size()) { s.q.clear(); s.head = 0; }
+        while (s.pull && room() > 2) {
+            PduBuffer pdu;
+            uint32_t  budget = (uint32_t)(room() - 2 < 256 ? room() - 2 : room() - 3);
+            if (s.pull(budget, &pdu, 1) == 0) break;
+            put((uint8_t)s.lc, pdu);
+        }
+    };
+    if (crnti_pending_ && room() >= 3) {
+        p[off] = MAC_LCID_CRNTI; p[off + 1] = (uint8_t)(crnti_ >> 8); p[off + 2] = (uint8_t)crnti_;
+        off += 3;
+        crnti_pending_ = false;
+    }
+    pack(lcs_[lc_order_[0]]);
+    if (bsr_pending_ && room() >= 2) { bsr_at = off; off += 2; bsr_pending_ = false; }
+    if (phr_pending_ && room() >= 3) {
+        p[off] = MAC_LCID_PHR; p[off + 1] = ph_ & 0x3F; p[off + 2] = pcmax_ & 0x3F;
+        off += 3;
+        phr_pending_ = false;
+    }
+    for (size_t i = 1; i < MAC_NUM_LC; i++) pack(lcs_[lc_order_[i]]);
+    size_t left = queued_bytes();
+    if (bsr_at == SIZE_MAX && left && room() >= 2) { bsr_at = off; off += 2; }
+    if (bsr_at != SIZE_MAX) {
+        p[bsr_at]     = MAC_LCID_SHORT_BSR;
+        p[bsr_at + 1] = mac_bsr_index(left);   // LCG 0
+    }
+    if (room()) {
+        p[off] = MAC_LCID_PADDING;
+        std::memset(p + off + 1, 0, room() - 1);
+    }
+    LOGF_DEBUG("MAC", "TB tbs={} sdus={} padding={}", tbs, nsdu, tbs - off);
+    return nsdu;
+}
+Status MacLayer::transmit_tb(uint32_t tbs, PduBuffer& tb) {
+    if (!harq_.has_free()) return Status::BUFFER_FULL;
+    build_tb(tbs, tb);
+    Status st = tx_one(tb, true);
+    if (st == Status::OK) LOGF_INFO("MAC", "TX TB proc={} size={}", last_harq_id_, tb.size());
+    return st;
+}
+size_t MacLayer::demux_tb(const PduBuffer& tb, MacSdu* out, size_t max, MacCeReport* ces) {
+    capture(false, tb);
+    const uint8_t* p = tb.data();
+    size_t off = 0, n = 0;
+    while (off < tb.size()) {
+        uint8_t lcid;
+        size_t  len;
+        size_t  hl = parse_subhdr(p + off, tb.size() - off, lcid, len);
+        if (hl == 0) { LOGF_WARN("MAC", "malformed subheader at {}", off); break; }
+        const uint8_t* v = p + off + hl;
+        if (lcid == MAC_LCID_PADDING) break;
+        if (is_data_lcid(lcid)) {
+            if (n == max) break;
+            out[n].lc  = (LogicalChannel)lcid;
+            out[n].sdu = tb.slice(off + hl, len);
+            n++;
+        } else if (ces) {
+            switch (lcid) {
+                case MAC_LCID_SHORT_BSR: ces->has_bsr = true; ces->bsr_lcg = v[0] >> 5; ces->bsr_index = v[0] & 0x1F; break;
+                case MAC_LCID_CRNTI:     ces->has_crnti = true; ces->crnti = (uint16_t)((v[0] << 8) | v[1]); break;
+                case MAC_LCID_PHR:       ces->has_phr = true; ces->ph = v[0] & 0x3F; ces->pcmax = v[1] & 0x3F; break;
+            }
+        }
+        off += hl + len;
+    }
+    rx_pdus_++;
+    metrics_.rx_pdus.add();
+    LOGF_DEBUG("MAC", "RX TB size={} sdus={}", tb.size(), n);
+    return n;
+}
+void MacLayer::bind_metrics(uint32_t ue) {
+    MetricsRegistry& reg = MetricsRegistry::instance();
+    MetricLabels     l{"MAC", ue};
+    metrics_.tx_pdus = reg.counter("mac_tx_pdus_total", l);
+    metrics_.rx_pdus = reg.counter("mac_rx_pdus_total", l);
+    harq_.bind_metrics(l);
+}
+Status MacLayer::tx_one(PduBuffer& pdu, bool framed) {
+    if (!harq_.has_free()) return Status::BUFFER_FULL;
+    if (!framed) build_mac_pdu(LogicalChannel::DTCH, pdu);
+    harq_.transmit(pdu, last_harq_id_);
+    capture(true, pdu, last_harq_id_);
     tx_pdus_++;
-    LOG_INFO("MAC", "TX MAC-PDU proc=" + std::to_string(proc_id) + " size=" + std::to_string(mac_pdu.size()));
+    metrics_.tx_pdus.add();
     return Status::OK;
 }
-Status MacLayer::receive_pdu(const Bytes& phy_pdu, Bytes& rlc_sdu) {
+Status MacLayer::retransmit(PduBuffer& tb) {
+    if (!harq_.next_retx(tb, last_harq_id_)) return Status::PENDING;
+    capture(true, tb, last_harq_id_);
+    LOGF_INFO("MAC", "HARQ RETX proc={} retx={}", last_harq_id_, harq_.process(last_harq_id_).retx_count);
+    tx_pdus_++;
+    metrics_.tx_pdus.add();
+    return Status::OK;
+}
+Status MacLayer::transmit_sdu(PduBuffer& pdu) {
+    Status st = tx_one(pdu);
+    if (st == Status::OK) LOGF_INFO("MAC", "TX MAC-PDU proc={} size={}", last_harq_id_, pdu.size());
+    return st;
+}
+Status MacLayer::receive_pdu(PduBuffer& pdu) {
     LogicalChannel lc;
-    if (!parse_mac_pdu(phy_pdu, lc, rlc_sdu)) return Status::ERROR;
+    capture(false, pdu);
+    if (!parse_mac_pdu(pdu, lc)) return Status::ERROR;
     rx_pdus_++;
-    LOG_INFO("MAC", "RX MAC-PDU payload=" + std::to_string(rlc_sdu.size()) + " bytes");
+    metrics_.rx_pdus.add();
+    LOGF_INFO("MAC", "RX MAC-PDU payload={} bytes", pdu.size());
     return Status::OK;
 }
+size_t MacLayer::transmit_burst(PduBuffer* pdus, size_t n, Status* status, uint8_t* harq_ids) {
+    size_t ok = 0;
+    for (size_t i = 0; i < n; i++) {
+        status[i] = tx_one(pdus[i]);
+        if (harq_ids) harq_ids[i] = status[i] == Status::OK ? last_harq_id_ : 0xFF;
+        if (status[i] == Status::OK) ok++;
+    }
+    LOGF_INFO("MAC", "TX burst n={} ok={}", n, ok);
+    return ok;
+}
+size_t MacLayer::receive_burst(PduBuffer* pdus, size_t n, Status* status) {
+    size_t ok = 0;
+    LogicalChannel lc;
+    for (size_t i = 0; i < n; i++) {
+        capture(false, pdus[i]);
+        status[i] = parse_mac_pdu(pdus[i], lc) ? Status::OK : Status::ERROR;
+        if (status[i] == Status::OK) ok++;
+    }
+    rx_pdus_ += (uint32_t)ok;
+    metrics_.rx_pdus.add(ok);
+    LOGF_INFO("MAC", "RX burst n={} ok={}", n, ok);
+    return ok;
+}
+Status MacLayer::transmit_sdu(const Bytes& rlc_sdu, Bytes& phy_pdu) {
+    PduBuffer pdu = PduBuffer::from(rlc_sdu);
+    Status st = transmit_sdu(pdu);
+    if (st == Status::OK) phy_pdu = pdu.to_bytes();
+    return st;
+}
+Status MacLayer::receive_pdu(const Bytes& phy_pdu, Bytes& rlc_sdu) {
+    PduBuffer pdu = PduBuffer::from(phy_pdu);
+    Status st = receive_pdu(pdu);
+    if (st == Status::OK) rlc_sdu = pdu.to_bytes();
+    return st;
+}
 void MacLayer::harq_feedback(uint8_t process_id, bool ack) {
-    if (process_id >= MAX_HARQ_PROCESSES) return;
-    HarqProcess& proc = harq_procs_[process_id];
-    LOG_INFO("MAC", "HARQ feedback proc=" + std::to_string(process_id) + (ack ? " ACK" : " NACK"));
-    if (ack) { proc.state = HarqState::IDLE; proc.ack_received = true; proc.buffer.clear(); }
-    else      { proc.state = HarqState::NACKED; }
+    LOGF_INFO("MAC", "HARQ feedback proc={} {}", process_id, ack ? "ACK" : "NACK");
+    harq_.feedback(process_id, ack);
 }
@@ -0,0 +1,165 @@
+#include "mac_scheduler.h"
+#include <algorithm>
+namespace {
+// Link adaptation candidates, lowest to highest spectral efficiency.
+constexpr MCS SCHED_MCS[] = {MCS::QPSK_1_3, MCS::QPSK_1_2, MCS::QAM16_1_2,
+                             MCS::QAM64_2_3, MCS::QAM64_5_6, MCS::QAM256_3_4};
+constexpr uint8_t SCHED_NUM_MCS = sizeof(SCHED_MCS) / sizeof(SCHED_MCS[0]);
+constexpr double  PF_RENORM_AT  = 1e150;
+constexpr double  PF_MIN_AVG    = 1e-300;
+}
+MacScheduler::MacScheduler(SchedConfig cfg) : cfg_(cfg) {
+    if (cfg_.num_prbs == 0) cfg_.num_prbs = 1;
+    for (uint8_t i = 0; i < SCHED_NUM_MCS; i++)
+        rate_[i] = (float)transport_block_size(SCHED_MCS[i], cfg_.num_prbs) / cfg_.num_prbs;
+}
+double MacScheduler::key_of(const SchedUe& u) const {
+    switch (cfg_.policy) {
+        case SchedPolicy::RR:     return 0.0;
+        case SchedPolicy::MAX_CI: return u.rate;
+        case SchedPolicy::PF:     return u.rate / std::max(u.avg, PF_MIN_AVG);
+    }
+    return 0.0;
+}
+bool MacScheduler::before(uint16_t a, uint16_t b) const {
+    const SchedUe& x = ues_[a];
+    const SchedUe& y = ues_[b];
+    return x.key > y.key || (x.key == y.key && x.last_served < y.last_served);
+}
+void MacScheduler::sift_up(size_t pos) {
+    uint16_t r = heap_[pos];
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!before(r, heap_[parent])) break;
+        heap_set(pos, heap_[parent]);
+        pos = parent;
+    }
+    heap_set(pos, r);
+}
+void MacScheduler::sift_down(size_t pos) {
+    uint16_t r = heap_[pos];
+    size_t   n = heap_.size();
+    for (;;) {
+        size_t c = 2 * pos + 1;
+        if (c >= n) break;
+        if (c + 1 < n && before(heap_[c + 1], heap_[c])) c++;
+        if (!before(heap_[c], r)) break;
+        heap_set(pos, heap_[c]);
+        pos = c;
+    }
+    heap_set(pos, r);
+}
+void MacScheduler::heap_push(uint16_t rnti) {
+    SchedUe& u = ues_[rnti];
+    u.key = key_of(u);
+    heap_.push_back(rnti);
+    u.heap_pos = (int32_t)heap_.size() - 1;
+    sift_up(heap_.size() - 1);
+}
+void MacScheduler::heap_erase(uint16_t rnti) {
+    size_t pos = (size_t)ues_[rnti].heap_pos;
+    ues_[rnti].heap_pos = -1;
+    uint16_t last = heap_.back();
+    heap_.pop_back();
+    if (pos == heap_.size()) return;
+    heap_set(pos, last);
+    sift_up(pos);
+    sift_down((size_t)ues_[last].heap_pos);
+}
+void MacScheduler::heap_fix(uint16_t rnti) {
+    SchedUe& u = ues_[rnti];
+    u.key = key_of(u);
+    if (u.heap_pos < 0) return;
+    sift_up((size_t)u.heap_pos);
+    sift_down((size_t)u.heap_pos);
+}
+Status MacScheduler::add_ue(uint16_t rnti) {
+    if (rnti >= ues_.size()) ues_.resize((size_t)rnti + 1);
+    SchedUe& u = ues_[rnti];
+    if (u.active) return Status::INVALID_STATE;
+    u = SchedUe();
+    u.active = true;
+    u.rate   = rate_[0];
+    u.avg    = decay_;   // 1 byte per slot: new UEs start near the top under PF
+    u.last_served = ++served_seq_;   // ties go in order of arrival
+    num_ues_++;
+    return Status::OK;
+}
+Status MacScheduler::remove_ue(uint16_t rnti) {
+    if (!ue(rnti)) return Status::ERROR;
+    if (ues_[rnti].heap_pos >= 0) heap_erase(rnti);
+    ues_[rnti].active = false;
+    num_ues_--;
+    return Status::OK;
+}
+Status MacScheduler::update_buffer(uint16_t rnti, uint32_t bytes) {
+    if (!ue(rnti)) return Status::ERROR;
+    SchedUe& u = ues_[rnti];
+    u.buffer = bytes;
+    if (bytes && u.heap_pos < 0) heap_push(rnti);
+    else if (!bytes && u.heap_pos >= 0) heap_erase(rnti);
+    return Status::OK;
+}
+Status MacScheduler::update_channel(uint16_t rnti, float snr_db) {
+    if (!ue(rnti)) return Status::ERROR;
+    SchedUe& u = ues_[rnti];
+    u.snr_db = snr_db;
+    uint8_t lvl = SCHED_NUM_MCS - 1;
+    while (lvl > 0 && ChannelModel::bler(SCHED_MCS[lvl], snr_db) > cfg_.target_bler) lvl--;
+    if (SCHED_MCS[lvl] == u.mcs) return Status::OK;
+    u.mcs  = SCHED_MCS[lvl];
+    u.rate = rate_[lvl];
+    heap_fix(rnti);
+    return Status::OK;
+}
+void MacScheduler::set_policy(SchedPolicy policy) {
+    cfg_.policy = policy;
+    for (uint16_t r : heap_) ues_[r].key = key_of(ues_[r]);
+    for (size_t i = heap_.size() / 2; i-- > 0;) sift_down(i);
+}
+// Brings decay_ back to 1. Every PF key scales by the same factor, so the
+// heap order holds and only the stored keys are refreshed.
+void MacScheduler::renormalize() {
+    for (SchedUe& u : ues_) {
+        if (!u.active) continue;
+        u.avg = std::max(u.avg / decay_, PF_MIN_AVG);
+        if (u.heap_pos >= 0) u.key = key_of(u);
+    }
+    decay_ = 1.0;
+}
+double MacScheduler::avg_rate(uint16_t rnti) const {
+    const SchedUe* u = ue(rnti);
+    return u ? u->avg / decay_ : 0.0;
+}
+size_t MacScheduler::schedule(SchedGrant* out, size_t max) {
+    slot_++;
+    if (cfg_.policy == SchedPolicy::PF) {
+        decay_ /= 1.0 - cfg_.pf_alpha;
+        if (decay_ > PF_RENORM_AT) renormalize();
+    }
+    max = std::min<size_t>(max, cfg_.max_ues_per_slot);
+    uint16_t picked[256];
+    size_t   n = 0;
+    uint16_t prb = 0;
+    while (n < max && prb < cfg_.num_prbs && !heap_.empty()) {
+        uint16_t rnti = heap_[0];
+        heap_erase(rnti);
+        SchedUe& u = ues_[rnti];
+        uint16_t left = cfg_.num_prbs - prb;
+        uint32_t want = (uint32_t)((u.buffer + u.rate - 1) / u.rate);
+        uint16_t prbs = (uint16_t)std::min<uint32_t>(std::max<uint32_t>(want, 1), left);
+        uint32_t tbs  = transport_block_size(u.mcs, prbs);
+        while (tbs < u.buffer && prbs < left) tbs = transport_block_size(u.mcs, ++prbs);
+        out[n] = {rnti, prb, prbs, u.mcs, tbs};
+        prb += prbs;
+        uint32_t served = std::min(tbs, u.buffer);
+        u.buffer -= served;
+        u.last_served = ++served_seq_;
+        if (cfg_.policy == SchedPolicy::PF) u.avg += cfg_.pf_alpha * served * decay_;
+        picked[n++] = rnti;
+    }
+    for (size_t i = 0; i < n; i++)
+        if (ues_[picked[i]].buffer) heap_push(picked[i]);
+    if (n) LOGF_DEBUG("SCHED", "slot {}: {} grants, {}/{} PRBs, {} UEs waiting", slot_, n, prb, cfg_.num_prbs, heap_.size());
+    return n;
+}
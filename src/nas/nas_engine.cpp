@@ -0,0 +1,165 @@
+#include "nas_engine.h"
+#include <chrono>
+#include <cstring>
+namespace {
+// Per-UE long-term key: the default UeIdentity key with the UE ID folded
+// into its last word.
+void derive_key(uint32_t ue, uint8_t key[16]) {
+    static const UeIdentity defaults;
+    std::memcpy(key, defaults.key, 16);
+    for (int i = 0; i < 4; i++) key[12 + i] ^= (uint8_t)(ue >> (24 - 8 * i));
+}
+AkaConfig aka_config(const NasEngineConfig& cfg) {
+    AkaConfig a;
+    a.cache_depth = cfg.aka_cache_depth;
+    return a;
+}
+}
+NasEngine::Shard::Shard(const NasEngineConfig& cfg, size_t index, size_t num_shards)
+    : inbox(cfg.queue_depth),
+      ues((cfg.num_ues + num_shards - 1 - index) / num_shards),
+      pool(cfg.ip_first + (uint32_t)(cfg.ip_count / num_shards * index), (uint32_t)(cfg.ip_count / num_shards)),
+      auc(aka_config(cfg), index),
+      fsm(&pool, &auc, (uint32_t)index << 24 | 1) {
+    static const UeIdentity defaults;
+    for (size_t slot = 0; slot < ues.size(); slot++) {
+        NasContext& c = ues[slot];
+        derive_key((uint32_t)(slot * num_shards + index), c.k);
+        milenage_opc(c.k, defaults.op, c.opc);
+        auc.add_subscriber(c.k, c.opc);
+    }
+}
+NasEngine::NasEngine(NasEngineConfig cfg) : cfg_(cfg) {
+    size_t n = cfg_.num_workers ? cfg_.num_workers : 1;
+    if (cfg_.batch == 0) cfg_.batch = 1;
+    for (size_t i = 0; i < n; i++) shards_.push_back(std::make_unique<Shard>(cfg_, i, n));
+}
+NasEngine::~NasEngine() { stop(); }
+void NasEngine::start() {
+    if (running_.exchange(true)) return;
+    for (auto& sh : shards_) {
+        Shard* s = sh.get();
+        s->worker = std::thread([this, s] { worker_loop(*s); });
+    }
+    LOGF_INFO("NAS", "NAS engine started: {} UEs on {} workers", cfg_.num_ues, shards_.size());
+}
+void NasEngine::stop() {
+    if (!running_.exchange(false)) return;
+    for (auto& sh : shards_) if (sh->worker.joinable()) sh->worker.join();
+}
+Status NasEngine::submit(NasCommand&& cmd) {
+    if (cmd.ue >= cfg_.num_ues) return Status::ERROR;
+    if (!shards_[shard_of(cmd.ue)]->inbox.push(std::move(cmd))) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return Status::BUFFER_FULL;
+    }
+    return Status::OK;
+}
+Status NasEngine::broadcast(NasCmdType type, NasEvent ev, bool flag) {
+    Status s = Status::OK;
+    for (auto& sh : shards_) {
+        NasCommand c; c.type = type; c.ev = ev; c.ue = NAS_ALL_UES; c.flag = flag;
+        if (!sh->inbox.push(std::move(c))) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            s = Status::BUFFER_FULL;
+        }
+    }
+    return s;
+}
+Status NasEngine::register_ue(uint32_t ue, bool with_session) {
+    NasCommand c; c.ev = NasEvent::REGISTER; c.ue = ue; c.flag = with_session;
+    return submit(std::move(c));
+}
+Status NasEngine::request_session(uint32_t ue) {
+    NasCommand c; c.ev = NasEvent::SESSION; c.ue = ue;
+    return submit(std::move(c));
+}
+Status NasEngine::deregister_ue(uint32_t ue) {
+    NasCommand c; c.ev = NasEvent::DEREGISTER; c.ue = ue;
+    return submit(std::move(c));
+}
+Status NasEngine::register_all(bool with_session) { return broadcast(NasCmdType::EVENT, NasEvent::REGISTER, with_session); }
+Status NasEngine::deregister_all() { return broadcast(NasCmdType::EVENT, NasEvent::DEREGISTER); }
+Status NasEngine::core_restart() { return broadcast(NasCmdType::EVENT, NasEvent::CORE_RESTART); }
+Status NasEngine::prefill_auth_vectors() { return broadcast(NasCmdType::PREFILL_AKA, NasEvent::REGISTER); }
+void NasEngine::drain() {
+    if (!running_.load(std::memory_order_acquire)) {
+        NasCommand cmd;
+        for (auto& sh : shards_) {
+            while (sh->inbox.pop(cmd)) execute(*sh, cmd);
+            sh->fsm.run(sh->ues.data());
+        }
+        return;
+    }
+    std::atomic<size_t> done{0};
+    for (auto& sh : shards_) {
+        NasCommand c; c.type = NasCmdType::BARRIER; c.done = &done;
+        while (!sh->inbox.push(std::move(c))) std::this_thread::yield();
+    }
+    while (done.load(std::memory_order_acquire) < shards_.size()) std::this_thread::yield();
+}
+const NasContext* NasEngine::context(uint32_t ue) const {
+    if (ue >= cfg_.num_ues) return nullptr;
+    return &shards_[shard_of(ue)]->ues[ue / shards_.size()];
+}
+NasEngineStats NasEngine::stats() const {
+    NasEngineStats s;
+    s.ues = cfg_.num_ues;
+    for (auto& sh : shards_) {
+        const NasStats& f = sh->fsm.stats();
+        s.events          += f.events.load(std::memory_order_relaxed);
+        s.registrations   += f.registrations.load(std::memory_order_relaxed);
+        s.auth_failures   += f.auth_failures.load(std::memory_order_relaxed);
+        s.sessions        += f.sessions.load(std::memory_order_relaxed);
+        s.session_rejects += f.session_rejects.load(std::memory_order_relaxed);
+        s.deregistrations += f.deregistrations.load(std::memory_order_relaxed);
+        s.unexpected      += f.unexpected.load(std::memory_order_relaxed);
+        const AkaStats& a = sh->auc.stats();
+        s.aka_generated    += a.generated.load(std::memory_order_relaxed);
+        s.aka_cache_hits   += a.cache_hits.load(std::memory_order_relaxed);
+        s.aka_cache_misses += a.cache_misses.load(std::memory_order_relaxed);
+    }
+    s.rejected_cmds = rejected_.load(std::memory_order_relaxed);
+    return s;
+}
+void NasEngine::trigger(Shard& sh, uint32_t slot, NasEvent ev, bool flag) {
+    NasContext& c = sh.ues[slot];
+    if (ev == NasEvent::REGISTER) c.want_session = flag;
+    sh.fsm.post(slot, ev);
+}
+// Commands only queue trigger events; the worker runs them in batches, so a
+// broadcast starts every UE's procedure before any of them completes.
+void NasEngine::execute(Shard& sh, NasCommand& cmd) {
+    if (cmd.type == NasCmdType::BARRIER) {
+        sh.fsm.run(sh.ues.data());
+        cmd.done->fetch_add(1, std::memory_order_release);
+        return;
+    }
+    if (cmd.type == NasCmdType::PREFILL_AKA) {
+        sh.auc.prefill();
+        return;
+    }
+    if (cmd.ue == NAS_ALL_UES) {
+        for (uint32_t slot = 0; slot < sh.ues.size(); slot++) {
+            // A restart only concerns UEs the network knew about.
+            if (cmd.ev == NasEvent::CORE_RESTART && sh.ues[slot].reg_state != NasRegistrationState::REGISTERED) continue;
+            trigger(sh, slot, cmd.ev, cmd.flag);
+        }
+        return;
+    }
+    trigger(sh, (uint32_t)(cmd.ue / shards_.size()), cmd.ev, cmd.flag);
+}
+void NasEngine::worker_loop(Shard& sh) {
+    NasCommand cmd;
+    unsigned idle = 0;
+    while (running_.load(std::memory_order_acquire)) {
+        bool busy = false;
+        for (size_t i = 0; i < cfg_.batch && sh.inbox.pop(cmd); i++) { execute(sh, cmd); busy = true; }
+        if (sh.fsm.run(sh.ues.data(), cfg_.batch)) busy = true;
+        if (busy) { idle = 0; continue; }
+        if (++idle < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    while (sh.inbox.pop(cmd)) execute(sh, cmd);
+    sh.fsm.run(sh.ues.data());
+}
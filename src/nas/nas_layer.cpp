@@ -1,9 +1,248 @@
 #include "nas_layer.h"
-#include <sstream>
-#include <cstdlib>
-NasLayer::NasLayer(UeIdentity ue_id) : ue_id_(ue_id) {}
+#include "nas_msgs.h"
+#include <cstring>
+namespace {
+// The UE's NAS random stream is keyed on its SUPI (FNV-1a).
+uint64_t supi_hash(const std::string& supi) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (unsigned char c : supi) h = (h ^ c) * 0x100000001B3ull;
+    return h;
+}
+inline void bump(std::atomic<uint64_t>& c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+enum class NasAction : uint8_t {
+    NONE,   // no transition: the event is dropped
+    UE_REGISTER, AMF_AUTHENTICATE, UE_AUTHENTICATE, AMF_CHECK_RES, AMF_AUTH_FAILED, UE_SMC_COMPLETE,
+    AMF_ACCEPT, UE_REGISTERED, AMF_REGISTERED, UE_REJECTED,
+    UE_SESSION, SMF_ESTABLISH, UE_SESSION_UP, UE_SESSION_REJECTED,
+    UE_DEREGISTER, AMF_DEREGISTER, UE_DEREGISTERED, CORE_RESTART,
+};
+struct NasTransition {
+    NasAction            action = NasAction::NONE;
+    NasRegistrationState next   = NasRegistrationState::DEREGISTERED;
+};
+struct NasRow {
+    NasRegistrationState state;
+    NasEvent             event;
+    NasAction            action;
+    NasRegistrationState next;
+};
+using S = NasRegistrationState;
+using E = NasEvent;
+using A = NasAction;
+constexpr NasRow NAS_ROWS[] = {
+    {S::DEREGISTERED,  E::REGISTER,        A::UE_REGISTER,         S::REGISTERING},
+    {S::REGISTERING,   E::REG_REQUEST,     A::AMF_AUTHENTICATE,    S::REGISTERING},
+    {S::REGISTERING,   E::AUTH_REQUEST,    A::UE_AUTHENTICATE,     S::REGISTERING},
+    {S::REGISTERING,   E::AUTH_RESPONSE,   A::AMF_CHECK_RES,       S::REGISTERING},
+    {S::REGISTERING,   E::AUTH_FAILURE,    A::AMF_AUTH_FAILED,     S::REGISTERING},
+    {S::REGISTERING,   E::SMC,             A::UE_SMC_COMPLETE,     S::REGISTERING},
+    {S::REGISTERING,   E::SMC_COMPLETE,    A::AMF_ACCEPT,          S::REGISTERING},
+    {S::REGISTERING,   E::REG_ACCEPT,      A::UE_REGISTERED,       S::REGISTERED},
+    {S::REGISTERING,   E::REG_REJECT,      A::UE_REJECTED,         S::DEREGISTERED},
+    {S::REGISTERED,    E::REG_COMPLETE,    A::AMF_REGISTERED,      S::REGISTERED},
+    {S::REGISTERED,    E::SESSION,         A::UE_SESSION,          S::REGISTERED},
+    {S::REGISTERED,    E::SESSION_REQUEST, A::SMF_ESTABLISH,       S::REGISTERED},
+    {S::REGISTERED,    E::SESSION_ACCEPT,  A::UE_SESSION_UP,       S::REGISTERED},
+    {S::REGISTERED,    E::SESSION_REJECT,  A::UE_SESSION_REJECTED, S::REGISTERED},
+    {S::REGISTERED,    E::DEREGISTER,      A::UE_DEREGISTER,       S::DEREGISTERING},
+    {S::REGISTERED,    E::CORE_RESTART,    A::CORE_RESTART,        S::REGISTERING},
+    {S::DEREGISTERING, E::DEREG_REQUEST,   A::AMF_DEREGISTER,      S::DEREGISTERING},
+    {S::DEREGISTERING, E::DEREG_ACCEPT,    A::UE_DEREGISTERED,     S::DEREGISTERED},
+};
+struct NasTable { NasTransition at[NAS_NUM_STATES][NAS_NUM_EVENTS]; };
+constexpr NasTable build_table() {
+    NasTable t{};
+    for (const NasRow& r : NAS_ROWS) t.at[(size_t)r.state][(size_t)r.event] = {r.action, r.next};
+    return t;
+}
+constexpr NasTable NAS_TABLE = build_table();
+
+constexpr NasMsgType NAS_MSG_OF[NAS_NUM_EVENTS] = {
+    NasMsgType(0), NasMsgType(0), NasMsgType(0), NasMsgType(0),
+    NasMsgType::REGISTRATION_REQUEST, NasMsgType::AUTH_REQUEST, NasMsgType::AUTH_RESPONSE, NasMsgType::AUTH_FAILURE,
+    NasMsgType::SECURITY_MODE_CMD, NasMsgType::SECURITY_MODE_COMPLETE,
+    NasMsgType::REGISTRATION_ACCEPT, NasMsgType::REGISTRATION_COMPLETE, NasMsgType::REGISTRATION_REJECT,
+    NasMsgType::PDU_SESSION_ESTAB_REQ, NasMsgType::PDU_SESSION_ESTAB_ACC, NasMsgType::PDU_SESSION_ESTAB_REJ,
+    NasMsgType::DEREGISTRATION_REQUEST, NasMsgType::DEREGISTRATION_ACCEPT,
+};
+constexpr const char* NAS_EVENT_NAME[NAS_NUM_EVENTS] = {
+    "Register", "Session", "Deregister", "CoreRestart",
+    "RegistrationRequest", "AuthenticationRequest", "AuthenticationResponse", "AuthenticationFailure",
+    "SecurityModeCommand", "SecurityModeComplete",
+    "RegistrationAccept", "RegistrationComplete", "RegistrationReject",
+    "PduSessionEstablishmentRequest", "PduSessionEstablishmentAccept", "PduSessionEstablishmentReject",
+    "DeregistrationRequest", "DeregistrationAccept",
+};
+}
+NasMsgType nas_msg_of(NasEvent ev) { return NAS_MSG_OF[(size_t)ev]; }
+bool nas_event_of(NasMsgType type, NasEvent& ev) {
+    for (size_t i = 0; i < NAS_NUM_EVENTS; i++) {
+        if (NAS_MSG_OF[i] == type && (uint8_t)type) { ev = (NasEvent)i; return true; }
+    }
+    return false;
+}
+const char* nas_event_name(NasEvent ev) { return NAS_EVENT_NAME[(size_t)ev]; }
+std::string nas_ip_to_string(uint32_t ip) {
+    return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 0xFF) + "." +
+           std::to_string((ip >> 8) & 0xFF) + "." + std::to_string(ip & 0xFF);
+}
+
+NasIpPool::NasIpPool(uint32_t first, uint32_t count)
+    : first_(first), count_(count), used_(((size_t)count + 63) / 64, 0) {}
+uint32_t NasIpPool::alloc() {
+    uint32_t off;
+    if (!free_.empty()) { off = free_.back(); free_.pop_back(); }
+    else if (next_ < count_) off = next_++;
+    else return 0;
+    used_[off >> 6] |= 1ull << (off & 63);
+    in_use_++;
+    return first_ + off;
+}
+Status NasIpPool::release(uint32_t ip) {
+    uint32_t off = ip - first_;
+    if (off >= count_ || !(used_[off >> 6] >> (off & 63) & 1)) return Status::ERROR;
+    used_[off >> 6] &= ~(1ull << (off & 63));
+    free_.push_back(off);
+    in_use_--;
+    return Status::OK;
+}
+
+NasMachine::NasMachine(NasIpPool* pool, AkaAuc* auc, uint32_t first_tmsi)
+    : pool_(pool), auc_(auc), next_tmsi_(first_tmsi) {}
+size_t NasMachine::run(NasContext* ues, size_t max) {
+    size_t n = 0;
+    while (n < max && !queue_.empty()) {
+        Queued q = queue_.front();
+        queue_.pop_front();
+        dispatch(ues[q.ue], q.ue, q.ev);
+        n++;
+    }
+    return n;
+}
+bool NasMachine::dispatch(NasContext& c, uint32_t ue, NasEvent ev) {
+    const NasTransition& t = NAS_TABLE.at[(size_t)c.reg_state][(size_t)ev];
+    bump(stats_.events);
+    switch (t.action) {
+        case A::NONE:
+            bump(stats_.unexpected);
+            LOGF_DEBUG("NAS", "UE {}: {} unexpected in state {}", ue, nas_event_name(ev), (int)c.reg_state);
+            return false;
+        case A::UE_REGISTER:
+            send(ue, E::REG_REQUEST);
+            break;
+        case A::AMF_AUTHENTICATE: {
+            AkaVector v;
+            auc_->get_vector(ue, v);
+            std::memcpy(c.rand, v.rand, sizeof(c.rand));
+            std::memcpy(c.autn, v.autn, sizeof(c.autn));
+            std::memcpy(c.xres_star, v.xres_star, sizeof(c.xres_star));
+            std::memcpy(c.hxres_star, v.hxres_star, sizeof(c.hxres_star));
+            std::memcpy(c.k_seaf, v.k_seaf, sizeof(c.k_seaf));
+            send(ue, E::AUTH_REQUEST);
+            break;
+        }
+        case A::UE_AUTHENTICATE: {
+            AkaResult r = aka_ue_authenticate(c.k, c.opc, c.rand, c.autn, auc_->config().snn, c.sqn_ms, c.res_star, nullptr);
+            send(ue, r == AkaResult::OK ? E::AUTH_RESPONSE : E::AUTH_FAILURE);
+            break;
+        }
+        case A::AMF_CHECK_RES: {
+            // SEAF compares HRES* with HXRES*, then the AUSF RES* with XRES*.
+            uint8_t hres[16];
+            aka_hres_star(c.rand, c.res_star, hres);
+            if (std::memcmp(hres, c.hxres_star, 16) == 0 && std::memcmp(c.res_star, c.xres_star, 16) == 0) {
+                send(ue, E::SMC);
+                break;
+            }
+            bump(stats_.auth_failures);
+            send(ue, E::REG_REJECT);
+            break;
+        }
+        case A::AMF_AUTH_FAILED:
+            bump(stats_.auth_failures);
+            send(ue, E::REG_REJECT);
+            break;
+        case A::UE_SMC_COMPLETE:
+            send(ue, E::SMC_COMPLETE);
+            break;
+        case A::AMF_ACCEPT:
+            c.tmsi = next_tmsi_++;
+            send(ue, E::REG_ACCEPT);
+            break;
+        case A::UE_REGISTERED:
+            send(ue, E::REG_COMPLETE);
+            if (c.want_session && c.session == NasSessionState::INACTIVE) post(ue, E::SESSION);
+            break;
+        case A::AMF_REGISTERED:
+            bump(stats_.registrations);
+            break;
+        case A::UE_REJECTED:
+            c.tmsi = 0;
+            break;
+        case A::UE_SESSION:
+            c.want_session = true;
+            if (c.session != NasSessionState::INACTIVE) break;
+            c.session = NasSessionState::ACTIVATING;
+            send(ue, E::SESSION_REQUEST);
+            break;
+        case A::SMF_ESTABLISH:
+            c.ip = pool_ ? pool_->alloc() : 0;
+            if (c.ip) {
+                send(ue, E::SESSION_ACCEPT);
+            } else {
+                bump(stats_.session_rejects);
+                send(ue, E::SESSION_REJECT);
+            }
+            break;
+        case A::UE_SESSION_UP:
+            c.session = NasSessionState::ACTIVE;
+            bump(stats_.sessions);
+            break;
+        case A::UE_SESSION_REJECTED:
+            c.session      = NasSessionState::INACTIVE;
+            c.want_session = false;
+            break;
+        case A::UE_DEREGISTER:
+            c.want_session = false;
+            send(ue, E::DEREG_REQUEST);
+            break;
+        case A::AMF_DEREGISTER:
+        case A::CORE_RESTART:
+            // The network side forgets the UE; after an outage the UE
+            // finds out and registers again.
+            if (c.ip && pool_) pool_->release(c.ip);
+            c.ip      = 0;
+            c.tmsi    = 0;
+            c.session = NasSessionState::INACTIVE;
+            send(ue, t.action == A::CORE_RESTART ? E::REG_REQUEST : E::DEREG_ACCEPT);
+            break;
+        case A::UE_DEREGISTERED:
+            bump(stats_.deregistrations);
+            break;
+    }
+    c.reg_state = t.next;
+    return true;
+}
+
+NasLayer::NasLayer(UeIdentity ue_id, NasIpPool* pool)
+    : ue_id_(ue_id),
+      own_pool_(pool ? nullptr : new NasIpPool(0x0A2D0001, 254)),   // 10.45.0.1-254
+      pool_(pool ? pool : own_pool_.get()),
+      auc_(AkaConfig{}, supi_hash(ue_id_.supi)),
+      fsm_(pool_, &auc_, 0x12345678) {
+    std::memcpy(ctx_.k, ue_id_.key, sizeof(ctx_.k));
+    milenage_opc(ctx_.k, ue_id_.op, ctx_.opc);
+    auc_.add_subscriber(ctx_.k, ctx_.opc);
+    fsm_.set_send_hook([this](uint32_t, NasEvent ev) { on_send(ev); });
+}
+NasLayer::~NasLayer() {
+    if (ctx_.ip) pool_->release(ctx_.ip);
+}
 std::string NasLayer::get_reg_state_str() const {
-    switch(reg_state_) {
+    switch(ctx_.reg_state) {
         case NasRegistrationState::DEREGISTERED:  return "5GMM-DEREGISTERED";
         case NasRegistrationState::REGISTERING:   return "5GMM-REGISTERING";
         case NasRegistrationState::REGISTERED:    return "5GMM-REGISTERED";
@@ -11,116 +250,131 @@ std::string NasLayer::get_reg_state_str() const {
     }
     return "UNKNOWN";
 }
-Bytes NasLayer::build_nas_msg(NasMsgType type, const Bytes& payload) {
-    Bytes msg;
-    msg.push_back(0x7E);
-    msg.push_back(0x00);
-    msg.push_back((uint8_t)type);
-    msg.push_back(nas_seq_++);
-    msg.insert(msg.end(), payload.begin(), payload.end());
-    return msg;
-}
-bool NasLayer::parse_nas_msg(const Bytes& pdu, NasMsgType& type, Bytes& payload) {
-    if (pdu.size() < 4) return false;
-    type    = (NasMsgType)pdu[2];
-    payload = Bytes(pdu.begin() + 4, pdu.end());
-    return true;
-}
-bool NasLayer::authenticate(const Bytes& rand, const Bytes& autn, Bytes& res) {
-    (void)autn;
-    res.resize(8);
-    for (int i = 0; i < 8; i++) res[i] = rand[i % rand.size()] ^ ue_id_.key[i];
-    LOG_INFO("NAS", "AKA: computed RES");
-    return true;
-}
-Status NasLayer::initiate_registration() {
-    if (reg_state_ == NasRegistrationState::REGISTERED) return Status::INVALID_STATE;
-    reg_state_ = NasRegistrationState::REGISTERING;
-    LOG_INFO("NAS", "State -> " + get_reg_state_str());
-    Bytes payload; payload.push_back(0x01);
-    for (char c : ue_id_.imsi) payload.push_back((uint8_t)c);
-    payload.push_back(0x00);
-    Bytes req = build_nas_msg(NasMsgType::REGISTRATION_REQUEST, payload);
-    LOG_INFO("NAS", "Sending RegistrationRequest IMSI=" + ue_id_.imsi);
-    Bytes resp;
-    return receive_message(req, resp);
-}
-Status NasLayer::receive_message(const Bytes& nas_pdu, Bytes& response) {
-    NasMsgType type; Bytes payload;
-    if (!parse_nas_msg(nas_pdu, type, payload)) return Status::ERROR;
-    switch(type) {
-        case NasMsgType::REGISTRATION_REQUEST: {
-            Bytes rand_bytes(16, 0xAB), autn_bytes(16, 0x12), auth_req;
-            auth_req.insert(auth_req.end(), rand_bytes.begin(), rand_bytes.end());
-            auth_req.insert(auth_req.end(), autn_bytes.begin(), autn_bytes.end());
-            response = build_nas_msg(NasMsgType::AUTH_REQUEST, auth_req);
-            LOG_INFO("NAS", "-> AuthenticationRequest sent");
-            Bytes auth_resp;
-            receive_message(response, auth_resp);
+// Encodes each message the machine sends; the first one answering
+// receive_message() becomes its response.
+void NasLayer::on_send(NasEvent ev) {
+    LOGF_INFO("NAS", "-> {} sent", nas_event_name(ev));
+    uint8_t buf[NAS_MAX_MSG];
+    size_t  n = 0;
+    auto emit = [&](const auto& m) { n = nas_encode(m, nas_seq_++, buf, sizeof(buf)); };
+    switch (ev) {
+        case NasEvent::REG_REQUEST: {
+            NasRegistrationRequestMsg m;
+            m.supi = PerView::of(ue_id_.imsi.data(), ue_id_.imsi.size());
+            emit(m);
             break;
         }
-        case NasMsgType::AUTH_REQUEST: {
-            Bytes rand_bytes(payload.begin(), payload.begin()+16);
-            Bytes autn_bytes(payload.begin()+16, payload.begin()+32);
-            Bytes res;
-            authenticate(rand_bytes, autn_bytes, res);
-            response = build_nas_msg(NasMsgType::AUTH_RESPONSE, res);
-            LOG_INFO("NAS", "-> AuthenticationResponse sent");
-            Bytes sec_resp;
-            Bytes sec_cmd = build_nas_msg(NasMsgType::SECURITY_MODE_CMD, {0x01,0x01});
-            receive_message(sec_cmd, sec_resp);
+        case NasEvent::AUTH_REQUEST: {
+            static const uint8_t abba[2] = {0x00, 0x00};
+            NasAuthRequestMsg m;
+            m.abba = PerView::of(abba, sizeof(abba));
+            m.rand = PerView::of(ctx_.rand, sizeof(ctx_.rand));
+            m.autn = PerView::of(ctx_.autn, sizeof(ctx_.autn));
+            emit(m);
             break;
         }
-        case NasMsgType::SECURITY_MODE_CMD:
-            response = build_nas_msg(NasMsgType::SECURITY_MODE_COMPLETE, {});
-            LOG_INFO("NAS", "-> SecurityModeComplete sent");
-            {
-                Bytes reg_accept = build_nas_msg(NasMsgType::REGISTRATION_ACCEPT, {0x00,0x01});
-                Bytes rac_resp;
-                receive_message(reg_accept, rac_resp);
-            }
+        case NasEvent::AUTH_RESPONSE: {
+            NasAuthResponseMsg m;
+            m.res_star = PerView::of(ctx_.res_star, sizeof(ctx_.res_star));
+            emit(m);
             break;
-        case NasMsgType::REGISTRATION_ACCEPT:
-            reg_state_ = NasRegistrationState::REGISTERED;
-            ue_id_.tmsi = 0x12345678;
-            LOG_INFO("NAS", "REGISTERED! TMSI=0x12345678");
-            LOG_INFO("NAS", "State -> " + get_reg_state_str());
-            response = build_nas_msg(NasMsgType::REGISTRATION_COMPLETE, {});
-            break;
-        case NasMsgType::PDU_SESSION_ESTAB_REQ:
-            session_.ip_address = "10.45.0." + std::to_string(1+(std::rand()%254));
-            session_.state = NasSessionState::ACTIVE;
-            response = build_nas_msg(NasMsgType::PDU_SESSION_ESTAB_ACC, {session_.pdu_session_id});
-            LOG_INFO("NAS", "PDU Session established IP=" + session_.ip_address);
+        }
+        case NasEvent::AUTH_FAILURE: emit(NasAuthFailureMsg{}); break;
+        case NasEvent::SMC:          emit(NasSecurityModeCmdMsg{}); break;
+        case NasEvent::SMC_COMPLETE: emit(NasSecurityModeCompleteMsg{}); break;
+        case NasEvent::REG_ACCEPT: {
+            NasRegistrationAcceptMsg m;
+            m.tmsi = ctx_.tmsi;
+            emit(m);
             break;
-        case NasMsgType::PDU_SESSION_ESTAB_ACC:
-            session_.state = NasSessionState::ACTIVE;
+        }
+        case NasEvent::REG_COMPLETE: emit(NasRegistrationCompleteMsg{}); break;
+        case NasEvent::REG_REJECT:   emit(NasRegistrationRejectMsg{}); break;
+        case NasEvent::SESSION_REQUEST: {
+            NasPduSessionEstabReqMsg m;
+            m.session_id = session_.pdu_session_id;
+            m.dnn        = PerView::of(session_.apn.data(), session_.apn.size());
+            emit(m);
             break;
-        case NasMsgType::DEREGISTRATION_REQUEST:
-            reg_state_ = NasRegistrationState::DEREGISTERED;
-            LOG_INFO("NAS", "Deregistered from network");
+        }
+        case NasEvent::SESSION_ACCEPT: {
+            NasPduSessionEstabAccMsg m;
+            m.session_id = session_.pdu_session_id;
+            m.ipv4       = ctx_.ip;
+            emit(m);
             break;
-        default:
+        }
+        case NasEvent::SESSION_REJECT: {
+            NasPduSessionEstabRejMsg m;
+            m.session_id = session_.pdu_session_id;
+            emit(m);
             break;
+        }
+        case NasEvent::DEREG_REQUEST: emit(NasDeregistrationRequestMsg{}); break;
+        case NasEvent::DEREG_ACCEPT:  emit(NasDeregistrationAcceptMsg{}); break;
+        default: break;
     }
+    if (n == 0) {
+        LOGF_WARN("NAS", "{} does not encode", nas_event_name(ev));
+        return;
+    }
+    if (capture_ && reply_.empty()) reply_.assign(buf, buf + n);
+}
+Status NasLayer::run(NasEvent ev) {
+    NasRegistrationState before = ctx_.reg_state;
+    if (!fsm_.dispatch(ctx_, 0, ev)) return Status::INVALID_STATE;
+    fsm_.run(&ctx_);
+    ue_id_.tmsi    = ctx_.tmsi;
+    session_.state = ctx_.session;
+    if (ctx_.ip) session_.ip_address = nas_ip_to_string(ctx_.ip);
+    if (ctx_.reg_state != before) LOG_INFO("NAS", "State -> " + get_reg_state_str());
     return Status::OK;
 }
+Status NasLayer::initiate_registration() {
+    LOG_INFO("NAS", "Registering IMSI=" + ue_id_.imsi);
+    Status s = run(NasEvent::REGISTER);
+    if (s != Status::OK) return s;
+    if (ctx_.reg_state != NasRegistrationState::REGISTERED) return Status::ERROR;
+    LOGF_INFO("NAS", "REGISTERED! TMSI=0x{x}", ctx_.tmsi);
+    return Status::OK;
+}
+Status NasLayer::receive_message(const Bytes& nas_pdu, Bytes& response) {
+    const uint8_t* pdu = nas_pdu.data();
+    size_t         len = nas_pdu.size();
+    NasMsgType type; NasEvent ev;
+    if (!nas_peek_type(pdu, len, type) || !nas_event_of(type, ev)) return Status::ERROR;
+    if (ev == NasEvent::AUTH_REQUEST) {
+        NasAuthRequestMsg m;
+        if (nas_decode(pdu, len, m) != Status::OK) return Status::ERROR;
+        m.rand.copy_to(ctx_.rand, sizeof(ctx_.rand));
+        m.autn.copy_to(ctx_.autn, sizeof(ctx_.autn));
+    } else if (ev == NasEvent::AUTH_RESPONSE) {
+        NasAuthResponseMsg m;
+        if (nas_decode(pdu, len, m) != Status::OK) return Status::ERROR;
+        m.res_star.copy_to(ctx_.res_star, sizeof(ctx_.res_star));
+    } else if (nas_validate(pdu, len) != Status::OK) {
+        return Status::ERROR;
+    }
+    capture_ = true;
+    reply_.clear();
+    Status s = run(ev);
+    capture_ = false;
+    response = std::move(reply_);
+    return s;
+}
 Status NasLayer::request_pdu_session(const std::string& apn) {
-    if (reg_state_ != NasRegistrationState::REGISTERED) return Status::INVALID_STATE;
+    if (ctx_.reg_state != NasRegistrationState::REGISTERED) return Status::INVALID_STATE;
     session_.apn = apn;
-    session_.state = NasSessionState::ACTIVATING;
-    Bytes payload; payload.push_back(session_.pdu_session_id);
-    for (char c : apn) payload.push_back((uint8_t)c);
-    Bytes req = build_nas_msg(NasMsgType::PDU_SESSION_ESTAB_REQ, payload);
-    Bytes resp;
     LOG_INFO("NAS", "Requesting PDU Session APN=" + apn);
-    return receive_message(req, resp);
+    Status s = run(NasEvent::SESSION);
+    if (s != Status::OK) return s;
+    if (ctx_.session != NasSessionState::ACTIVE) return Status::ERROR;
+    LOG_INFO("NAS", "PDU Session established IP=" + session_.ip_address);
+    return Status::OK;
 }
 Status NasLayer::initiate_deregistration() {
-    if (reg_state_ != NasRegistrationState::REGISTERED) return Status::INVALID_STATE;
-    reg_state_ = NasRegistrationState::DEREGISTERING;
-    Bytes req = build_nas_msg(NasMsgType::DEREGISTRATION_REQUEST, {0x01});
-    Bytes resp;
-    LOG_INFO("NAS", "Sending DeregistrationRequest");
-    return receive_message(req, resp);
+    if (ctx_.reg_state != NasRegistrationState::REGISTERED) return Status::INVALID_STATE;
+    Status s = run(NasEvent::DEREGISTER);
+    if (s == Status::OK) LOG_INFO("NAS", "Deregistered from network");
+    return s;
 }
@@ -1,72 +1,311 @@
 #include "pdcp_layer.h"
+#include <algorithm>
 #include <sstream>
-PdcpLayer::PdcpLayer(PdcpBearerType type) : type_(type) {}
-Bytes PdcpLayer::build_pdcp_pdu(const PdcpHeader& hdr, const Bytes& payload) {
-    Bytes pdu;
-    uint8_t b0 = (hdr.data_ctrl ? 0x80 : 0x00) | ((hdr.sn >> 8) & 0x0F);
-    pdu.push_back(b0);
-    pdu.push_back(hdr.sn & 0xFF);
-    pdu.insert(pdu.end(), payload.begin(), payload.end());
-    return pdu;
-}
-bool PdcpLayer::parse_pdcp_pdu(const Bytes& pdu, PdcpHeader& hdr, Bytes& payload) {
-    if (pdu.size() < 2) return false;
-    hdr.data_ctrl = (pdu[0] & 0x80) != 0;
-    hdr.sn        = ((uint16_t)(pdu[0] & 0x0F) << 8) | pdu[1];
-    payload       = Bytes(pdu.begin() + 2, pdu.end());
+PdcpLayer::PdcpLayer(PdcpBearerType type, RohcConfig rohc, PdcpSnLen sn_len)
+    : type_(type), sn_bits_((uint8_t)sn_len), hdr_len_(sn_len == PdcpSnLen::SN12 ? 2 : 3),
+      rohc_tx_(rohc), rohc_rx_(rohc) {}
+// D/C, reserved bits, then the SN: 4 + 8 bits for 12-bit SNs, 2 + 16 for 18-bit.
+void PdcpLayer::build_pdcp_pdu(const PdcpHeader& hdr, PduBuffer& pdu) {
+    uint8_t* h = pdu.prepend(hdr_len_);
+    uint8_t dc = hdr.data_ctrl ? 0x80 : 0x00;
+    if (sn_bits_ == 12) {
+        h[0] = dc | ((hdr.sn >> 8) & 0x0F);
+    } else {
+        h[0] = dc | ((hdr.sn >> 16) & 0x03);
+        h[1] = (hdr.sn >> 8) & 0xFF;
+    }
+    h[hdr_len_ - 1] = hdr.sn & 0xFF;
+}
+bool PdcpLayer::parse_pdcp_pdu(PduBuffer& pdu, PdcpHeader& hdr) {
+    if (pdu.size() < hdr_len_) return false;
+    const uint8_t* h = pdu.data();
+    hdr.data_ctrl = (h[0] & 0x80) != 0;
+    hdr.sn        = sn_of(h);
+    pdu.strip(hdr_len_);
     return true;
 }
-Bytes PdcpLayer::compress_ip_header(const Bytes& ip_packet) {
-    if (ip_packet.size() < 20) return ip_packet;
-    if (!rohc_.established) {
-        rohc_.established = true;
-        Bytes out; out.push_back(0xFD);
-        out.push_back((rohc_.last_sn >> 8) & 0xFF);
-        out.push_back(rohc_.last_sn & 0xFF);
-        out.insert(out.end(), ip_packet.begin(), ip_packet.end());
-        LOG_DEBUG("PDCP", "ROHC: IR packet sent");
-        return out;
-    }
-    rohc_.last_sn++;
-    Bytes out; out.push_back(0x00); out.push_back(rohc_.last_sn & 0xFF);
-    uint8_t crc = 0;
-    for (size_t i = 0; i < std::min((size_t)12, ip_packet.size()); i++) crc ^= ip_packet[i];
-    out.push_back(crc);
-    size_t hdr_len = (ip_packet[0] & 0x0F) * 4;
-    out.insert(out.end(), ip_packet.begin() + hdr_len, ip_packet.end());
-    LOG_DEBUG("PDCP", "ROHC: compressed " + std::to_string(ip_packet.size()) + " -> " + std::to_string(out.size()) + " bytes");
-    return out;
-}
-Bytes PdcpLayer::decompress_ip_header(const Bytes& compressed, bool full_hdr) {
-    if (compressed.empty()) return {};
-    if (full_hdr || compressed[0] == 0xFD) {
-        if (compressed.size() < 3) return compressed;
-        return Bytes(compressed.begin() + 3, compressed.end());
-    }
-    if (compressed.size() < 3) return {};
-    return Bytes(compressed.begin() + 3, compressed.end());
+void PdcpLayer::set_security(const PdcpSecurityConfig& cfg) {
+    sec_cfg_ = cfg;
+    sec_on_  = true;
+    aes128_expand(cfg.k_enc, k_enc_);
+    aes128_cmac_init(cfg.k_int, k_int_);
+    LOGF_INFO("PDCP", "Security on: NEA{} NIA{} bearer={} ({})",
+              (int)cfg.cipher, (int)cfg.integ, cfg.bearer, aes128_impl_name());
 }
 uint32_t PdcpLayer::compute_integrity(const Bytes& msg, uint32_t count, uint32_t key) {
-    uint32_t mac_i = count ^ key;
-    for (size_t i = 0; i < msg.size(); i++) mac_i = (mac_i << 1) ^ (mac_i >> 31) ^ msg[i];
-    return mac_i;
+    uint8_t k[16];
+    for (int i = 0; i < 16; i++) k[i] = (uint8_t)(key >> (24 - 8 * (i & 3)));
+    Aes128Cmac cmac;
+    aes128_cmac_init(k, cmac);
+    return nia2(cmac, count, sec_cfg_.bearer, sec_cfg_.direction, msg.data(), msg.size() * 8);
 }
 bool PdcpLayer::verify_integrity(const Bytes& msg, uint32_t count, uint32_t key, uint32_t expected_mac) {
     return compute_integrity(msg, count, key) == expected_mac;
 }
-Status PdcpLayer::transmit_sdu(const Bytes& sdu_in, Bytes& rlc_pdu) {
-    Bytes payload = (type_ == PdcpBearerType::DRB) ? compress_ip_header(sdu_in) : sdu_in;
-    PdcpHeader hdr; hdr.data_ctrl = true; hdr.sn = tx_sn_;
-    rlc_pdu = build_pdcp_pdu(hdr, payload);
-    LOG_INFO("PDCP", "TX PDCP-PDU SN=" + std::to_string(tx_sn_) + " size=" + std::to_string(rlc_pdu.size()));
-    tx_sn_ = next_sn(tx_sn_);
+// Header is in place. MAC-I covers header + payload, ciphering covers payload
+// + MAC-I; both run as multi-buffer batches of PDCP_SEC_BATCH PDUs.
+void PdcpLayer::protect(PduBuffer* pdus, uint32_t first_count, size_t n) {
+    bool mac_i = has_mac_i();
+    IntegJob  ij[PDCP_SEC_BATCH];
+    CipherJob cj[PDCP_SEC_BATCH];
+    for (size_t base = 0; base < n; base += PDCP_SEC_BATCH) {
+        size_t m = std::min(n - base, PDCP_SEC_BATCH);
+        for (size_t i = 0; i < m; i++) {
+            PduBuffer& pdu = pdus[base + i];
+            uint32_t count = first_count + (uint32_t)(base + i);
+            pdu.make_writable();
+            // append may move the data, so both jobs point into it afterwards.
+            if (mac_i) pdu.append(PDCP_MAC_I_LEN);
+            ij[i] = {&k_int_, count, sec_cfg_.bearer, sec_cfg_.direction, pdu.data(),
+                     (pdu.size() - (mac_i ? PDCP_MAC_I_LEN : 0)) * 8, 0};
+            cj[i] = {&k_enc_, count, sec_cfg_.bearer, sec_cfg_.direction, pdu.data() + hdr_len_, (pdu.size() - hdr_len_) * 8};
+        }
+        if (mac_i) {
+            integ_batch(sec_cfg_.integ, ij, m);
+            for (size_t i = 0; i < m; i++) {
+                uint8_t* t = pdus[base + i].data() + pdus[base + i].size() - PDCP_MAC_I_LEN;
+                t[0] = ij[i].mac >> 24; t[1] = ij[i].mac >> 16; t[2] = ij[i].mac >> 8; t[3] = ij[i].mac;
+            }
+        }
+        cipher_batch(sec_cfg_.cipher, cj, m);
+    }
+}
+void PdcpLayer::unprotect(PduBuffer* pdus, const uint32_t* counts, size_t n, Status* status) {
+    bool    mac_i = has_mac_i();
+    uint8_t dir   = sec_cfg_.direction ^ 1;
+    size_t  min_len = hdr_len_ + (mac_i ? PDCP_MAC_I_LEN : 0);
+    IntegJob  ij[PDCP_SEC_BATCH];
+    CipherJob cj[PDCP_SEC_BATCH];
+    for (size_t base = 0; base < n; base += PDCP_SEC_BATCH) {
+        size_t m = std::min(n - base, PDCP_SEC_BATCH);
+        for (size_t i = 0; i < m; i++) {
+            PduBuffer& pdu = pdus[base + i];
+            size_t len = pdu.size() < min_len ? min_len : pdu.size();
+            if (pdu.size() < min_len) status[base + i] = Status::ERROR;
+            else pdu.make_writable();
+            cj[i] = {&k_enc_, counts[base + i], sec_cfg_.bearer, dir, pdu.data() + hdr_len_, (pdu.size() - hdr_len_) * 8};
+            ij[i] = {&k_int_, counts[base + i], sec_cfg_.bearer, dir, pdu.data(), (len - PDCP_MAC_I_LEN) * 8, 0};
+            if (status[base + i] != Status::OK) { cj[i].bits = 0; ij[i].bits = 0; }
+        }
+        cipher_batch(sec_cfg_.cipher, cj, m);
+        if (!mac_i) continue;
+        integ_batch(sec_cfg_.integ, ij, m);
+        for (size_t i = 0; i < m; i++) {
+            PduBuffer& pdu = pdus[base + i];
+            if (status[base + i] != Status::OK) continue;
+            const uint8_t* t = pdu.data() + pdu.size() - PDCP_MAC_I_LEN;
+            uint32_t rx_mac = ((uint32_t)t[0] << 24) | ((uint32_t)t[1] << 16) | ((uint32_t)t[2] << 8) | t[3];
+            pdu.trim(PDCP_MAC_I_LEN);
+            if (rx_mac != ij[i].mac) {
+                integrity_failures_++;
+                metrics_.rx_integrity_failures.add();
+                status[base + i] = Status::ERROR;
+                LOGF_WARN("PDCP", "Integrity check failed COUNT={}", counts[base + i]);
+            }
+        }
+    }
+}
+void PdcpLayer::bind_metrics(uint32_t ue, uint8_t bearer) {
+    MetricsRegistry& reg = MetricsRegistry::instance();
+    MetricLabels     l{"PDCP", ue, bearer};
+    metrics_.tx_pdus               = reg.counter("pdcp_tx_pdus_total", l);
+    metrics_.rx_pdus               = reg.counter("pdcp_rx_pdus_total", l);
+    metrics_.rx_duplicates         = reg.counter("pdcp_rx_duplicates_total", l);
+    metrics_.rx_integrity_failures = reg.counter("pdcp_rx_integrity_failures_total", l);
+    metrics_.rx_rohc_failures      = reg.counter("pdcp_rx_rohc_failures_total", l);
+    metrics_.rx_lost               = reg.counter("pdcp_rx_lost_total", l);
+    metrics_.rohc_in_bytes         = reg.counter("pdcp_rohc_in_bytes_total", l);
+    metrics_.rohc_out_bytes        = reg.counter("pdcp_rohc_out_bytes_total", l);
+}
+// RCVD_HFN from the SN relative to RX_DELIV (TS 38.323 5.2.2.1). A result
+// below HFN 0 is left at HFN 0, which lands outside the window and is dropped.
+uint32_t PdcpLayer::rx_count_of(uint32_t sn, uint32_t deliv) const {
+    uint32_t hfn = deliv >> sn_bits_;
+    int32_t  ref = (int32_t)(deliv & sn_mask()), win = (int32_t)window();
+    if ((int32_t)sn < ref - win) hfn++;
+    else if ((int32_t)sn >= ref + win && hfn > 0) hfn--;
+    return (hfn << sn_bits_) | sn;
+}
+void PdcpLayer::tx_one(PduBuffer& pdu, uint32_t sn) {
+    if (type_ == PdcpBearerType::DRB) {
+        size_t in_len = pdu.size();
+        rohc_tx_.compress(pdu);
+        metrics_.rohc_in_bytes.add(in_len);
+        metrics_.rohc_out_bytes.add(pdu.size());
+        LOGF_DEBUG("PDCP", "ROHC: compressed {} -> {} bytes", in_len, pdu.size());
+    }
+    PdcpHeader hdr; hdr.data_ctrl = true; hdr.sn = sn;
+    build_pdcp_pdu(hdr, pdu);
+    metrics_.tx_pdus.add();
+}
+// Header decompression runs at delivery so the ROHC context sees packets in
+// COUNT order.
+Status PdcpLayer::rx_decompress(PduBuffer& pdu, uint32_t count) {
+    if (type_ == PdcpBearerType::DRB && rohc_rx_.decompress(pdu) != Status::OK) {
+        metrics_.rx_rohc_failures.add();
+        LOGF_WARN("PDCP", "ROHC decompression failed COUNT={}", count);
+        return Status::ERROR;
+    }
     return Status::OK;
 }
-Status PdcpLayer::receive_pdu(const Bytes& rlc_pdu, Bytes& sdu_out) {
-    PdcpHeader hdr; Bytes payload;
-    if (!parse_pdcp_pdu(rlc_pdu, hdr, payload)) return Status::ERROR;
-    LOG_INFO("PDCP", "RX PDCP-PDU SN=" + std::to_string(hdr.sn));
-    sdu_out = (type_ == PdcpBearerType::DRB) ? decompress_ip_header(payload, payload[0]==0xFD) : payload;
-    rx_sn_ = next_sn(rx_sn_);
+Status PdcpLayer::rx_one(PduBuffer& pdu, PdcpHeader& hdr, uint32_t count) {
+    if (!parse_pdcp_pdu(pdu, hdr)) return Status::ERROR;
+    if (count < rx_deliv_ || count - rx_deliv_ >= window() || rx_has(count)) {
+        rx_duplicates_++;
+        metrics_.rx_duplicates.add();
+        pdu.reset();
+        return Status::PENDING;
+    }
+    metrics_.rx_pdus.add();
+    if (count >= rx_next_) rx_next_ = count + 1;
+    if (count != rx_deliv_) {
+        if (!rx_ring_) {
+            rx_ring_.reset(new PduBuffer[window()]);
+            rx_bitmap_.assign(window() / 64, 0);
+        }
+        rx_ring_[count & (window() - 1)] = std::move(pdu);
+        rx_mark(count, true);
+        rx_update_reordering_timer();
+        return Status::PENDING;
+    }
+    Status st = rx_decompress(pdu, count);
+    rx_deliv_++;
+    rx_deliver_in_order();
+    rx_update_reordering_timer();
+    return st;
+}
+void PdcpLayer::rx_deliver_in_order() {
+    while (rx_has(rx_deliv_)) {
+        PduBuffer& slot = rx_ring_[rx_deliv_ & (window() - 1)];
+        rx_mark(rx_deliv_, false);
+        if (rx_decompress(slot, rx_deliv_) == Status::OK) rx_ready_.push_back(std::move(slot));
+        else slot.reset();
+        rx_deliv_++;
+    }
+}
+void PdcpLayer::rx_update_reordering_timer() {
+    if (t_reordering_left_ >= 0 && rx_deliv_ >= rx_reord_) t_reordering_left_ = -1;
+    if (t_reordering_left_ < 0 && rx_deliv_ < rx_next_) {
+        rx_reord_          = rx_next_;
+        t_reordering_left_ = (int32_t)t_reordering_ms_;
+    }
+}
+// First buffered COUNT in [from, end), or end; scans a bitmap word at a time.
+// Window_Size is a multiple of 64 so a word never straddles the ring wrap.
+uint32_t PdcpLayer::rx_find_stored(uint32_t from, uint32_t end) const {
+    if (rx_bitmap_.empty()) return end;
+    while (from < end) {
+        uint32_t i = from & (window() - 1);
+        uint64_t w = rx_bitmap_[i >> 6] >> (i & 63);
+        if (w) return std::min(end, from + (uint32_t)__builtin_ctzll(w));
+        from += 64 - (i & 63);
+    }
+    return end;
+}
+// t-Reordering expiry: deliver everything buffered below RX_REORD, giving up
+// on the gaps, then the consecutive run from RX_REORD.
+void PdcpLayer::tick(uint32_t ms) {
+    if (t_reordering_left_ < 0) return;
+    t_reordering_left_ -= (int32_t)ms;
+    if (t_reordering_left_ > 0) return;
+    t_reordering_left_ = -1;
+    uint32_t skipped = 0;
+    while (rx_deliv_ < rx_reord_) {
+        uint32_t next = rx_find_stored(rx_deliv_, rx_reord_);
+        skipped  += next - rx_deliv_;
+        rx_deliv_ = next;
+        rx_deliver_in_order();
+    }
+    rx_lost_ += skipped;
+    metrics_.rx_lost.add(skipped);
+    LOGF_WARN("PDCP", "t-Reordering expired: skipped {} COUNTs, RX_DELIV={}", skipped, rx_deliv_);
+    rx_update_reordering_timer();
+}
+bool PdcpLayer::pop_sdu(PduBuffer& sdu) {
+    if (rx_ready_head_ == rx_ready_.size()) return false;
+    sdu = std::move(rx_ready_[rx_ready_head_++]);
+    if (rx_ready_head_ == rx_ready_.size()) { rx_ready_.clear(); rx_ready_head_ = 0; }
+    return true;
+}
+bool PdcpLayer::pop_sdu(Bytes& sdu) {
+    PduBuffer b;
+    if (!pop_sdu(b)) return false;
+    sdu = b.to_bytes();
+    return true;
+}
+Status PdcpLayer::transmit_sdu(PduBuffer& pdu) {
+    tx_one(pdu, get_tx_sn());
+    if (sec_on_) protect(&pdu, tx_count_, 1);
+    capture(true, pdu);
+    LOGF_INFO("PDCP", "TX PDCP-PDU SN={} size={}", get_tx_sn(), pdu.size());
+    tx_count_++;
     return Status::OK;
 }
+Status PdcpLayer::receive_pdu(PduBuffer& pdu) {
+    capture(false, pdu);
+    if (pdu.size() < hdr_len_) return Status::ERROR;
+    uint32_t count = rx_count_of(sn_of(pdu.data()), rx_deliv_);
+    Status st = Status::OK;
+    if (sec_on_) unprotect(&pdu, &count, 1, &st);
+    if (st != Status::OK) return st;
+    PdcpHeader hdr;
+    st = rx_one(pdu, hdr, count);
+    if (st == Status::OK) LOGF_INFO("PDCP", "RX PDCP-PDU SN={}", hdr.sn);
+    else if (st == Status::PENDING) LOGF_DEBUG("PDCP", "Out-of-order COUNT={} RX_DELIV={}", count, rx_deliv_);
+    return st;
+}
+size_t PdcpLayer::transmit_burst(PduBuffer* pdus, size_t n, Status* status) {
+    uint32_t first = tx_count_;
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        tx_one(pdus[i], (first + (uint32_t)i) & sn_mask());
+        status[i] = Status::OK;
+    }
+    if (sec_on_) protect(pdus, first, n);
+    for (size_t i = 0; i < n; i++) {
+        capture(true, pdus[i]);
+        bytes += pdus[i].size();
+    }
+    tx_count_ = first + (uint32_t)n;
+    LOGF_INFO("PDCP", "TX burst n={} SN={}.. bytes={}", n, first & sn_mask(), bytes);
+    return n;
+}
+// COUNTs of a batch are derived before any of it is processed, against
+// RX_DELIV advanced over the in-sequence PDUs of the batch.
+size_t PdcpLayer::receive_burst(PduBuffer* pdus, size_t n, Status* status) {
+    size_t ok = 0, pending = 0;
+    uint32_t counts[PDCP_SEC_BATCH];
+    PdcpHeader hdr;
+    for (size_t base = 0; base < n; base += PDCP_SEC_BATCH) {
+        size_t m = std::min(n - base, PDCP_SEC_BATCH);
+        uint32_t deliv = rx_deliv_;
+        for (size_t i = 0; i < m; i++) {
+            PduBuffer& pdu = pdus[base + i];
+            capture(false, pdu);
+            status[base + i] = pdu.size() < hdr_len_ ? Status::ERROR : Status::OK;
+            if (status[base + i] != Status::OK) { counts[i] = deliv; continue; }
+            counts[i] = rx_count_of(sn_of(pdu.data()), deliv);
+            if (counts[i] == deliv) deliv++;
+        }
+        if (sec_on_) unprotect(pdus + base, counts, m, status + base);
+        for (size_t i = 0; i < m; i++) {
+            if (status[base + i] == Status::OK) status[base + i] = rx_one(pdus[base + i], hdr, counts[i]);
+            if (status[base + i] == Status::OK) ok++;
+            else if (status[base + i] == Status::PENDING) pending++;
+        }
+    }
+    LOGF_INFO("PDCP", "RX burst n={} ok={} out-of-order={}", n, ok, pending);
+    return ok;
+}
+Status PdcpLayer::transmit_sdu(const Bytes& sdu_in, Bytes& rlc_pdu) {
+    PduBuffer pdu = PduBuffer::from(sdu_in);
+    Status st = transmit_sdu(pdu);
+    if (st == Status::OK) rlc_pdu = pdu.to_bytes();
+    return st;
+}
+Status PdcpLayer::receive_pdu(const Bytes& rlc_pdu, Bytes& sdu_out) {
+    PduBuffer pdu = PduBuffer::from(rlc_pdu);
+    Status st = receive_pdu(pdu);
+    if (st == Status::OK) sdu_out = pdu.to_bytes();
+    return st;
+}
@@ -0,0 +1,582 @@
+#include "rohc.h"
+#include "crc.h"
+#include <algorithm>
+#include <cstring>
+namespace {
+constexpr uint8_t PKT_IR     = 0xFC;   // | D: dynamic chain present
+constexpr uint8_t PKT_IR_DYN = 0xF8;
+constexpr uint8_t PKT_PAD    = 0xE0;
+constexpr uint8_t PKT_UOR2   = 0xC0;
+constexpr uint8_t PROTO_UDP  = 17;
+constexpr size_t  IPV4_LEN = 20, UDP_LEN = 8, RTP_LEN = 12;
+constexpr uint8_t FLAG_DF = 1, FLAG_RND = 2, FLAG_UDP_CSUM = 4;
+
+inline uint16_t rd16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+inline uint32_t rd32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+inline void wr16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+inline void wr32(uint8_t* p, uint32_t v) { wr16(p, (uint16_t)(v >> 16)); wr16(p + 2, (uint16_t)v); }
+
+uint16_t ip_checksum(const uint8_t* h) {
+    uint32_t s = 0;
+    for (size_t i = 0; i < IPV4_LEN; i += 2) s += rd16(h + i);
+    while (s >> 16) s = (s & 0xFFFF) + (s >> 16);
+    return (uint16_t)~s;
+}
+
+// Uncompressed header fields for profiles 1 and 2.
+struct Fields {
+    RohcFlowKey key;
+    uint8_t  tos = 0, ttl = 0;
+    bool     df = false, marker = false;
+    uint8_t  pt = 0;
+    uint16_t ip_id = 0, udp_csum = 0, sn = 0;
+    uint32_t ts = 0, ssrc = 0;
+};
+size_t header_len(RohcProfile p) { return IPV4_LEN + UDP_LEN + (p == RohcProfile::RTP ? RTP_LEN : 0); }
+
+// Only headers the decompressor rebuilds bit-exactly are compressed: no IP
+// options or fragments, a valid header checksum and consistent lengths.
+RohcProfile classify(const uint8_t* p, size_t n, const RohcConfig& cfg, Fields& f) {
+    if (n < IPV4_LEN || (p[0] >> 4) != 4) return RohcProfile::UNCOMPRESSED;
+    size_t ihl = (size_t)(p[0] & 0x0F) * 4;
+    f.key.proto = p[9];
+    f.key.src   = rd32(p + 12);
+    f.key.dst   = rd32(p + 16);
+    if ((f.key.proto == PROTO_UDP || f.key.proto == 6) && n >= ihl + 4) {
+        f.key.sport = rd16(p + ihl);
+        f.key.dport = rd16(p + ihl + 2);
+    }
+    if (ihl != IPV4_LEN || f.key.proto != PROTO_UDP || n < IPV4_LEN + UDP_LEN || rd16(p + 2) != n ||
+        (rd16(p + 6) & ~0x4000) != 0 || ip_checksum(p) != 0 || rd16(p + 24) != n - IPV4_LEN)
+        return RohcProfile::UNCOMPRESSED;
+    f.tos      = p[1];
+    f.ip_id    = rd16(p + 4);
+    f.df       = (p[6] & 0x40) != 0;
+    f.ttl      = p[8];
+    f.udp_csum = rd16(p + 26);
+    const uint8_t* r = p + IPV4_LEN + UDP_LEN;
+    if (f.key.dport < cfg.rtp_port_min || f.key.dport > cfg.rtp_port_max || n < header_len(RohcProfile::RTP) || r[0] != 0x80)
+        return RohcProfile::UDP;
+    f.marker = (r[1] & 0x80) != 0;
+    f.pt     = r[1] & 0x7F;
+    f.sn     = rd16(r + 2);
+    f.ts     = rd32(r + 4);
+    f.ssrc   = rd32(r + 8);
+    return RohcProfile::RTP;
+}
+void build_header(RohcProfile prof, const Fields& f, size_t payload, uint8_t* h) {
+    size_t len = header_len(prof) + payload;
+    h[0] = 0x45; h[1] = f.tos;
+    wr16(h + 2, (uint16_t)len);
+    wr16(h + 4, f.ip_id);
+    wr16(h + 6, f.df ? 0x4000 : 0);
+    h[8] = f.ttl; h[9] = PROTO_UDP;
+    wr16(h + 10, 0);
+    wr32(h + 12, f.key.src);
+    wr32(h + 16, f.key.dst);
+    wr16(h + 10, ip_checksum(h));
+    wr16(h + 20, f.key.sport);
+    wr16(h + 22, f.key.dport);
+    wr16(h + 24, (uint16_t)(len - IPV4_LEN));
+    wr16(h + 26, f.udp_csum);
+    if (prof != RohcProfile::RTP) return;
+    uint8_t* r = h + IPV4_LEN + UDP_LEN;
+    r[0] = 0x80; r[1] = (uint8_t)((f.marker ? 0x80 : 0) | f.pt);
+    wr16(r + 2, f.sn);
+    wr32(r + 4, f.ts);
+    wr32(r + 8, f.ssrc);
+}
+
+// W-LSB (RFC 3095 4.5.1): v is sent as its k LSBs and decodes against any
+// reference r with v in [r - p, r - p + 2^k).
+enum LsbKind { LSB_SN, LSB_IPID, LSB_TS };
+inline uint32_t lsb_p(LsbKind kind, int k) {
+    switch (kind) {
+        case LSB_SN:   return k <= 4 ? 1 : (1u << (k - 5)) - 1;
+        case LSB_IPID: return 0;
+        case LSB_TS:   return k < 2 ? 0 : (1u << (k - 2)) - 1;
+    }
+    return 0;
+}
+inline uint32_t lsb_decode(uint32_t ref, uint32_t bits, int k, LsbKind kind, uint32_t mask) {
+    uint32_t base = (ref - lsb_p(kind, k)) & mask;
+    return (base + ((bits - base) & ((1u << k) - 1))) & mask;
+}
+template <typename Get>
+bool lsb_fits(const RohcTxContext& c, uint32_t v, int k, LsbKind kind, uint32_t mask, Get get) {
+    for (uint8_t i = 0; i < c.win_n; i++)
+        if (((v - get(c.win[i]) + lsb_p(kind, k)) & mask) >= (1u << k)) return false;
+    return true;
+}
+inline uint32_t ts_inferred(const RohcRef& r, uint16_t sn) { return r.ts_scaled + (uint32_t)(int32_t)(int16_t)(sn - r.sn); }
+
+// Dynamic chain: TOS, TTL, IP-ID, flags, UDP checksum, SN; RTP adds M/PT,
+// TS and TS_STRIDE.
+size_t put_dynamic(uint8_t* o, RohcProfile prof, const Fields& f, uint16_t sn, bool rnd, uint32_t stride) {
+    uint8_t* s = o;
+    *o++ = f.tos; *o++ = f.ttl;
+    wr16(o, f.ip_id); o += 2;
+    *o++ = (uint8_t)((f.df ? FLAG_DF : 0) | (rnd ? FLAG_RND : 0) | (f.udp_csum ? FLAG_UDP_CSUM : 0));
+    wr16(o, f.udp_csum); o += 2;
+    wr16(o, sn); o += 2;
+    if (prof == RohcProfile::RTP) {
+        *o++ = (uint8_t)((f.marker ? 0x80 : 0) | f.pt);
+        wr32(o, f.ts); o += 4;
+        wr32(o, stride); o += 4;
+    }
+    return (size_t)(o - s);
+}
+size_t dynamic_len(RohcProfile prof) { return 9 + (prof == RohcProfile::RTP ? 9 : 0); }
+size_t static_len(RohcProfile prof) { return 12 + (prof == RohcProfile::RTP ? 4 : 0); }
+
+inline size_t cid_len(uint16_t cid, bool large) { return large ? (cid < 128 ? 1 : 2) : (cid ? 1 : 0); }
+// Prepends hdr (type octet first) with the CID framing: an Add-CID octet in
+// front for small CIDs, SDVL bytes after the type octet for large ones.
+void emit(PduBuffer& pkt, const uint8_t* hdr, size_t n, uint16_t cid, bool large) {
+    size_t   cl = cid_len(cid, large);
+    uint8_t* o  = pkt.prepend(n + cl);
+    if (!large) {
+        if (cid) *o++ = (uint8_t)(PKT_PAD | cid);
+        std::memcpy(o, hdr, n);
+        return;
+    }
+    o[0] = hdr[0];
+    if (cl == 1) o[1] = (uint8_t)cid;
+    else { o[1] = (uint8_t)(0x80 | (cid >> 8)); o[2] = (uint8_t)cid; }
+    std::memcpy(o + 1 + cl, hdr + 1, n - 1);
+}
+uint64_t key_hash(const RohcFlowKey& k) {
+    uint64_t h = (((uint64_t)k.src << 32) | k.dst) * 0x9E3779B97F4A7C15ull;
+    h ^= (((uint64_t)k.sport << 24) | ((uint64_t)k.dport << 8) | k.proto) * 0xC2B2AE3D27D4EB4Full;
+    return h ^ (h >> 29);
+}
+}
+
+RohcCompressor::RohcCompressor(RohcConfig cfg) : cfg_(cfg) {
+    cfg_.max_cid = std::min(cfg_.max_cid, ROHC_MAX_LARGE_CID);
+    cfg_.window  = std::max<uint8_t>(1, std::min<uint8_t>(cfg_.window, 8));
+    ctx_.resize((size_t)cfg_.max_cid + 1);
+    size_t cap = 16;
+    while (cap < 2 * ctx_.size()) cap <<= 1;
+    table_.assign(cap, -1);
+    for (size_t c = ctx_.size(); c-- > 0;) free_cids_.push_back((uint16_t)c);
+}
+size_t RohcCompressor::slot_of(const RohcFlowKey& key) const {
+    size_t mask = table_.size() - 1, s = key_hash(key) & mask;
+    while (table_[s] >= 0 && !(ctx_[table_[s]].key == key)) s = (s + 1) & mask;
+    return s;
+}
+void RohcCompressor::erase(const RohcFlowKey& key) {
+    size_t mask = table_.size() - 1, i = slot_of(key), j = i;
+    if (table_[i] < 0) return;
+    table_[i] = -1;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (table_[j] < 0) return;
+        size_t k = key_hash(ctx_[table_[j]].key) & mask;
+        // Leave entries whose home slot lies cyclically in (i, j].
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        table_[i] = table_[j];
+        table_[j] = -1;
+        i = j;
+    }
+}
+uint16_t RohcCompressor::lookup(const RohcFlowKey& key, RohcProfile profile) {
+    size_t s = slot_of(key);
+    if (table_[s] < 0) {
+        uint16_t cid;
+        if (free_cids_.empty()) {
+            cid = 0;
+            for (size_t c = 1; c < ctx_.size(); c++)
+                if (ctx_[c].last_used < ctx_[cid].last_used) cid = (uint16_t)c;
+            erase(ctx_[cid].key);
+            flows_--;
+            stats_.evictions++;
+            s = slot_of(key);
+        } else {
+            cid = free_cids_.back();
+            free_cids_.pop_back();
+        }
+        table_[s] = cid;
+        ctx_[cid] = RohcTxContext{};
+        ctx_[cid].key    = key;
+        ctx_[cid].in_use = true;
+        flows_++;
+    }
+    RohcTxContext& c = ctx_[table_[s]];
+    if (c.profile != profile) {
+        // A flow switching profile (e.g. a bad checksum) starts over with IR.
+        c = RohcTxContext{};
+        c.key    = key;
+        c.in_use = true;
+    }
+    c.profile = profile;
+    return (uint16_t)table_[s];
+}
+void RohcCompressor::compress(PduBuffer& pkt) {
+    const bool large = cfg_.max_cid > ROHC_MAX_SMALL_CID;
+    Fields      f;
+    RohcProfile prof = classify(pkt.data(), pkt.size(), cfg_, f);
+    uint16_t    cid  = lookup(f.key, prof);
+    RohcTxContext& c = ctx_[cid];
+    c.last_used = ++clock_;
+    stats_.packets++;
+    stats_.bytes_in += pkt.size();
+    uint8_t h[64];
+    if (prof == RohcProfile::UNCOMPRESSED) {
+        // Profile 0: IR until confirmed by repetition, then the packet as-is
+        // unless its first octet would parse as a ROHC packet type.
+        if (c.state == RohcCompState::IR || pkt.empty() || pkt[0] >= PKT_PAD || ++c.since_ir >= cfg_.ir_refresh) {
+            h[0] = PKT_IR; h[1] = (uint8_t)RohcProfile::UNCOMPRESSED; h[2] = 0;
+            h[2] = rohc_crc8(h, 3);
+            emit(pkt, h, 3, cid, large);
+            if (++c.reps >= cfg_.ir_repeat) c.state = RohcCompState::SO;
+            c.since_ir = 0;
+            stats_.ir++;
+        } else {
+            size_t cl = cid_len(cid, large);
+            if (large) {
+                pkt.make_writable();
+                uint8_t* o = pkt.prepend(cl);
+                o[0] = o[cl];
+                if (cl == 1) o[1] = (uint8_t)cid;
+                else { o[1] = (uint8_t)(0x80 | (cid >> 8)); o[2] = (uint8_t)cid; }
+            } else if (cl) {
+                pkt.prepend(1)[0] = (uint8_t)(PKT_PAD | cid);
+            }
+            stats_.normal++;
+        }
+        stats_.bytes_out += pkt.size();
+        return;
+    }
+
+    const bool     rtp  = prof == RohcProfile::RTP;
+    const bool     init = c.state == RohcCompState::IR && c.reps == 0;
+    const uint16_t sn   = rtp ? f.sn : (uint16_t)(c.sn + 1);
+    // IP-ID is random (sent as-is) when its offset from the SN moves by more
+    // than a small step.
+    bool     rnd    = !init && (uint16_t)((f.ip_id - sn) - (c.ip_id - c.sn)) > 32;
+    uint32_t stride = c.ts_stride;
+    bool     changed = !init && (f.tos != c.tos || f.ttl != c.ttl || f.df != c.df || rnd != c.rnd ||
+                                 (f.udp_csum != 0) != c.udp_csum);
+    if (rtp && !init) {
+        uint32_t dts = f.ts - c.ts;
+        if (f.pt != c.pt) changed = true;
+        // TS_STRIDE is learnt from consecutive packets; a TS off the stride
+        // grid goes back to FO with the new stride (0: constant TS).
+        if (stride == 0 ? (dts != 0) : (f.ts % stride != c.ts_offset)) {
+            stride  = (uint16_t)(sn - c.sn) == 1 ? dts : 0;
+            changed = true;
+        }
+    }
+    const uint32_t ts_scaled = rtp && stride ? f.ts / stride : 0;
+    const uint16_t ipid_off  = (uint16_t)(f.ip_id - sn);
+    if (rtp && !init && f.ssrc != c.ssrc) {
+        // SSRC is static: a new RTP source needs a new IR.
+        c.state = RohcCompState::IR;
+        c.reps  = 0;
+    } else if (changed && c.state != RohcCompState::IR) {
+        c.state = RohcCompState::FO;
+        c.reps  = 0;
+    }
+
+    size_t n = 0;
+    enum { IR, IR_DYN, UO0, UO1, UOR2 } type;
+    if (c.state == RohcCompState::IR || c.since_ir >= cfg_.ir_refresh) type = IR;
+    else if (c.state == RohcCompState::FO || c.since_fo >= cfg_.fo_refresh) type = IR_DYN;
+    else type = UO0;
+
+    uint8_t crc_in[IPV4_LEN + UDP_LEN + RTP_LEN];
+    std::memcpy(crc_in, pkt.data(), header_len(prof));
+    if (type == UO0) {
+        auto get_sn   = [](const RohcRef& r) { return (uint32_t)r.sn; };
+        auto get_ipid = [](const RohcRef& r) { return (uint32_t)r.ipid_off; };
+        auto get_ts   = [](const RohcRef& r) { return r.ts_scaled; };
+        auto sn_fits   = [&](int k) { return lsb_fits(c, sn, k, LSB_SN, 0xFFFF, get_sn); };
+        auto ipid_fits = [&](int k) { return rnd || lsb_fits(c, ipid_off, k, LSB_IPID, 0xFFFF, get_ipid); };
+        auto ts_fits   = [&](int k) { return lsb_fits(c, ts_scaled, k, LSB_TS, 0xFFFFFFFF, get_ts); };
+        bool ipid_inf = rnd, ts_inf = true;
+        if (!rnd) {
+            ipid_inf = true;
+            for (uint8_t i = 0; i < c.win_n; i++) ipid_inf = ipid_inf && c.win[i].ipid_off == ipid_off;
+        }
+        for (uint8_t i = 0; stride && i < c.win_n; i++) ts_inf = ts_inf && ts_inferred(c.win[i], sn) == ts_scaled;
+        uint8_t crc3 = rohc_crc3(crc_in, header_len(prof)), crc7 = rohc_crc7(crc_in, header_len(prof));
+        if (!rtp) {
+            if (sn_fits(4) && ipid_inf) {
+                h[n++] = (uint8_t)((sn & 0x0F) << 3 | crc3);
+            } else if (sn_fits(5) && ipid_fits(6)) {
+                type = UO1;
+                h[n++] = (uint8_t)(0x80 | (ipid_off & 0x3F));
+                h[n++] = (uint8_t)((sn & 0x1F) << 3 | crc3);
+            } else if (sn_fits(5) && ipid_inf) {
+                type = UOR2;
+                h[n++] = (uint8_t)(PKT_UOR2 | (sn & 0x1F));
+                h[n++] = crc7;
+            } else if (sn_fits(13) && ipid_fits(8)) {
+                type = UOR2;
+                h[n++] = (uint8_t)(PKT_UOR2 | (sn & 0x1F));
+                h[n++] = (uint8_t)(0x80 | crc7);
+                h[n++] = (uint8_t)(sn >> 5);
+                h[n++] = (uint8_t)ipid_off;
+            } else {
+                type = IR_DYN;
+            }
+        } else {
+            uint8_t m = f.marker ? 1 : 0;
+            if (!m && sn_fits(4) && ipid_inf && ts_inf) {
+                h[n++] = (uint8_t)((sn & 0x0F) << 3 | crc3);
+            } else if (sn_fits(4) && ipid_inf && ts_fits(6)) {
+                type = UO1;
+                h[n++] = (uint8_t)(0x80 | (ts_scaled & 0x3F));
+                h[n++] = (uint8_t)(m << 7 | (sn & 0x0F) << 3 | crc3);
+            } else if (sn_fits(6) && ipid_inf && ts_fits(6)) {
+                type = UOR2;
+                h[n++] = (uint8_t)(PKT_UOR2 | ((ts_scaled >> 1) & 0x1F));
+                h[n++] = (uint8_t)((ts_scaled & 1) << 7 | m << 6 | (sn & 0x3F));
+                h[n++] = crc7;
+            } else if (sn_fits(14) && ipid_fits(8) && ts_fits(14)) {
+                type = UOR2;
+                h[n++] = (uint8_t)(PKT_UOR2 | ((ts_scaled >> 1) & 0x1F));
+                h[n++] = (uint8_t)((ts_scaled & 1) << 7 | m << 6 | (sn & 0x3F));
+                h[n++] = (uint8_t)(0x80 | crc7);
+                h[n++] = (uint8_t)(sn >> 6);
+                h[n++] = (uint8_t)(ts_scaled >> 6);
+                h[n++] = (uint8_t)ipid_off;
+            } else {
+                type = IR_DYN;
+            }
+        }
+        if (type == IR_DYN) { c.state = RohcCompState::FO; c.reps = 0; n = 0; }
+        else {
+            if (rnd) { wr16(h + n, f.ip_id); n += 2; }
+            if (f.udp_csum) { wr16(h + n, f.udp_csum); n += 2; }
+        }
+    }
+    if (type == IR || type == IR_DYN) {
+        h[n++] = type == IR ? (uint8_t)(PKT_IR | 1) : PKT_IR_DYN;
+        h[n++] = (uint8_t)prof;
+        h[n++] = 0;
+        if (type == IR) {
+            wr32(h + n, f.key.src); wr32(h + n + 4, f.key.dst);
+            wr16(h + n + 8, f.key.sport); wr16(h + n + 10, f.key.dport);
+            if (rtp) wr32(h + n + 12, f.ssrc);
+            n += static_len(prof);
+        }
+        n += put_dynamic(h + n, prof, f, sn, rnd, stride);
+        h[2] = rohc_crc8(h, n);
+        if (++c.reps >= cfg_.ir_repeat) c.state = RohcCompState::SO;
+        c.since_fo = 0;
+        c.win_n = c.win_head = 0;
+        if (type == IR) { c.since_ir = 0; stats_.ir++; }
+        else stats_.ir_dyn++;
+    } else {
+        stats_.uo0 += type == UO0;
+        stats_.uo1 += type == UO1;
+        stats_.uor2 += type == UOR2;
+    }
+    c.since_ir++;
+    c.since_fo++;
+    pkt.strip(header_len(prof));
+    emit(pkt, h, n, cid, large);
+    stats_.bytes_out += pkt.size();
+
+    c.tos = f.tos; c.ttl = f.ttl; c.df = f.df; c.rnd = rnd; c.udp_csum = f.udp_csum != 0;
+    c.sn = sn; c.ip_id = f.ip_id;
+    c.marker = f.marker; c.pt = f.pt; c.ts = f.ts; c.ssrc = f.ssrc;
+    c.ts_stride = stride; c.ts_offset = stride ? f.ts % stride : f.ts;
+    c.win[c.win_head] = {sn, ipid_off, ts_scaled};
+    c.win_head = (uint8_t)((c.win_head + 1) % cfg_.window);
+    if (c.win_n < cfg_.window) c.win_n++;
+}
+
+RohcDecompressor::RohcDecompressor(RohcConfig cfg) : cfg_(cfg) {
+    cfg_.max_cid = std::min(cfg_.max_cid, ROHC_MAX_LARGE_CID);
+    ctx_.resize((size_t)cfg_.max_cid + 1);
+}
+void RohcDecompressor::crc_failed(RohcRxContext& c) {
+    crc_failures_++;
+    if (++c.failures < cfg_.crc_fail_k) return;
+    c.failures = 0;
+    c.state = c.state == RohcDecompState::FC ? RohcDecompState::SC : RohcDecompState::NC;
+}
+Status RohcDecompressor::decompress(PduBuffer& pkt) {
+    const bool large = cfg_.max_cid > ROHC_MAX_SMALL_CID;
+    const uint8_t* p = pkt.data();
+    size_t   n = pkt.size(), pos = 0;
+    uint16_t cid = 0;
+    while (pos < n && p[pos] == PKT_PAD) pos++;
+    if (!large && pos < n && (p[pos] & 0xF0) == PKT_PAD) cid = p[pos++] & 0x0F;
+    if (pos >= n) return Status::ERROR;
+    size_t  type_pos = pos;
+    uint8_t type     = p[pos++];
+    if (large) {
+        if (pos >= n) return Status::ERROR;
+        if (!(p[pos] & 0x80)) cid = p[pos++];
+        else if ((p[pos] & 0xC0) == 0x80 && pos + 1 < n) { cid = (uint16_t)((p[pos] & 0x3F) << 8 | p[pos + 1]); pos += 2; }
+        else return Status::ERROR;
+    }
+    if (cid > cfg_.max_cid) return Status::ERROR;
+    RohcRxContext& c = ctx_[cid];
+    // Header bytes without CID framing, for the CRC-8 over IR / IR-DYN.
+    uint8_t hdr[64];
+    Fields  f;
+    uint8_t out[IPV4_LEN + UDP_LEN + RTP_LEN];
+
+    if ((type & 0xFE) == PKT_IR || type == PKT_IR_DYN) {
+        if (pos + 2 > n) return Status::ERROR;
+        RohcProfile prof = (RohcProfile)p[pos];
+        bool ir = type != PKT_IR_DYN, dyn = type != PKT_IR;
+        if (prof > RohcProfile::UDP || (!ir && (c.state == RohcDecompState::NC || prof != c.profile))) return Status::ERROR;
+        if (prof == RohcProfile::UNCOMPRESSED && dyn) return Status::ERROR;
+        size_t len = 3 + (ir ? static_len(prof) : 0) + (dyn ? dynamic_len(prof) : 0);
+        if (prof == RohcProfile::UNCOMPRESSED) len = 3;
+        if (pos + len - 1 > n) return Status::ERROR;
+        hdr[0] = type;
+        std::memcpy(hdr + 1, p + pos, len - 1);
+        uint8_t crc = hdr[2];
+        hdr[2] = 0;
+        if (rohc_crc8(hdr, len) != crc) { crc_failures_++; return Status::ERROR; }
+        size_t end = pos + len - 1;
+        if (prof == RohcProfile::UNCOMPRESSED) {
+            c = RohcRxContext{};
+            c.profile = prof;
+            c.state   = RohcDecompState::FC;
+            pkt.strip(end);
+            return Status::OK;
+        }
+        const uint8_t* q = hdr + 3;
+        if (ir) {
+            c = RohcRxContext{};
+            c.profile   = prof;
+            c.key.src   = rd32(q); c.key.dst = rd32(q + 4);
+            c.key.sport = rd16(q + 8); c.key.dport = rd16(q + 10);
+            c.key.proto = PROTO_UDP;
+            if (prof == RohcProfile::RTP) c.ssrc = rd32(q + 12);
+            q += static_len(prof);
+        }
+        f.key  = c.key; f.ssrc = c.ssrc;
+        f.tos  = q[0]; f.ttl = q[1];
+        f.ip_id = rd16(q + 2);
+        c.df = (q[4] & FLAG_DF) != 0; c.rnd = (q[4] & FLAG_RND) != 0; c.udp_csum = (q[4] & FLAG_UDP_CSUM) != 0;
+        f.df = c.df;
+        f.udp_csum = rd16(q + 5);
+        f.sn = rd16(q + 7);
+        uint32_t ts_scaled = 0;
+        if (prof == RohcProfile::RTP) {
+            f.marker = (q[9] & 0x80) != 0; f.pt = q[9] & 0x7F;
+            f.ts = rd32(q + 10);
+            c.ts_stride = rd32(q + 14);
+            c.ts_offset = c.ts_stride ? f.ts % c.ts_stride : f.ts;
+            ts_scaled   = c.ts_stride ? f.ts / c.ts_stride : 0;
+            c.pt = f.pt;
+        }
+        c.tos = f.tos; c.ttl = f.ttl;
+        c.ref   = {f.sn, (uint16_t)(f.ip_id - f.sn), ts_scaled};
+        c.prev  = c.ref;
+        c.state = RohcDecompState::FC;
+        c.failures = 0;
+        build_header(prof, f, n - end, out);
+        pkt.strip(end);
+        std::memcpy(pkt.prepend(header_len(prof)), out, header_len(prof));
+        return Status::OK;
+    }
+
+    if (c.state != RohcDecompState::FC) return Status::ERROR;
+    if (c.profile == RohcProfile::UNCOMPRESSED) {
+        if (large) {
+            pkt.make_writable();
+            pkt.data()[pos - 1] = type;
+            pkt.strip(pos - 1);
+        } else {
+            pkt.strip(type_pos);
+        }
+        return Status::OK;
+    }
+
+    // Compressed base header: LSBs and their widths, -1 where inferred.
+    const bool rtp = c.profile == RohcProfile::RTP;
+    uint32_t sn_bits = 0, ts_bits = 0, ipid_bits = 0, crc = 0;
+    int      k_sn = 0, k_ts = -1, k_ipid = -1;
+    bool     crc7 = false, marker = false;
+    auto need = [&](size_t m) { return pos + m <= n; };
+    if (!(type & 0x80)) {
+        sn_bits = (type >> 3) & 0x0F; k_sn = 4; crc = type & 7;
+    } else if ((type & 0xC0) == 0x80) {
+        if (!need(1)) return Status::ERROR;
+        uint8_t b = p[pos++];
+        crc = b & 7;
+        if (!rtp) { ipid_bits = type & 0x3F; k_ipid = 6; sn_bits = b >> 3; k_sn = 5; }
+        else      { ts_bits = type & 0x3F; k_ts = 6; marker = (b & 0x80) != 0; sn_bits = (b >> 3) & 0x0F; k_sn = 4; }
+    } else if ((type & 0xE0) == PKT_UOR2) {
+        crc7 = true;
+        if (!rtp) {
+            if (!need(1)) return Status::ERROR;
+            sn_bits = type & 0x1F; k_sn = 5;
+            uint8_t b = p[pos++];
+            crc = b & 0x7F;
+            if (b & 0x80) {
+                if (!need(2)) return Status::ERROR;
+                sn_bits |= (uint32_t)p[pos] << 5; k_sn = 13;
+                ipid_bits = p[pos + 1]; k_ipid = 8;
+                pos += 2;
+            }
+        } else {
+            if (!need(2)) return Status::ERROR;
+            uint8_t b1 = p[pos], b2 = p[pos + 1];
+            pos += 2;
+            ts_bits = (uint32_t)(type & 0x1F) << 1 | b1 >> 7; k_ts = 6;
+            marker  = (b1 & 0x40) != 0;
+            sn_bits = b1 & 0x3F; k_sn = 6;
+            crc = b2 & 0x7F;
+            if (b2 & 0x80) {
+                if (!need(3)) return Status::ERROR;
+                sn_bits |= (uint32_t)p[pos] << 6; k_sn = 14;
+                ts_bits |= (uint32_t)p[pos + 1] << 6; k_ts = 14;
+                ipid_bits = p[pos + 2]; k_ipid = 8;
+                pos += 3;
+            }
+        }
+    } else {
+        return Status::ERROR;
+    }
+    uint16_t raw_ipid = 0;
+    if (c.rnd) { if (!need(2)) return Status::ERROR; raw_ipid = rd16(p + pos); pos += 2; }
+    f.udp_csum = 0;
+    if (c.udp_csum) { if (!need(2)) return Status::ERROR; f.udp_csum = rd16(p + pos); pos += 2; }
+    f.key = c.key; f.ssrc = c.ssrc; f.tos = c.tos; f.ttl = c.ttl; f.df = c.df;
+    f.pt = c.pt; f.marker = marker;
+    const size_t hlen = header_len(c.profile), payload = n - pos;
+
+    // Decode against a reference, optionally forcing an SN wraparound, and
+    // check the CRC over the rebuilt header.
+    RohcRef got{};
+    auto attempt = [&](const RohcRef& ref, uint32_t sn_add) {
+        uint16_t sn   = (uint16_t)(lsb_decode(ref.sn, sn_bits, k_sn, LSB_SN, 0xFFFF) + sn_add);
+        uint16_t ioff = k_ipid < 0 ? ref.ipid_off : (uint16_t)lsb_decode(ref.ipid_off, ipid_bits, k_ipid, LSB_IPID, 0xFFFF);
+        uint32_t tss  = 0;
+        if (rtp && c.ts_stride)
+            tss = k_ts < 0 ? ts_inferred(ref, sn) : lsb_decode(ref.ts_scaled, ts_bits, k_ts, LSB_TS, 0xFFFFFFFF);
+        f.sn    = rtp ? sn : 0;
+        f.ip_id = c.rnd ? raw_ipid : (uint16_t)(sn + ioff);
+        f.ts    = tss * c.ts_stride + c.ts_offset;
+        build_header(c.profile, f, payload, out);
+        uint8_t calc = crc7 ? rohc_crc7(out, hlen) : rohc_crc3(out, hlen);
+        got = {sn, ioff, tss};
+        return calc == crc;
+    };
+    bool ok = attempt(c.ref, 0);
+    if (!ok) {
+        // Context repair, RFC 3095 5.3.2.2.4-5: SN wraparound, then the
+        // previous reference.
+        ok = attempt(c.ref, 1u << k_sn) || (!(c.prev.sn == c.ref.sn && c.prev.ts_scaled == c.ref.ts_scaled) && attempt(c.prev, 0));
+        if (ok) repairs_++;
+    }
+    if (!ok) { crc_failed(c); return Status::ERROR; }
+    c.prev = c.ref;
+    c.ref  = got;
+    c.failures = 0;
+    pkt.strip(pos);
+    std::memcpy(pkt.prepend(hlen), out, hlen);
+    return Status::OK;
+}
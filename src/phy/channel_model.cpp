@@ -0,0 +1,151 @@
+#include "channel_model.h"
+#include "phy_layer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+namespace {
+// SNR at 50% BLER for each MCS; curves are logistic with BLER_SLOPE per dB,
+// close to LDPC AWGN link-level results for TB sizes of a few kbit.
+struct McsCurve {
+    MCS   mcs;
+    float snr50_db;
+};
+const McsCurve CURVES[] = {
+    {MCS::QPSK_1_3,  -2.0f},
+    {MCS::QPSK_1_2,   0.5f},
+    {MCS::QAM16_1_2,  5.5f},
+    {MCS::QAM64_2_3, 12.0f},
+    {MCS::QAM64_5_6, 15.5f},
+    {MCS::QAM256_3_4, 20.0f},
+};
+constexpr int   N_MCS      = sizeof(CURVES) / sizeof(CURVES[0]);
+constexpr int   N_SNR      = (int)((ChannelModel::SNR_MAX_DB - ChannelModel::SNR_MIN_DB) / ChannelModel::SNR_STEP_DB) + 1;
+constexpr float BLER_SLOPE = 2.0f;
+constexpr float BER_DENSE  = 1.0f / 64;
+
+struct BlerTable {
+    float v[N_MCS][N_SNR];
+    BlerTable() {
+        for (int m = 0; m < N_MCS; m++)
+            for (int i = 0; i < N_SNR; i++) {
+                float snr = ChannelModel::SNR_MIN_DB + i * ChannelModel::SNR_STEP_DB;
+                v[m][i] = 1.0f / (1.0f + std::exp(BLER_SLOPE * (snr - CURVES[m].snr50_db)));
+            }
+    }
+};
+const BlerTable& bler_table() {
+    static const BlerTable t;
+    return t;
+}
+int mcs_row(MCS mcs) {
+    for (int m = 0; m < N_MCS; m++) if (CURVES[m].mcs == mcs) return m;
+    return 0;
+}
+inline float q_func(float x) { return 0.5f * std::erfc(x * 0.70710678f); }
+}
+ChannelModel::ChannelModel(uint64_t stream, uint64_t seed) : rng_(seed, stream) {}
+float ChannelModel::bler(MCS mcs, float snr_db) {
+    float pos = (snr_db - SNR_MIN_DB) / SNR_STEP_DB + 0.5f;
+    int   i   = pos <= 0.0f ? 0 : std::min((int)pos, N_SNR - 1);
+    return bler_table().v[mcs_row(mcs)][i];
+}
+// Gray-mapped square QAM in AWGN, nearest-neighbour approximation.
+float ChannelModel::raw_ber(MCS mcs, float snr_db) {
+    uint32_t qm  = mcs_params(mcs).qm;
+    float    snr = std::pow(10.0f, snr_db / 10.0f);
+    float    m   = (float)(1u << qm);
+    float    ber = qm == 2 ? q_func(std::sqrt(snr))
+                           : 4.0f / qm * (1.0f - 1.0f / std::sqrt(m)) * q_func(std::sqrt(3.0f * snr / (m - 1.0f)));
+    return std::min(ber, 0.5f);
+}
+// Sparse errors use a geometric skip (one variate per flipped bit). Dense
+// errors build 64-bit Bernoulli masks from the 8-bit binary expansion of ber
+// (mask = r | m or r & m per bit), fed by a wyrand generator seeded from the
+// Philox stream.
+size_t ChannelModel::inject_bit_errors(uint8_t* p, size_t len, float ber) {
+    if (ber <= 0.0f || len == 0) return 0;
+    size_t flips = 0;
+    if (ber < BER_DENSE) {
+        uint64_t bits  = (uint64_t)len * 8;
+        float    scale = 1.0f / std::log1p(-ber);
+        uint64_t pos   = (uint64_t)(std::log(rng_.next_float_nz()) * scale);
+        while (pos < bits) {
+            p[pos >> 3] ^= (uint8_t)(0x80 >> (pos & 7));
+            flips++;
+            pos += 1 + (uint64_t)(std::log(rng_.next_float_nz()) * scale);
+        }
+    } else {
+        uint32_t q  = (uint32_t)std::min(ber * 256.0f + 0.5f, 128.0f);
+        int      lo = __builtin_ctz(q);
+        uint64_t s = ((uint64_t)rng_.next_u32() << 32) | rng_.next_u32();
+        auto wyrand = [&s]() {
+            s += 0xA0761D6478BD642Full;
+            __uint128_t t = (__uint128_t)s * (s ^ 0xE7037ED1A0B428DBull);
+            return (uint64_t)(t >> 64) ^ (uint64_t)t;
+        };
+        for (size_t off = 0; off < len; off += 8) {
+            uint64_t m = 0;
+            for (int i = lo; i < 8; i++) m = (q >> i) & 1 ? (m | wyrand()) : (m & wyrand());
+            size_t   n = std::min<size_t>(8, len - off);
+            uint64_t w = 0;
+            if (n < 8) m &= (1ull << (8 * n)) - 1;
+            std::memcpy(&w, p + off, n);
+            w ^= m;
+            std::memcpy(p + off, &w, n);
+            flips += (size_t)__builtin_popcountll(m);
+        }
+    }
+    bit_errors_ += flips;
+    return flips;
+}
+bool ChannelModel::decode(PduBuffer& tb, MCS mcs, float snr_db) {
+    Status st;
+    return decode_batch(&tb, 1, mcs, snr_db, &st) == 1;
+}
+size_t ChannelModel::decode_batch(PduBuffer* tbs, size_t n, MCS mcs, float snr_db, Status* status) {
+    // One table lookup and one BER evaluation per batch, uniforms drawn in
+    // blocks; only failed TBs are touched.
+    const float    p_fail = bler(mcs, snr_db);
+    const uint32_t thresh = (uint32_t)std::min(p_fail * 4294967296.0, 4294967295.0);
+    float  ber = -1.0f;
+    size_t ok  = 0;
+    uint32_t u[64];
+    for (size_t base = 0; base < n; base += 64) {
+        size_t m = std::min<size_t>(64, n - base);
+        rng_.fill(u, m);
+        for (size_t i = 0; i < m; i++) {
+            if (u[i] >= thresh) { status[base + i] = Status::OK; ok++; continue; }
+            status[base + i] = Status::RETRY;
+            PduBuffer& tb = tbs[base + i];
+            if (ber < 0.0f) ber = raw_ber(mcs, snr_db);
+            tb.make_writable();
+            // A failed TB always carries at least one error so its CRC fails.
+            if (inject_bit_errors(tb.data(), tb.size(), ber) == 0 && tb.size()) {
+                uint32_t r = rng_.next_u32();
+                tb.data()[r % tb.size()] ^= (uint8_t)(1u << (r >> 29));
+                bit_errors_++;
+            }
+        }
+    }
+    return ok;
+}
+size_t ChannelModel::transmit_symbols(PduBuffer& tb, MCS mcs, float snr_db, uint32_t c_init) {
+    uint8_t qm    = mcs_params(mcs).qm;
+    size_t  len   = tb.size(), nbits = len * 8, nsym = num_symbols(qm, nbits);
+    float   n0    = std::pow(10.0f, -snr_db / 10.0f);
+    if (len == 0) return 0;
+    tb.make_writable();
+    uint8_t* p = tb.data();
+    if (sym_.size() < nsym) { sym_.resize(nsym); llr_.resize(nsym * qm); }
+    scramble(p, len, c_init);
+    ref_.assign(p, p + len);
+    modulate(qm, p, nbits, sym_.data());
+    awgn(sym_.data(), nsym, n0, rng_);
+    demodulate_llr(qm, sym_.data(), nsym, n0, llr_.data());
+    llr_to_bits(llr_.data(), nbits, p);
+    size_t flips = 0;
+    for (size_t i = 0; i < len; i++) flips += (size_t)__builtin_popcount(p[i] ^ ref_[i]);
+    scramble(p, len, c_init);
+    bit_errors_ += flips;
+    return flips;
+}
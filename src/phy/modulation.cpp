@@ -0,0 +1,312 @@
+#include "modulation.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+namespace {
+inline uint8_t rev8(uint8_t b) {
+    return (uint8_t)(((b * 0x0802u & 0x22110u) | (b * 0x8020u & 0x88440u)) * 0x10101u >> 16);
+}
+// Gray mapping, TS 38.211 5.1.3-5.1.5: each axis is a PAM built from every
+// other bit, I from b0 b2 b4 b6 and Q from b1 b3 b5 b7.
+float pam_level(const int* s, int m) {
+    float t = 1.0f;
+    for (int k = m - 1; k >= 1; k--) t = (float)(1 << (m - k)) - (1 - 2 * s[k]) * t;
+    return (1 - 2 * s[0]) * t;
+}
+inline float axis_scale(int m) { return 1.0f / std::sqrt(2.0f * ((1 << (2 * m)) - 1) / 3.0f); }
+struct MapTables {
+    cf32 lut[5][256];   // indexed by qm / 2
+    MapTables() {
+        for (int m = 1; m <= 4; m++) {
+            int   qm = 2 * m;
+            float a  = axis_scale(m);
+            for (int idx = 0; idx < (1 << qm); idx++) {
+                int si[4], sq[4];
+                for (int k = 0; k < m; k++) {
+                    si[k] = (idx >> (qm - 1 - 2 * k)) & 1;
+                    sq[k] = (idx >> (qm - 2 - 2 * k)) & 1;
+                }
+                lut[m][idx] = {a * pam_level(si, m), a * pam_level(sq, m)};
+            }
+        }
+    }
+};
+const MapTables& map_tables() {
+    static const MapTables t;
+    return t;
+}
+
+// Max-log LLRs per axis in units of the PAM grid: L0 = y, then
+// L_k = 2^(m-k) - |L_(k-1)| with |y| for k = 1.
+void demod_scalar(uint8_t qm, const cf32* sym, size_t nsym, float n0, float* llr) {
+    int   m     = qm / 2;
+    float a     = axis_scale(m);
+    float inv_a = 1.0f / a, scale = 4.0f * a * a / n0;
+    for (size_t s = 0; s < nsym; s++) {
+        float yi = sym[s].re * inv_a, yq = sym[s].im * inv_a;
+        float* o = llr + s * qm;
+        o[0] = yi * scale; o[1] = yq * scale;
+        float ti = std::fabs(yi), tq = std::fabs(yq), A = (float)(1 << (m - 1));
+        for (int k = 1; k < m; k++, A *= 0.5f) {
+            float li = A - ti, lq = A - tq;
+            o[2 * k] = li * scale; o[2 * k + 1] = lq * scale;
+            ti = std::fabs(li); tq = std::fabs(lq);
+        }
+    }
+}
+
+// Vector kernel over interleaved I/Q floats, N per register; each level is
+// computed for N/2 symbols at once, then written out as (I, Q) pairs.
+typedef float   v8f  __attribute__((vector_size(32)));
+typedef int32_t v8i  __attribute__((vector_size(32)));
+typedef float   v16f __attribute__((vector_size(64)));
+typedef int32_t v16i __attribute__((vector_size(64)));
+template <typename V, typename VI, int N, int M>
+inline __attribute__((always_inline)) void demod_vec(const cf32* sym, size_t nsym, float n0, float* llr) {
+    constexpr int QM = 2 * M;
+    const float a = axis_scale(M), inv_a = 1.0f / a, scale = 4.0f * a * a / n0;
+    const float* in = &sym[0].re;
+    size_t s = 0;
+    for (; s + N / 2 <= nsym; s += N / 2) {
+        V y;
+        std::memcpy(&y, in + 2 * s, sizeof(V));
+        V L[M];
+        V x  = y * inv_a;
+        L[0] = x * scale;
+        V t  = (V)((VI)x & 0x7FFFFFFF);
+        float A = (float)(1 << (M - 1));
+        for (int k = 1; k < M; k++, A *= 0.5f) {
+            V l  = A - t;
+            L[k] = l * scale;
+            t    = (V)((VI)l & 0x7FFFFFFF);
+        }
+        float* o = llr + s * QM;
+        for (int k = 0; k < M; k++)
+            for (int j = 0; j < N / 2; j++) {
+                o[j * QM + 2 * k]     = L[k][2 * j];
+                o[j * QM + 2 * k + 1] = L[k][2 * j + 1];
+            }
+    }
+    if (s < nsym) demod_scalar(QM, sym + s, nsym - s, n0, llr + s * QM);
+}
+__attribute__((target("avx2,fma")))
+void demod_avx2(uint8_t qm, const cf32* sym, size_t nsym, float n0, float* llr) {
+    switch (qm) {
+        case 2: demod_vec<v8f, v8i, 8, 1>(sym, nsym, n0, llr); break;
+        case 4: demod_vec<v8f, v8i, 8, 2>(sym, nsym, n0, llr); break;
+        case 6: demod_vec<v8f, v8i, 8, 3>(sym, nsym, n0, llr); break;
+        case 8: demod_vec<v8f, v8i, 8, 4>(sym, nsym, n0, llr); break;
+    }
+}
+__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl,fma")))
+void demod_avx512(uint8_t qm, const cf32* sym, size_t nsym, float n0, float* llr) {
+    switch (qm) {
+        case 2: demod_vec<v16f, v16i, 16, 1>(sym, nsym, n0, llr); break;
+        case 4: demod_vec<v16f, v16i, 16, 2>(sym, nsym, n0, llr); break;
+        case 6: demod_vec<v16f, v16i, 16, 3>(sym, nsym, n0, llr); break;
+        case 8: demod_vec<v16f, v16i, 16, 4>(sym, nsym, n0, llr); break;
+    }
+}
+
+// Hard decisions are the LLR sign bits; movemask packs them LSB-first.
+void bits_scalar(const float* llr, size_t nbits, uint8_t* bits) {
+    size_t i = 0;
+    for (; i + 8 <= nbits; i += 8) {
+        uint32_t b = 0;
+        for (int k = 0; k < 8; k++) {
+            uint32_t u;
+            std::memcpy(&u, llr + i + k, 4);
+            b |= (u >> 31) << (7 - k);
+        }
+        bits[i / 8] = (uint8_t)b;
+    }
+    if (i < nbits) {
+        uint8_t b = 0;
+        for (int k = 0; i + k < nbits; k++) b |= (uint8_t)((llr[i + k] < 0.0f) << (7 - k));
+        bits[i / 8] = b;
+    }
+}
+__attribute__((target("avx2")))
+void bits_avx2(const float* llr, size_t nbits, uint8_t* bits) {
+    size_t i = 0;
+    for (; i + 8 <= nbits; i += 8) bits[i / 8] = rev8((uint8_t)_mm256_movemask_ps(_mm256_loadu_ps(llr + i)));
+    if (i < nbits) bits_scalar(llr + i, nbits - i, bits + i / 8);
+}
+__attribute__((target("avx512f,avx512dq")))
+void bits_avx512(const float* llr, size_t nbits, uint8_t* bits) {
+    size_t i = 0;
+    for (; i + 16 <= nbits; i += 16) {
+        uint16_t m = (uint16_t)_mm512_movepi32_mask(_mm512_castps_si512(_mm512_loadu_ps(llr + i)));
+        bits[i / 8]     = rev8((uint8_t)m);
+        bits[i / 8 + 1] = rev8((uint8_t)(m >> 8));
+    }
+    if (i < nbits) bits_scalar(llr + i, nbits - i, bits + i / 8);
+}
+
+struct ModKernel {
+    const char* name;
+    void (*demod)(uint8_t, const cf32*, size_t, float, float*);
+    void (*bits)(const float*, size_t, uint8_t*);
+};
+const ModKernel SCALAR_KERNEL = {"scalar", demod_scalar, bits_scalar};
+const ModKernel AVX2_KERNEL   = {"avx2", demod_avx2, bits_avx2};
+const ModKernel AVX512_KERNEL = {"avx512", demod_avx512, bits_avx512};
+bool cpu_has_avx2()   { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"); }
+bool cpu_has_avx512() {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+           __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+}
+const ModKernel* best_kernel() {
+    return cpu_has_avx512() ? &AVX512_KERNEL : cpu_has_avx2() ? &AVX2_KERNEL : &SCALAR_KERNEL;
+}
+const ModKernel*& active_kernel() {
+    static const ModKernel* k = best_kernel();
+    return k;
+}
+
+// Ziggurat (Marsaglia & Tsang, 2000), 128 layers.
+struct Ziggurat {
+    uint32_t kn[128];
+    float    wn[128], fn[128];
+    Ziggurat() {
+        const double m1 = 2147483648.0, vn = 9.91256303526217e-3;
+        double dn = 3.442619855899, tn = dn;
+        double q  = vn / std::exp(-0.5 * dn * dn);
+        kn[0] = (uint32_t)((dn / q) * m1);
+        kn[1] = 0;
+        wn[0] = (float)(q / m1);
+        wn[127] = (float)(dn / m1);
+        fn[0] = 1.0f;
+        fn[127] = (float)std::exp(-0.5 * dn * dn);
+        for (int i = 126; i >= 1; i--) {
+            dn = std::sqrt(-2.0 * std::log(vn / dn + std::exp(-0.5 * dn * dn)));
+            kn[i + 1] = (uint32_t)((dn / tn) * m1);
+            tn = dn;
+            fn[i] = (float)std::exp(-0.5 * dn * dn);
+            wn[i] = (float)(dn / m1);
+        }
+    }
+};
+const Ziggurat& zig() {
+    static const Ziggurat z;
+    return z;
+}
+
+// Both LFSRs advance 28 bits per step: bit i of a state word is x(n + i),
+// and x(n + 31 + i) depends only on bits i..i+3 for i < 28. With mix set the
+// sequence is XORed into out instead of stored.
+void gold(uint32_t c_init, uint8_t* out, size_t nbytes, bool mix) {
+    uint32_t x1 = 1, x2 = c_init & 0x7FFFFFFF;
+    auto step = [&]() {
+        uint32_t n1 = ((x1 >> 3) ^ x1) & 0x0FFFFFFF;
+        uint32_t n2 = ((x2 >> 3) ^ (x2 >> 2) ^ (x2 >> 1) ^ x2) & 0x0FFFFFFF;
+        uint32_t c  = (x1 ^ x2) & 0x0FFFFFFF;
+        x1 = (x1 >> 28) | (n1 << 3);
+        x2 = (x2 >> 28) | (n2 << 3);
+        return c;
+    };
+    // Discard Nc = 1600 = 57 * 28 + 4 bits.
+    for (int i = 0; i < 57; i++) step();
+    uint64_t acc  = step() >> 4;
+    int      have = 24;
+    for (size_t i = 0; i < nbytes; i++) {
+        if (have < 8) { acc |= (uint64_t)step() << have; have += 28; }
+        // c(n) is LSB-first in acc; output bytes are MSB-first.
+        uint8_t b = rev8((uint8_t)acc);
+        out[i] = mix ? out[i] ^ b : b;
+        acc >>= 8;
+        have -= 8;
+    }
+}
+}
+void gold_sequence(uint32_t c_init, uint8_t* out, size_t nbytes) { gold(c_init, out, nbytes, false); }
+void scramble(uint8_t* data, size_t nbytes, uint32_t c_init) { gold(c_init, data, nbytes, true); }
+size_t num_symbols(uint8_t qm, size_t nbits) { return (nbits + qm - 1) / qm; }
+size_t modulate(uint8_t qm, const uint8_t* bits, size_t nbits, cf32* sym) {
+    const cf32* lut    = map_tables().lut[qm / 2];
+    size_t      nsym   = num_symbols(qm, nbits);
+    size_t      nbytes = (nbits + 7) / 8, byte = 0;
+    uint32_t    mask   = (1u << qm) - 1;
+    uint64_t    acc    = 0;
+    int         have   = 0;
+    for (size_t s = 0; s < nsym; s++) {
+        while (have < qm) {
+            acc = (acc << 8) | (byte < nbytes ? bits[byte] : 0);
+            byte++;
+            have += 8;
+        }
+        have  -= qm;
+        sym[s] = lut[(acc >> have) & mask];
+    }
+    return nsym;
+}
+void demodulate_llr(uint8_t qm, const cf32* sym, size_t nsym, float n0, float* llr) {
+    active_kernel()->demod(qm, sym, nsym, n0, llr);
+}
+void llr_to_bits(const float* llr, size_t nbits, uint8_t* bits) { active_kernel()->bits(llr, nbits, bits); }
+namespace {
+// Ziggurat rejection for a draw hz that missed the rectangle; redraws as
+// needed.
+float gaussian_slow(int32_t hz, Philox4x32& rng) {
+    const Ziggurat& z = zig();
+    for (;;) {
+        uint32_t iz = hz & 127;
+        if ((uint32_t)std::abs(hz) < z.kn[iz]) return hz * z.wn[iz];
+        float x = hz * z.wn[iz];
+        if (iz == 0) {
+            // Tail beyond r = 3.4426.
+            const float r = 3.442620f;
+            float y;
+            do {
+                x = -std::log(rng.next_float_nz()) * (1.0f / r);
+                y = -std::log(rng.next_float_nz());
+            } while (y + y < x * x);
+            return hz > 0 ? r + x : -r - x;
+        }
+        if (z.fn[iz] + rng.next_float() * (z.fn[iz - 1] - z.fn[iz]) < std::exp(-0.5f * x * x)) return x;
+        hz = (int32_t)rng.next_u32();
+    }
+}
+}
+float gaussian(Philox4x32& rng) {
+    const Ziggurat& z  = zig();
+    int32_t         hz = (int32_t)rng.next_u32();
+    uint32_t        iz = hz & 127;
+    if ((uint32_t)std::abs(hz) < z.kn[iz]) return hz * z.wn[iz];
+    return gaussian_slow(hz, rng);
+}
+// Draws come from Philox in blocks; about 1% miss the rectangle and take the
+// slow path, which draws further values from the same stream.
+void awgn(cf32* sym, size_t n, float n0, Philox4x32& rng) {
+    const Ziggurat& z     = zig();
+    const float     sigma = std::sqrt(n0 * 0.5f);
+    float*          f     = &sym[0].re;
+    uint32_t        u[256];
+    for (size_t base = 0; base < 2 * n; base += 256) {
+        size_t m = std::min<size_t>(256, 2 * n - base);
+        rng.fill(u, m);
+        for (size_t j = 0; j < m; j++) {
+            int32_t  hz = (int32_t)u[j];
+            uint32_t iz = hz & 127;
+            float    g  = (uint32_t)std::abs(hz) < z.kn[iz] ? hz * z.wn[iz] : gaussian_slow(hz, rng);
+            f[base + j] += sigma * g;
+        }
+    }
+}
+bool modulation_select(ModImpl impl) {
+    switch (impl) {
+        case ModImpl::AUTO:   active_kernel() = best_kernel(); return true;
+        case ModImpl::SCALAR: active_kernel() = &SCALAR_KERNEL; return true;
+        case ModImpl::AVX2:
+            if (!cpu_has_avx2()) return false;
+            active_kernel() = &AVX2_KERNEL;
+            return true;
+        case ModImpl::AVX512:
+            if (!cpu_has_avx512()) return false;
+            active_kernel() = &AVX512_KERNEL;
+            return true;
+    }
+    return false;
+}
+const char* modulation_impl_name() { return active_kernel()->name; }
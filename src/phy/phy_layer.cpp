@@ -1,46 +1,177 @@
 #include "phy_layer.h"
+#include "crc.h"
+#include <algorithm>
 #include <cmath>
-#include <cstdlib>
 #include <sstream>
-PhyLayer::PhyLayer(PhyConfig cfg) : cfg_(cfg) {}
-bool PhyLayer::simulate_crc_pass() const {
-    float snr = cfg_.channel_snr_db;
-    float ber = 0.5f / (1.0f + std::exp((snr - 10.0f) * 0.5f));
-    float rand_val = (float)std::rand() / RAND_MAX;
-    return rand_val > ber * 100;
-}
-Bytes PhyLayer::apply_noise(const Bytes& data) const {
-    Bytes out = data;
-    if (cfg_.channel_snr_db < 5.0f)
-        for (size_t i = 0; i < out.size(); i += 10) out[i] ^= 0x01;
-    return out;
+namespace {
+// TS 38.214 Table 5.1.3.2-1, TBS for N_info <= 3824.
+const uint16_t TBS_TABLE[] = {
+    24,   32,   40,   48,   56,   64,   72,   80,   88,   96,   104,  112,  120,  128,  136,  144,
+    152,  160,  168,  176,  184,  192,  208,  224,  240,  256,  272,  288,  304,  320,  336,  352,
+    368,  384,  408,  432,  456,  480,  504,  528,  552,  576,  608,  640,  672,  704,  736,  768,
+    808,  848,  888,  928,  984,  1032, 1064, 1128, 1160, 1192, 1224, 1256, 1288, 1320, 1352, 1416,
+    1480, 1544, 1608, 1672, 1736, 1800, 1864, 1928, 2024, 2088, 2152, 2216, 2280, 2408, 2472, 2536,
+    2600, 2664, 2728, 2792, 2856, 2976, 3104, 3240, 3368, 3496, 3624, 3752, 3824,
+};
+inline uint32_t ceil_div(uint32_t a, uint32_t b) { return (a + b - 1) / b; }
 }
-Status PhyLayer::receive_transport_block(const Bytes& tb_in, Bytes& tb_out) {
+McsParams mcs_params(MCS mcs) {
+    switch (mcs) {
+        case MCS::QPSK_1_3:  return {2, 1.0f / 3};
+        case MCS::QPSK_1_2:  return {2, 0.5f};
+        case MCS::QAM16_1_2: return {4, 0.5f};
+        case MCS::QAM64_2_3: return {6, 2.0f / 3};
+        case MCS::QAM64_5_6: return {6, 5.0f / 6};
+        case MCS::QAM256_3_4: return {8, 0.75f};
+    }
+    return {2, 1.0f / 3};
+}
+uint32_t transport_block_size(MCS mcs, uint32_t num_prbs) {
+    McsParams m = mcs_params(mcs);
+    uint32_t n_re   = 144 * num_prbs;
+    uint32_t n_info = (uint32_t)(n_re * m.rate * m.qm);
+    if (n_info == 0) return 0;
+    uint32_t tbs;
+    if (n_info <= 3824) {
+        int      n     = std::max(3, (int)std::log2((double)n_info) - 6);
+        uint32_t n_q   = std::max<uint32_t>(24, (1u << n) * (n_info >> n));
+        tbs = *std::lower_bound(std::begin(TBS_TABLE), std::end(TBS_TABLE), n_q);
+    } else {
+        int      n   = (int)std::log2((double)(n_info - 24)) - 5;
+        uint32_t n_q = std::max<uint32_t>(3840, (1u << n) * (uint32_t)std::lround((double)(n_info - 24) / (1u << n)));
+        uint32_t c   = m.rate <= 0.25f ? ceil_div(n_q + 24, 3816) : (n_q > 8424 ? ceil_div(n_q + 24, 8424) : 1);
+        tbs = 8 * c * ceil_div(n_q + 24, 8 * c) - 24;
+    }
+    return tbs / 8;
+}
+uint32_t phy_num_code_blocks(size_t tb_bytes) {
+    size_t b = tb_bytes * 8 + 24;
+    if (tb_bytes * 8 <= PHY_CRC16_MAX_BITS || b <= PHY_CB_MAX_BITS) return 1;
+    return (uint32_t)((b + PHY_CB_MAX_BITS - 24 - 1) / (PHY_CB_MAX_BITS - 24));
+}
+size_t phy_crc_overhead(size_t tb_bytes) {
+    uint32_t c = phy_num_code_blocks(tb_bytes);
+    return (tb_bytes * 8 <= PHY_CRC16_MAX_BITS ? 2 : 3) + (c > 1 ? 3 * c : 0);
+}
+namespace {
+// Recovers the TB size from a received block length; the (L, C) pairs map to
+// disjoint length ranges so at most one candidate is consistent.
+bool tb_size_of(size_t total, size_t& tb) {
+    if (total >= 2 && (total - 2) * 8 <= PHY_CRC16_MAX_BITS) { tb = total - 2; return true; }
+    for (uint32_t c = 1; 3 + (c > 1 ? 3 * c : 0) <= total; c++) {
+        size_t n = total - 3 - (c > 1 ? 3 * c : 0);
+        if (n * 8 > PHY_CRC16_MAX_BITS && phy_num_code_blocks(n) == c) { tb = n; return true; }
+        if (n * 8 <= PHY_CRC16_MAX_BITS) break;
+    }
+    return false;
+}
+}
+void PhyLayer::attach_crc(PduBuffer& tb) {
+    size_t   n   = tb.size();
+    uint32_t c   = phy_num_code_blocks(n);
+    CrcType  tbc = n * 8 <= PHY_CRC16_MAX_BITS ? CrcType::CRC16 : CrcType::CRC24A;
+    uint8_t* p   = tb.append(phy_crc_overhead(n)) - n;
+    crc_attach(tbc, p, n);
+    if (c == 1) return;
+    size_t b = n + 3, seg = (b + c - 1) / c;
+    for (uint32_t k = 0; k < c; k++) {
+        size_t   off = k * seg, len = std::min(seg, b - off);
+        uint32_t crc = crc_compute(CrcType::CRC24B, p + off, len);
+        uint8_t* q   = p + b + 3 * k;
+        q[0] = (uint8_t)(crc >> 16); q[1] = (uint8_t)(crc >> 8); q[2] = (uint8_t)crc;
+    }
+}
+bool PhyLayer::check_crc(PduBuffer& tb) {
+    size_t n;
+    if (!tb_size_of(tb.size(), n)) return false;
+    const uint8_t* p = tb.data();
+    uint32_t c = phy_num_code_blocks(n);
+    if (c > 1) {
+        size_t b = n + 3, seg = (b + c - 1) / c;
+        uint32_t bad = 0;
+        for (uint32_t k = 0; k < c; k++) {
+            size_t         off = k * seg, len = std::min(seg, b - off);
+            const uint8_t* q   = p + b + 3 * k;
+            uint32_t       rx  = ((uint32_t)q[0] << 16) | ((uint32_t)q[1] << 8) | q[2];
+            if (crc_compute(CrcType::CRC24B, p + off, len) != rx) bad++;
+        }
+        cb_errors_ += bad;
+        metrics_.cb_errors.add(bad);
+        if (bad) return false;
+    }
+    CrcType tbc = n * 8 <= PHY_CRC16_MAX_BITS ? CrcType::CRC16 : CrcType::CRC24A;
+    if (!crc_check(tbc, p, n + crc_bytes(tbc))) return false;
+    tb.trim(tb.size() - n);
+    return true;
+}
+PhyLayer::PhyLayer(PhyConfig cfg, uint64_t stream)
+    : cfg_(cfg), channel_(rng_stream(RngDomain::PHY, stream)),
+      c_init_((uint32_t)((stream & 0xFFFF) << 15) | (cfg.cell_id & 0x3FF)) {}
+void PhyLayer::bind_metrics(uint32_t ue) {
+    MetricsRegistry& reg = MetricsRegistry::instance();
+    MetricLabels     l{"PHY", ue};
+    metrics_.tbs       = reg.counter("phy_rx_tbs_total", l);
+    metrics_.tb_errors = reg.counter("phy_rx_tb_errors_total", l);
+    metrics_.cb_errors = reg.counter("phy_rx_cb_errors_total", l);
+}
+Status PhyLayer::receive_transport_block(PduBuffer& tb) {
     rx_total_++;
-    tb_out = apply_noise(tb_in);
-    if (!simulate_crc_pass()) {
+    metrics_.tbs.add();
+    if (cfg_.link_level) channel_.transmit_symbols(tb, cfg_.mcs, cfg_.channel_snr_db, c_init_);
+    else                 channel_.decode(tb, cfg_.mcs, cfg_.channel_snr_db);
+    if (!check_crc(tb)) {
         rx_errors_++;
-        std::ostringstream ss;
-        ss << "CRC FAIL SNR=" << cfg_.channel_snr_db << " dB";
-        LOG_WARN("PHY", ss.str());
+        metrics_.tb_errors.add();
+        LOGF_WARN("PHY", "CRC FAIL SNR={} dB", cfg_.channel_snr_db);
         return Status::RETRY;
     }
-    LOG_DEBUG("PHY", "RX TB ok " + std::to_string(tb_in.size()) + " bytes");
+    LOGF_DEBUG("PHY", "RX TB ok {} bytes", tb.size());
     return Status::OK;
 }
-Status PhyLayer::transmit_transport_block(const Bytes& tb_in, Bytes& tb_out) {
-    tb_out = tb_in;
-    LOG_DEBUG("PHY", "TX TB " + std::to_string(tb_in.size()) + " bytes");
+Status PhyLayer::transmit_transport_block(PduBuffer& tb) {
+    attach_crc(tb);
+    LOGF_DEBUG("PHY", "TX TB {} bytes", tb.size());
     return Status::OK;
 }
-float PhyLayer::estimate_throughput_mbps() const {
-    float bits_per_sym = 2.0f;
-    switch (cfg_.mcs) {
-        case MCS::QAM16_1_2: bits_per_sym = 4.0f * 0.5f; break;
-        case MCS::QAM64_2_3: bits_per_sym = 6.0f * 0.67f; break;
-        case MCS::QAM64_5_6: bits_per_sym = 6.0f * 0.83f; break;
-        default: bits_per_sym = 2.0f * 0.33f; break;
+size_t PhyLayer::transmit_burst(PduBuffer* tbs, size_t n, Status* status) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++) { attach_crc(tbs[i]); status[i] = Status::OK; bytes += tbs[i].size(); }
+    LOGF_DEBUG("PHY", "TX burst n={} bytes={}", n, bytes);
+    return n;
+}
+size_t PhyLayer::receive_burst(PduBuffer* tbs, size_t n, Status* status) {
+    if (cfg_.link_level)
+        for (size_t i = 0; i < n; i++) channel_.transmit_symbols(tbs[i], cfg_.mcs, cfg_.channel_snr_db, c_init_);
+    else
+        channel_.decode_batch(tbs, n, cfg_.mcs, cfg_.channel_snr_db, status);
+    size_t ok = 0;
+    for (size_t i = 0; i < n; i++) {
+        status[i] = check_crc(tbs[i]) ? Status::OK : Status::RETRY;
+        if (status[i] == Status::OK) ok++;
     }
+    rx_total_  += (uint32_t)n;
+    rx_errors_ += (uint32_t)(n - ok);
+    metrics_.tbs.add(n);
+    metrics_.tb_errors.add(n - ok);
+    if (ok < n) LOGF_WARN("PHY", "RX burst n={} CRC FAIL={} SNR={} dB", n, n - ok, cfg_.channel_snr_db);
+    else        LOGF_DEBUG("PHY", "RX burst n={} ok", n);
+    return ok;
+}
+Status PhyLayer::receive_transport_block(const Bytes& tb_in, Bytes& tb_out) {
+    PduBuffer tb = PduBuffer::from(tb_in);
+    Status st = receive_transport_block(tb);
+    tb_out = tb.to_bytes();
+    return st;
+}
+Status PhyLayer::transmit_transport_block(const Bytes& tb_in, Bytes& tb_out) {
+    PduBuffer tb = PduBuffer::from(tb_in);
+    Status st = transmit_transport_block(tb);
+    tb_out = tb.to_bytes();
+    return st;
+}
+float PhyLayer::estimate_throughput_mbps() const {
+    McsParams m = mcs_params(cfg_.mcs);
+    float bits_per_sym = m.qm * m.rate;
     float sym_per_sec = cfg_.num_prbs * 12.0f * 14.0f * 1000.0f;
     return (bits_per_sym * sym_per_sec) / 1e6f;
 }
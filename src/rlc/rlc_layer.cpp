@@ -1,88 +1,615 @@
 #include "rlc_layer.h"
+#include <algorithm>
 #include <sstream>
 RlcLayer::RlcLayer(RlcMode mode) : mode_(mode) {}
-Bytes RlcLayer::build_am_pdu(const RlcAmHeader& hdr, const Bytes& payload) {
-    Bytes pdu;
+void RlcLayer::bind_metrics(uint32_t ue, uint8_t bearer) {
+    MetricsRegistry& reg = MetricsRegistry::instance();
+    MetricLabels     l{"RLC", ue, bearer};
+    metrics_.tx_pdus       = reg.counter("rlc_tx_pdus_total", l);
+    metrics_.retx_pdus     = reg.counter("rlc_retx_pdus_total", l);
+    metrics_.max_retx      = reg.counter("rlc_max_retx_total", l);
+    metrics_.rx_duplicates = reg.counter("rlc_rx_duplicates_total", l);
+    metrics_.rx_lost       = reg.counter("rlc_rx_lost_total", l);
+    metrics_.status_pdus   = reg.counter("rlc_status_pdus_total", l);
+    metrics_.tx_window     = TrackedGauge(reg.gauge("rlc_tx_window", l));
+    metrics_.rx_window     = TrackedGauge(reg.gauge("rlc_rx_window", l));
+    update_window_metrics();
+}
+void RlcLayer::build_am_pdu(const RlcAmHeader& hdr, PduBuffer& pdu) {
     uint8_t b0 = 0;
     b0 |= (hdr.data_ctrl ? 0x80 : 0x00);
     b0 |= (hdr.poll_bit  ? 0x40 : 0x00);
     b0 |= ((hdr.seg_info & 0x03) << 4);
     b0 |= ((hdr.sn >> 8) & 0x0F);
-    pdu.push_back(b0);
-    pdu.push_back(hdr.sn & 0xFF);
-    pdu.insert(pdu.end(), payload.begin(), payload.end());
-    return pdu;
+    bool has_so = hdr.seg_info >= 2;
+    uint8_t* h = pdu.prepend(has_so ? 4 : 2);
+    h[0] = b0;
+    h[1] = hdr.sn & 0xFF;
+    if (has_so) { h[2] = hdr.so >> 8; h[3] = hdr.so & 0xFF; }
 }
-bool RlcLayer::parse_am_pdu(const Bytes& pdu, RlcAmHeader& hdr, Bytes& payload) {
+bool RlcLayer::parse_am_pdu(PduBuffer& pdu, RlcAmHeader& hdr) {
     if (pdu.size() < 2) return false;
-    hdr.data_ctrl = (pdu[0] & 0x80) != 0;
-    hdr.poll_bit  = (pdu[0] & 0x40) != 0;
-    hdr.seg_info  = (pdu[0] >> 4) & 0x03;
-    hdr.sn        = ((uint16_t)(pdu[0] & 0x0F) << 8) | pdu[1];
-    payload       = Bytes(pdu.begin() + 2, pdu.end());
+    const uint8_t* h = pdu.data();
+    hdr.data_ctrl = (h[0] & 0x80) != 0;
+    hdr.poll_bit  = (h[0] & 0x40) != 0;
+    hdr.seg_info  = (h[0] >> 4) & 0x03;
+    hdr.sn        = ((uint16_t)(h[0] & 0x0F) << 8) | h[1];
+    hdr.so        = 0;
+    if (hdr.seg_info < 2) return pdu.strip(2);
+    if (pdu.size() < 4) return false;
+    hdr.so = ((uint16_t)h[2] << 8) | h[3];
+    return pdu.strip(4);
+}
+// STATUS PDU, 12-bit SN: D/C=0, CPT=000, ACK_SN, E1, then per NACK:
+// NACK_SN, E1 (more NACKs), E2 (SOstart/SOend), E3 (NACK range).
+void RlcLayer::encode_status_pdu(const RlcStatusPdu& status, PduBuffer& pdu) {
+    size_t len = 3;
+    for (const RlcNack& nk : status.nacks)
+        len += 2 + ((nk.so_start != 0 || nk.so_end != RLC_SO_END) ? 4 : 0) + (nk.range > 1 ? 1 : 0);
+    pdu = PduBuffer::alloc(len);
+    uint8_t* p = pdu.data();
+    p[0] = (status.ack_sn >> 8) & 0x0F;
+    p[1] = status.ack_sn & 0xFF;
+    p[2] = status.nacks.empty() ? 0x00 : 0x80;
+    p += 3;
+    for (size_t i = 0; i < status.nacks.size(); i++) {
+        const RlcNack& nk = status.nacks[i];
+        bool so = nk.so_start != 0 || nk.so_end != RLC_SO_END;
+        bool rg = nk.range > 1;
+        p[0] = (nk.sn >> 4) & 0xFF;
+        p[1] = ((nk.sn & 0x0F) << 4) | (i + 1 < status.nacks.size() ? 0x08 : 0) | (so ? 0x04 : 0) | (rg ? 0x02 : 0);
+        p += 2;
+        if (so) {
+            p[0] = nk.so_start >> 8; p[1] = nk.so_start & 0xFF;
+            p[2] = nk.so_end >> 8;   p[3] = nk.so_end & 0xFF;
+            p += 4;
+        }
+        if (rg) *p++ = nk.range;
+    }
+}
+bool RlcLayer::decode_status_pdu(const uint8_t* p, size_t len, RlcStatusPdu& status) {
+    if (len < 3 || (p[0] & 0x80) || (p[0] & 0x70)) return false;
+    status.ack_sn = ((uint16_t)(p[0] & 0x0F) << 8) | p[1];
+    status.nacks.clear();
+    bool more = (p[2] & 0x80) != 0;
+    size_t i = 3;
+    while (more) {
+        if (i + 2 > len) return false;
+        RlcNack nk;
+        nk.sn = ((uint16_t)p[i] << 4) | (p[i + 1] >> 4);
+        more       = (p[i + 1] & 0x08) != 0;
+        bool so    = (p[i + 1] & 0x04) != 0;
+        bool rg    = (p[i + 1] & 0x02) != 0;
+        i += 2;
+        if (so) {
+            if (i + 4 > len) return false;
+            nk.so_start = ((uint16_t)p[i] << 8) | p[i + 1];
+            nk.so_end   = ((uint16_t)p[i + 2] << 8) | p[i + 3];
+            i += 4;
+        }
+        if (rg) {
+            if (i + 1 > len) return false;
+            nk.range = p[i++];
+        }
+        status.nacks.push_back(nk);
+    }
     return true;
 }
-Bytes RlcLayer::build_status_pdu(uint16_t ack_sn) {
-    Bytes pdu;
-    pdu.push_back((uint8_t)(ack_sn >> 8) & 0x0F);
-    pdu.push_back(ack_sn & 0xFF);
-    return pdu;
+void RlcLayer::build_status_report(RlcStatusPdu& status) {
+    status.ack_sn = rx_next_highest_;
+    status.nacks.clear();
+    uint16_t span = rx_offset(rx_next_highest_);
+    for (uint16_t off = 0; off < span;) {
+        uint16_t sn = (rx_next_ + off) & 0x0FFF;
+        if (rx_has(sn)) { off++; continue; }
+        const RlcRxBuffer* slot = rx_ring_ ? &rx_ring_[sn % RLC_AM_WINDOW_SIZE] : nullptr;
+        if (slot && slot->sn == sn && !slot->segs.empty()) {
+            // Partly received: one NACK per missing byte range.
+            uint32_t pos = 0;
+            for (const RlcRxSegment& sg : slot->segs) {
+                if (sg.so > pos) { RlcNack nk; nk.sn = sn; nk.so_start = (uint16_t)pos; nk.so_end = sg.so - 1; status.nacks.push_back(nk); }
+                pos = sg.so + (uint32_t)sg.data.size();
+            }
+            if (!slot->seg_total) { RlcNack nk; nk.sn = sn; nk.so_start = (uint16_t)pos; status.nacks.push_back(nk); }
+            off++;
+            continue;
+        }
+        RlcNack nk; nk.sn = sn; nk.range = 0;
+        for (; off < span && nk.range < 255; nk.range++, off++) {
+            uint16_t s = (rx_next_ + off) & 0x0FFF;
+            if (rx_has(s)) break;
+            const RlcRxBuffer* b = rx_ring_ ? &rx_ring_[s % RLC_AM_WINDOW_SIZE] : nullptr;
+            if (b && b->sn == s && !b->segs.empty()) break;
+        }
+        status.nacks.push_back(nk);
+    }
+    rx_status_required_ = false;
 }
-Status RlcLayer::transmit_sdu(const Bytes& pdcp_sdu, Bytes& mac_pdu) {
-    if (mode_ == RlcMode::TM) {
-        mac_pdu = pdcp_sdu;
-        LOG_DEBUG("RLC", "TM TX " + std::to_string(pdcp_sdu.size()) + " bytes");
-        return Status::OK;
+// What goes on the air holds back the tail of the highest SDU while its
+// last segment has not arrived: it is most likely still in flight, so ACK_SN
+// stops short of that SDU instead of NACKing it into a spurious resend.
+void RlcLayer::build_status_pdu(PduBuffer& pdu) {
+    RlcStatusPdu status;
+    build_status_report(status);
+    uint16_t top = (status.ack_sn - 1) & 0x0FFF;
+    size_t   n   = status.nacks.size();
+    if (n && status.nacks[n - 1].sn == top && status.nacks[n - 1].so_start > 0 &&
+        status.nacks[n - 1].so_end == RLC_SO_END && (n == 1 || status.nacks[n - 2].sn != top)) {
+        status.nacks.pop_back();
+        status.ack_sn = top;
     }
+    encode_status_pdu(status, pdu);
+    metrics_.status_pdus.add();
+    capture(true, pdu);
+}
+bool RlcLayer::tx_poll(size_t bytes, bool new_data, bool last) {
+    if (new_data) { pdu_without_poll_++; byte_without_poll_ += (uint32_t)bytes; }
+    bool poll = poll_pending_ || last || tx_window_full() ||
+                pdu_without_poll_ >= RLC_POLL_PDU || byte_without_poll_ >= RLC_POLL_BYTE;
+    if (!poll) return false;
+    pdu_without_poll_  = 0;
+    byte_without_poll_ = 0;
+    poll_pending_      = false;
+    poll_sn_           = (tx_sn_ - 1) & 0x0FFF;
+    t_poll_retx_left_  = (int32_t)t_poll_retx_ms_;
+    return true;
+}
+// Keeps the SDU taking SN TX_Next for retransmission.
+void RlcLayer::tx_store(const PduBuffer& sdu) {
+    if (!tx_ring_) tx_ring_.reset(new RlcTxBuffer[RLC_AM_WINDOW_SIZE]);
+    uint16_t i = tx_sn_ % RLC_AM_WINDOW_SIZE;
+    RlcTxBuffer& slot = tx_ring_[i];
+    slot.sdu         = sdu;
+    slot.sn          = tx_sn_;
+    slot.retx_count  = 0;
+    slot.retx_queued = false;
+    tx_bitmap_[i >> 6] |= (1ULL << (i & 63));
+}
+void RlcLayer::tx_one(PduBuffer& pdu, bool last) {
     RlcAmHeader hdr;
     hdr.data_ctrl = true;
     hdr.sn        = tx_sn_;
-    hdr.poll_bit  = (tx_sn_ % 16 == 0);
+    hdr.poll_bit  = false;
     hdr.seg_info  = 0x00;
-    mac_pdu = build_am_pdu(hdr, pdcp_sdu);
-    if (mode_ == RlcMode::AM) {
-        RlcTxBuffer buf; buf.sdu = pdcp_sdu; buf.sn = tx_sn_;
-        tx_window_.push_back(buf);
-        if (tx_window_.size() > RLC_AM_WINDOW_SIZE) tx_window_.pop_front();
-    }
-    LOG_INFO("RLC", "TX AM-PDU SN=" + std::to_string(tx_sn_) + " size=" + std::to_string(mac_pdu.size()));
+    if (mode_ == RlcMode::AM) tx_store(pdu);
     tx_sn_ = next_sn(tx_sn_);
+    metrics_.tx_pdus.add();
+    if (mode_ == RlcMode::AM) hdr.poll_bit = tx_poll(pdu.size(), true, last);
+    build_am_pdu(hdr, pdu);
+}
+// Positively acknowledges TX window offsets [from, to), a bitmap word at a time.
+void RlcLayer::tx_ack_range(uint16_t from, uint16_t to) {
+    while (from < to) {
+        uint16_t idx = (tx_next_ack_ + from) % RLC_AM_WINDOW_SIZE;
+        uint16_t bit = idx & 63;
+        uint16_t n   = std::min<uint16_t>(64 - bit, to - from);
+        uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+        uint64_t hit  = tx_bitmap_[idx >> 6] & mask;
+        while (hit) {
+            RlcTxBuffer& slot = tx_ring_[(idx & ~63) + __builtin_ctzll(hit)];
+            slot.sdu.reset();
+            slot.retx_queued = false;
+            hit &= hit - 1;
+        }
+        tx_bitmap_[idx >> 6] &= ~mask;
+        from += n;
+    }
+}
+void RlcLayer::tx_queue_retx(uint16_t sn, uint16_t so_start, uint16_t so_end, bool more) {
+    RlcTxBuffer& slot = tx_ring_[sn % RLC_AM_WINDOW_SIZE];
+    bool whole = so_start == 0 && so_end == RLC_SO_END;
+    if (whole && slot.retx_queued) return;
+    if (more) {
+        if (slot.retx_count <= RLC_MAX_RETX) retx_q_.push_back({sn, so_start, so_end});
+        return;
+    }
+    if (slot.retx_count >= RLC_MAX_RETX) {
+        if (slot.retx_count == RLC_MAX_RETX) {
+            slot.retx_count++;
+            tx_max_retx_++;
+            metrics_.max_retx.add();
+            LOGF_ERR("RLC", "SN={} reached max retransmissions ({})", sn, RLC_MAX_RETX);
+        }
+        return;
+    }
+    slot.retx_count++;
+    if (whole) slot.retx_queued = true;
+    retx_q_.push_back({sn, so_start, so_end});
+}
+void RlcLayer::process_status(const RlcStatusPdu& status) {
+    if (mode_ != RlcMode::AM) return;
+    uint16_t in_flight = tx_in_flight();
+    uint16_t ack_off   = tx_offset(status.ack_sn);
+    if (ack_off > in_flight) {
+        LOGF_WARN("RLC", "STATUS ACK_SN={} outside TX window [{}, {})", status.ack_sn, tx_next_ack_, tx_sn_);
+        return;
+    }
+    uint16_t pos  = 0;
+    bool     open = false;   // the SN before pos may have more byte ranges NACKed
+    for (const RlcNack& nk : status.nacks) {
+        uint16_t off = tx_offset(nk.sn);
+        if (off >= ack_off) continue;
+        if (off < pos) {
+            // One NACK per missing byte range: each is resent.
+            if (open && off == pos - 1 && tx_has(nk.sn)) tx_queue_retx(nk.sn, nk.so_start, nk.so_end, true);
+            continue;
+        }
+        tx_ack_range(pos, off);
+        uint16_t n = std::min<uint16_t>(std::max<uint8_t>(nk.range, 1), ack_off - off);
+        for (uint16_t k = 0; k < n; k++) {
+            uint16_t sn = (nk.sn + k) & 0x0FFF;
+            if (tx_has(sn)) tx_queue_retx(sn, k == 0 ? nk.so_start : 0, k == n - 1 ? nk.so_end : RLC_SO_END);
+        }
+        pos  = off + n;
+        open = nk.so_end != RLC_SO_END;
+    }
+    tx_ack_range(pos, ack_off);
+    if (t_poll_retx_left_ >= 0 && tx_offset(poll_sn_) < ack_off) t_poll_retx_left_ = -1;
+    // TX_Next_Ack moves to the lowest SN still unacknowledged.
+    uint16_t adv = 0;
+    while (adv < in_flight) {
+        uint16_t idx  = (tx_next_ack_ + adv) % RLC_AM_WINDOW_SIZE;
+        uint64_t bits = tx_bitmap_[idx >> 6] >> (idx & 63);
+        if (bits) { adv += __builtin_ctzll(bits); break; }
+        adv += 64 - (idx & 63);
+    }
+    tx_next_ack_ = (tx_next_ack_ + std::min(adv, in_flight)) & 0x0FFF;
+    update_window_metrics();
+    LOGF_DEBUG("RLC", "STATUS ACK_SN={} nacks={} TX_Next_Ack={} retx={}",
+               status.ack_sn, status.nacks.size(), tx_next_ack_, retx_pending());
+}
+void RlcLayer::process_status_pdu(uint16_t ack_sn, const std::vector<uint16_t>& nack_sns) {
+    RlcStatusPdu status;
+    status.ack_sn = ack_sn;
+    status.nacks.reserve(nack_sns.size());
+    for (uint16_t sn : nack_sns) { RlcNack nk; nk.sn = sn; status.nacks.push_back(nk); }
+    std::sort(status.nacks.begin(), status.nacks.end(),
+              [this](const RlcNack& a, const RlcNack& b) { return tx_offset(a.sn) < tx_offset(b.sn); });
+    process_status(status);
+}
+size_t RlcLayer::tx_pull_retx(uint32_t& budget, PduBuffer* out, size_t max) {
+    size_t n = 0;
+    while (n < max && retx_head_ < retx_q_.size()) {
+        const RlcRetxSeg e = retx_q_[retx_head_];
+        RlcTxBuffer& slot = tx_ring_[e.sn % RLC_AM_WINDOW_SIZE];
+        bool whole = e.so_start == 0 && e.so_end == RLC_SO_END;
+        size_t len = slot.sdu.size();
+        size_t so  = std::min<size_t>(e.so_start, len);
+        size_t end = e.so_end == RLC_SO_END ? len : std::min<size_t>((size_t)e.so_end + 1, len);
+        if (!tx_has(e.sn) || slot.sn != e.sn || (whole && !slot.retx_queued) || so >= end) {
+            retx_head_++;
+            continue;
+        }
+        // Resegment when the grant is short; the rest stays queued as a
+        // plain segment.
+        size_t hdr_len = so == 0 ? 2 : 4;
+        if (budget <= hdr_len) break;
+        if (whole) slot.retx_queued = false;
+        if (hdr_len + (end - so) > budget) {
+            end = so + (budget - hdr_len);
+            retx_q_[retx_head_].so_start = (uint16_t)end;
+        } else {
+            retx_head_++;
+        }
+        RlcAmHeader hdr;
+        hdr.data_ctrl = true;
+        hdr.sn        = e.sn;
+        hdr.so        = (uint16_t)so;
+        hdr.seg_info  = so == 0 ? (end == len ? 0 : 1) : (end == len ? 2 : 3);
+        size_t size = hdr_len + (end - so);
+        out[n] = hdr.seg_info == 0 ? slot.sdu : slot.sdu.slice(so, end - so);
+        hdr.poll_bit = tx_poll(end - so, false, retx_head_ == retx_q_.size() && queued_sdus() == 0);
+        build_am_pdu(hdr, out[n]);
+        budget -= (uint32_t)size;
+        tx_retx_pdus_++;
+        metrics_.retx_pdus.add();
+        n++;
+    }
+    if (retx_head_ == retx_q_.size()) { retx_q_.clear(); retx_head_ = 0; }
+    return n;
+}
+Status RlcLayer::enqueue_sdu(PduBuffer& sdu) {
+    tx_sdus_.push_back(std::move(sdu));
     return Status::OK;
 }
-Status RlcLayer::receive_pdu(const Bytes& mac_pdu, Bytes& pdcp_sdu) {
-    if (mode_ == RlcMode::TM) { pdcp_sdu = mac_pdu; return Status::OK; }
-    RlcAmHeader hdr; Bytes payload;
-    if (!parse_am_pdu(mac_pdu, hdr, payload)) return Status::ERROR;
-    LOG_INFO("RLC", "RX AM-PDU SN=" + std::to_string(hdr.sn));
-    if (hdr.sn == rx_sn_) {
-        pdcp_sdu = payload;
-        rx_sn_   = next_sn(rx_sn_);
+// Next new-data PDU within budget: the whole head SDU, or in AM/UM a segment
+// of it. tx_seg_so_ is how much of the head SDU earlier segments carried.
+bool RlcLayer::tx_pull_new(uint32_t& budget, PduBuffer& out) {
+    PduBuffer& sdu = tx_sdus_[tx_sdus_head_];
+    size_t hdr_len = mode_ == RlcMode::TM ? 0 : (tx_seg_so_ ? 4 : 2);
+    size_t rest    = sdu.size() - tx_seg_so_;
+    bool   fits    = rest + hdr_len <= budget;
+    if (!fits && (mode_ == RlcMode::TM || budget <= hdr_len)) return false;
+    if (tx_seg_so_ == 0 && tx_window_full()) return false;
+    if (fits && tx_seg_so_ == 0) {
+        budget -= (uint32_t)(rest + hdr_len);
+        out = std::move(sdu);
+        tx_sdus_head_++;
+        if (mode_ != RlcMode::TM) tx_one(out, tx_sdus_head_ == tx_sdus_.size() && retx_pending() == 0);
+        return true;
+    }
+    size_t len = fits ? rest : budget - hdr_len;
+    RlcAmHeader hdr;
+    hdr.data_ctrl = true;
+    hdr.so        = tx_seg_so_;
+    hdr.seg_info  = tx_seg_so_ == 0 ? 1 : (fits ? 2 : 3);
+    if (tx_seg_so_ == 0) {
+        tx_seg_sn_ = tx_sn_;
+        if (mode_ == RlcMode::AM) tx_store(sdu);
+        tx_sn_ = next_sn(tx_sn_);
+    }
+    hdr.sn = tx_seg_sn_;
+    out = sdu.slice(tx_seg_so_, len);
+    budget -= (uint32_t)(len + hdr_len);
+    tx_seg_so_ += (uint16_t)len;
+    if (fits) {
+        tx_sdus_[tx_sdus_head_++].reset();
+        tx_seg_so_ = 0;
+    }
+    metrics_.tx_pdus.add();
+    hdr.poll_bit = mode_ == RlcMode::AM && tx_poll(len, true, fits && tx_sdus_head_ == tx_sdus_.size() && retx_pending() == 0);
+    build_am_pdu(hdr, out);
+    return true;
+}
+size_t RlcLayer::pull_pdus(uint32_t budget, PduBuffer* out, size_t max) {
+    size_t n = (mode_ == RlcMode::AM && retx_pending()) ? tx_pull_retx(budget, out, max) : 0;
+    while (n < max && tx_sdus_head_ < tx_sdus_.size() && tx_pull_new(budget, out[n])) n++;
+    if (tx_sdus_head_ == tx_sdus_.size()) { tx_sdus_.clear(); tx_sdus_head_ = 0; }
+    for (size_t i = 0; i < n; i++) capture(true, out[i]);
+    update_window_metrics();
+    if (n) LOGF_DEBUG("RLC", "pulled {} PDUs, TX_Next={} retx pending={}", n, tx_sn_, retx_pending());
+    return n;
+}
+Status RlcLayer::rx_one(PduBuffer& pdu, RlcAmHeader& hdr) {
+    hdr.data_ctrl = true;
+    if (mode_ == RlcMode::AM && pdu.size() >= 1 && !(pdu.data()[0] & 0x80)) {
+        hdr.data_ctrl = false;
+        RlcStatusPdu status;
+        if (!decode_status_pdu(pdu.data(), pdu.size(), status)) return Status::ERROR;
+        process_status(status);
+        pdu.reset();
+        return Status::PENDING;
+    }
+    if (!parse_am_pdu(pdu, hdr)) return Status::ERROR;
+    if (mode_ == RlcMode::AM && hdr.poll_bit) rx_status_required_ = true;
+    uint16_t off = rx_offset(hdr.sn);
+    if (off >= RLC_AM_WINDOW_SIZE || rx_has(hdr.sn)) {
+        rx_duplicates_++;
+        metrics_.rx_duplicates.add();
+        pdu.reset();
+        return Status::PENDING;
+    }
+    if (off >= rx_offset(rx_next_highest_)) rx_next_highest_ = next_sn(hdr.sn);
+    // A whole retransmission supersedes any segments held for this SN.
+    if (hdr.seg_info == 0) rx_drop_segments(hdr.sn);
+    if (hdr.seg_info != 0) {
+        if (!rx_ring_) rx_ring_.reset(new RlcRxBuffer[RLC_AM_WINDOW_SIZE]);
+        RlcRxBuffer& slot = rx_ring_[hdr.sn % RLC_AM_WINDOW_SIZE];
+        if (!rx_add_segment(slot, pdu, hdr)) {
+            rx_update_reassembly_timer();
+            return Status::PENDING;
+        }
+        if (off != 0) {
+            rx_mark(hdr.sn, true);
+            rx_update_reassembly_timer();
+            return Status::PENDING;
+        }
+        pdu = std::move(slot.payload);
+        slot.received = false;
+    }
+    if (off == 0) {
+        rx_next_ = next_sn(rx_next_);
+        rx_deliver_in_order();
+        rx_update_reassembly_timer();
         return Status::OK;
     }
-    RlcRxBuffer rbuf; rbuf.payload = payload; rbuf.sn = hdr.sn; rbuf.received = true;
-    rx_window_[hdr.sn] = rbuf;
-    LOG_WARN("RLC", "Out-of-order SN=" + std::to_string(hdr.sn));
+    if (!rx_ring_) rx_ring_.reset(new RlcRxBuffer[RLC_AM_WINDOW_SIZE]);
+    RlcRxBuffer& slot = rx_ring_[hdr.sn % RLC_AM_WINDOW_SIZE];
+    slot.payload  = std::move(pdu);
+    slot.sn       = hdr.sn;
+    slot.received = true;
+    rx_mark(hdr.sn, true);
+    rx_update_reassembly_timer();
     return Status::PENDING;
 }
-void RlcLayer::process_status_pdu(uint16_t ack_sn, const std::vector<uint16_t>& nack_sns) {
-    for (auto& buf : tx_window_) {
-        bool before_ack = ((ack_sn - buf.sn) & 0x0FFF) < RLC_AM_WINDOW_SIZE;
-        if (before_ack) buf.acked = true;
+// Adds the bytes of a segment not yet held to the slot's scatter list.
+// Returns true once the SDU is complete, with payload holding it: a single
+// segment is passed on as is, several are gathered into one buffer.
+bool RlcLayer::rx_add_segment(RlcRxBuffer& slot, PduBuffer& pdu, const RlcAmHeader& hdr) {
+    if (slot.sn != hdr.sn || slot.received) {
+        slot.segs.clear();
+        slot.seg_bytes = slot.seg_total = 0;
+        slot.received  = false;
+        slot.sn        = hdr.sn;
     }
-    for (uint16_t nack : nack_sns) nack_list_.push_back(nack);
-    while (!tx_window_.empty() && tx_window_.front().acked) tx_window_.pop_front();
-}
-Status RlcLayer::retransmit_nacked(Bytes& mac_pdu) {
-    if (nack_list_.empty()) return Status::OK;
-    uint16_t nack_sn = nack_list_.front(); nack_list_.pop_front();
-    for (auto& buf : tx_window_) {
-        if (buf.sn == nack_sn) {
-            if (buf.retx_count >= RLC_MAX_RETX) return Status::ERROR;
-            buf.retx_count++;
-            RlcAmHeader hdr; hdr.data_ctrl=true; hdr.sn=buf.sn; hdr.poll_bit=true; hdr.seg_info=0;
-            mac_pdu = build_am_pdu(hdr, buf.sdu);
-            return Status::OK;
+    uint32_t so = hdr.so, end = so + (uint32_t)pdu.size(), cur = so, added = 0;
+    if (hdr.seg_info == 0 || hdr.seg_info == 2) slot.seg_total = end;
+    size_t k = 0;
+    while (cur < end) {
+        while (k < slot.segs.size() && slot.segs[k].so + slot.segs[k].data.size() <= cur) k++;
+        uint32_t stop = end;
+        if (k < slot.segs.size()) {
+            if (slot.segs[k].so <= cur) { cur = slot.segs[k].so + (uint32_t)slot.segs[k].data.size(); continue; }
+            stop = std::min<uint32_t>(end, slot.segs[k].so);
         }
+        slot.segs.insert(slot.segs.begin() + k, RlcRxSegment{(uint16_t)cur, pdu.slice(cur - so, stop - cur)});
+        added += stop - cur;
+        cur = stop;
+        k++;
     }
-    return Status::ERROR;
+    pdu.reset();
+    if (!added) { rx_duplicates_++; metrics_.rx_duplicates.add(); }
+    slot.seg_bytes += added;
+    if (!slot.seg_total || slot.seg_bytes != slot.seg_total) return false;
+    if (slot.segs.size() == 1) {
+        slot.payload = std::move(slot.segs[0].data);
+    } else {
+        slot.payload = PduBuffer::alloc(slot.seg_total);
+        for (const RlcRxSegment& sg : slot.segs) std::memcpy(slot.payload.data() + sg.so, sg.data.data(), sg.data.size());
+    }
+    slot.segs.clear();
+    slot.seg_bytes = slot.seg_total = 0;
+    slot.received  = true;
+    return true;
+}
+void RlcLayer::rx_drop_segments(uint16_t sn) {
+    if (!rx_ring_) return;
+    RlcRxBuffer& slot = rx_ring_[sn % RLC_AM_WINDOW_SIZE];
+    if (slot.sn != sn || slot.segs.empty()) return;
+    slot.segs.clear();
+    slot.seg_bytes = slot.seg_total = 0;
+}
+void RlcLayer::rx_deliver_in_order() {
+    while (rx_has(rx_next_)) {
+        RlcRxBuffer& slot = rx_ring_[rx_next_ % RLC_AM_WINDOW_SIZE];
+        rx_ready_.push_back(std::move(slot.payload));
+        slot.received = false;
+        rx_mark(rx_next_, false);
+        rx_next_ = next_sn(rx_next_);
+    }
+}
+void RlcLayer::rx_update_reassembly_timer() {
+    if (t_reassembly_left_ >= 0) {
+        uint16_t trig = rx_offset(rx_reassembly_sn_);
+        if (trig == 0 || trig > rx_offset(rx_next_highest_)) t_reassembly_left_ = -1;
+    }
+    if (t_reassembly_left_ < 0 && rx_next_highest_ != rx_next_) {
+        rx_reassembly_sn_  = rx_next_highest_;
+        t_reassembly_left_ = (int32_t)t_reassembly_ms_;
+    }
+}
+void RlcLayer::rx_tick(uint32_t ms) {
+    if (t_reassembly_left_ < 0) return;
+    t_reassembly_left_ -= (int32_t)ms;
+    if (t_reassembly_left_ > 0) return;
+    t_reassembly_left_ = -1;
+    uint32_t skipped = 0;
+    while (rx_offset(rx_reassembly_sn_) != 0 && rx_offset(rx_reassembly_sn_) < RLC_AM_WINDOW_SIZE) {
+        if (rx_has(rx_next_)) rx_deliver_in_order();
+        else { skipped++; rx_drop_segments(rx_next_); rx_next_ = next_sn(rx_next_); }
+    }
+    rx_deliver_in_order();
+    rx_lost_ += skipped;
+    metrics_.rx_lost.add(skipped);
+    if (mode_ == RlcMode::AM) rx_status_required_ = true;
+    LOGF_WARN("RLC", "t-Reassembly expired: skipped {} SNs, RX_Next={}", skipped, rx_next_);
+    rx_update_reassembly_timer();
+}
+void RlcLayer::tx_tick(uint32_t ms) {
+    if (t_poll_retx_left_ < 0) return;
+    t_poll_retx_left_ -= (int32_t)ms;
+    if (t_poll_retx_left_ > 0) return;
+    t_poll_retx_left_ = -1;
+    if (tx_in_flight() == 0) return;
+    if ((queued_sdus() == 0 && retx_pending() == 0) || tx_window_full()) {
+        uint16_t sn = (tx_sn_ - 1) & 0x0FFF;
+        tx_queue_retx(tx_has(sn) ? sn : tx_next_ack_, 0, RLC_SO_END);
+    }
+    poll_pending_ = true;
+    LOGF_WARN("RLC", "t-PollRetransmit expired: POLL_SN={} TX_Next_Ack={}", poll_sn_, tx_next_ack_);
+}
+void RlcLayer::tick(uint32_t ms) {
+    rx_tick(ms);
+    if (mode_ == RlcMode::AM) tx_tick(ms);
+    update_window_metrics();
+}
+bool RlcLayer::pop_sdu(PduBuffer& sdu) {
+    if (rx_ready_head_ == rx_ready_.size()) return false;
+    sdu = std::move(rx_ready_[rx_ready_head_++]);
+    if (rx_ready_head_ == rx_ready_.size()) { rx_ready_.clear(); rx_ready_head_ = 0; }
+    return true;
+}
+bool RlcLayer::pop_sdu(Bytes& sdu) {
+    PduBuffer b;
+    if (!pop_sdu(b)) return false;
+    sdu = b.to_bytes();
+    return true;
+}
+Status RlcLayer::transmit_sdu(PduBuffer& pdu) {
+    if (mode_ == RlcMode::TM) {
+        capture(true, pdu);
+        LOGF_DEBUG("RLC", "TM TX {} bytes", pdu.size());
+        return Status::OK;
+    }
+    if (tx_window_full()) {
+        LOGF_WARN("RLC", "TX window full: TX_Next_Ack={} TX_Next={}", tx_next_ack_, tx_sn_);
+        return Status::BUFFER_FULL;
+    }
+    uint16_t sn = tx_sn_;
+    tx_one(pdu, false);
+    capture(true, pdu);
+    update_window_metrics();
+    LOGF_INFO("RLC", "TX AM-PDU SN={} size={}", sn, pdu.size());
+    return Status::OK;
+}
+Status RlcLayer::receive_pdu(PduBuffer& pdu) {
+    capture(false, pdu);
+    if (mode_ == RlcMode::TM) return Status::OK;
+    RlcAmHeader hdr;
+    Status st = rx_one(pdu, hdr);
+    update_window_metrics();
+    if (st == Status::OK) LOGF_INFO("RLC", "RX AM-PDU SN={}", hdr.sn);
+    else if (st == Status::PENDING && !hdr.data_ctrl) LOGF_DEBUG("RLC", "RX STATUS PDU, TX_Next_Ack={}", tx_next_ack_);
+    else if (st == Status::PENDING) LOGF_WARN("RLC", "Out-of-order SN={}", hdr.sn);
+    return st;
+}
+size_t RlcLayer::transmit_burst(PduBuffer* pdus, size_t n, Status* status) {
+    for (size_t i = 0; i < n; i++) status[i] = Status::OK;
+    if (mode_ == RlcMode::TM) {
+        for (size_t i = 0; i < n; i++) capture(true, pdus[i]);
+        LOGF_DEBUG("RLC", "TM TX burst n={}", n);
+        return n;
+    }
+    uint16_t first = tx_sn_;
+    size_t sent = 0;
+    for (; sent < n && !tx_window_full(); sent++) {
+        tx_one(pdus[sent], false);
+        capture(true, pdus[sent]);
+    }
+    for (size_t i = sent; i < n; i++) status[i] = Status::BUFFER_FULL;
+    update_window_metrics();
+    LOGF_INFO("RLC", "TX burst n={} SN={}..", sent, first);
+    return sent;
+}
+size_t RlcLayer::receive_burst(PduBuffer* pdus, size_t n, Status* status) {
+    for (size_t i = 0; i < n; i++) capture(false, pdus[i]);
+    if (mode_ == RlcMode::TM) {
+        for (size_t i = 0; i < n; i++) status[i] = Status::OK;
+        return n;
+    }
+    size_t ok = 0, pending = 0;
+    RlcAmHeader hdr;
+    for (size_t i = 0; i < n; i++) {
+        status[i] = rx_one(pdus[i], hdr);
+        if (status[i] == Status::OK) ok++;
+        else if (status[i] == Status::PENDING) pending++;
+    }
+    update_window_metrics();
+    LOGF_INFO("RLC", "RX burst n={} ok={} out-of-order={}", n, ok, pending);
+    return ok;
+}
+Status RlcLayer::transmit_sdu(const Bytes& pdcp_sdu, Bytes& mac_pdu) {
+    PduBuffer pdu = PduBuffer::from(pdcp_sdu);
+    Status st = transmit_sdu(pdu);
+    if (st == Status::OK) mac_pdu = pdu.to_bytes();
+    return st;
+}
+Status RlcLayer::receive_pdu(const Bytes& mac_pdu, Bytes& pdcp_sdu) {
+    PduBuffer pdu = PduBuffer::from(mac_pdu);
+    Status st = receive_pdu(pdu);
+    if (st == Status::OK) pdcp_sdu = pdu.to_bytes();
+    return st;
+}
+Status RlcLayer::retransmit_nacked(PduBuffer& mac_pdu) {
+    mac_pdu.reset();
+    if (mode_ != RlcMode::AM || !retx_pending()) return Status::OK;
+    uint32_t budget = UINT32_MAX;
+    if (tx_pull_retx(budget, &mac_pdu, 1)) capture(true, mac_pdu);
+    return Status::OK;
+}
+Status RlcLayer::retransmit_nacked(Bytes& mac_pdu) {
+    PduBuffer pdu;
+    Status st = retransmit_nacked(pdu);
+    if (st == Status::OK && pdu.valid()) mac_pdu = pdu.to_bytes();
+    return st;
 }
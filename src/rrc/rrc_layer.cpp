@@ -1,8 +1,8 @@
 #include "rrc_layer.h"
+#include "rrc_msgs.h"
 #include <sstream>
-#include <cstdlib>
-#include <ctime>
-RrcLayer::RrcLayer(CellConfig cell) : cell_cfg_(cell) { std::srand((unsigned)std::time(nullptr)); }
+RrcLayer::RrcLayer(CellConfig cell, uint64_t stream)
+    : cell_cfg_(cell), rng_(rng_seed(), rng_stream(RngDomain::RRC, ((uint64_t)cell.cell_id << 32) | stream)) {}
 void RrcLayer::transition(RrcState new_state) {
     state_ = new_state;
     LOG_INFO("RRC", "State -> " + get_state_str());
@@ -16,52 +16,69 @@ std::string RrcLayer::get_state_str() const {
     }
     return "UNKNOWN";
 }
-Bytes RrcLayer::build_rrc_msg(RrcMsgType type, const Bytes& payload) {
-    Bytes msg;
-    msg.push_back((uint8_t)type);
-    msg.push_back((payload.size() >> 8) & 0xFF);
-    msg.push_back(payload.size() & 0xFF);
-    msg.insert(msg.end(), payload.begin(), payload.end());
-    return msg;
-}
-bool RrcLayer::parse_rrc_msg(const Bytes& pdu, RrcMsgType& type, Bytes& payload) {
-    if (pdu.size() < 3) return false;
-    type = (RrcMsgType)pdu[0];
-    uint16_t len = ((uint16_t)pdu[1] << 8) | pdu[2];
-    if (pdu.size() < (size_t)(3 + len)) return false;
-    payload = Bytes(pdu.begin() + 3, pdu.begin() + 3 + len);
-    return true;
+template <typename Msg>
+Status RrcLayer::deliver(const Msg& m) {
+    uint8_t pdu[RRC_MAX_MSG], resp[RRC_MAX_MSG];
+    size_t  n = rrc_encode(m, pdu, sizeof(pdu)), resp_len;
+    if (n == 0) return Status::ERROR;
+    return receive_message(pdu, n, resp, sizeof(resp), resp_len);
 }
 Status RrcLayer::initiate_connection() {
     if (state_ != RrcState::IDLE && state_ != RrcState::INACTIVE) return Status::INVALID_STATE;
-    rnti_ = 0xC000 + (std::rand() % 0x3FFF);
+    rnti_ = 0xC000 + (rng_.next_u32() % 0x3FFF);
     LOG_INFO("RRC", "Sending RRC_SETUP_REQUEST RNTI=0x" + std::to_string(rnti_));
-    Bytes req = build_rrc_msg(RrcMsgType::RRC_SETUP_REQUEST, {(uint8_t)(rnti_>>8),(uint8_t)(rnti_&0xFF),0x01});
-    Bytes resp;
-    return receive_message(req, resp);
+    RrcSetupRequestMsg req;
+    req.ue_identity = (uint16_t)rnti_;
+    return deliver(req);
 }
 Status RrcLayer::receive_message(const Bytes& pdu, Bytes& response) {
-    RrcMsgType type; Bytes payload;
-    if (!parse_rrc_msg(pdu, type, payload)) return Status::ERROR;
+    uint8_t resp[RRC_MAX_MSG];
+    size_t  n = 0;
+    Status  s = receive_message(pdu.data(), pdu.size(), resp, sizeof(resp), n);
+    response.assign(resp, resp + n);
+    return s;
+}
+Status RrcLayer::receive_message(const uint8_t* pdu, size_t len, uint8_t* resp, size_t cap, size_t& resp_len) {
+    resp_len = 0;
+    RrcMsgType type;
+    if (!rrc_peek_type(pdu, len, type)) return Status::ERROR;
     switch(type) {
-        case RrcMsgType::RRC_SETUP_REQUEST:
+        case RrcMsgType::RRC_SETUP_REQUEST: {
+            RrcSetupRequestMsg req;
+            if (rrc_decode(pdu, len, req) != Status::OK) return Status::ERROR;
             transition(RrcState::CONNECTED);
-            response = build_rrc_msg(RrcMsgType::RRC_SETUP, {0x01,(uint8_t)cell_cfg_.num_prbs,0x02});
+            RrcSetupMsg setup;
+            setup.num_prbs = cell_cfg_.num_prbs;
+            resp_len = rrc_encode(setup, resp, cap);
             LOG_INFO("RRC", "-> RRC_SETUP sent");
             break;
-        case RrcMsgType::RRC_SETUP:
-            response = build_rrc_msg(RrcMsgType::RRC_SETUP_COMPLETE, {0x00});
+        }
+        case RrcMsgType::RRC_SETUP: {
+            RrcSetupMsg setup;
+            if (rrc_decode(pdu, len, setup) != Status::OK) return Status::ERROR;
+            RrcSetupCompleteMsg done;
+            done.transaction_id = setup.transaction_id;
+            resp_len = rrc_encode(done, resp, cap);
             LOG_INFO("RRC", "-> RRC_SETUP_COMPLETE sent");
             break;
-        case RrcMsgType::RRC_RELEASE:
+        }
+        case RrcMsgType::RRC_RELEASE: {
+            RrcReleaseMsg rel;
+            if (rrc_decode(pdu, len, rel) != Status::OK) return Status::ERROR;
             transition(RrcState::IDLE);
             LOG_INFO("RRC", "Connection released");
-            response = {};
             break;
-        case RrcMsgType::SECURITY_MODE_CMD:
-            response = build_rrc_msg(RrcMsgType::SECURITY_MODE_COMPLETE, {});
+        }
+        case RrcMsgType::SECURITY_MODE_CMD: {
+            RrcSecurityModeCmdMsg cmd;
+            if (rrc_decode(pdu, len, cmd) != Status::OK) return Status::ERROR;
+            RrcSecurityModeCompleteMsg done;
+            done.transaction_id = cmd.transaction_id;
+            resp_len = rrc_encode(done, resp, cap);
             break;
+        }
         default:
+            if (rrc_validate(pdu, len) != Status::OK) return Status::ERROR;
             LOG_WARN("RRC", "Unhandled message type");
             break;
     }
@@ -70,9 +87,7 @@ Status RrcLayer::receive_message(const Bytes& pdu, Bytes& response) {
 }
 Status RrcLayer::release_connection() {
     if (state_ == RrcState::IDLE) return Status::INVALID_STATE;
-    Bytes msg = build_rrc_msg(RrcMsgType::RRC_RELEASE, {});
-    Bytes resp;
-    return receive_message(msg, resp);
+    return deliver(RrcReleaseMsg{});
 }
 Status RrcLayer::suspend_connection() {
     if (state_ != RrcState::CONNECTED) return Status::INVALID_STATE;
@@ -83,11 +98,17 @@ Status RrcLayer::suspend_connection() {
 Status RrcLayer::resume_connection() {
     if (state_ != RrcState::INACTIVE) return Status::INVALID_STATE;
     LOG_INFO("RRC", "Resuming from RRC_INACTIVE");
-    Bytes req = build_rrc_msg(RrcMsgType::RRC_SETUP_REQUEST, {});
-    Bytes resp;
-    return receive_message(req, resp);
+    RrcSetupRequestMsg req;
+    req.ue_identity = (uint16_t)rnti_;
+    req.cause       = RRC_CAUSE_MO_DATA;
+    return deliver(req);
 }
 Status RrcLayer::send_measurement_report(int8_t rsrp, int8_t rsrq) {
+    RrcMeasurementReportMsg rep;
+    rep.rsrp = rsrp;
+    rep.rsrq = rsrq;
+    uint8_t pdu[RRC_MAX_MSG];
+    if (rrc_encode(rep, pdu, sizeof(pdu)) == 0) return Status::ERROR;   // outside the reportable range
     LOG_INFO("RRC", "MeasReport RSRP=" + std::to_string(rsrp) + " RSRQ=" + std::to_string(rsrq));
     return Status::OK;
 }
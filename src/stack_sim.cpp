@@ -1,30 +1,368 @@
 #include "common_types.h"
 #include "phy_layer.h"
 #include "mac_layer.h"
+#include "mac_scheduler.h"
 #include "rlc_layer.h"
 #include "pdcp_layer.h"
 #include "rrc_layer.h"
 #include "nas_layer.h"
+#include "ue_manager.h"
+#include "nas_engine.h"
+#include "bearer_pipeline.h"
+#include "loopback.h"
+#include "metrics.h"
+#include "pcap_capture.h"
+#include "ue_trace.h"
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 
-Bytes make_ip_packet(const std::string& payload_str) {
+// IPv4/UDP packet 10.45.0.1:40000 -> 8.8.8.8:53 with a valid header checksum,
+// so the DRB's ROHC compressor can take it.
+Bytes make_ip_packet(const std::string& payload_str, uint16_t ip_id = 1) {
     Bytes pkt;
     pkt.push_back(0x45); pkt.push_back(0x00);
-    uint16_t total_len = 20 + (uint16_t)payload_str.size();
+    uint16_t total_len = 28 + (uint16_t)payload_str.size();
     pkt.push_back((total_len >> 8) & 0xFF);
     pkt.push_back(total_len & 0xFF);
-    pkt.push_back(0x00); pkt.push_back(0x01);
+    pkt.push_back(ip_id >> 8); pkt.push_back(ip_id & 0xFF);
     pkt.push_back(0x40); pkt.push_back(0x00);
     pkt.push_back(0x40); pkt.push_back(0x11);
     pkt.push_back(0x00); pkt.push_back(0x00);
     pkt.push_back(0x0A); pkt.push_back(0x2D); pkt.push_back(0x00); pkt.push_back(0x01);
     pkt.push_back(0x08); pkt.push_back(0x08); pkt.push_back(0x08); pkt.push_back(0x08);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < 20; i += 2) sum += (uint32_t)(pkt[i] << 8 | pkt[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    pkt[10] = (uint8_t)(~sum >> 8); pkt[11] = (uint8_t)~sum;
+    uint16_t udp_len = total_len - 20;
+    pkt.push_back(0x9C); pkt.push_back(0x40); pkt.push_back(0x00); pkt.push_back(0x35);
+    pkt.push_back(udp_len >> 8); pkt.push_back(udp_len & 0xFF);
+    pkt.push_back(0x00); pkt.push_back(0x00);
     for (char c : payload_str) pkt.push_back((uint8_t)c);
     return pkt;
 }
 
-int main() {
+void print_tb_digest(const UeTbDigest& d) {
+    std::cout << "TB digest:    " << std::hex << std::setfill('0') << std::setw(16) << d.combined()
+              << std::dec << std::setfill(' ') << "\n";
+}
+
+int run_load_test(size_t num_ues, size_t workers, size_t sdus_per_ue, UeMetrics metrics, bool capture,
+                  const std::string& trace_path) {
+    Logger::instance().set_level(LogLevel::WARN);
+    UeManagerConfig cfg;
+    cfg.num_workers = workers;
+    cfg.metrics     = metrics;
+    cfg.capture     = capture;
+    UeTraceRecorder rec;
+    UeTbDigest      digest;
+    if (!trace_path.empty()) {
+        if (rec.open(trace_path, cfg) != Status::OK) {
+            std::cerr << "cannot write " << trace_path << "\n";
+            return 1;
+        }
+        cfg.trace   = &rec;
+        cfg.tb_sink = digest.sink();
+    }
+    UeManager mgr(cfg);
+    mgr.start();
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_ues; i++) mgr.add_ue((uint16_t)(i + 1));
+    mgr.drain();
+    auto t1 = std::chrono::steady_clock::now();
+    Bytes pkt = make_ip_packet("load test payload");
+    for (size_t n = 0; n < sdus_per_ue; n++)
+        for (size_t i = 0; i < num_ues; i++)
+            while (mgr.inject_sdu((uint16_t)(i + 1), PduBuffer::from(pkt)) == Status::BUFFER_FULL)
+                std::this_thread::yield();
+    mgr.drain();
+    auto t2 = std::chrono::steady_clock::now();
+    mgr.stop();
+    UeManagerStats st = mgr.stats();
+    double setup_s = std::chrono::duration<double>(t1 - t0).count();
+    double run_s   = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "UEs:          " << st.ues << " on " << mgr.num_workers() << " workers (setup "
+              << setup_s * 1e3 << " ms)\n";
+    std::cout << "SDUs sent:    " << st.tx_sdus << " (" << st.tx_bytes << " bytes, " << st.errors << " errors)\n";
+    std::cout << "Rate:         " << (run_s > 0 ? st.tx_sdus / run_s : 0.0) << " SDUs/s\n";
+    if (rec.is_open()) {
+        rec.close();
+        std::cout << "Trace:        " << rec.records() << " records, " << rec.bytes_written() << " bytes to "
+                  << trace_path << "\n";
+        print_tb_digest(digest);
+    }
+    return st.errors == 0 ? 0 : 1;
+}
+
+// Feeds a recorded trace to a manager configured as the recording one was;
+// the TB digest matches the recording run's.
+int run_replay(const std::string& path, bool paced) {
+    Logger::instance().set_level(LogLevel::WARN);
+    UeTraceReplayer rp;
+    if (rp.open(path) != Status::OK) {
+        std::cerr << "cannot read trace " << path << "\n";
+        return 1;
+    }
+    UeManagerConfig cfg = rp.config();
+    UeTbDigest      digest;
+    cfg.tb_sink = digest.sink();
+    UeManager mgr(cfg);
+    mgr.start();
+    UeTraceReplayStats rs;
+    Status rc = rp.replay(mgr, paced ? TracePacing::RECORDED : TracePacing::MAX_SPEED, rs);
+    mgr.stop();
+    UeManagerStats st = mgr.stats();
+    double s = rs.elapsed_ns / 1e9;
+    std::cout << "Trace:        " << rs.records << " of " << rp.records() << " records from " << path
+              << (rp.truncated() ? " (torn tail dropped)" : "") << "\n";
+    std::cout << "UEs:          " << st.ues << " on " << mgr.num_workers() << " workers\n";
+    std::cout << "SDUs sent:    " << st.tx_sdus << " (" << st.tx_bytes << " bytes, " << st.errors << " errors)\n";
+    std::cout << "Replay:       " << s * 1e3 << " ms, " << (s > 0 ? rs.records / s : 0.0) << " records/s"
+              << (paced ? " (recorded pacing)" : "") << "\n";
+    print_tb_digest(digest);
+    return rc == Status::OK ? 0 : 1;
+}
+
+// Registers every UE with a PDU session (AKA vectors generated on demand),
+// pre-generates the next vectors, then replays a core outage: the network
+// drops all contexts and every UE registers again at once.
+int run_nas_storm(size_t num_ues, size_t workers) {
+    Logger::instance().set_level(LogLevel::WARN);
+    NasEngineConfig cfg;
+    cfg.num_ues     = num_ues;
+    cfg.num_workers = workers;
+    cfg.ip_count    = std::max<uint32_t>(cfg.ip_count, (uint32_t)num_ues * 2);
+    NasEngine eng(cfg);
+    eng.start();
+    auto t0 = std::chrono::steady_clock::now();
+    eng.register_all();
+    eng.drain();
+    auto t1 = std::chrono::steady_clock::now();
+    NasEngineStats first = eng.stats();
+    eng.prefill_auth_vectors();
+    eng.drain();
+    auto t2 = std::chrono::steady_clock::now();
+    eng.core_restart();
+    eng.drain();
+    auto t3 = std::chrono::steady_clock::now();
+    eng.stop();
+    NasEngineStats st = eng.stats();
+    double reg_s   = std::chrono::duration<double>(t1 - t0).count();
+    double fill_s  = std::chrono::duration<double>(t2 - t1).count();
+    double storm_s = std::chrono::duration<double>(t3 - t2).count();
+    uint64_t rereg = st.registrations - first.registrations;
+    std::cout << "UEs:          " << num_ues << " on " << eng.num_workers() << " workers\n";
+    std::cout << "Registration: " << first.registrations << " UEs, " << first.sessions << " sessions in "
+              << reg_s * 1e3 << " ms (" << (reg_s > 0 ? first.registrations / reg_s : 0.0) << " reg/s)\n";
+    std::cout << "AKA prefill:  " << st.aka_generated - first.aka_generated << " vectors in " << fill_s * 1e3 << " ms\n";
+    std::cout << "Core restart: " << rereg << " UEs re-registered in " << storm_s * 1e3 << " ms ("
+              << (storm_s > 0 ? rereg / storm_s : 0.0) << " reg/s)\n";
+    std::cout << "NAS events:   " << st.events << " (" << st.unexpected << " unexpected, "
+              << st.auth_failures << " auth failures, " << st.session_rejects << " session rejects)\n";
+    std::cout << "AKA vectors:  " << st.aka_generated << " generated, " << st.aka_cache_hits << " cache hits, "
+              << st.aka_cache_misses << " misses\n";
+    return rereg == num_ues && st.unexpected == 0 ? 0 : 1;
+}
+
+// Pushes num_sdus IP packets of sdu_bytes through one AM bearer with the
+// submitter refilling as fast as the stack takes them.
+int run_bearer_test(size_t num_sdus, size_t sdu_bytes, PipelineMode mode, int first_cpu) {
+    Logger::instance().set_level(LogLevel::WARN);
+    PipelineConfig cfg;
+    cfg.mode      = mode;
+    cfg.first_cpu = first_cpu;
+    BearerPipeline pipe(cfg);
+    pipe.start();
+    Bytes pkt = make_ip_packet(std::string(sdu_bytes > 28 ? sdu_bytes - 28 : 0, 'x'));
+    PduBuffer burst[64];
+    size_t pending = 0, sent = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    while (sent < num_sdus) {
+        size_t want = std::min<size_t>(64, num_sdus - sent);
+        for (; pending < want; pending++) burst[pending] = PduBuffer::from(pkt);
+        size_t k = pipe.submit_burst(burst, pending);
+        for (size_t i = k; i < pending; i++) burst[i - k] = std::move(burst[i]);
+        pending -= k;
+        sent    += k;
+        if (!k) std::this_thread::yield();
+    }
+    pipe.drain();
+    auto t1 = std::chrono::steady_clock::now();
+    pipe.stop();
+    PipelineStats st = pipe.stats();
+    double run_s = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << "Mode:         " << (mode == PipelineMode::PIPELINED ? "pipelined" : "run-to-completion");
+    if (mode == PipelineMode::PIPELINED) std::cout << " (" << (first_cpu < 0 ? "unpinned" : "pinned from CPU " + std::to_string(first_cpu)) << ")";
+    std::cout << "\nSDUs:         " << st.completed << " x " << pkt.size() << " bytes (" << st.errors << " errors, "
+              << st.refused << " refused with BUFFER_FULL)\n";
+    std::cout << "Rate:         " << (run_s > 0 ? st.completed / run_s : 0.0) << " SDUs/s, "
+              << (run_s > 0 ? st.tx_bytes * 8 / run_s / 1e9 : 0.0) << " Gbit/s\n";
+    if (mode == PipelineMode::PIPELINED)
+        std::cout << "Stalls:       PDCP " << st.stalls[PIPE_PDCP] << ", RLC " << st.stalls[PIPE_RLC]
+                  << ", MAC/PHY " << st.stalls[PIPE_MACPHY] << "\n";
+    return st.errors == 0 && st.completed == num_sdus ? 0 : 1;
+}
+
+// Sends num_sdus IP packets from a UE stack to a peer stack over the PHY
+// channel, offering rate_mbps (0: as fast as the link takes them), and
+// prints where each SDU spent its time.
+int run_loopback_test(size_t num_sdus, size_t sdu_bytes, float snr_db, double rate_mbps, bool metrics, bool capture) {
+    Logger::instance().set_level(LogLevel::ERR);
+    LoopbackConfig cfg;
+    cfg.phy.mcs            = MCS::QAM64_2_3;
+    cfg.phy.num_prbs       = 52;
+    cfg.phy.channel_snr_db = snr_db;
+    cfg.harq.num_procs     = HARQ_PROCS_NR;
+    cfg.metrics            = metrics;
+    cfg.capture            = capture;
+    LoopbackLink link(cfg);
+    Bytes  pkt    = make_ip_packet(std::string(sdu_bytes > 28 ? sdu_bytes - 28 : 0, 'x'));
+    double credit = 0, per_slot = rate_mbps * cfg.slot_us / 8;
+    size_t sent   = 0;
+    while (sent < num_sdus) {
+        credit = rate_mbps > 0 ? std::min(credit + per_slot, per_slot + pkt.size()) : 1e18;
+        for (; sent < num_sdus && credit >= pkt.size(); sent++, credit -= pkt.size()) {
+            PduBuffer sdu = PduBuffer::from(pkt);
+            if (link.submit(sdu) != Status::OK) break;
+        }
+        link.run_slot();
+    }
+    bool drained = link.drain();
+    LoopbackStats st = link.stats();
+    std::cout << "Link:         " << (int)cfg.phy.num_prbs << " PRBs, SNR " << snr_db << " dB, BLER "
+              << (st.tbs ? 100.0 * st.tb_errors / st.tbs : 0.0) << "%, "
+              << st.slots << " slots of " << cfg.slot_us << " us\n";
+    std::cout << "SDUs:         " << st.delivered << " of " << st.submitted << " delivered x " << pkt.size()
+              << " bytes (" << st.lost << " lost)\n";
+    std::cout << "Goodput:      " << st.goodput_mbps << " Mbit/s\n";
+    std::cout << "Feedback:     " << st.tbs << " TBs, " << st.harq_retx << " HARQ retx, " << st.harq_failures
+              << " HARQ failures, " << st.rlc_retx << " RLC retx, " << st.status_pdus << " STATUS PDUs\n\n";
+    std::cout << std::left << std::setw(12) << "Latency (us)" << std::right;
+    for (const char* h : {"min", "p50", "p90", "p99", "p99.9", "max"}) std::cout << std::setw(10) << h;
+    std::cout << std::fixed << std::setprecision(1) << "\n";
+    for (int s = 0; s < LOOP_STAGES; s++) {
+        const LatencyHistogram& h = link.latency((LoopStage)s);
+        std::cout << std::left << std::setw(12) << loop_stage_str((LoopStage)s) << std::right;
+        for (uint64_t v : {h.min(), h.percentile(50), h.percentile(90), h.percentile(99), h.percentile(99.9), h.max()})
+            std::cout << std::setw(10) << v / 1e3;
+        std::cout << "\n";
+    }
+    std::cout << std::defaultfloat;
+    return drained && st.lost == 0 ? 0 : 1;
+}
+
+// The headline counters of a metrics snapshot, summed over UEs and bearers.
+void print_metrics_summary(const MetricsSnapshot& m, const std::string& path) {
+    auto ratio = [](int64_t a, int64_t b) { return b ? (double)a / (double)b : 0.0; };
+    std::cout << std::fixed << std::setprecision(2) << "\nMetrics:      " << m.samples.size() << " series, dumped to " << path << "\n";
+    std::cout << "  BLER        " << 100.0 * ratio(m.total("phy_rx_tb_errors_total"), m.total("phy_rx_tbs_total"))
+              << "% of " << m.total("phy_rx_tbs_total") << " TBs\n";
+    MetricSample tx = m.merged("mac_harq_tx_per_tb");
+    std::cout << "  HARQ tx/TB ";
+    for (size_t b = 0; b < tx.buckets.size(); b++)
+        std::cout << ' ' << (b < tx.bounds.size() ? std::to_string(tx.bounds[b]) : std::string("dropped")) << ": "
+                  << tx.buckets[b];
+    std::cout << "\n  RLC         " << m.total("rlc_retx_pdus_total") << " retx of " << m.total("rlc_tx_pdus_total")
+              << " PDUs, " << m.total("rlc_max_retx_total") << " at max retx, TX/RX window "
+              << m.total("rlc_tx_window") << "/" << m.total("rlc_rx_window") << "\n";
+    std::cout << "  PDCP        " << m.total("pdcp_rx_duplicates_total") << " duplicates, "
+              << m.total("pdcp_rx_integrity_failures_total") << " integrity and "
+              << m.total("pdcp_rx_rohc_failures_total") << " ROHC failures, " << m.total("pdcp_rx_lost_total")
+              << " lost\n";
+    std::cout << "  ROHC        " << m.total("pdcp_rohc_out_bytes_total") << " of "
+              << m.total("pdcp_rohc_in_bytes_total") << " bytes ("
+              << 100.0 * ratio(m.total("pdcp_rohc_out_bytes_total"), m.total("pdcp_rohc_in_bytes_total")) << "%)\n" << std::defaultfloat;
+}
+
+void print_capture_summary(const PcapStats& s, const std::string& path) {
+    std::cout << "\nCapture:      " << s.frames << " frames (" << s.dropped << " dropped), " << s.bytes_written
+              << " bytes in " << s.writes << " writes to " << path << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t num_ues = 0, workers = 4, sdus = 10, nas_ues = 0, bearer_sdus = 0, sdu_bytes = 1400;
+    size_t loop_sdus = 0;
+    float  snr = 20.0f;
+    double rate = 0;
+    std::string mode = "rtc";
+    int pin = -1;
+    std::string   metrics_path;
+    MetricsFormat metrics_fmt   = MetricsFormat::PROMETHEUS;
+    uint32_t      metrics_every = 1000;
+    UeMetrics     metrics_scope = UeMetrics::CELL;
+    PcapConfig    pcap;
+    std::string   trace_path, replay_path;
+    bool          replay_paced = false;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if      (!std::strcmp(argv[i], "--ues"))     num_ues = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--workers")) workers = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--sdus"))    sdus    = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--nas-storm")) nas_ues = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--bearer"))  bearer_sdus = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--size"))    sdu_bytes   = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--mode"))    mode        = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--pin"))     pin         = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--loopback")) loop_sdus  = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--snr"))     snr         = std::strtof(argv[i + 1], nullptr);
+        else if (!std::strcmp(argv[i], "--rate"))    rate        = std::strtod(argv[i + 1], nullptr);
+        else if (!std::strcmp(argv[i], "--metrics")) metrics_path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--metrics-format"))
+            metrics_fmt = !std::strcmp(argv[i + 1], "json") ? MetricsFormat::JSON : MetricsFormat::PROMETHEUS;
+        else if (!std::strcmp(argv[i], "--metrics-every")) metrics_every = (uint32_t)std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--metrics-scope"))
+            metrics_scope = !std::strcmp(argv[i + 1], "ue") ? UeMetrics::PER_UE : UeMetrics::CELL;
+        else if (!std::strcmp(argv[i], "--pcap")) pcap.path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--trace"))  trace_path  = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--replay")) replay_path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--replay-pacing")) replay_paced = !std::strcmp(argv[i + 1], "recorded");
+        else if (!std::strcmp(argv[i], "--pcap-layers"))
+            pcap.layers = (std::strstr(argv[i + 1], "mac") ? PCAP_MAC : 0) | (std::strstr(argv[i + 1], "rlc") ? PCAP_RLC : 0) |
+                          (std::strstr(argv[i + 1], "pdcp") ? PCAP_PDCP : 0);
+        else if (!std::strcmp(argv[i], "--pcap-ues")) {
+            char* p = argv[i + 1];
+            for (char* e; *p; p = *e == ',' ? e + 1 : e) {
+                unsigned long ue = std::strtoul(p, &e, 0);
+                if (e == p) break;
+                pcap.ues.push_back((uint16_t)ue);
+            }
+        }
+    }
+    if (!replay_path.empty()) return run_replay(replay_path, replay_paced);
+    bool metrics = !metrics_path.empty(), capture = !pcap.path.empty();
+    if ((metrics || capture) && (loop_sdus || num_ues)) {
+        if (capture && PcapCapture::instance().start(pcap) != Status::OK) {
+            std::cerr << "cannot write " << pcap.path << "\n";
+            return 1;
+        }
+        if (metrics) MetricsRegistry::instance().start_dump(metrics_path, metrics_fmt, metrics_every ? metrics_every : 1000);
+        int rc = loop_sdus ? run_loopback_test(loop_sdus, sdu_bytes, snr, rate, metrics, capture)
+                           : run_load_test(num_ues, workers, sdus, metrics ? metrics_scope : UeMetrics::OFF, capture,
+                                           trace_path);
+        if (metrics) {
+            MetricsRegistry::instance().stop_dump();
+            print_metrics_summary(MetricsRegistry::instance().snapshot(), metrics_path);
+        }
+        if (capture) {
+            PcapCapture::instance().stop();
+            print_capture_summary(PcapCapture::instance().stats(), pcap.path);
+        }
+        return rc;
+    }
+    if (loop_sdus) return run_loopback_test(loop_sdus, sdu_bytes, snr, rate, false, false);
+    if (bearer_sdus) {
+        int rc = 0;
+        if (mode == "rtc" || mode == "both")      rc |= run_bearer_test(bearer_sdus, sdu_bytes, PipelineMode::RUN_TO_COMPLETION, pin);
+        if (mode == "pipeline" || mode == "both") rc |= run_bearer_test(bearer_sdus, sdu_bytes, PipelineMode::PIPELINED, pin);
+        return rc;
+    }
+    if (nas_ues) return run_nas_storm(nas_ues, workers);
+    if (num_ues) return run_load_test(num_ues, workers, sdus, UeMetrics::OFF, false, trace_path);
+    Logger::instance().set_async(false);
     std::cout << "╔══════════════════════════════════════════════════╗\n";
     std::cout << "║   Cellular Protocol Stack Simulation (LTE/5G NR) ║\n";
     std::cout << "╚══════════════════════════════════════════════════╝\n\n";
@@ -62,16 +400,37 @@ int main() {
         "HTTP GET /index.html",
         "DNS query google.com"
     };
-    for (auto msg : messages) {
-        Bytes ip_pkt = make_ip_packet(msg);
-        Bytes pdcp_pdu, rlc_pdu, mac_pdu, tb;
-        pdcp.transmit_sdu(ip_pkt, pdcp_pdu);
-        rlc.transmit_sdu(pdcp_pdu, rlc_pdu);
-        mac.transmit_sdu(rlc_pdu, mac_pdu);
-        phy.transmit_transport_block(mac_pdu, tb);
-        mac.harq_feedback(0, true);
-        std::cout << "Sent: " << msg << "\n";
+    constexpr size_t num_msgs = sizeof(messages) / sizeof(messages[0]);
+    PduBuffer pdus[num_msgs];
+    Status    status[num_msgs];
+    for (size_t i = 0; i < num_msgs; i++) pdus[i] = PduBuffer::from(make_ip_packet(messages[i], (uint16_t)(i + 1)));
+    pdcp.transmit_burst(pdus, num_msgs, status);
+    rlc.transmit_burst(pdus, num_msgs, status);
+    for (size_t i = 0; i < num_msgs; i++) mac.queue_sdu(LogicalChannel::DTCH, pdus[i]);
+    // The scheduler sizes each slot's grant from the MAC buffer and the SNR.
+    const uint16_t rnti = 0x4601;
+    SchedConfig sched_cfg;
+    sched_cfg.num_prbs = phy_cfg.num_prbs;
+    MacScheduler sched(sched_cfg);
+    sched.add_ue(rnti);
+    sched.update_channel(rnti, phy.get_snr());
+    sched.update_buffer(rnti, (uint32_t)mac.queued_bytes());
+    SchedGrant grants[4];
+    while (mac.queued_bytes() && sched.get_slot() < 8) {
+        size_t n = sched.schedule(grants, 4);
+        for (size_t g = 0; g < n; g++) {
+            PduBuffer tb;
+            Status st = mac.transmit_tb(grants[g].tbs, tb);
+            if (st == Status::OK) st = phy.transmit_transport_block(tb);
+            mac.harq_feedback(mac.get_last_harq_id(), true);
+            std::cout << "Slot " << sched.get_slot() << ": RNTI 0x" << std::hex << grants[g].rnti << std::dec
+                      << " PRBs " << grants[g].prb_start << "-" << grants[g].prb_start + grants[g].num_prbs - 1
+                      << " TBS " << grants[g].tbs << " bytes [" << status_str(st) << "]\n";
+        }
+        sched.update_buffer(rnti, (uint32_t)mac.queued_bytes());
     }
+    for (size_t i = 0; i < num_msgs; i++)
+        std::cout << "Sent: " << messages[i] << " [" << status_str(mac.queued_bytes() ? Status::PENDING : Status::OK) << "]\n";
 
     std::cout << "\n━━━━━━━━━━ PHASE 6: RRC SUSPEND/RESUME ━━━━━━━━━━\n";
     rrc.suspend_connection();
@@ -84,6 +443,8 @@ int main() {
     std::cout << "MAC HARQ Retx: " << mac.get_harq_retx() << "\n";
     std::cout << "RLC TX SN:     " << rlc.get_tx_sn()     << "\n";
     std::cout << "PDCP TX SN:    " << pdcp.get_tx_sn()    << "\n";
+    const RohcStats& rs = pdcp.rohc_tx().stats();
+    std::cout << "ROHC:          " << rs.bytes_in << " -> " << rs.bytes_out << " bytes (" << rs.ir << " IR)\n";
 
     std::cout << "\n━━━━━━━━━━ PHASE 7: TEARDOWN ━━━━━━━━━━\n";
     rrc.release_connection();
@@ -0,0 +1,232 @@
+#include "bearer_pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+namespace {
+constexpr size_t PIPE_MAX_BATCH = 256;
+const char* const STAGE_NAME[PIPE_STAGES] = {"PDCP", "RLC", "MAC/PHY"};
+inline void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+size_t clamp_batch(size_t b) { return std::min(std::max<size_t>(b, 1), PIPE_MAX_BATCH); }
+size_t take(SpscRing<PipeItem>& ring, std::vector<PduBuffer>& pdu, std::vector<Status>& st,
+            std::vector<uint16_t>& sn, std::vector<uint32_t>& bytes, size_t max) {
+    size_t n = 0;
+    for (PipeItem* it; n < max && (it = ring.front()); n++) {
+        pdu[n]   = std::move(it->pdu);
+        st[n]    = it->status;
+        sn[n]    = it->rlc_sn;
+        bytes[n] = it->bytes;
+        ring.pop_front();
+    }
+    return n;
+}
+}
+BearerPipeline::BearerPipeline(PipelineConfig cfg)
+    : cfg_(cfg), pdcp_(cfg.bearer), rlc_(cfg.rlc_mode), phy_(cfg.phy), rtc_(clamp_batch(cfg.batch)) {
+    cfg_.batch = clamp_batch(cfg_.batch);
+    if (cfg_.mode == PipelineMode::PIPELINED)
+        for (size_t s = 0; s < PIPE_STAGES; s++) {
+            down_[s] = std::make_unique<Ring>(cfg_.ring_depth);
+            up_[s]   = std::make_unique<Ring>(cfg_.ring_depth);
+        }
+}
+BearerPipeline::~BearerPipeline() { stop(); }
+void BearerPipeline::start() {
+    if (cfg_.mode != PipelineMode::PIPELINED || running_.exchange(true)) return;
+    unsigned ncpu = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t s = 0; s < PIPE_STAGES; s++) {
+        workers_[s] = std::thread([this, s] { stage_loop(s); });
+        if (cfg_.first_cpu < 0) continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((cfg_.first_cpu + s) % ncpu, &set);
+        if (pthread_setaffinity_np(workers_[s].native_handle(), sizeof(set), &set) != 0)
+            LOGF_WARN("PIPE", "Cannot pin {} stage to CPU {}", STAGE_NAME[s], (cfg_.first_cpu + s) % ncpu);
+    }
+    LOGF_INFO("PIPE", "Pipeline started, first CPU {}", cfg_.first_cpu);
+}
+void BearerPipeline::stop() {
+    if (!running_.exchange(false)) return;
+    for (auto& w : workers_) if (w.joinable()) w.join();
+}
+Status BearerPipeline::submit(PduBuffer& sdu) { return submit_burst(&sdu, 1) ? Status::OK : Status::BUFFER_FULL; }
+size_t BearerPipeline::submit_burst(PduBuffer* sdus, size_t n) {
+    if (cfg_.mode == PipelineMode::RUN_TO_COMPLETION) {
+        run_to_completion(sdus, n);
+        return n;
+    }
+    reap();
+    size_t i = 0;
+    for (; i < n; i++) {
+        PipeItem* slot = down_[PIPE_PDCP]->try_claim();
+        if (!slot) break;
+        slot->bytes  = (uint32_t)sdus[i].size();
+        slot->status = Status::OK;
+        slot->pdu    = std::move(sdus[i]);
+        down_[PIPE_PDCP]->publish();
+    }
+    submitted_ += i;
+    refused_   += n - i;
+    return i;
+}
+size_t BearerPipeline::reap() {
+    if (cfg_.mode != PipelineMode::PIPELINED) return 0;
+    Ring& done = *up_[PIPE_PDCP];
+    size_t n = 0;
+    for (PipeItem* it; (it = done.front()); n++) {
+        account(it->status, it->bytes);
+        it->pdu.reset();
+        done.pop_front();
+    }
+    return n;
+}
+void BearerPipeline::drain() {
+    while (completed_ < submitted_) {
+        if (!reap()) std::this_thread::yield();
+    }
+}
+PipelineStats BearerPipeline::stats() const {
+    PipelineStats s;
+    s.submitted = submitted_;
+    s.completed = completed_;
+    s.tx_bytes  = tx_bytes_;
+    s.errors    = errors_;
+    s.refused   = refused_;
+    for (size_t i = 0; i < PIPE_STAGES; i++) s.stalls[i] = stage_stats_[i].stalls.load(std::memory_order_relaxed);
+    return s;
+}
+void BearerPipeline::account(Status st, uint32_t bytes) {
+    completed_++;
+    if (st == Status::OK) tx_bytes_ += bytes;
+    else errors_++;
+}
+// Runs stage s over l[from, from + n); returns how many it took, all of
+// them unless the RLC window is full.
+size_t BearerPipeline::process(size_t s, Lane& l, size_t from, size_t n) {
+    switch (s) {
+        case PIPE_PDCP:
+            pdcp_.transmit_burst(&l.pdu[from], n, &l.st[from]);
+            return n;
+        case PIPE_RLC: {
+            uint16_t first = rlc_.get_tx_sn();
+            size_t   sent  = rlc_.transmit_burst(&l.pdu[from], n, &l.st[from]);
+            for (size_t i = 0; i < sent; i++) l.sn[from + i] = (uint16_t)((first + i + 1) & (RLC_SN_MOD - 1));
+            // Without acknowledgements the window never reopens.
+            return cfg_.auto_rlc_ack ? sent : n;
+        }
+        default:
+            for (size_t i = from; i < from + n; i++) {
+                Status& st = l.st[i];
+                st = mac_.transmit_sdu(l.pdu[i]);
+                if (st == Status::OK) st = phy_.transmit_transport_block(l.pdu[i]);
+                if (st == Status::OK && cfg_.auto_harq_ack) mac_.harq_feedback(mac_.get_last_harq_id(), true);
+            }
+            return n;
+    }
+}
+// Completions arrive in order, so the last delivered SN acknowledges them all.
+void BearerPipeline::ack_rlc(const Lane& l, size_t from, size_t n) {
+    if (!cfg_.auto_rlc_ack || rlc_.get_mode() != RlcMode::AM) return;
+    for (size_t i = from + n; i-- > from; ) {
+        if (l.st[i] != Status::OK) continue;
+        rlc_.process_status_pdu(l.sn[i], {});
+        return;
+    }
+}
+// Completes the failed PDUs of l[0, n) and packs the rest to the front.
+size_t BearerPipeline::settle(Lane& l, size_t n) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (l.st[i] != Status::OK) {
+            account(l.st[i], l.bytes[i]);
+            l.pdu[i].reset();
+            continue;
+        }
+        if (i != k) {
+            l.pdu[k]   = std::move(l.pdu[i]);
+            l.sn[k]    = l.sn[i];
+            l.bytes[k] = l.bytes[i];
+            l.st[k]    = Status::OK;
+        }
+        k++;
+    }
+    return k;
+}
+void BearerPipeline::run_to_completion(PduBuffer* sdus, size_t n) {
+    Lane& l = rtc_;
+    for (size_t off = 0; off < n; off += cfg_.batch) {
+        size_t k = std::min(cfg_.batch, n - off);
+        for (size_t i = 0; i < k; i++) {
+            l.bytes[i] = (uint32_t)sdus[off + i].size();
+            l.pdu[i]   = std::move(sdus[off + i]);
+        }
+        submitted_ += k;
+        process(PIPE_PDCP, l, 0, k);
+        k = settle(l, k);
+        process(PIPE_RLC, l, 0, k);
+        k = settle(l, k);
+        process(PIPE_MACPHY, l, 0, k);
+        ack_rlc(l, 0, k);
+        k = settle(l, k);
+        for (size_t i = 0; i < k; i++) {
+            account(Status::OK, l.bytes[i]);
+            l.pdu[i].reset();
+        }
+    }
+}
+// Pushes l[head, done) on: OK PDUs down to the next stage (the last stage
+// sends everything up), failed ones straight back up. False if it stalled.
+bool BearerPipeline::flush(size_t s, Lane& l, bool up) {
+    for (; l.head < l.done; l.head++) {
+        bool down = !up && s + 1 < PIPE_STAGES && l.st[l.head] == Status::OK;
+        Ring& ring = down ? *down_[s + 1] : *up_[s];
+        PipeItem* slot = ring.try_claim();
+        if (!slot) {
+            bump(stage_stats_[s].stalls);
+            return false;
+        }
+        slot->pdu    = std::move(l.pdu[l.head]);
+        slot->status = l.st[l.head];
+        slot->rlc_sn = l.sn[l.head];
+        slot->bytes  = l.bytes[l.head];
+        ring.publish();
+    }
+    return true;
+}
+// Completions first, since they reopen the RLC window, then new work.
+bool BearerPipeline::pass(size_t s, Lane& down, Lane& up) {
+    bool busy = false;
+    if (s + 1 < PIPE_STAGES && flush(s, up, true)) {
+        up.head = up.done = 0;
+        up.n = take(*up_[s + 1], up.pdu, up.st, up.sn, up.bytes, cfg_.batch);
+        if (up.n) {
+            if (s == PIPE_RLC) ack_rlc(up, 0, up.n);
+            up.done = up.n;
+            flush(s, up, true);
+            busy = true;
+        }
+    }
+    if (!flush(s, down, false)) return busy;
+    if (down.done == down.n) {
+        down.head = down.done = 0;
+        down.n = take(*down_[s], down.pdu, down.st, down.sn, down.bytes, cfg_.batch);
+    }
+    if (down.done < down.n) {
+        size_t k = process(s, down, down.done, down.n - down.done);
+        if (k == 0) bump(stage_stats_[s].stalls);
+        down.done += k;
+        flush(s, down, false);
+        busy |= k > 0;
+    }
+    return busy;
+}
+void BearerPipeline::stage_loop(size_t s) {
+    Lane down(cfg_.batch), up(cfg_.batch);
+    unsigned idle = 0;
+    while (running_.load(std::memory_order_acquire)) {
+        if (pass(s, down, up)) { idle = 0; continue; }
+        if (++idle < 1024) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
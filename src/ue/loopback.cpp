@@ -0,0 +1,262 @@
+#include "loopback.h"
+#include <algorithm>
+#include <chrono>
+namespace {
+constexpr size_t   TRACE_RING    = 4096;   // PDCP SN12 space
+constexpr size_t   MAX_IN_FLIGHT = TRACE_RING / 2;
+constexpr uint32_t SN12_MASK     = 0x0FFF;
+uint64_t wall_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+// RLC AM/UM data PDU (12-bit SN): D/C, P, SI, SN. True if it carries the
+// last byte of its SDU, i.e. it is a whole SDU or a last segment.
+bool rlc_ends_sdu(const PduBuffer& pdu, uint16_t& sn) {
+    if (pdu.size() < 2 || !(pdu[0] & 0x80)) return false;
+    uint8_t si = (pdu[0] >> 4) & 0x03;
+    sn = (uint16_t)(((pdu[0] & 0x0F) << 8) | pdu[1]);
+    return si == 0 || si == 2;
+}
+uint16_t pdcp_sn12(const PduBuffer& pdu) { return (uint16_t)(((pdu[0] & 0x0F) << 8) | pdu[1]); }
+}
+const char* loop_stage_str(LoopStage s) {
+    switch (s) {
+        case LOOP_PDCP_TX: return "PDCP TX";
+        case LOOP_RLC_TX:  return "RLC TX";
+        case LOOP_MAC_PHY: return "MAC/PHY";
+        case LOOP_RLC_RX:  return "RLC RX";
+        case LOOP_PDCP_RX: return "PDCP RX";
+        case LOOP_E2E:     return "end-to-end";
+        default:           return "?";
+    }
+}
+struct LoopbackLink::Side {
+    PdcpLayer             pdcp;
+    RlcLayer              rlc;
+    MacLayer              mac;
+    PhyLayer              phy;
+    std::vector<Feedback> fb;   // ACK/NACKs on their way to this side
+    Side(const LoopbackConfig& cfg, uint64_t stream, bool peer)
+        : pdcp(PdcpBearerType::DRB), rlc(cfg.rlc_mode), mac(cfg.harq), phy(cfg.phy, stream) {
+        if (peer && cfg.capture) {
+            PcapContext cap;
+            cap.ueid = cap.rnti = cfg.rnti;
+            pdcp.bind_capture(cap);
+            rlc.bind_capture(cap);
+            mac.bind_capture(cap);
+        }
+        if (!cfg.metrics) return;
+        uint8_t drb = (uint8_t)LogicalChannel::DTCH;
+        pdcp.bind_metrics(cfg.rnti, drb);
+        rlc.bind_metrics(cfg.rnti, drb);
+        mac.bind_metrics(cfg.rnti);
+        phy.bind_metrics(cfg.rnti);
+    }
+};
+LoopbackLink::LoopbackLink(LoopbackConfig cfg)
+    : cfg_(cfg), ue_(new Side(cfg, cfg.rnti, false)), peer_(new Side(cfg, 0x10000u | cfg.rnti, true)), trace_(TRACE_RING) {
+    cfg_.max_in_flight = std::min(std::max<size_t>(cfg_.max_in_flight, 1), MAX_IN_FLIGHT);
+    rx_sdus_.resize(peer_->phy.tbs_bytes() / 3 + 1);
+    ue_->mac.set_lc_pull(LogicalChannel::DTCH, [this](uint32_t budget, PduBuffer* out, size_t max) {
+        return pull(*ue_, budget, out, max);
+    });
+    peer_->mac.set_lc_pull(LogicalChannel::DTCH, [this](uint32_t budget, PduBuffer* out, size_t max) {
+        return pull(*peer_, budget, out, max);
+    });
+    if (cfg_.metrics) {
+        std::vector<uint64_t> bounds = MetricsRegistry::exp_buckets(1000, 2, 24);   // 1 us to 8 s
+        for (unsigned s = 0; s < LOOP_STAGES; s++)
+            hist_metrics_[s] = MetricsRegistry::instance().histogram(
+                "loop_latency_ns", bounds, {loop_stage_str((LoopStage)s), cfg_.rnti, (uint8_t)LogicalChannel::DTCH});
+    }
+    begin_phase(0);
+}
+LoopbackLink::~LoopbackLink() = default;
+const PdcpLayer& LoopbackLink::ue_pdcp()  const { return ue_->pdcp; }
+const RlcLayer&  LoopbackLink::ue_rlc()   const { return ue_->rlc; }
+const MacLayer&  LoopbackLink::ue_mac()   const { return ue_->mac; }
+const RlcLayer&  LoopbackLink::peer_rlc() const { return peer_->rlc; }
+const PhyLayer&  LoopbackLink::peer_phy() const { return peer_->phy; }
+void LoopbackLink::set_snr(float snr_db) {
+    ue_->phy.set_snr(snr_db);
+    peer_->phy.set_snr(snr_db);
+}
+void LoopbackLink::begin_phase(uint64_t base_ns) {
+    base_ns_ = base_ns;
+    if (cfg_.measure_cpu) phase_wall_ = wall_ns();
+}
+uint64_t LoopbackLink::now_ns() const {
+    return base_ns_ + (cfg_.measure_cpu ? wall_ns() - phase_wall_ : 0);
+}
+void LoopbackLink::stamp(uint32_t count, LoopStamp s) {
+    SduTrace& t = trace(count);
+    if (t.seen & (1u << s)) return;
+    t.t[s]  = now_ns();
+    t.seen |= (uint8_t)(1u << s);
+}
+// At most MAX_IN_FLIGHT COUNTs are open, all at or above rx_deliv_, so the
+// 12-bit SN picks one out.
+uint32_t LoopbackLink::count_of(uint16_t sn12) const {
+    return (uint32_t)(rx_deliv_ + ((sn12 - rx_deliv_) & SN12_MASK));
+}
+Status LoopbackLink::submit(PduBuffer& sdu) {
+    if (in_flight() >= cfg_.max_in_flight) {
+        refused_++;
+        return Status::BUFFER_FULL;
+    }
+    uint32_t count = ue_->pdcp.get_tx_count();
+    trace(count).seen = 0;
+    stamp(count, STAMP_SUBMIT);
+    PduBuffer pdu = std::move(sdu);
+    ue_->pdcp.transmit_sdu(pdu);
+    ue_->rlc.enqueue_sdu(pdu);
+    stamp(count, STAMP_PDCP_TX);
+    submitted_++;
+    return Status::OK;
+}
+// DTCH in the MAC's logical channel prioritisation. A pending STATUS PDU
+// goes before data; if the grant cannot take it, the poll or t-Reassembly
+// that asked for it will ask again.
+size_t LoopbackLink::pull(Side& s, uint32_t budget, PduBuffer* out, size_t max) {
+    if (s.rlc.status_required()) {
+        s.rlc.build_status_pdu(out[0]);
+        if (out[0].size() <= budget) {
+            status_pdus_++;
+            return 1;
+        }
+        out[0].reset();
+    }
+    size_t n = s.rlc.pull_pdus(budget, out, max);
+    if (&s == ue_.get())
+        for (size_t i = 0; i < n; i++) {
+            uint16_t sn;
+            if (rlc_ends_sdu(out[i], sn)) stamp(count_of(sn), STAMP_RLC_TX);
+        }
+    return n;
+}
+bool LoopbackLink::has_data(const Side& s) const {
+    return s.mac.queued_bytes() || s.rlc.queued_sdus() || s.rlc.retx_pending() || s.rlc.status_required();
+}
+// This slot's TB from tx: a HARQ retransmission, else new data if there is
+// any and a HARQ process is free.
+bool LoopbackLink::transmit(Side& tx, PduBuffer& tb, uint8_t& harq_id) {
+    if (tx.mac.retransmit(tb) != Status::OK) {
+        if (!has_data(tx) || tx.mac.transmit_tb(tx.phy.tbs_bytes(), tb) != Status::OK) return false;
+    }
+    harq_id = tx.mac.get_last_harq_id();
+    tx.phy.transmit_transport_block(tb);
+    // The HARQ process still references the TB; the channel corrupts its own copy.
+    tb.make_writable();
+    tbs_++;
+    return true;
+}
+void LoopbackLink::receive(Side& rx, Side& tx, PduBuffer& tb, uint8_t harq_id) {
+    bool ok = rx.phy.receive_transport_block(tb) == Status::OK;
+    tx.fb.push_back({slot_ + cfg_.harq_k1, harq_id, ok});
+    if (!ok) return;
+    size_t n = rx.mac.demux_tb(tb, rx_sdus_.data(), rx_sdus_.size());
+    bool   to_peer = &rx == peer_.get();
+    for (size_t i = 0; i < n; i++) {
+        if (rx_sdus_[i].lc != LogicalChannel::DTCH) continue;
+        PduBuffer& pdu = rx_sdus_[i].sdu;
+        uint16_t   sn;
+        if (to_peer && rlc_ends_sdu(pdu, sn)) stamp(count_of(sn), STAMP_MAC_RX);
+        if (rx.rlc.receive_pdu(pdu) == Status::OK && to_peer) to_pdcp(pdu);
+        pdu.reset();
+    }
+    if (!to_peer) return;
+    for (PduBuffer sdu; peer_->rlc.pop_sdu(sdu); ) to_pdcp(sdu);
+}
+void LoopbackLink::to_pdcp(PduBuffer& pdu) {
+    if (pdu.size() >= 2) stamp(count_of(pdcp_sn12(pdu)), STAMP_RLC_RX);
+    if (peer_->pdcp.receive_pdu(pdu) == Status::OK) deliver(pdu);
+    deliver_ready();
+}
+void LoopbackLink::deliver(PduBuffer& sdu) {
+    delivered_++;
+    rx_bytes_ += sdu.size();
+    if (sink_) sink_(sdu);
+    sdu.reset();
+}
+void LoopbackLink::deliver_ready() {
+    for (PduBuffer sdu; peer_->pdcp.pop_sdu(sdu); ) deliver(sdu);
+    settle();
+}
+// Closes the COUNTs the peer's PDCP has moved past: delivered if they got
+// there, lost if t-Reordering gave up on them.
+void LoopbackLink::settle() {
+    uint64_t deliv = peer_->pdcp.get_rx_deliv();
+    for (; rx_deliv_ < deliv; rx_deliv_++) {
+        SduTrace& t = trace((uint32_t)rx_deliv_);
+        if (!(t.seen & (1u << STAMP_RLC_RX))) {
+            lost_++;
+            continue;
+        }
+        stamp((uint32_t)rx_deliv_, STAMP_PDCP_RX);
+        for (unsigned s = 0; s + 1 < STAMP_COUNT; s++)
+            if ((t.seen >> s & 3) == 3) record(s, t.t[s], t.t[s + 1]);
+        record(LOOP_E2E, t.t[STAMP_SUBMIT], t.t[STAMP_PDCP_RX]);
+    }
+}
+void LoopbackLink::record(unsigned stage, uint64_t from, uint64_t to) {
+    uint64_t v = to > from ? to - from : 0;
+    hist_[stage].record(v);
+    hist_metrics_[stage].record(v);
+}
+void LoopbackLink::feedback(Side& tx) {
+    size_t k = 0;
+    for (const Feedback& f : tx.fb) {
+        if (f.due <= slot_) tx.mac.harq_feedback(f.harq_id, f.ack);
+        else                tx.fb[k++] = f;
+    }
+    tx.fb.resize(k);
+}
+// Slot n: feedback due now, then each side's TB, received at the start of
+// slot n + 1, then the timers.
+void LoopbackLink::run_slot() {
+    uint64_t slot_ns = (uint64_t)cfg_.slot_us * 1000;
+    begin_phase(slot_ * slot_ns);
+    feedback(*ue_);
+    feedback(*peer_);
+    PduBuffer ul, dl;
+    uint8_t   ul_id = 0, dl_id = 0;
+    bool      has_ul = transmit(*ue_, ul, ul_id);
+    bool      has_dl = transmit(*peer_, dl, dl_id);
+    begin_phase((slot_ + 1) * slot_ns);
+    if (has_ul) receive(*peer_, *ue_, ul, ul_id);
+    if (has_dl) receive(*ue_, *peer_, dl, dl_id);
+    timer_us_ += cfg_.slot_us;
+    uint32_t ms = timer_us_ / 1000;
+    timer_us_  %= 1000;
+    for (Side* s : {ue_.get(), peer_.get()}) {
+        s->mac.tick();
+        if (!ms) continue;
+        s->rlc.tick(ms);
+        s->pdcp.tick(ms);
+    }
+    for (PduBuffer sdu; peer_->rlc.pop_sdu(sdu); ) to_pdcp(sdu);
+    deliver_ready();
+    slot_++;
+    begin_phase(slot_ * slot_ns);
+}
+bool LoopbackLink::drain(uint64_t max_slots) {
+    for (uint64_t n = 0; in_flight() && n < max_slots; n++) run_slot();
+    return in_flight() == 0;
+}
+LoopbackStats LoopbackLink::stats() const {
+    LoopbackStats s;
+    s.slots         = slot_;
+    s.submitted     = submitted_;
+    s.refused       = refused_;
+    s.delivered     = delivered_;
+    s.lost          = lost_;
+    s.rx_bytes      = rx_bytes_;
+    s.tbs           = tbs_;
+    s.tb_errors     = ue_->phy.get_rx_errors() + peer_->phy.get_rx_errors();
+    s.harq_retx     = ue_->mac.get_harq_retx() + peer_->mac.get_harq_retx();
+    s.harq_failures = ue_->mac.harq().get_failures() + peer_->mac.harq().get_failures();
+    s.rlc_retx      = ue_->rlc.get_tx_retx();
+    s.status_pdus   = status_pdus_;
+    s.goodput_mbps  = slot_ ? rx_bytes_ * 8.0 / ((double)slot_ * cfg_.slot_us) : 0.0;
+    return s;
+}
@@ -0,0 +1,190 @@
+#include "ue_manager.h"
+#include "ue_trace.h"
+#include <chrono>
+#include <cstdio>
+namespace {
+UeIdentity make_identity(uint16_t rnti) {
+    UeIdentity id;
+    char imsi[16];
+    std::snprintf(imsi, sizeof(imsi), "310260%09u", (unsigned)rnti);
+    id.imsi = imsi;
+    id.supi = "imsi-" + id.imsi;
+    return id;
+}
+inline void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+}
+UeContext::UeContext(uint16_t r, const UeManagerConfig& cfg, NasIpPool* ip_pool)
+    : rnti(r), nas(make_identity(r), ip_pool), rrc(CellConfig{}, r), pdcp(cfg.bearer), rlc(cfg.rlc_mode), phy(cfg.phy, r) {
+    if (cfg.capture) {
+        PcapContext cap;
+        cap.ueid = cap.rnti = r;
+        pdcp.bind_capture(cap);
+        rlc.bind_capture(cap);
+        mac.bind_capture(cap);
+    }
+    if (cfg.metrics == UeMetrics::OFF) return;
+    bool     per_ue = cfg.metrics == UeMetrics::PER_UE;
+    uint32_t ue     = per_ue ? r : METRIC_NO_UE;
+    uint8_t  drb    = per_ue ? (uint8_t)LogicalChannel::DTCH : METRIC_NO_BEARER;
+    phy.bind_metrics(ue);
+    mac.bind_metrics(ue);
+    rlc.bind_metrics(ue, drb);
+    pdcp.bind_metrics(ue, drb);
+}
+
+UeManager::UeManager(UeManagerConfig cfg) : cfg_(std::move(cfg)) {
+    size_t n = cfg_.num_workers ? cfg_.num_workers : 1;
+    uint32_t per = (uint32_t)(65534 / n);
+    for (size_t i = 0; i < n; i++)
+        shards_.push_back(std::make_unique<Shard>(cfg_.queue_depth, 0x0A2D0001 + per * (uint32_t)i, per));
+}
+UeManager::~UeManager() { stop(); }
+void UeManager::start() {
+    if (running_.exchange(true)) return;
+    for (auto& sh : shards_) {
+        Shard* s = sh.get();
+        s->worker = std::thread([this, s] { worker_loop(*s); });
+    }
+    LOGF_INFO("UE", "UE manager started with {} workers", shards_.size());
+}
+void UeManager::stop() {
+    if (!running_.exchange(false)) return;
+    for (auto& sh : shards_) if (sh->worker.joinable()) sh->worker.join();
+}
+Status UeManager::submit(UeCommand&& cmd) {
+    Shard& sh = *shards_[shard_of(cmd.rnti)];
+    if (cfg_.trace) cmd.ts_ns = cfg_.trace->now_ns();
+    if (!sh.queue.push(std::move(cmd))) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return Status::BUFFER_FULL;
+    }
+    return Status::OK;
+}
+Status UeManager::add_ue(uint16_t rnti) {
+    UeCommand c; c.type = UeCmdType::ADD_UE; c.rnti = rnti;
+    return submit(std::move(c));
+}
+Status UeManager::remove_ue(uint16_t rnti) {
+    UeCommand c; c.type = UeCmdType::REMOVE_UE; c.rnti = rnti;
+    return submit(std::move(c));
+}
+Status UeManager::attach_ue(uint16_t rnti) {
+    UeCommand c; c.type = UeCmdType::ATTACH; c.rnti = rnti;
+    return submit(std::move(c));
+}
+Status UeManager::inject_sdu(uint16_t rnti, PduBuffer sdu) {
+    UeCommand c; c.type = UeCmdType::TX_SDU; c.rnti = rnti; c.pdu = std::move(sdu);
+    return submit(std::move(c));
+}
+Status UeManager::inject_harq_feedback(uint16_t rnti, uint8_t harq_id, bool ack) {
+    UeCommand c; c.type = UeCmdType::HARQ_FEEDBACK; c.rnti = rnti; c.arg = harq_id; c.flag = ack;
+    return submit(std::move(c));
+}
+Status UeManager::inject_rlc_status(uint16_t rnti, uint16_t ack_sn, std::vector<uint16_t> nack_sns) {
+    UeCommand c; c.type = UeCmdType::RLC_STATUS; c.rnti = rnti; c.arg = ack_sn; c.sns = std::move(nack_sns);
+    return submit(std::move(c));
+}
+Status UeManager::inject_snr(uint16_t rnti, float snr_db) {
+    UeCommand c; c.type = UeCmdType::SET_SNR; c.rnti = rnti; c.value = snr_db;
+    return submit(std::move(c));
+}
+void UeManager::drain() {
+    if (!running_.load(std::memory_order_acquire)) {
+        UeCommand cmd;
+        for (auto& sh : shards_) while (sh->queue.pop(cmd)) execute(*sh, cmd);
+        return;
+    }
+    std::atomic<size_t> done{0};
+    for (size_t i = 0; i < shards_.size(); i++) {
+        UeCommand c; c.type = UeCmdType::BARRIER; c.done = &done;
+        while (!shards_[i]->queue.push(std::move(c))) std::this_thread::yield();
+    }
+    while (done.load(std::memory_order_acquire) < shards_.size()) std::this_thread::yield();
+}
+UeManagerStats UeManager::stats() const {
+    UeManagerStats s;
+    for (auto& sh : shards_) {
+        s.ues        += sh->stats.ues.load(std::memory_order_relaxed);
+        s.tx_sdus    += sh->stats.tx_sdus.load(std::memory_order_relaxed);
+        s.tx_bytes   += sh->stats.tx_bytes.load(std::memory_order_relaxed);
+        s.errors     += sh->stats.errors.load(std::memory_order_relaxed);
+        s.unknown_ue += sh->stats.unknown_ue.load(std::memory_order_relaxed);
+    }
+    s.rejected_cmds = rejected_.load(std::memory_order_relaxed);
+    return s;
+}
+void UeManager::worker_loop(Shard& sh) {
+    UeCommand cmd;
+    unsigned idle = 0;
+    while (running_.load(std::memory_order_acquire)) {
+        if (sh.queue.pop(cmd)) { execute(sh, cmd); idle = 0; continue; }
+        if (++idle < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    while (sh.queue.pop(cmd)) execute(sh, cmd);
+}
+void UeManager::execute(Shard& sh, UeCommand& cmd) {
+    if (cmd.type == UeCmdType::BARRIER) {
+        cmd.done->fetch_add(1, std::memory_order_release);
+        return;
+    }
+    if (cfg_.trace) cfg_.trace->record(shard_of(cmd.rnti), cmd);
+    size_t slot = cmd.rnti / shards_.size();
+    if (cmd.type == UeCmdType::ADD_UE) {
+        if (slot >= sh.ues.size()) sh.ues.resize(slot + 1);
+        if (!sh.ues[slot]) {
+            sh.ues[slot] = std::make_unique<UeContext>(cmd.rnti, cfg_, &sh.ip_pool);
+            bump(sh.stats.ues);
+        }
+        return;
+    }
+    UeContext* ue = find(sh, cmd.rnti);
+    if (!ue) { bump(sh.stats.unknown_ue); return; }
+    switch (cmd.type) {
+        case UeCmdType::REMOVE_UE:
+            sh.ues[slot].reset();
+            sh.stats.ues.store(sh.stats.ues.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            break;
+        case UeCmdType::ATTACH:
+            if (ue->nas.initiate_registration() != Status::OK ||
+                ue->nas.request_pdu_session() != Status::OK ||
+                ue->rrc.initiate_connection() != Status::OK) bump(sh.stats.errors);
+            break;
+        case UeCmdType::TX_SDU: {
+            size_t len = cmd.pdu.size();
+            if (ue->pdcp.transmit_sdu(cmd.pdu) != Status::OK ||
+                ue->rlc.transmit_sdu(cmd.pdu) != Status::OK ||
+                ue->mac.transmit_sdu(cmd.pdu) != Status::OK ||
+                ue->phy.transmit_transport_block(cmd.pdu) != Status::OK) {
+                bump(sh.stats.errors);
+                break;
+            }
+            if (cfg_.tb_sink) cfg_.tb_sink(ue->rnti, cmd.pdu);
+            if (cfg_.auto_harq_ack) ue->mac.harq_feedback(ue->mac.get_last_harq_id(), true);
+            if (cfg_.auto_rlc_ack && ue->rlc.get_mode() == RlcMode::AM) ue->rlc.process_status_pdu(ue->rlc.get_tx_sn(), {});
+            bump(sh.stats.tx_sdus);
+            bump(sh.stats.tx_bytes, len);
+            break;
+        }
+        case UeCmdType::HARQ_FEEDBACK: {
+            ue->mac.harq_feedback((uint8_t)cmd.arg, cmd.flag);
+            PduBuffer tb;
+            while (ue->mac.retransmit(tb) == Status::OK) {
+                ue->phy.transmit_transport_block(tb);
+                if (cfg_.tb_sink) cfg_.tb_sink(ue->rnti, tb);
+            }
+            break;
+        }
+        case UeCmdType::RLC_STATUS:
+            ue->rlc.process_status_pdu(cmd.arg, cmd.sns);
+            break;
+        case UeCmdType::SET_SNR:
+            ue->phy.set_snr(cmd.value);
+            break;
+        default:
+            break;
+    }
+    cmd.pdu.reset();
+}
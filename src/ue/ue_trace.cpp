@@ -0,0 +1,306 @@
+#include "ue_trace.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+namespace {
+uint64_t steady_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+template <typename T> void put(std::vector<uint8_t>& b, T v) {
+    size_t n = b.size();
+    b.resize(n + sizeof(T));
+    std::memcpy(b.data() + n, &v, sizeof(T));
+}
+void put_varint(std::vector<uint8_t>& b, uint64_t v) {
+    while (v >= 0x80) { b.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    b.push_back((uint8_t)v);
+}
+// Bounds-checked reader over one record stream.
+struct Reader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool           ok = true;
+    template <typename T> T get() {
+        T v{};
+        if (end - p < (ptrdiff_t)sizeof(T)) { ok = false; return v; }
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int s = 0; s < 64; s += 7) {
+            if (p == end) break;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << s;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    const uint8_t* bytes(size_t n) {
+        if ((size_t)(end - p) < n) { ok = false; return nullptr; }
+        const uint8_t* r = p;
+        p += n;
+        return r;
+    }
+};
+}
+
+Status UeTraceRecorder::open(const std::string& path, const UeManagerConfig& cfg) {
+    close();
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return Status::ERROR;
+    std::vector<uint8_t> h(UE_TRACE_MAGIC, UE_TRACE_MAGIC + 8);
+    uint16_t workers = (uint16_t)(cfg.num_workers ? cfg.num_workers : 1);
+    put<uint16_t>(h, UE_TRACE_VERSION);
+    put<uint16_t>(h, workers);
+    put<uint8_t>(h, (uint8_t)cfg.rlc_mode);
+    put<uint8_t>(h, (uint8_t)cfg.bearer);
+    put<uint8_t>(h, (uint8_t)(cfg.auto_harq_ack | cfg.auto_rlc_ack << 1 | cfg.phy.harq_enabled << 2 |
+                              cfg.phy.link_level << 3));
+    put<uint8_t>(h, (uint8_t)cfg.phy.mcs);
+    put<uint8_t>(h, cfg.phy.num_prbs);
+    put<uint8_t>(h, 0);
+    put<uint16_t>(h, cfg.phy.cell_id);
+    put<float>(h, cfg.phy.channel_snr_db);
+    put<uint64_t>(h, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count());
+    std::fwrite(h.data(), 1, h.size(), f);
+    num_shards_ = workers;
+    shards_.reset(new ShardBuf[num_shards_]);
+    for (size_t i = 0; i < num_shards_; i++) shards_[i].buf.reserve(UE_TRACE_CHUNK_BYTES + 256);
+    bytes_written_.store(h.size());
+    t0_ns_ = steady_ns();
+    file_  = f;
+    return Status::OK;
+}
+void UeTraceRecorder::close() {
+    if (!file_) return;
+    for (size_t i = 0; i < num_shards_; i++) flush(i, shards_[i]);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+uint64_t UeTraceRecorder::now_ns() const { return steady_ns() - t0_ns_; }
+uint64_t UeTraceRecorder::records() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i < num_shards_; i++) n += shards_[i].total;
+    return n;
+}
+void UeTraceRecorder::record(size_t shard, const UeCommand& cmd) {
+    if (!file_ || shard >= num_shards_) return;
+    ShardBuf& sb = shards_[shard];
+    std::vector<uint8_t>& b = sb.buf;
+    if (b.empty()) {
+        b.resize(UE_TRACE_CHUNK_HDR);   // filled in by flush()
+        sb.base_ns = sb.last_ns;
+    }
+    int64_t dt = (int64_t)(cmd.ts_ns - sb.last_ns);
+    sb.last_ns = cmd.ts_ns;
+    put<uint8_t>(b, (uint8_t)cmd.type);
+    put_varint(b, ((uint64_t)dt << 1) ^ (uint64_t)(dt >> 63));
+    put<uint16_t>(b, cmd.rnti);
+    switch (cmd.type) {
+        case UeCmdType::TX_SDU:
+            put_varint(b, cmd.pdu.size());
+            b.insert(b.end(), cmd.pdu.data(), cmd.pdu.data() + cmd.pdu.size());
+            break;
+        case UeCmdType::HARQ_FEEDBACK:
+            put<uint8_t>(b, (uint8_t)cmd.arg);
+            put<uint8_t>(b, cmd.flag);
+            break;
+        case UeCmdType::RLC_STATUS:
+            put<uint16_t>(b, cmd.arg);
+            put_varint(b, cmd.sns.size());
+            for (uint16_t sn : cmd.sns) put<uint16_t>(b, sn);
+            break;
+        case UeCmdType::SET_SNR:
+            put<float>(b, cmd.value);
+            break;
+        default:
+            break;
+    }
+    sb.records++;
+    sb.total++;
+    if (b.size() >= UE_TRACE_CHUNK_BYTES) flush(shard, sb);
+}
+void UeTraceRecorder::flush(size_t shard, ShardBuf& sb) {
+    std::vector<uint8_t>& b = sb.buf;
+    if (b.empty()) return;
+    uint32_t hdr[3] = { UE_TRACE_CHUNK_MAGIC, (uint32_t)(b.size() - UE_TRACE_CHUNK_HDR), (uint32_t)sb.records };
+    uint16_t sh[2]  = { (uint16_t)shard, 0 };
+    std::memcpy(b.data(), hdr, 12);
+    std::memcpy(b.data() + 12, sh, 4);
+    std::memcpy(b.data() + 16, &sb.base_ns, 8);
+    {
+        std::lock_guard<std::mutex> lk(file_mu_);
+        std::fwrite(b.data(), 1, b.size(), file_);
+    }
+    bytes_written_.fetch_add(b.size(), std::memory_order_relaxed);
+    b.clear();
+    sb.records = 0;
+}
+
+UeTraceReplayer::~UeTraceReplayer() {
+    if (map_) munmap((void*)map_, size_);
+}
+Status UeTraceReplayer::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return Status::ERROR;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < UE_TRACE_HEADER) { ::close(fd); return Status::ERROR; }
+    void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) return Status::ERROR;
+    if (map_) munmap((void*)map_, size_);
+    map_  = (const uint8_t*)m;
+    size_ = (size_t)st.st_size;
+    madvise(m, size_, MADV_SEQUENTIAL);
+
+    Reader r{map_ + 8, map_ + UE_TRACE_HEADER};
+    if (std::memcmp(map_, UE_TRACE_MAGIC, 8) != 0 || r.get<uint16_t>() != UE_TRACE_VERSION) return Status::ERROR;
+    uint16_t workers = r.get<uint16_t>();
+    if (!workers) return Status::ERROR;
+    cfg_ = UeManagerConfig{};
+    cfg_.num_workers       = workers;
+    cfg_.rlc_mode          = (RlcMode)r.get<uint8_t>();
+    cfg_.bearer            = (PdcpBearerType)r.get<uint8_t>();
+    uint8_t flags          = r.get<uint8_t>();
+    cfg_.auto_harq_ack     = flags & 1;
+    cfg_.auto_rlc_ack      = flags & 2;
+    cfg_.phy.harq_enabled  = flags & 4;
+    cfg_.phy.link_level    = flags & 8;
+    cfg_.phy.mcs           = (MCS)r.get<uint8_t>();
+    cfg_.phy.num_prbs      = r.get<uint8_t>();
+    r.get<uint8_t>();
+    cfg_.phy.cell_id       = r.get<uint16_t>();
+    cfg_.phy.channel_snr_db = r.get<float>();
+
+    chunks_.assign(workers, {});
+    records_  = 0;
+    truncated_ = false;
+    for (size_t off = UE_TRACE_HEADER; off < size_;) {
+        Reader c{map_ + off, map_ + size_};
+        uint32_t magic = c.get<uint32_t>(), len = c.get<uint32_t>(), nrec = c.get<uint32_t>();
+        uint16_t shard = c.get<uint16_t>();
+        c.get<uint16_t>();
+        uint64_t base  = c.get<uint64_t>();
+        if (!c.ok || magic != UE_TRACE_CHUNK_MAGIC || len > size_ - off - UE_TRACE_CHUNK_HDR) { truncated_ = true; break; }
+        if (shard >= workers) return Status::ERROR;
+        chunks_[shard].push_back({c.p, len, nrec, base});
+        records_ += nrec;
+        off += UE_TRACE_CHUNK_HDR + len;
+    }
+    return Status::OK;
+}
+Status UeTraceReplayer::replay(UeManager& mgr, TracePacing pacing, UeTraceReplayStats& stats) const {
+    struct Cursor {
+        const std::vector<Chunk>* chunks;
+        size_t   chunk = 0;
+        Reader   r{nullptr, nullptr};
+        uint32_t left = 0;
+        uint64_t ts   = 0;
+        // Positions r on the next record and decodes its type and time.
+        bool next(UeCmdType& type) {
+            while (!left) {
+                if (chunk == chunks->size()) return false;
+                const Chunk& c = (*chunks)[chunk++];
+                r    = Reader{c.p, c.p + c.len};
+                left = c.records;
+                ts   = c.base_ns;
+            }
+            left--;
+            type = (UeCmdType)r.get<uint8_t>();
+            uint64_t z = r.varint();
+            ts += (uint64_t)((int64_t)(z >> 1) ^ -(int64_t)(z & 1));
+            return r.ok;
+        }
+    };
+    std::vector<Cursor>    cur(chunks_.size());
+    std::vector<UeCmdType> type(chunks_.size());
+    std::vector<bool>      live(chunks_.size());
+    for (size_t i = 0; i < cur.size(); i++) {
+        cur[i].chunks = &chunks_[i];
+        live[i] = cur[i].next(type[i]);
+    }
+    auto submit = [&](auto&& fn) {
+        while (fn() == Status::BUFFER_FULL) { stats.stalls++; mgr.drain(); }
+    };
+    uint64_t t0 = steady_ns(), first_ts = UINT64_MAX;
+    for (auto& c : cur) if (!c.chunks->empty()) first_ts = std::min(first_ts, c.chunks->front().base_ns);
+    std::vector<uint16_t> sns;
+    Status st = Status::OK;
+    for (;;) {
+        size_t s = SIZE_MAX;
+        for (size_t i = 0; i < cur.size(); i++)
+            if (live[i] && (s == SIZE_MAX || cur[i].ts < cur[s].ts)) s = i;
+        if (s == SIZE_MAX) break;
+        Cursor& c = cur[s];
+        if (pacing == TracePacing::RECORDED) {
+            uint64_t due = t0 + (c.ts - first_ts);
+            uint64_t now = steady_ns();
+            if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+        uint16_t rnti = c.r.get<uint16_t>();
+        switch (type[s]) {
+            case UeCmdType::ADD_UE:    submit([&] { return mgr.add_ue(rnti); }); break;
+            case UeCmdType::REMOVE_UE: submit([&] { return mgr.remove_ue(rnti); }); break;
+            case UeCmdType::ATTACH:    submit([&] { return mgr.attach_ue(rnti); }); break;
+            case UeCmdType::TX_SDU: {
+                size_t         len = (size_t)c.r.varint();
+                const uint8_t* p   = c.r.bytes(len);
+                if (!c.r.ok) break;
+                submit([&] { return mgr.inject_sdu(rnti, PduBuffer::from(p, len)); });
+                stats.sdus++;
+                stats.sdu_bytes += len;
+                break;
+            }
+            case UeCmdType::HARQ_FEEDBACK: {
+                uint8_t id = c.r.get<uint8_t>(), ack = c.r.get<uint8_t>();
+                if (c.r.ok) submit([&] { return mgr.inject_harq_feedback(rnti, id, ack != 0); });
+                break;
+            }
+            case UeCmdType::RLC_STATUS: {
+                uint16_t ack_sn = c.r.get<uint16_t>();
+                uint64_t n      = c.r.varint();
+                sns.clear();
+                for (uint64_t i = 0; i < n && c.r.ok; i++) sns.push_back(c.r.get<uint16_t>());
+                if (c.r.ok) submit([&] { return mgr.inject_rlc_status(rnti, ack_sn, sns); });
+                break;
+            }
+            case UeCmdType::SET_SNR: {
+                float snr = c.r.get<float>();
+                if (c.r.ok) submit([&] { return mgr.inject_snr(rnti, snr); });
+                break;
+            }
+            default:
+                c.r.ok = false;
+                break;
+        }
+        if (!c.r.ok) { st = Status::ERROR; break; }
+        stats.records++;
+        live[s] = c.next(type[s]);
+        if (!live[s] && !c.r.ok) { st = Status::ERROR; break; }
+    }
+    mgr.drain();
+    stats.elapsed_ns = steady_ns() - t0;
+    return st;
+}
+
+TbSink UeTbDigest::sink() {
+    return [this](uint16_t rnti, PduBuffer& tb) {
+        uint64_t h = h_[rnti];
+        for (size_t i = 0; i < tb.size(); i++) h = (h ^ tb.data()[i]) * 0x100000001b3ull;
+        h_[rnti] = (h ^ tb.size()) * 0x100000001b3ull;
+    };
+}
+uint64_t UeTbDigest::combined() const {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint64_t v : h_) h = (h ^ v) * 0x100000001b3ull;
+    return h;
+}
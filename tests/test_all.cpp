@@ -1,12 +1,35 @@
 #include "common_types.h"
 #include "phy_layer.h"
 #include "mac_layer.h"
+#include "mac_scheduler.h"
 #include "rlc_layer.h"
 #include "pdcp_layer.h"
 #include "rrc_layer.h"
+#include "rrc_msgs.h"
 #include "nas_layer.h"
+#include "nas_engine.h"
+#include "nas_msgs.h"
+#include "pdu_buffer.h"
+#include "ue_manager.h"
+#include "bearer_pipeline.h"
+#include "loopback.h"
+#include "ue_trace.h"
+#include "metrics.h"
+#include "pcap_capture.h"
+#include "latency_histogram.h"
+#include "security.h"
+#include "sha256.h"
+#include "aka.h"
+#include "crc.h"
+#include "modulation.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 static int tests_run = 0;
 static int tests_passed = 0;
@@ -18,11 +41,209 @@ static int tests_passed = 0;
     catch(...) { std::cout << "FAIL\n"; } \
 } while(0)
 
+void test_pdu_headroom() {
+    PduBuffer b = PduBuffer::from(Bytes{0x10,0x20,0x30});
+    const uint8_t* payload = b.data();
+    uint8_t* h = b.prepend(2); h[0] = 0xAA; h[1] = 0xBB;
+    assert(b.size() == 5 && b.data() + 2 == payload);
+    PduBuffer held = b;
+    held.strip(2);
+    b.prepend(1)[0] = 0xCC;
+    assert(b.data() + 3 == payload);
+    PduBuffer retx = held;
+    retx.prepend(1)[0] = 0xDD;
+    assert(retx.data() != b.data());
+    assert(b.to_bytes() == (Bytes{0xCC,0xAA,0xBB,0x10,0x20,0x30}));
+    assert(retx.to_bytes() == (Bytes{0xDD,0x10,0x20,0x30}));
+}
+void test_pdu_zero_copy_stack() {
+    PdcpLayer pdcp_tx(PdcpBearerType::SRB), pdcp_rx(PdcpBearerType::SRB);
+    RlcLayer  rlc_tx(RlcMode::AM), rlc_rx(RlcMode::AM);
+    MacLayer  mac_tx, mac_rx;
+    PhyLayer  phy;
+    Bytes sdu(200, 0x5A);
+    PduBuffer pdu = PduBuffer::from(sdu);
+    const uint8_t* payload = pdu.data();
+    PduPool::reset_stats();
+    assert(pdcp_tx.transmit_sdu(pdu) == Status::OK);
+    assert(rlc_tx.transmit_sdu(pdu) == Status::OK);
+    assert(mac_tx.transmit_sdu(pdu) == Status::OK);
+    assert(phy.transmit_transport_block(pdu) == Status::OK);
+    assert(mac_rx.receive_pdu(pdu) == Status::OK);
+    assert(rlc_rx.receive_pdu(pdu) == Status::OK);
+    assert(pdcp_rx.receive_pdu(pdu) == Status::OK);
+    assert(PduPool::stats().copies == 0 && PduPool::stats().allocs == 0);
+    assert(pdu.data() == payload && pdu.to_bytes() == sdu);
+}
+void test_logger_deferred() {
+    std::ostringstream out;
+    Logger& log = Logger::instance();
+    log.set_output(&out);
+    log.set_async(true);
+    int evaluated = 0;
+    auto arg = [&]() { evaluated++; return 7; };
+    log.set_level(LogLevel::WARN);
+    LOGF_INFO("TEST", "skipped {}", arg());
+    assert(evaluated == 0);
+    log.set_level(LogLevel::DEBUG);
+    std::string name = "cell";
+    LOGF_INFO("TEST", "n={} rnti=0x{x} {} snr={}", arg(), 0xC0DEu, name, 1.5);
+    log.flush();
+    assert(evaluated == 1);
+    assert(out.str() == "[INFO ][ TEST] n=7 rnti=0xc0de cell snr=1.5\n");
+    log.set_async(false);
+    log.set_output(nullptr);
+}
 void test_phy_throughput() {
     PhyConfig cfg; cfg.mcs = MCS::QAM64_5_6; cfg.num_prbs = 100;
     PhyLayer phy(cfg);
     assert(phy.estimate_throughput_mbps() > 50.0f);
 }
+void test_channel_model() {
+    // Random123 known-answer vectors for Philox4x32-10.
+    uint32_t ctr0[4] = {}, key0[2] = {}, out[4];
+    Philox4x32::block(ctr0, key0, out);
+    assert(out[0] == 0x6627e8d5 && out[1] == 0xe169c58d && out[2] == 0xbc57ac4c && out[3] == 0x9b00dbd8);
+    uint32_t ctr1[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, key1[2] = {0xa4093822, 0x299f31d0};
+    Philox4x32::block(ctr1, key1, out);
+    assert(out[0] == 0xd16cfe09 && out[1] == 0x94fdcceb && out[2] == 0x5001e420 && out[3] == 0x24126ea1);
+    Philox4x32 a(7, 1), b(7, 1), c(7, 2);
+    uint32_t fa[10], fc[10];
+    a.fill(fa, 10); c.fill(fc, 10);
+    for (int i = 0; i < 10; i++) assert(fa[i] == b.next_u32());
+    assert(std::memcmp(fa, fc, sizeof(fa)) != 0);
+    assert(ChannelModel::bler(MCS::QAM16_1_2, -10.0f) > 0.99f && ChannelModel::bler(MCS::QAM16_1_2, 30.0f) < 1e-6f);
+    assert(ChannelModel::bler(MCS::QAM64_5_6, 10.0f) > ChannelModel::bler(MCS::QAM16_1_2, 10.0f));
+    // Same stream, same outcome; about half the TBs fail at the 50% point.
+    PhyConfig cfg; cfg.channel_snr_db = 5.5f;
+    PhyLayer p1(cfg, 42), p2(cfg, 42), ptx;
+    const size_t n = 1000;
+    std::vector<PduBuffer> t1(n), t2(n);
+    std::vector<Status> s1(n), s2(n);
+    for (size_t i = 0; i < n; i++) { t1[i] = PduBuffer::from(Bytes(64, 0)); t2[i] = PduBuffer::from(Bytes(64, 0)); }
+    ptx.transmit_burst(t1.data(), n, s1.data());
+    ptx.transmit_burst(t2.data(), n, s2.data());
+    size_t ok = p1.receive_burst(t1.data(), n, s1.data());
+    assert(p2.receive_burst(t2.data(), n, s2.data()) == ok && ok > 400 && ok < 600);
+    for (size_t i = 0; i < n; i++) {
+        assert(s1[i] == s2[i] && t1[i].to_bytes() == t2[i].to_bytes());
+        if (s1[i] == Status::OK) assert(t1[i].to_bytes() == Bytes(64, 0));
+    }
+    ChannelModel ch(3);
+    Bytes buf(10000, 0);
+    size_t flips = ch.inject_bit_errors(buf.data(), buf.size(), 0.01f), ones = 0;
+    for (uint8_t v : buf) ones += __builtin_popcount(v);
+    assert(flips == ones && flips > 650 && flips < 950);
+    Bytes dense(10000, 0);
+    flips = ch.inject_bit_errors(dense.data(), dense.size(), 0.25f), ones = 0;
+    for (uint8_t v : dense) ones += __builtin_popcount(v);
+    assert(flips == ones && flips > 19000 && flips < 21000);
+}
+void test_crc() {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    assert(crc_compute(CrcType::CRC24A, check, 9) == 0xCDE703 && crc_compute(CrcType::CRC24B, check, 9) == 0x23EF52);
+    assert(crc_compute(CrcType::CRC16, check, 9) == 0x31C3);
+    assert(rohc_crc8(check, 9) == 0xD0 && rohc_crc7(check, 9) == 0x53 && rohc_crc3(check, 9) == 0x6);
+    Philox4x32 rng(1, rng_stream(RngDomain::TEST, 12));
+    Bytes buf(5000 + 3);
+    for (auto& b : buf) b = (uint8_t)rng.next_u32();
+    const size_t lens[] = {0, 1, 7, 15, 16, 63, 64, 65, 127, 200, 1500, 5000};
+    for (CrcImpl impl : {CrcImpl::TABLE, CrcImpl::PCLMUL}) {
+        if (!crc_select(impl)) continue;
+        for (CrcType t : {CrcType::CRC24A, CrcType::CRC24B, CrcType::CRC24C, CrcType::CRC16})
+            for (size_t len : lens) assert(crc_compute(t, buf.data(), len) == crc_compute_bitwise(t, buf.data(), len));
+    }
+    crc_select(CrcImpl::AUTO);
+    crc_attach(CrcType::CRC24A, buf.data(), 5000);
+    assert(crc_check(CrcType::CRC24A, buf.data(), 5003));
+    buf[1234] ^= 0x10;
+    assert(!crc_check(CrcType::CRC24A, buf.data(), 5003));
+    // Segmented TB: 5 code blocks, each with its own CRC24B.
+    PhyConfig cfg; cfg.channel_snr_db = 30.0f;
+    PhyLayer tx(cfg), rx(cfg);
+    assert(phy_num_code_blocks(5000) == 5 && phy_crc_overhead(5000) == 3 + 15 && phy_crc_overhead(400) == 2);
+    // N'_info = 143360 needs 18 code blocks of at most 8424 bits (TS 38.214 5.1.3.2).
+    assert(transport_block_size(MCS::QAM256_3_4, 166) == 17925);
+    for (size_t len : {size_t(40), size_t(478), size_t(479), size_t(1053), size_t(1054), size_t(5000)}) {
+        PduBuffer tb = PduBuffer::from(Bytes(buf.begin(), buf.begin() + len));
+        assert(tx.transmit_transport_block(tb) == Status::OK && tb.size() == len + phy_crc_overhead(len));
+        PduBuffer bad = PduBuffer::from(tb.to_bytes());
+        assert(rx.receive_transport_block(tb) == Status::OK && tb.to_bytes() == Bytes(buf.begin(), buf.begin() + len));
+        bad.data()[len / 2] ^= 0x01;
+        assert(rx.receive_transport_block(bad) == Status::RETRY);
+    }
+    assert(rx.get_cb_errors() == 2);
+}
+void test_modulation() {
+    // Gold sequence against the bit-serial definition, TS 38.211 5.2.1.
+    const uint32_t c_init = (0x4601u << 15) | 17;
+    std::vector<uint8_t> x1(1600 + 31 + 256), x2(1600 + 31 + 256);
+    for (int i = 0; i < 31; i++) { x1[i] = i == 0; x2[i] = (c_init >> i) & 1; }
+    for (size_t n = 0; n + 31 < x1.size(); n++) {
+        x1[n + 31] = x1[n + 3] ^ x1[n];
+        x2[n + 31] = x2[n + 3] ^ x2[n + 2] ^ x2[n + 1] ^ x2[n];
+    }
+    uint8_t seq[32];
+    gold_sequence(c_init, seq, sizeof(seq));
+    for (int n = 0; n < 256; n++) assert(((seq[n / 8] >> (7 - n % 8)) & 1) == (x1[n + 1600] ^ x2[n + 1600]));
+    Philox4x32 rng(1, rng_stream(RngDomain::TEST, 13));
+    Bytes data(999), orig;
+    for (auto& v : data) v = (uint8_t)rng.next_u32();
+    orig = data;
+    scramble(data.data(), data.size(), c_init);
+    assert(data != orig);
+    scramble(data.data(), data.size(), c_init);
+    assert(data == orig);
+    // Noiseless roundtrip per Qm, unit average energy, and the SIMD demappers
+    // agree with the scalar reference (odd bit count exercises the tails).
+    const size_t nbits = data.size() * 8 - 3;
+    for (uint8_t qm : {2, 4, 6, 8}) {
+        size_t nsym = num_symbols(qm, nbits);
+        std::vector<cf32> sym(nsym);
+        assert(modulate(qm, data.data(), nbits, sym.data()) == nsym);
+        double e = 0;
+        for (auto& c : sym) e += c.re * c.re + c.im * c.im;
+        assert(std::fabs(e / nsym - 1.0) < 0.05);
+        std::vector<float> ref(nsym * qm), llr(nsym * qm);
+        modulation_select(ModImpl::SCALAR);
+        demodulate_llr(qm, sym.data(), nsym, 0.1f, ref.data());
+        Bytes out(data.size(), 0);
+        llr_to_bits(ref.data(), nbits, out.data());
+        assert(std::memcmp(out.data(), data.data(), data.size() - 1) == 0 && (out.back() ^ data.back()) < 8);
+        for (ModImpl impl : {ModImpl::AVX2, ModImpl::AVX512}) {
+            if (!modulation_select(impl)) continue;
+            demodulate_llr(qm, sym.data(), nsym, 0.1f, llr.data());
+            for (size_t i = 0; i < llr.size(); i++) assert(std::fabs(llr[i] - ref[i]) <= 1e-4f * (1 + std::fabs(ref[i])));
+        }
+        modulation_select(ModImpl::AUTO);
+    }
+    // Unit-variance noise; raw BER falls with SNR and tracks the analytic value.
+    double m1 = 0, m2 = 0;
+    for (int i = 0; i < 100000; i++) { double g = gaussian(rng); m1 += g; m2 += g * g; }
+    assert(std::fabs(m1 / 100000) < 0.02 && std::fabs(m2 / 100000 - 1.0) < 0.02);
+    ChannelModel ch(5);
+    float prev = 1.0f;
+    for (float snr : {5.0f, 10.0f, 15.0f}) {
+        PduBuffer tb = PduBuffer::from(Bytes(4000, 0));
+        float ber = (float)ch.transmit_symbols(tb, MCS::QAM16_1_2, snr, c_init) / 32000;
+        float exp = ChannelModel::raw_ber(MCS::QAM16_1_2, snr);
+        assert(ber < prev && ber > 0.5f * exp && ber < 2.0f * exp + 1e-4f);
+        prev = ber;
+    }
+    // Link-level PHY: clean at high SNR, CRC failures near the 256QAM limit.
+    PhyConfig cfg; cfg.link_level = true; cfg.mcs = MCS::QAM256_3_4; cfg.channel_snr_db = 35.0f;
+    PhyLayer tx(cfg), rx(cfg, 9);
+    Bytes payload(1000, 0x5A), got;
+    for (int i = 0; i < 20; i++) {
+        Bytes air;
+        tx.transmit_transport_block(payload, air);
+        assert(rx.receive_transport_block(air, got) == Status::OK && got == payload);
+    }
+    rx.set_snr(12.0f);
+    Bytes air;
+    tx.transmit_transport_block(payload, air);
+    assert(rx.receive_transport_block(air, got) == Status::RETRY && rx.get_rx_errors() == 1);
+}
 void test_mac_roundtrip() {
     MacLayer mac;
     Bytes sdu = {0x11,0x22,0x33,0x44}, pdu, recovered;
@@ -32,11 +253,111 @@ void test_mac_roundtrip() {
 }
 void test_mac_harq() {
     MacLayer mac;
-    Bytes sdu = {0xAA,0xBB}, pdu;
+    Bytes sdu = {0xAA,0xBB}, pdu, tmp;
     mac.transmit_sdu(sdu, pdu);
-    mac.harq_feedback(0, false);
-    for (int i = 0; i < 8; i++) { Bytes tmp; mac.transmit_sdu(sdu, tmp); }
-    assert(mac.get_harq_retx() >= 1);
+    uint8_t first = mac.get_last_harq_id();
+    mac.harq_feedback(first, false);
+    PduBuffer tb;
+    assert(mac.retransmit(tb) == Status::OK && mac.get_last_harq_id() == first && tb.to_bytes() == pdu);
+    assert(mac.retransmit(tb) == Status::PENDING && mac.get_harq_retx() == 1);
+    // All processes busy: back-pressure instead of overwriting one.
+    for (int i = 1; i < HARQ_PROCS_LTE; i++) assert(mac.transmit_sdu(sdu, tmp) == Status::OK);
+    assert(mac.transmit_sdu(sdu, tmp) == Status::BUFFER_FULL && mac.harq().busy() == HARQ_PROCS_LTE);
+    // No feedback within the HARQ RTT counts as a NACK.
+    mac.tick(HARQ_RTT_TTI - 1);
+    assert(mac.harq().retx_ready() == 0);
+    mac.tick(1);
+    assert(mac.harq().retx_ready() == HARQ_PROCS_LTE && mac.harq().get_dtx() == HARQ_PROCS_LTE);
+    // NTN entity: 32 processes, lowest free process first, TB dropped after max_retx.
+    HarqEntity ntn(HarqConfig{HARQ_PROCS_NTN, 2, 32});
+    PduBuffer b = PduBuffer::from(Bytes(10, 1)), r;
+    uint8_t id;
+    for (int i = 0; i < HARQ_PROCS_NTN; i++) assert(ntn.transmit(b, id) == Status::OK && id == i);
+    assert(ntn.transmit(b, id) == Status::BUFFER_FULL);
+    ntn.feedback(5, true);
+    ntn.feedback(3, false);
+    assert(ntn.transmit(b, id) == Status::OK && id == 5);
+    assert(ntn.next_retx(r, id) && id == 3 && r.data() == b.data());
+    ntn.feedback(3, false);
+    assert(ntn.next_retx(r, id) && id == 3);
+    ntn.feedback(3, false);
+    assert(!ntn.next_retx(r, id) && ntn.get_failures() == 1 && ntn.busy() == HARQ_PROCS_NTN - 1);
+}
+void test_mac_mux() {
+    PhyLayer phy;
+    assert(phy.tbs_bytes() == 896 && transport_block_size(MCS::QPSK_1_3, 1) == 12);
+    MacLayer tx, rx;
+    for (int i = 0; i < 3; i++) { PduBuffer p = PduBuffer::from(Bytes(100, (uint8_t)(0x40 + i))); tx.queue_sdu(LogicalChannel::DTCH, p); }
+    for (int i = 0; i < 2; i++) { PduBuffer p = PduBuffer::from(Bytes(20, (uint8_t)(0x20 + i))); tx.queue_sdu(LogicalChannel::DCCH, p); }
+    PduBuffer ccch = PduBuffer::from(Bytes(300, 0x10));
+    tx.queue_sdu(LogicalChannel::CCCH, ccch);
+    tx.send_crnti_ce(0x4601);
+    tx.report_phr(40, 22);
+    PduBuffer tb;
+    assert(tx.transmit_tb(phy.tbs_bytes(), tb) == Status::OK && tb.size() == 896 && tx.queued_bytes() == 0);
+    MacSdu sdus[12];
+    MacCeReport ces;
+    assert(rx.demux_tb(tb, sdus, 12, &ces) == 6);
+    assert(ces.has_crnti && ces.crnti == 0x4601 && ces.has_phr && ces.ph == 40 && ces.pcmax == 22);
+    assert(ces.has_bsr && ces.bsr_index == 0);
+    assert(sdus[0].lc == LogicalChannel::CCCH && sdus[0].sdu.to_bytes() == Bytes(300, 0x10));
+    assert(sdus[1].lc == LogicalChannel::DCCH && sdus[2].sdu.to_bytes() == Bytes(20, 0x21));
+    assert(sdus[5].lc == LogicalChannel::DTCH && sdus[5].sdu.to_bytes() == Bytes(100, 0x42));
+    for (MacSdu& m : sdus) if (m.sdu.size()) assert(m.sdu.data() > tb.data() && m.sdu.data() < tb.data() + tb.size());
+    // DTCH outranks DCCH; DCCH still fills the remainder and what does not fit
+    // stays queued and is reported.
+    tx.set_lc_priority(LogicalChannel::DTCH, 0);
+    for (int i = 0; i < 12; i++) { PduBuffer p = PduBuffer::from(Bytes(100, (uint8_t)i)); tx.queue_sdu(LogicalChannel::DTCH, p); }
+    PduBuffer dcch = PduBuffer::from(Bytes(20, 0x77));
+    tx.queue_sdu(LogicalChannel::DCCH, dcch);
+    assert(tx.build_tb(phy.tbs_bytes(), tb) == 9);
+    assert(rx.demux_tb(tb, sdus, 12, &ces) == 9 && sdus[7].lc == LogicalChannel::DTCH && sdus[8].lc == LogicalChannel::DCCH);
+    assert(ces.bsr_index == mac_bsr_index(400) && tx.queued_bytes() == 400);
+    // Grant-driven pull from RLC.
+    RlcLayer rlc(RlcMode::UM);
+    for (int i = 0; i < 4; i++) { PduBuffer p = PduBuffer::from(Bytes(50, (uint8_t)i)); rlc.enqueue_sdu(p); }
+    MacLayer ue;
+    ue.set_lc_pull(LogicalChannel::DTCH, [&](uint32_t budget, PduBuffer* out, size_t max) { return rlc.pull_pdus(budget, out, max); });
+    assert(ue.build_tb(120, tb) == 3 && tb.size() == 120);   // two SDUs and a segment of the third
+}
+void test_mac_scheduler() {
+    SchedConfig cfg; cfg.policy = SchedPolicy::RR; cfg.num_prbs = 52; cfg.max_ues_per_slot = 1;
+    MacScheduler rr(cfg);
+    SchedGrant g[16];
+    for (uint16_t r = 1; r <= 3; r++) { rr.add_ue(r); rr.update_channel(r, 20.0f); rr.update_buffer(r, 100000); }
+    assert(rr.add_ue(2) == Status::INVALID_STATE && rr.num_ues() == 3);
+    for (int i = 0; i < 6; i++) assert(rr.schedule(g, 16) == 1 && g[0].rnti == i % 3 + 1 && g[0].num_prbs == 52);
+    // PRBs sized to the buffer, contiguous, never beyond the carrier.
+    cfg.max_ues_per_slot = 16;
+    MacScheduler ci((cfg.policy = SchedPolicy::MAX_CI, cfg));
+    for (uint16_t r = 1; r <= 3; r++) ci.add_ue(r);
+    ci.update_channel(1, 5.0f); ci.update_channel(2, 25.0f); ci.update_channel(3, 12.0f);
+    assert(ci.ue(2)->mcs == MCS::QAM256_3_4 && ci.ue(1)->mcs == MCS::QPSK_1_2);
+    ci.update_buffer(1, 1000000); ci.update_buffer(2, 300); ci.update_buffer(3, 1000000);
+    assert(ci.schedule(g, 16) == 2 && g[0].rnti == 2 && g[1].rnti == 3);
+    assert(g[0].prb_start == 0 && g[0].tbs >= 300 && transport_block_size(g[0].mcs, g[0].num_prbs - 1) < 300);
+    assert(g[1].prb_start == g[0].num_prbs && g[0].num_prbs + g[1].num_prbs == 52);
+    assert(ci.backlogged() == 2 && !ci.ue(2)->buffer);
+    assert(ci.schedule(g, 16) == 1 && g[0].rnti == 3);   // max C/I starves UE 1
+    ci.remove_ue(3);
+    assert(ci.schedule(g, 16) == 1 && g[0].rnti == 1 && ci.update_buffer(3, 1) == Status::ERROR);
+    // PF with full buffers: equal time shares despite a 3x rate gap.
+    cfg.policy = SchedPolicy::PF; cfg.max_ues_per_slot = 1;
+    MacScheduler pf(cfg);
+    pf.add_ue(7); pf.add_ue(9);
+    pf.update_channel(7, 25.0f); pf.update_channel(9, 10.0f);
+    int slots7 = 0;
+    for (int i = 0; i < 2000; i++) {
+        pf.update_buffer(7, 1000000); pf.update_buffer(9, 1000000);
+        pf.schedule(g, 16);
+        slots7 += g[0].rnti == 7;
+    }
+    assert(slots7 > 900 && slots7 < 1100 && pf.avg_rate(7) > 2 * pf.avg_rate(9));
+    // Thousands of UEs: one slot touches only the UEs it serves.
+    MacScheduler big;
+    for (uint16_t r = 1; r <= 20000; r++) { big.add_ue(r); big.update_channel(r, (float)(r % 30)); big.update_buffer(r, 5000); }
+    for (int i = 0; i < 100; i++) assert(big.schedule(g, 16) >= 1);
+    assert(big.backlogged() <= 20000 && big.get_slot() == 100);
 }
 void test_rlc_am() {
     RlcLayer tx(RlcMode::AM), rx(RlcMode::AM);
@@ -45,6 +366,159 @@ void test_rlc_am() {
     assert(rx.receive_pdu(pdu, recovered) == Status::OK);
     assert(recovered == sdu);
 }
+void test_rlc_am_reorder() {
+    RlcLayer tx(RlcMode::AM), rx(RlcMode::AM);
+    PduBuffer pdus[5];
+    for (int i = 0; i < 5; i++) { pdus[i] = PduBuffer::from(Bytes(8, (uint8_t)i)); tx.transmit_sdu(pdus[i]); }
+    PduBuffer dup = pdus[2];
+    PduBuffer out;
+    assert(rx.receive_pdu(pdus[0]) == Status::OK && pdus[0].to_bytes() == Bytes(8, 0));
+    assert(rx.receive_pdu(pdus[2]) == Status::PENDING);
+    assert(rx.receive_pdu(pdus[3]) == Status::PENDING);
+    assert(rx.receive_pdu(dup) == Status::PENDING && rx.get_rx_duplicates() == 1);
+    assert(!rx.pop_sdu(out));
+    assert(rx.receive_pdu(pdus[1]) == Status::OK && pdus[1].to_bytes() == Bytes(8, 1));
+    assert(rx.pending_sdus() == 2);
+    assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(8, 2));
+    assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(8, 3));
+    assert(!rx.pop_sdu(out) && rx.get_rx_sn() == 4);
+}
+void test_rlc_t_reassembly() {
+    RlcLayer tx(RlcMode::AM), rx(RlcMode::AM);
+    PduBuffer pdus[4];
+    for (int i = 0; i < 4; i++) { pdus[i] = PduBuffer::from(Bytes(4, (uint8_t)i)); tx.transmit_sdu(pdus[i]); }
+    rx.receive_pdu(pdus[0]);
+    assert(rx.receive_pdu(pdus[2]) == Status::PENDING);
+    assert(rx.receive_pdu(pdus[3]) == Status::PENDING);
+    rx.tick(RLC_T_REASSEMBLY_MS - 1);
+    assert(rx.pending_sdus() == 0);
+    rx.tick(1);
+    Bytes out;
+    assert(rx.pop_sdu(out) && out == Bytes(4, 2));
+    assert(rx.pop_sdu(out) && out == Bytes(4, 3));
+    assert(rx.get_rx_sn() == 4 && rx.get_rx_lost() == 1);
+}
+void test_rlc_am_arq() {
+    RlcLayer tx(RlcMode::AM), rx(RlcMode::AM);
+    for (int i = 0; i < 10; i++) { PduBuffer s = PduBuffer::from(Bytes(100, (uint8_t)i)); tx.enqueue_sdu(s); }
+    PduBuffer out[16];
+    assert(tx.pull_pdus(5 * 102 + 2, out, 16) == 5);
+    assert(tx.pull_pdus(UINT32_MAX, out + 5, 16) == 5 && (out[9][0] & 0x40) && !(out[4][0] & 0x40));
+    for (int i = 0; i < 10; i++) if (i < 2 || i == 5 || i == 6 || i > 7) rx.receive_pdu(out[i]);
+    assert(rx.status_required());
+    RlcStatusPdu st, dec;
+    rx.build_status_report(st);
+    assert(st.ack_sn == 10 && st.nacks.size() == 2 && st.nacks[0].sn == 2 && st.nacks[0].range == 3 && st.nacks[1].sn == 7);
+    PduBuffer ctrl;
+    RlcLayer::encode_status_pdu(st, ctrl);
+    assert(RlcLayer::decode_status_pdu(ctrl.data(), ctrl.size(), dec) && dec.nacks.size() == 2 && dec.nacks[0].range == 3);
+    assert(tx.receive_pdu(ctrl) == Status::PENDING && tx.retx_pending() == 4 && tx.get_tx_next_ack() == 2);
+    PduBuffer fresh = PduBuffer::from(Bytes(100, 10));
+    tx.enqueue_sdu(fresh);
+    assert(tx.pull_pdus(UINT32_MAX, out, 16) == 5 && tx.get_tx_retx() == 4);
+    const uint8_t order[5] = {2, 3, 4, 7, 10};
+    for (int i = 0; i < 5; i++) assert(rx.receive_pdu(out[i]) == Status::OK && out[i].to_bytes() == Bytes(100, order[i]));
+    assert(rx.get_rx_sn() == 11 && rx.pending_sdus() == 4);
+    rx.build_status_pdu(ctrl);
+    tx.receive_pdu(ctrl);
+    assert(tx.tx_in_flight() == 0 && tx.get_tx_next_ack() == 11);
+}
+void test_rlc_am_poll_window() {
+    RlcLayer tx(RlcMode::AM);
+    PduBuffer p = PduBuffer::from(Bytes(100, 0x5A)), out;
+    tx.transmit_sdu(p);
+    RlcStatusPdu st; st.ack_sn = 1;
+    RlcNack nk; nk.sn = 0; nk.so_start = 10; nk.so_end = 19; st.nacks.push_back(nk);
+    tx.process_status(st);
+    assert(tx.pull_pdus(UINT32_MAX, &out, 1) == 1 && out.size() == 14);
+    assert(((out[0] >> 4) & 0x03) == 3 && out[2] == 0 && out[3] == 10 && out[4] == 0x5A);
+    tx.tick(RLC_T_POLL_RETRANSMIT_MS);
+    assert(tx.retx_pending() == 1 && tx.pull_pdus(UINT32_MAX, &out, 1) == 1);
+    assert((out[0] & 0x40) && out.size() == 102);
+    RlcLayer full(RlcMode::AM);
+    for (int i = 0; i < RLC_AM_WINDOW_SIZE; i++) { p = PduBuffer::from(Bytes(4, 1)); assert(full.transmit_sdu(p) == Status::OK); }
+    p = PduBuffer::from(Bytes(4, 1));
+    assert(full.transmit_sdu(p) == Status::BUFFER_FULL);
+    full.process_status_pdu(100, {3, 40});
+    assert(full.get_tx_next_ack() == 3 && full.retx_pending() == 2 && full.transmit_sdu(p) == Status::OK);
+}
+void test_rlc_segmentation() {
+    RlcLayer tx(RlcMode::AM), rx(RlcMode::AM);
+    Bytes big(300), small(100, 0x77);
+    for (size_t i = 0; i < big.size(); i++) big[i] = (uint8_t)(i * 7);
+    PduBuffer s1 = PduBuffer::from(big), s2 = PduBuffer::from(small), out[8];
+    tx.enqueue_sdu(s1); tx.enqueue_sdu(s2);
+    // 300 bytes over 100-byte grants: 2+98, 4+96, 4+96, then the last 10
+    // bytes share a grant with the first 84 bytes of the second SDU.
+    size_t n = 0;
+    while (size_t k = tx.pull_pdus(100, out + n, 8 - n)) n += k;
+    assert(n == 6 && tx.queued_sdus() == 0 && tx.get_tx_sn() == 2);
+    const uint8_t si[6] = {1, 3, 3, 2, 1, 2};
+    const size_t  sz[6] = {100, 100, 100, 14, 86, 20};
+    for (size_t i = 0; i < 6; i++) assert(((out[i][0] >> 4) & 3) == si[i] && out[i].size() == sz[i]);
+    assert(out[1][2] == 0 && out[1][3] == 98 && ((out[3][2] << 8) | out[3][3]) == 290);
+    // Segments out of order and duplicated; bytes 194..289 of the first SDU
+    // and the tail of the second are lost.
+    PduBuffer dup = out[1];
+    assert(rx.receive_pdu(out[3]) == Status::PENDING && rx.receive_pdu(out[0]) == Status::PENDING);
+    assert(rx.receive_pdu(dup) == Status::PENDING && rx.receive_pdu(out[4]) == Status::PENDING);
+    assert(rx.receive_pdu(out[1]) == Status::PENDING && rx.get_rx_duplicates() == 1);
+    // Only the missing bytes are NACKed and resent, resegmented to the grant.
+    RlcStatusPdu st;
+    rx.build_status_report(st);
+    assert(st.ack_sn == 2 && st.nacks.size() == 2 && st.nacks[0].sn == 0 && st.nacks[0].so_start == 194 && st.nacks[0].so_end == 289);
+    assert(st.nacks[1].sn == 1 && st.nacks[1].so_start == 84 && st.nacks[1].so_end == RLC_SO_END);
+    tx.process_status(st);
+    assert(tx.retx_pending() == 2);
+    n = 0;
+    while (size_t k = tx.pull_pdus(60, out + n, 8 - n)) n += k;
+    assert(n == 4 && out[0].size() == 60 && out[1].size() == 44 && out[2].size() == 16 && out[3].size() == 8);
+    assert(rx.receive_pdu(out[1]) == Status::PENDING && rx.receive_pdu(out[0]) == Status::OK);
+    assert(out[0].to_bytes() == big);
+    assert(rx.receive_pdu(out[2]) == Status::PENDING && rx.receive_pdu(out[3]) == Status::OK);
+    assert(out[3].to_bytes() == small && rx.get_rx_sn() == 2);
+    // Two holes in one SDU: both byte ranges are NACKed and both resent.
+    RlcLayer htx(RlcMode::AM), hrx(RlcMode::AM);
+    PduBuffer h = PduBuffer::from(big);
+    htx.enqueue_sdu(h);
+    n = 0;
+    while (size_t k = htx.pull_pdus(100, out + n, 8 - n)) n += k;
+    assert(n == 4 && hrx.receive_pdu(out[1]) == Status::PENDING);
+    hrx.build_status_report(st);
+    assert(st.nacks.size() == 2 && st.nacks[0].so_start == 0 && st.nacks[0].so_end == 97);
+    assert(st.nacks[1].so_start == 194 && st.nacks[1].so_end == RLC_SO_END);
+    htx.process_status(st);
+    assert(htx.retx_pending() == 2);
+    n = 0;
+    while (size_t k = htx.pull_pdus(250, out + n, 8 - n)) n += k;
+    assert(n == 2 && hrx.receive_pdu(out[0]) == Status::PENDING && hrx.receive_pdu(out[1]) == Status::OK);
+    assert(out[1].to_bytes() == big);
+    // A whole retransmission after a partial segment leaves no stale
+    // segments behind: once the slot comes round again with a gap, the
+    // STATUS report still terminates and NACKs the missing SN.
+    RlcLayer stx(RlcMode::AM), wtx(RlcMode::AM), wrx(RlcMode::AM);
+    PduBuffer seg = PduBuffer::from(big);
+    stx.enqueue_sdu(seg);
+    assert(stx.pull_pdus(100, &seg, 1) == 1 && wrx.receive_pdu(seg) == Status::PENDING);
+    for (uint16_t sn = 0; sn <= RLC_AM_WINDOW_SIZE + 1; sn++) {
+        PduBuffer w = PduBuffer::from(small);
+        if (sn % 256 == 0) { wrx.build_status_report(st); wtx.process_status(st); }
+        assert(wtx.transmit_sdu(w) == Status::OK);
+        if (sn != RLC_AM_WINDOW_SIZE) wrx.receive_pdu(w);
+    }
+    assert(wrx.get_rx_sn() == RLC_AM_WINDOW_SIZE);
+    wrx.build_status_report(st);
+    assert(st.nacks.size() == 1 && st.nacks[0].sn == RLC_AM_WINDOW_SIZE && st.nacks[0].range == 1);
+    // UM: segments reassemble the same way.
+    RlcLayer utx(RlcMode::UM), urx(RlcMode::UM);
+    PduBuffer u = PduBuffer::from(big);
+    utx.enqueue_sdu(u);
+    n = 0;
+    while (size_t k = utx.pull_pdus(128, out + n, 8 - n)) n += k;
+    assert(n == 3);
+    for (size_t i = 0; i < 2; i++) assert(urx.receive_pdu(out[i]) == Status::PENDING);
+    assert(urx.receive_pdu(out[2]) == Status::OK && out[2].to_bytes() == big);
+}
 void test_rlc_tm() {
     RlcLayer rlc(RlcMode::TM);
     Bytes sdu = {0xDE,0xAD,0xBE,0xEF}, pdu, recovered;
@@ -60,6 +534,47 @@ void test_pdcp_roundtrip() {
     rx.receive_pdu(pdu, recovered);
     assert(recovered == msg);
 }
+void test_pdcp_reordering() {
+    for (PdcpSnLen len : {PdcpSnLen::SN12, PdcpSnLen::SN18}) {
+        PdcpLayer tx(PdcpBearerType::SRB, {}, len), rx(PdcpBearerType::SRB, {}, len);
+        size_t hdr = len == PdcpSnLen::SN12 ? 2 : 3;
+        uint32_t win = 1u << ((int)len - 1);
+        PduBuffer pdus[6], out;
+        for (int i = 0; i < 6; i++) { pdus[i] = PduBuffer::from(Bytes(8, (uint8_t)i)); tx.transmit_sdu(pdus[i]); }
+        assert(pdus[0].size() == 8 + hdr);
+        PduBuffer dup = pdus[2], old = pdus[0];
+        assert(rx.receive_pdu(pdus[0]) == Status::OK && pdus[0].to_bytes() == Bytes(8, 0));
+        assert(rx.receive_pdu(pdus[2]) == Status::PENDING && rx.receive_pdu(pdus[3]) == Status::PENDING);
+        assert(rx.receive_pdu(dup) == Status::PENDING && rx.receive_pdu(old) == Status::PENDING);
+        assert(rx.get_rx_duplicates() == 2 && !rx.pop_sdu(out) && rx.get_rx_count() == 4);
+        assert(rx.receive_pdu(pdus[1]) == Status::OK && pdus[1].to_bytes() == Bytes(8, 1));
+        assert(rx.pending_sdus() == 2 && rx.get_rx_deliv() == 4);
+        assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(8, 2));
+        assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(8, 3));
+        // COUNT 4 is lost: t-Reordering gives up on it.
+        assert(rx.receive_pdu(pdus[5]) == Status::PENDING);
+        rx.tick(PDCP_T_REORDERING_MS - 1);
+        assert(rx.pending_sdus() == 0);
+        rx.tick(1);
+        assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(8, 5));
+        assert(rx.get_rx_deliv() == 6 && rx.get_rx_lost() == 1);
+        // Across the SN wrap (HFN + 1) with pairwise swaps, and a long gap
+        // skipped by one expiry.
+        uint32_t n = (1u << (int)len) + 100;
+        std::vector<PduBuffer> v(n);
+        for (uint32_t i = 0; i < n; i++) { v[i] = PduBuffer::from(Bytes(4, (uint8_t)i)); tx.transmit_sdu(v[i]); }
+        uint32_t got = 0;
+        for (uint32_t i = 0; i + 1 < n; i += 2) {
+            if (i >= 1000 && i < 1000 + win / 2) continue;
+            assert(rx.receive_pdu(v[i + 1]) == Status::PENDING);
+            if (rx.receive_pdu(v[i]) == Status::OK) got++;
+            while (rx.pop_sdu(out)) got++;
+            if (i == 1000 + win / 2) { rx.tick(PDCP_T_REORDERING_MS); while (rx.pop_sdu(out)) got++; }
+        }
+        assert(got == n - win / 2 && rx.get_rx_deliv() == n + 6 && rx.get_rx_lost() == 1 + win / 2);
+        assert(out.to_bytes() == Bytes(4, (uint8_t)(n - 1)));
+    }
+}
 void test_pdcp_integrity() {
     PdcpLayer pdcp(PdcpBearerType::SRB);
     Bytes msg = {0x01,0x02,0x03};
@@ -67,6 +582,190 @@ void test_pdcp_integrity() {
     assert(pdcp.verify_integrity(msg, 0, 0xDEADBEEF, mac_i) == true);
     assert(pdcp.verify_integrity(msg, 0, 0x12345678, mac_i) == false);
 }
+static Bytes hex(const char* s) {
+    Bytes b;
+    for (size_t i = 0; s[i] && s[i + 1]; i += 2) b.push_back((uint8_t)std::stoul(std::string(s + i, 2), nullptr, 16));
+    return b;
+}
+void test_security_vectors() {
+    for (AesImpl impl : {AesImpl::SCALAR, AesImpl::AESNI}) {
+        if (!aes128_select(impl)) continue;
+        Aes128Key key; uint8_t out[16];
+        aes128_expand(hex("000102030405060708090a0b0c0d0e0f").data(), key);
+        aes128_encrypt(key, hex("00112233445566778899aabbccddeeff").data(), out);
+        assert(Bytes(out, out + 16) == hex("69c4e0d86a7b0430d8cdb78070b4c55a"));
+        // TS 33.401 C.1 / C.2 test set 1 (bit-exact lengths)
+        Aes128Key ek; aes128_expand(hex("d3c5d592327fb11c4035c6680af8c6d1").data(), ek);
+        Bytes data = hex("981ba6824c1bfb1ab485472029b71d808ce33e2cc3c0b5fc1f3de8a6dc66b1f0");
+        nea2(ek, 0x398a59b4, 0x15, 1, data.data(), 253);
+        assert(data == hex("e9fed8a63d155304d71df20bf3e82214b20ed7dad2f233dc3c22d7bdeeed8e78"));
+        Aes128Cmac ik; aes128_cmac_init(hex("2bd6459f82c5b300952c49104881ff48").data(), ik);
+        assert(nia2(ik, 0x38a6f056, 0x18, 0, hex("3332346263393840").data(), 58) == 0x118c6eb8);
+    }
+    aes128_select(AesImpl::AUTO);
+}
+void test_pdcp_security() {
+    PdcpSecurityConfig cfg;
+    cfg.cipher = CipherAlg::NEA2; cfg.integ = IntegAlg::NIA2; cfg.bearer = 3;
+    for (int i = 0; i < 16; i++) { cfg.k_enc[i] = (uint8_t)i; cfg.k_int[i] = (uint8_t)(0xA0 + i); }
+    PdcpLayer tx(PdcpBearerType::SRB), rx(PdcpBearerType::SRB);
+    tx.set_security(cfg);
+    cfg.direction = 1;
+    rx.set_security(cfg);
+    const size_t n = 40;
+    PduBuffer pdus[n]; Status st[n];
+    for (size_t i = 0; i < n; i++) pdus[i] = PduBuffer::from(Bytes(1 + i * 7, (uint8_t)i));
+    assert(tx.transmit_burst(pdus, n, st) == n && pdus[5].size() == 2 + 36 + PDCP_MAC_I_LEN);
+    assert(pdus[5].to_bytes() != Bytes(pdus[5].size(), 5));
+    pdus[7][3] ^= 0x01;
+    // The dropped PDU leaves a gap: later ones wait for t-Reordering.
+    assert(rx.receive_burst(pdus, n, st) == 7 && st[7] == Status::ERROR && rx.get_integrity_failures() == 1);
+    assert(st[8] == Status::PENDING && rx.pending_sdus() == 0);
+    for (size_t i = 0; i < 7; i++) assert(pdus[i].to_bytes() == Bytes(1 + i * 7, (uint8_t)i));
+    rx.tick(PDCP_T_REORDERING_MS);
+    PduBuffer out;
+    for (size_t i = 8; i < n; i++) assert(rx.pop_sdu(out) && out.to_bytes() == Bytes(1 + i * 7, (uint8_t)i));
+    assert(rx.get_rx_lost() == 1 && rx.get_rx_deliv() == n);
+    // Multi-buffer batches must match one-at-a-time results on every kernel.
+    Aes128Cmac k1, k2; aes128_cmac_init(cfg.k_int, k1); aes128_cmac_init(cfg.k_enc, k2);
+    Bytes msg(300); for (size_t i = 0; i < msg.size(); i++) msg[i] = (uint8_t)(i * 31);
+    IntegJob jobs[12];
+    for (size_t i = 0; i < 12; i++) jobs[i] = {(i & 1) ? &k2 : &k1, (uint32_t)i, (uint8_t)i, 0, msg.data(), i * 200, 0};
+    integ_batch(IntegAlg::NIA2, jobs, 12);
+    for (AesImpl impl : {AesImpl::SCALAR, AesImpl::AUTO}) {
+        aes128_select(impl);
+        for (size_t i = 0; i < 12; i++) assert(nia2(*jobs[i].key, jobs[i].count, jobs[i].bearer, 0, msg.data(), jobs[i].bits) == jobs[i].mac);
+    }
+}
+// IPv4/UDP, optionally with an RTP header, and a valid IP header checksum.
+static Bytes make_udp(uint32_t src, uint16_t dport, uint16_t ip_id, size_t payload,
+                      bool rtp = false, uint16_t sn = 0, uint32_t ts = 0, bool marker = false) {
+    size_t len = 28 + (rtp ? 12 : 0) + payload;
+    Bytes p(len, 0xA5);
+    uint8_t ip[20] = {0x45, 0, (uint8_t)(len >> 8), (uint8_t)len, (uint8_t)(ip_id >> 8), (uint8_t)ip_id, 0x40, 0, 64, 17, 0, 0,
+                      (uint8_t)(src >> 24), (uint8_t)(src >> 16), (uint8_t)(src >> 8), (uint8_t)src, 8, 8, 4, 4};
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2) sum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    ip[10] = (uint8_t)(~sum >> 8); ip[11] = (uint8_t)~sum;
+    std::memcpy(p.data(), ip, 20);
+    uint8_t udp[8] = {0x13, 0x88, (uint8_t)(dport >> 8), (uint8_t)dport, (uint8_t)((len - 20) >> 8), (uint8_t)(len - 20), 0xBE, 0xEF};
+    std::memcpy(p.data() + 20, udp, 8);
+    if (rtp) {
+        uint8_t h[12] = {0x80, (uint8_t)((marker ? 0x80 : 0) | 96), (uint8_t)(sn >> 8), (uint8_t)sn,
+                         (uint8_t)(ts >> 24), (uint8_t)(ts >> 16), (uint8_t)(ts >> 8), (uint8_t)ts, 0x11, 0x22, 0x33, 0x44};
+        std::memcpy(p.data() + 28, h, 12);
+    }
+    return p;
+}
+void test_rohc() {
+    // UDP flow: IR x3, then one-byte UO-0 headers.
+    RohcCompressor comp;
+    RohcDecompressor decomp;
+    for (uint16_t i = 0; i < 40; i++) {
+        Bytes ip = make_udp(0x0A000001, 5000, (uint16_t)(100 + i), 32);
+        PduBuffer b = PduBuffer::from(ip);
+        comp.compress(b);
+        if (i >= 3) assert(b.size() == 32 + 1 + 2);   // UO-0 + UDP checksum
+        assert(decomp.decompress(b) == Status::OK && b.to_bytes() == ip);
+    }
+    assert(comp.stats().ir == 3 && comp.stats().uo0 == 37);
+    // RTP voice: TS stride 160 is learnt, then UO-0; a marker needs UO-1 and
+    // a large SN/TS jump UOR-2 with extension.
+    RohcCompressor rtp_tx;
+    RohcDecompressor rtp_rx;
+    for (uint16_t i = 0; i < 60; i++) {
+        uint32_t n  = i + (i >= 50 ? 300 : 0);
+        uint16_t sn = (uint16_t)(65500 + n);
+        Bytes ip = make_udp(0x0A000002, 20000, (uint16_t)(7 + sn), 20, true, sn, 1000 + 160 * n, i == 30);
+        PduBuffer b = PduBuffer::from(ip);
+        rtp_tx.compress(b);
+        assert(rtp_rx.decompress(b) == Status::OK && b.to_bytes() == ip);
+    }
+    const RohcStats& rs = rtp_tx.stats();
+    assert(rtp_tx.context(0)->profile == RohcProfile::RTP && rtp_tx.context(0)->ts_stride == 160);
+    assert(rs.uo0 > 45 && rs.uo1 >= 1 && rs.uor2 >= 1);
+    // Lost packets: W-LSB covers short gaps, a 20-packet gap wraps the 4-bit
+    // SN and is fixed by context repair.
+    RohcCompressor lt;
+    RohcDecompressor lr;
+    for (uint16_t i = 0; i < 60; i++) {
+        Bytes ip = make_udp(0x0A000003, 6000, i, 16);
+        PduBuffer b = PduBuffer::from(ip);
+        lt.compress(b);
+        if ((i >= 10 && i < 18) || (i >= 30 && i < 50)) continue;
+        assert(lr.decompress(b) == Status::OK && b.to_bytes() == ip);
+    }
+    assert(lr.get_repairs() == 1);
+    // Corrupted UO-0 headers fail the CRC-3; k failures drop to static context.
+    for (int i = 0; i < 3; i++) {
+        PduBuffer b = PduBuffer::from(make_udp(0x0A000003, 6000, (uint16_t)(60 + i), 16));
+        lt.compress(b);
+        b[0] ^= 0x40;
+        assert(lr.decompress(b) == Status::ERROR);
+    }
+    assert(lr.get_crc_failures() >= 3 && lr.context(0)->state == RohcDecompState::SC);
+    // Many flows over large CIDs; non-UDP and non-IP payloads use profile 0.
+    RohcConfig cfg; cfg.max_cid = 1000;
+    RohcCompressor mt(cfg);
+    RohcDecompressor mr(cfg);
+    for (int round = 0; round < 5; round++)
+        for (uint32_t f = 0; f < 300; f++) {
+            Bytes ip = make_udp(0x0B000000 + f, (uint16_t)(1000 + f % 7), (uint16_t)(round * 3 + f), 10);
+            PduBuffer b = PduBuffer::from(ip);
+            mt.compress(b);
+            assert(mr.decompress(b) == Status::OK && b.to_bytes() == ip);
+        }
+    Bytes tcp = make_udp(0x0C000001, 80, 1, 40);
+    tcp[9] = 6;
+    Bytes raw = {0xF8, 0x01, 0x02}, small = {0x01, 0x02};
+    for (const Bytes& x : {tcp, raw, small, tcp, small, raw}) {
+        PduBuffer b = PduBuffer::from(x);
+        mt.compress(b);
+        assert(mr.decompress(b) == Status::OK && b.to_bytes() == x);
+    }
+    assert(mt.num_flows() == 302 && mt.stats().evictions == 0);
+    // Small CIDs: the 17th flow evicts the least recently used one.
+    RohcCompressor st;
+    RohcDecompressor sr;
+    for (uint32_t f = 0; f < 17; f++) {
+        Bytes ip = make_udp(0x0D000000 + f, 9, 1, 8);
+        PduBuffer b = PduBuffer::from(ip);
+        st.compress(b);
+        assert(sr.decompress(b) == Status::OK && b.to_bytes() == ip);
+    }
+    assert(st.num_flows() == 16 && st.stats().evictions == 1);
+    // Through PDCP: the DRB restores the IP packet exactly.
+    PdcpLayer ptx, prx;
+    for (uint16_t i = 0; i < 10; i++) {
+        Bytes ip = make_udp(0x0A000009, 7000, i, 100), pdu, out;
+        ptx.transmit_sdu(ip, pdu);
+        assert(prx.receive_pdu(pdu, out) == Status::OK && out == ip);
+        if (i >= 3) assert(pdu.size() == 2 + 1 + 2 + 100);
+    }
+}
+void test_burst_roundtrip() {
+    const size_t n = 16;
+    PdcpLayer pdcp_tx(PdcpBearerType::SRB), pdcp_rx(PdcpBearerType::SRB);
+    RlcLayer  rlc_tx(RlcMode::AM), rlc_rx(RlcMode::AM);
+    MacLayer  mac_tx(HarqConfig{HARQ_PROCS_NR}), mac_rx;
+    PhyLayer  phy;
+    PduBuffer pdus[n];
+    Status    st[n];
+    uint8_t   harq_ids[n];
+    for (size_t i = 0; i < n; i++) pdus[i] = PduBuffer::from(Bytes(40 + i, (uint8_t)i));
+    assert(pdcp_tx.transmit_burst(pdus, n, st) == n);
+    assert(rlc_tx.transmit_burst(pdus, n, st) == n);
+    size_t sent = mac_tx.transmit_burst(pdus, n, st, harq_ids);
+    assert(sent == n && harq_ids[0] != harq_ids[1]);
+    assert(phy.transmit_burst(pdus, n, st) == n);
+    assert(mac_rx.receive_burst(pdus, n, st) == n);
+    assert(rlc_rx.receive_burst(pdus, n, st) == n);
+    assert(pdcp_rx.receive_burst(pdus, n, st) == n);
+    for (size_t i = 0; i < n; i++) assert(st[i] == Status::OK && pdus[i].to_bytes() == Bytes(40 + i, (uint8_t)i));
+    assert(pdcp_tx.get_tx_sn() == n && rlc_tx.get_tx_sn() == n && rlc_rx.get_rx_sn() == n);
+    assert(mac_rx.get_rx_pdus() == n);
+}
 void test_rrc_connection() {
     RrcLayer rrc;
     assert(rrc.get_state() == RrcState::IDLE);
@@ -83,6 +782,189 @@ void test_rrc_inactive() {
     rrc.resume_connection();
     assert(rrc.get_state() == RrcState::CONNECTED);
 }
+struct PerProbe {
+    uint8_t a = 5;
+    bool    b = true;
+    uint8_t c = 0xAB;
+    using Fields = PerFields<PerField<&PerProbe::a, PerInt<0, 7>>, PerField<&PerProbe::b, PerBool>,
+                             PerField<&PerProbe::c, PerInt<0, 255>>>;
+};
+template <typename M> void codec_fill(M&) {}
+void codec_fill(RrcReconfigMsg& m)             { static const uint8_t nas[5] = {1, 2, 3, 4, 5}; m.dedicated_nas = PerView::of(nas, 5); }
+void codec_fill(RrcUeCapabilityInfoMsg& m)     { static const Bytes cap(300, 0x5A); m.container = PerView::of(cap.data(), cap.size()); }
+void codec_fill(NasRegistrationRequestMsg& m)  { m.supi = PerView::of("310260123456789", 15); }
+void codec_fill(NasAuthRequestMsg& m) {
+    static const Bytes abba(2, 0), rnd(16, 0x11), autn(16, 0x22);
+    m.abba = PerView::of(abba.data(), 2); m.rand = PerView::of(rnd.data(), 16); m.autn = PerView::of(autn.data(), 16);
+}
+void codec_fill(NasAuthResponseMsg& m)         { static const Bytes res(16, 0x33); m.res_star = PerView::of(res.data(), 16); }
+void codec_fill(NasPduSessionEstabReqMsg& m)   { m.dnn = PerView::of("internet", 8); }
+// Encode, decode, re-encode to the same bytes; every truncation must fail.
+template <typename Encode, typename Decode, typename Validate>
+void codec_roundtrip(Encode enc, Decode dec, Validate validate) {
+    uint8_t a[512], b[512];
+    size_t n = enc(a);
+    assert(n > 0 && validate(a, n) == Status::OK);
+    assert(dec(a, n, b) == n && std::memcmp(a, b, n) == 0);
+    for (size_t len = 0; len < n; len++) assert(validate(a, len) == Status::ERROR);
+    a[n] = 0;
+    assert(validate(a, n + 1) == Status::ERROR);
+}
+void test_msg_codec() {
+    uint8_t buf[8];
+    PerWriter w(buf, sizeof(buf));
+    per_encode<PerMode::UNALIGNED>(w, PerProbe{});
+    assert(w.ok() && w.bytes() == 2 && buf[0] == 0xBA && buf[1] == 0xB0);
+    PerWriter wa(buf, sizeof(buf));
+    per_encode<PerMode::ALIGNED>(wa, PerProbe{});
+    assert(wa.ok() && wa.bytes() == 2 && buf[0] == 0xB0 && buf[1] == 0xAB);
+    PerProbe p; p.a = 0; p.b = false; p.c = 0;
+    PerReader r(buf, 2);
+    per_decode<PerMode::ALIGNED>(r, p);
+    assert(r.ok() && p.a == 5 && p.b && p.c == 0xAB);
+
+    for (RrcMsgType t : RrcMsgSet::TYPES) {
+        assert(RrcMsgSet::visit(t, [](auto m) {
+            using M = decltype(m);
+            codec_fill(m);
+            codec_roundtrip([&](uint8_t* out) { return rrc_encode(m, out, 512); },
+                            [](const uint8_t* in, size_t n, uint8_t* out) {
+                                M d; assert(rrc_decode(in, n, d) == Status::OK); return rrc_encode(d, out, 512);
+                            }, rrc_validate);
+        }));
+    }
+    for (NasMsgType t : NasMsgSet::TYPES) {
+        assert(NasMsgSet::visit(t, [](auto m) {
+            using M = decltype(m);
+            codec_fill(m);
+            codec_roundtrip([&](uint8_t* out) { return nas_encode(m, 7, out, 512); },
+                            [](const uint8_t* in, size_t n, uint8_t* out) {
+                                M d; uint8_t seq = 0; NasMsgType type;
+                                assert(nas_peek_type(in, n, type, &seq) && type == M::TYPE && seq == 7);
+                                assert(nas_decode(in, n, d) == Status::OK); return nas_encode(d, seq, out, 512);
+                            }, nas_validate);
+        }));
+    }
+
+    // UPER leaves octet strings unaligned; views read across the boundary.
+    RrcReconfigMsg sc; codec_fill(sc);
+    uint8_t pdu[64];
+    size_t n = rrc_encode(sc, pdu, sizeof(pdu));
+    RrcReconfigMsg sd;
+    assert(rrc_decode(pdu, n, sd) == Status::OK && !sd.dedicated_nas.aligned());
+    uint8_t nas[5];
+    assert(sd.dedicated_nas.copy_to(nas, 5) && nas[0] == 1 && nas[4] == 5 && !sd.dedicated_nas.copy_to(nas, 4));
+    // APER aligns them, so they are plain pointers into the PDU.
+    NasAuthRequestMsg ar; codec_fill(ar);
+    n = nas_encode(ar, 0, pdu, sizeof(pdu));
+    NasAuthRequestMsg ad;
+    assert(nas_decode(pdu, n, ad) == Status::OK && ad.rand.data() && ad.rand.data() >= pdu && ad.autn.data() + 16 == pdu + n);
+
+    // Encoding refuses short buffers and values outside their range.
+    RrcSetupMsg setup; setup.num_prbs = 106;
+    assert(rrc_encode(setup, pdu, 1) == 0 && rrc_encode(setup, pdu, 3) == 3);
+    setup.num_prbs = 0;
+    assert(rrc_encode(setup, pdu, sizeof(pdu)) == 0);
+    NasRegistrationRequestMsg rq;
+    assert(nas_encode(rq, 0, pdu, sizeof(pdu)) == 0);   // SUPI is mandatory
+    // Unknown CHOICE index / protocol discriminator.
+    RrcMsgType rt; NasMsgType nt;
+    pdu[0] = 0xF0;
+    assert(!rrc_peek_type(pdu, 1, rt));
+    n = nas_encode(ar, 0, pdu, sizeof(pdu));
+    pdu[0] = 0x2E;
+    assert(!nas_peek_type(pdu, n, nt) && nas_validate(pdu, n) == Status::ERROR);
+
+    // A truncated AUTH_REQUEST is rejected before anything is copied.
+    NasLayer ue;
+    Bytes in(pdu, pdu + n), resp;
+    in[0] = NAS_EPD_5GMM;
+    in.resize(20);
+    assert(ue.receive_message(in, resp) == Status::ERROR && resp.empty());
+    RrcLayer rrc;
+    assert(rrc.send_measurement_report(-85, -10) == Status::OK);
+    assert(rrc.send_measurement_report(-20, -10) == Status::ERROR);
+}
+void test_aka() {
+    for (ShaImpl impl : {ShaImpl::SCALAR, ShaImpl::SHANI}) {
+        if (!sha256_select(impl)) continue;
+        uint8_t d[32];
+        sha256(reinterpret_cast<const uint8_t*>("abc"), 3, d);
+        assert(Bytes(d, d + 32) == hex("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+        Bytes a200(200, 'a');
+        sha256(a200.data(), a200.size(), d);
+        assert(Bytes(d, d + 32) == hex("c2a908d98f5df987ade41b5fce213067efbcc21ef2240212a41e54b5e7c28ae5"));
+        // RFC 4231 test case 2
+        hmac_sha256(reinterpret_cast<const uint8_t*>("Jefe"), 4,
+                    reinterpret_cast<const uint8_t*>("what do ya want for nothing?"), 28, d);
+        assert(Bytes(d, d + 32) == hex("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"));
+    }
+    sha256_select(ShaImpl::AUTO);
+    // TS 35.208 test set 1, then the TS 33.501 Annex A chain on its outputs.
+    Bytes k = hex("465b5ce8b199b49faa5f0a2ee238a6bc"), rand = hex("23553cbe9637a89d218ae64dae47bf35");
+    Bytes sqn = hex("ff9bb4d0b607"), amf = hex("b9b9"), opc(16);
+    milenage_opc(k.data(), hex("cdc202d5123e20f62b6d676ac72cb318").data(), opc.data());
+    assert(opc == hex("cd63cb71954a9f4e48a5994e37a02baf"));
+    const std::string snn = "5G:mnc260.mcc310.3gppnetwork.org";
+    for (AesImpl impl : {AesImpl::SCALAR, AesImpl::AESNI}) {
+        if (!aes128_select(impl)) continue;
+        Aes128Key key; aes128_expand(k.data(), key);
+        MilenageOut o;
+        milenage(key, opc.data(), rand.data(), sqn.data(), amf.data(), o);
+        assert(Bytes(o.mac_a, o.mac_a + 8) == hex("4a9ffac354dfafb3") && Bytes(o.mac_s, o.mac_s + 8) == hex("01cfaf9ec4e871e9"));
+        assert(Bytes(o.res, o.res + 8) == hex("a54211d5e3ba50bf") && Bytes(o.ak, o.ak + 6) == hex("aa689c648370"));
+        assert(Bytes(o.ck, o.ck + 16) == hex("b40ba9a3c58b2a05bbf0d987b21bf8cb"));
+        assert(Bytes(o.ik, o.ik + 16) == hex("f769bcd751044604127672711c6d3441"));
+        assert(Bytes(o.ak_star, o.ak_star + 6) == hex("451e8beca43b"));
+        uint8_t res_star[16], hres[16], k_ausf[32], k_seaf[32], sqn_ak[6];
+        for (int i = 0; i < 6; i++) sqn_ak[i] = sqn[i] ^ o.ak[i];
+        aka_res_star(o.ck, o.ik, snn, rand.data(), o.res, res_star);
+        assert(Bytes(res_star, res_star + 16) == hex("1504f5522bb79f4154a56e194a1a1b36"));
+        aka_hres_star(rand.data(), res_star, hres);
+        assert(Bytes(hres, hres + 16) == hex("a5677302eadfb4f28f4069aa707233bf"));
+        aka_k_ausf(o.ck, o.ik, snn, sqn_ak, k_ausf);
+        assert(Bytes(k_ausf, k_ausf + 32) == hex("f2dc0b8f55dd8bd4603f1e60a8be67930f361bf1c5f22dd60a805a284d97bbaa"));
+        aka_k_seaf(k_ausf, snn, k_seaf);
+        assert(Bytes(k_seaf, k_seaf + 32) == hex("ba28aad65223da136b00823da83e35578d5c8ab63d72320b7de0cb05a8e133a4"));
+        // A batch of 11 (one full lane group and a partial one) matches one-at-a-time.
+        Aes128Key keys[11]; MilenageOut outs[11]; MilenageJob jobs[11]; Bytes rands[11];
+        for (int i = 0; i < 11; i++) {
+            Bytes ki = k; ki[0] ^= (uint8_t)i;
+            aes128_expand(ki.data(), keys[i]);
+            rands[i] = rand; rands[i][15] ^= (uint8_t)(i * 7);
+            jobs[i] = {&keys[i], opc.data(), rands[i].data(), sqn.data(), amf.data(), &outs[i]};
+        }
+        milenage_batch(jobs, 11);
+        for (int i = 0; i < 11; i++) {
+            MilenageOut one;
+            milenage(keys[i], opc.data(), rands[i].data(), sqn.data(), amf.data(), one);
+            assert(std::memcmp(&one, &outs[i], sizeof(one)) == 0);
+        }
+    }
+    aes128_select(AesImpl::AUTO);
+
+    // Home network and USIM agree; replayed or tampered AUTNs are refused.
+    AkaConfig cfg; cfg.cache_depth = 3;
+    AkaAuc auc(cfg, 1);
+    uint32_t s0 = auc.add_subscriber(k.data(), opc.data());
+    Bytes k1 = k; k1[5] ^= 0x40;
+    uint32_t s1 = auc.add_subscriber(k1.data(), opc.data());
+    assert(auc.prefill() == 6 && auc.cached(s0) == 3 && auc.prefill() == 0);
+    uint8_t sqn_ms[6] = {}, res_star[16], hres[16], k_seaf[32];
+    AkaVector v, first;
+    for (int i = 0; i < 5; i++) {
+        auc.get_vector(s0, v);
+        if (i == 0) first = v;
+        assert(aka_ue_authenticate(k.data(), opc.data(), v.rand, v.autn, snn, sqn_ms, res_star, k_seaf) == AkaResult::OK);
+        aka_hres_star(v.rand, res_star, hres);
+        assert(std::memcmp(res_star, v.xres_star, 16) == 0 && std::memcmp(hres, v.hxres_star, 16) == 0);
+        assert(std::memcmp(k_seaf, v.k_seaf, 32) == 0);
+    }
+    assert(auc.stats().cache_hits == 3 && auc.stats().cache_misses == 2 && auc.stats().generated == 8);
+    assert(aka_ue_authenticate(k.data(), opc.data(), first.rand, first.autn, snn, sqn_ms, res_star, nullptr) == AkaResult::SYNC_FAILURE);
+    auc.get_vector(s1, v);
+    assert(aka_ue_authenticate(k.data(), opc.data(), v.rand, v.autn, snn, sqn_ms, res_star, nullptr) == AkaResult::MAC_FAILURE);
+}
 void test_nas_registration() {
     NasLayer nas;
     assert(nas.get_reg_state() == NasRegistrationState::DEREGISTERED);
@@ -101,17 +983,397 @@ void test_nas_deregistration() {
     nas.initiate_deregistration();
     assert(nas.get_reg_state() == NasRegistrationState::DEREGISTERED);
 }
+void test_nas_engine() {
+    NasIpPool pool(0x0A2D0001, 3);
+    uint32_t a = pool.alloc(), b = pool.alloc(), c = pool.alloc();
+    assert(a == 0x0A2D0001 && b == a + 1 && c == a + 2 && pool.alloc() == 0);
+    assert(pool.release(b) == Status::OK && pool.release(b) == Status::ERROR && pool.release(a + 3) == Status::ERROR);
+    assert(pool.alloc() == b && pool.in_use() == 3);
+    assert(nas_ip_to_string(a) == "10.45.0.1");
+
+    Logger::instance().set_level(LogLevel::WARN);
+    // Inline: every UE's procedure starts before the first one finishes.
+    NasEngineConfig cfg; cfg.num_ues = 500; cfg.num_workers = 2; cfg.ip_count = 480;
+    NasEngine eng(cfg);
+    assert(eng.register_all() == Status::OK);
+    assert(eng.register_ue(500) == Status::ERROR);
+    eng.drain();
+    NasEngineStats st = eng.stats();
+    assert(st.registrations == 500 && st.sessions == 480 && st.session_rejects == 20 && st.unexpected == 0);
+    std::vector<uint32_t> ips;
+    for (uint32_t u = 0; u < 500; u++) {
+        const NasContext* ctx = eng.context(u);
+        assert(ctx->reg_state == NasRegistrationState::REGISTERED && ctx->tmsi != 0);
+        if (ctx->ip) ips.push_back(ctx->ip);
+    }
+    std::sort(ips.begin(), ips.end());
+    assert(ips.size() == 480 && std::unique(ips.begin(), ips.end()) == ips.end());
+    assert(eng.deregister_ue(7) == Status::OK);
+    eng.drain();
+    assert(eng.context(7)->reg_state == NasRegistrationState::DEREGISTERED && eng.context(7)->ip == 0);
+    assert(eng.register_ue(7, false) == Status::OK);
+    eng.drain();
+    assert(eng.context(7)->reg_state == NasRegistrationState::REGISTERED && eng.context(7)->session == NasSessionState::INACTIVE);
+
+    // Threaded: 4 shards register, lose the core, register again.
+    NasEngineConfig big; big.num_ues = 20000; big.num_workers = 4;
+    NasEngine storm(big);
+    storm.start();
+    assert(storm.register_all() == Status::OK);
+    storm.drain();
+    assert(storm.stats().registrations == 20000 && storm.stats().aka_cache_misses == 20000);
+    assert(storm.prefill_auth_vectors() == Status::OK);
+    storm.drain();
+    assert(storm.core_restart() == Status::OK);
+    storm.drain();
+    st = storm.stats();
+    assert(st.registrations == 40000 && st.sessions == 40000 && st.unexpected == 0 && st.auth_failures == 0);
+    assert(st.aka_cache_hits == 20000 && st.aka_generated == 20000 + 20000 * big.aka_cache_depth);
+    assert(storm.deregister_all() == Status::OK);
+    storm.drain();
+    storm.stop();
+    Logger::instance().set_level(LogLevel::DEBUG);
+    assert(storm.stats().deregistrations == 20000);
+    for (uint32_t u = 0; u < 20000; u += 997) assert(storm.context(u)->ip == 0);
+}
+void test_ue_manager_sharding() {
+    Logger::instance().set_level(LogLevel::WARN);
+    UeManagerConfig cfg; cfg.num_workers = 3;
+    std::vector<std::atomic<uint32_t>> tbs_per_ue(301);
+    cfg.tb_sink = [&](uint16_t rnti, PduBuffer& tb) { assert(tb.size() > 0); tbs_per_ue[rnti]++; };
+    UeManager mgr(cfg);
+    mgr.start();
+    for (uint16_t r = 1; r <= 300; r++) assert(mgr.add_ue(r) == Status::OK);
+    for (int n = 0; n < 5; n++)
+        for (uint16_t r = 1; r <= 300; r++) assert(mgr.inject_sdu(r, PduBuffer::from(Bytes(60, (uint8_t)r))) == Status::OK);
+    mgr.inject_sdu(999, PduBuffer::from(Bytes(10, 0)));
+    mgr.drain();
+    UeManagerStats st = mgr.stats();
+    mgr.stop();
+    Logger::instance().set_level(LogLevel::DEBUG);
+    assert(st.ues == 300 && st.tx_sdus == 1500 && st.errors == 0 && st.unknown_ue == 1);
+    for (uint16_t r = 1; r <= 300; r++) assert(tbs_per_ue[r] == 5);
+    assert(mgr.shard_of(4) == 1 && mgr.num_workers() == 3);
+}
+void test_bearer_pipeline() {
+    Logger::instance().set_level(LogLevel::WARN);
+    const size_t N = 3000;   // wraps past the 512-SDU RLC AM window several times
+    for (PipelineMode mode : {PipelineMode::RUN_TO_COMPLETION, PipelineMode::PIPELINED}) {
+        PipelineConfig cfg; cfg.mode = mode; cfg.ring_depth = 64; cfg.batch = 16;
+        BearerPipeline pipe(cfg);
+        pipe.start();
+        for (size_t i = 0; i < N; ) {
+            PduBuffer sdu = PduBuffer::from(Bytes(100 + i % 50, (uint8_t)i));
+            while (pipe.submit(sdu) == Status::BUFFER_FULL) std::this_thread::yield();
+            i++;
+        }
+        pipe.drain();
+        pipe.stop();
+        PipelineStats st = pipe.stats();
+        assert(st.submitted == N && st.completed == N && st.errors == 0);
+        assert(st.tx_bytes == N * 100 + (N / 50) * (49 * 50 / 2));
+        assert(pipe.pdcp().get_tx_count() == N && pipe.mac().get_tx_pdus() == N);
+        assert(pipe.rlc().get_tx_sn() == N % RLC_SN_MOD && pipe.rlc().tx_in_flight() == 0);
+    }
+    // Back-pressure: with the stages not running, the first ring fills up.
+    PipelineConfig cfg; cfg.mode = PipelineMode::PIPELINED; cfg.ring_depth = 4;
+    BearerPipeline pipe(cfg);
+    PduBuffer sdus[6];
+    for (PduBuffer& b : sdus) b = PduBuffer::from(Bytes(40, 1));
+    assert(pipe.submit_burst(sdus, 6) == 4 && sdus[4].size() == 40);
+    assert(pipe.submit(sdus[4]) == Status::BUFFER_FULL && pipe.stats().refused == 3);
+    pipe.start();
+    pipe.drain();
+    assert(pipe.submit_burst(sdus + 4, 2) == 2);
+    pipe.drain();
+    pipe.stop();
+    Logger::instance().set_level(LogLevel::DEBUG);
+    assert(pipe.stats().completed == 6 && pipe.stats().errors == 0);
+}
+
+void test_metrics() {
+    MetricsRegistry& reg = MetricsRegistry::instance();
+    MetricLabels l{"TEST", 7, 4};
+    MetricCounter   c = reg.counter("test_events_total", l);
+    MetricGauge     g = reg.gauge("test_depth", l);
+    MetricHistogram h = reg.histogram("test_delay_ns", {10, 100}, l);
+    size_t series = reg.num_series();
+    assert(c.bound() && g.bound() && h.bound() && !MetricCounter().bound());
+    assert(reg.counter("test_events_total", l).bound() && reg.num_series() == series);
+    assert(!reg.gauge("test_events_total", l).bound());   // name and labels taken by a counter
+    MetricCounter().add(5);
+    // Every thread writes its own cells; the snapshot adds them up.
+    std::vector<std::thread> ts;
+    for (int t = 0; t < 4; t++)
+        ts.emplace_back([&] {
+            for (int i = 0; i < 10000; i++) c.add();
+            g.add(3);
+            h.record(5); h.record(50); h.record(500);
+        });
+    for (std::thread& t : ts) t.join();
+    g.add(-2);
+    {
+        TrackedGauge tg(g);
+        tg.set(100);
+        assert(reg.snapshot().find("test_depth", 7, 4)->value == 110);
+        tg.set(40);
+    }
+    MetricsSnapshot snap = reg.snapshot();
+    assert(snap.total("test_events_total") == 40000 && snap.find("test_depth", 7, 4)->value == 10);
+    const MetricSample* hs = snap.find("test_delay_ns", 7, 4);
+    assert(hs && hs->kind == MetricKind::HISTOGRAM && hs->count == 12 && hs->sum == 4 * 555);
+    assert(hs->buckets.size() == 3 && hs->buckets[0] == 4 && hs->buckets[1] == 4 && hs->buckets[2] == 4);
+    reg.histogram("test_delay_ns", {10, 100}, {"TEST", 8, 4}).record(10);
+    MetricSample all = reg.snapshot().merged("test_delay_ns");
+    assert(all.count == 13 && all.buckets[0] == 5);
+    // Layers report through bound handles only.
+    PhyConfig pc; pc.channel_snr_db = -10.0f;
+    PhyLayer phy(pc, 99), quiet(pc, 98);
+    phy.bind_metrics(900001);
+    for (PhyLayer* p : {&phy, &quiet}) {
+        PduBuffer tb = PduBuffer::from(Bytes(100, 1));
+        p->transmit_transport_block(tb);
+        p->receive_transport_block(tb);
+    }
+    RlcLayer rlc(RlcMode::AM);
+    rlc.bind_metrics(900001, 4);
+    for (int i = 0; i < 3; i++) { PduBuffer p = PduBuffer::from(Bytes(10, 1)); rlc.transmit_sdu(p); }
+    snap = reg.snapshot();
+    assert(snap.find("phy_rx_tbs_total", 900001)->value == 1 && snap.find("phy_rx_tb_errors_total", 900001)->value == 1);
+    assert(snap.find("rlc_tx_pdus_total", 900001, 4)->value == 3 && snap.find("rlc_tx_window", 900001, 4)->value == 3);
+    std::ostringstream prom, json;
+    snap.write_prometheus(prom);
+    snap.write_json(json);
+    assert(prom.str().find("# TYPE test_delay_ns histogram\n") != std::string::npos);
+    assert(prom.str().find("test_delay_ns_bucket{layer=\"TEST\",ue=\"7\",bearer=\"4\",le=\"+Inf\"} 12\n") != std::string::npos);
+    assert(prom.str().find("test_events_total{layer=\"TEST\",ue=\"7\",bearer=\"4\"} 40000\n") != std::string::npos);
+    assert(json.str().find("\"name\":\"test_depth\",\"layer\":\"TEST\",\"ue\":7,\"bearer\":4,\"type\":\"gauge\",\"value\":10}") != std::string::npos);
+    const std::string path = "/tmp/test_metrics.prom";
+    assert(reg.write(path, MetricsFormat::PROMETHEUS));
+    std::ifstream in(path);
+    std::string first;
+    assert(std::getline(in, first) && first.rfind("# TYPE ", 0) == 0 && !std::ifstream(path + ".tmp"));
+    std::remove(path.c_str());
+}
+
+// Records of a pcap file as (UDP payload) strings.
+static std::vector<std::string> read_pcap(const std::string& path, uint32_t& linktype) {
+    std::ifstream in(path, std::ios::binary);
+    std::string f((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<std::string> out;
+    uint32_t magic = 0;
+    if (f.size() < 24) return out;
+    std::memcpy(&magic, f.data(), 4);
+    std::memcpy(&linktype, f.data() + 20, 4);
+    assert(magic == 0xa1b23c4d);
+    for (size_t off = 24; off + 16 <= f.size();) {
+        uint32_t caplen;
+        std::memcpy(&caplen, f.data() + off + 8, 4);
+        out.push_back(f.substr(off + 16 + 28, caplen - 28));
+        off += 16 + caplen;
+    }
+    return out;
+}
+void test_pcap_capture() {
+    PcapCapture& cap = PcapCapture::instance();
+    const std::string path = "/tmp/test_capture.pcap";
+    PcapConfig cfg;
+    cfg.path = path;
+    cfg.ues  = {7};
+    assert(cap.start(cfg) == Status::OK && cap.running());
+    assert(cap.start(cfg) == Status::INVALID_STATE);
+    // UE 7 is selected, UE 8 is not; the receiving MAC stamps uplink.
+    size_t pdcp_len = 0;
+    for (uint16_t ue : {7, 8}) {
+        PcapContext ctx;
+        ctx.ueid = ctx.rnti = ue;
+        PdcpLayer pdcp; RlcLayer rlc; MacLayer mac, peer;
+        pdcp.bind_capture(ctx); rlc.bind_capture(ctx); mac.bind_capture(ctx); peer.bind_capture(ctx);
+        PduBuffer p = PduBuffer::from(Bytes(40, 0xAB));
+        assert(pdcp.transmit_sdu(p) == Status::OK);
+        pdcp_len = p.size();
+        assert(rlc.transmit_sdu(p) == Status::OK && mac.transmit_sdu(p) == Status::OK);
+        assert(peer.receive_pdu(p) == Status::OK);
+    }
+    cap.stop();
+    PcapStats st = cap.stats();
+    assert(!cap.running() && st.frames == 4 && st.dropped == 0 && st.writes >= 2);
+    uint32_t link = 0;
+    std::vector<std::string> recs = read_pcap(path, link);
+    assert(link == PCAP_LINKTYPE_IPV4 && recs.size() == 4);
+    assert(recs[0].compare(0, 7, "pdcp-nr") == 0 && recs[0][7] == 2);             // user plane
+    assert(recs[1].compare(0, 6, "rlc-nr") == 0 && recs[1][6] == PCAP_RLC_AM && recs[1][7] == 12);
+    for (int i : {2, 3}) {
+        const std::string& r = recs[i];
+        // signature, FDD, direction, C-RNTI, RNTI and UEID tags
+        assert(r.compare(0, 6, "mac-nr") == 0 && r[6] == 1 && r[8] == 3);
+        assert(r[9] == 0x02 && r[11] == 7 && r[12] == 0x03 && r[14] == 7);
+    }
+    assert(recs[2][7] == (char)PcapDirection::DOWNLINK && recs[2][15] == 0x06);   // HARQ ID on TX
+    assert(recs[3][7] == (char)PcapDirection::UPLINK && recs[3][15] == 0x01);
+    // 18 bytes of framing ending in the payload tag, then the PDU as sent.
+    assert(recs[0].size() == 18 + pdcp_len && recs[0][17] == 0x01);
+    // A ring far smaller than the burst drops frames instead of blocking.
+    cfg.ues.clear();
+    cfg.layers     = PCAP_MAC;
+    cfg.ring_bytes = 1024;
+    assert(cap.start(cfg) == Status::OK);
+    PcapContext ctx;
+    ctx.on = true;
+    Bytes pdu(200, 0x5A);
+    for (int i = 0; i < 1000; i++) cap.mac(ctx, true, pdu.data(), pdu.size());
+    cap.rlc(ctx, true, PCAP_RLC_AM, 12, pdu.data(), pdu.size());   // layer not selected
+    cap.stop();
+    st = cap.stats();
+    assert(st.dropped > 0 && st.frames + st.dropped == 1000);
+    assert(read_pcap(path, link).size() == st.frames);
+    std::remove(path.c_str());
+}
+void test_latency_histogram() {
+    LatencyHistogram h;
+    assert(h.count() == 0 && h.percentile(50) == 0 && h.min() == 0);
+    for (uint64_t v = 1; v <= 100; v++) h.record(v);
+    assert(h.count() == 100 && h.min() == 1 && h.max() == 100 && h.mean() == 50.5);
+    assert(h.percentile(50) == 50 && h.percentile(99) == 99 && h.percentile(100) == 100 && h.percentile(0) == 1);
+    // Above 128 a bucket is within 1/64 of its values.
+    for (uint64_t v : {129ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        size_t i = LatencyHistogram::index_of(v);
+        assert(i < LatencyHistogram::BUCKETS && LatencyHistogram::upper_of(i) >= v);
+        assert(LatencyHistogram::upper_of(i) - v <= v / 64);
+    }
+    LatencyHistogram g;
+    g.record(1000000, 100);
+    h.merge(g);
+    assert(h.count() == 200 && h.max() == 1000000 && h.percentile(50) == 100);
+    uint64_t p75 = h.percentile(75);
+    assert(p75 >= 1000000 && p75 - 1000000 <= 1000000 / 64);
+    h.reset();
+    assert(h.count() == 0 && h.max() == 0);
+}
+
+void test_loopback() {
+    Logger::instance().set_level(LogLevel::ERR);
+    const size_t N = 600;
+    for (float snr : {30.0f, 13.0f}) {
+        LoopbackConfig cfg; cfg.phy.mcs = MCS::QAM64_2_3; cfg.phy.num_prbs = 52;
+        cfg.phy.channel_snr_db = snr; cfg.harq.num_procs = HARQ_PROCS_NR; cfg.measure_cpu = false;
+        LoopbackLink link(cfg);
+        size_t got = 0;
+        bool in_order = true;
+        link.set_sink([&](const PduBuffer& sdu) {
+            in_order = in_order && sdu.size() == 1000 && sdu.data()[0] == (uint8_t)got;
+            got++;
+        });
+        for (size_t i = 0; i < N; ) {
+            PduBuffer sdu = PduBuffer::from(Bytes(1000, (uint8_t)i));
+            if (link.submit(sdu) == Status::OK) { i++; continue; }
+            link.run_slot();
+        }
+        assert(link.drain());
+        LoopbackStats st = link.stats();
+        assert(st.submitted == N && st.delivered == N && st.lost == 0 && got == N && in_order);
+        assert(st.rx_bytes == N * 1000 && st.status_pdus > 0 && link.in_flight() == 0);
+        const LatencyHistogram& e2e = link.latency(LOOP_E2E);
+        assert(e2e.count() == N && link.latency(LOOP_MAC_PHY).count() == N);
+        assert(e2e.min() >= cfg.slot_us * 1000ULL && e2e.max() <= link.now_ns());
+        if (snr > 20) {
+            // A clean channel needs neither HARQ nor ARQ.
+            assert(st.tb_errors == 0 && st.harq_retx == 0 && st.rlc_retx == 0);
+            assert(link.latency(LOOP_MAC_PHY).max() <= 2ULL * cfg.slot_us * 1000);
+        } else {
+            assert(st.tb_errors > 0 && st.harq_retx > 0);
+        }
+    }
+    Logger::instance().set_level(LogLevel::DEBUG);
+}
+
+// Drives a manager with every kind of stimulus; the pause splits the run
+// into two bursts for the paced replay.
+static void trace_workload(UeManager& mgr, uint32_t pause_ms) {
+    for (uint16_t r = 1; r <= 8; r++) mgr.add_ue(r);
+    for (uint16_t r = 1; r <= 8; r += 2) mgr.attach_ue(r);
+    mgr.inject_snr(3, 2.0f);
+    for (int n = 0; n < 40; n++) {
+        uint16_t r = (uint16_t)(1 + n % 8);
+        Bytes    sdu(20 + n, (uint8_t)n);
+        mgr.inject_sdu(r, PduBuffer::from(sdu));
+        mgr.inject_harq_feedback(r, (uint8_t)(n / 8 % 8), n % 3 != 0);
+        if (n == 20) {
+            mgr.drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(pause_ms));
+        }
+    }
+    mgr.inject_rlc_status(2, 3, {1, 2});
+    mgr.remove_ue(8);
+    mgr.inject_sdu(8, PduBuffer::from(Bytes(10, 1)));   // unknown UE by now
+    mgr.drain();
+}
+void test_trace_replay() {
+    const std::string path = "/tmp/test_trace.bin";
+    UeManagerConfig cfg;
+    cfg.num_workers   = 2;
+    cfg.auto_harq_ack = false;
+    UeTbDigest      live;
+    UeTraceRecorder rec;
+    cfg.tb_sink = live.sink();
+    cfg.trace   = &rec;
+    assert(rec.open(path, cfg) == Status::OK);
+    UeManagerStats  recorded;
+    {
+        UeManager mgr(cfg);
+        mgr.start();
+        trace_workload(mgr, 30);
+        mgr.stop();
+        recorded = mgr.stats();
+    }
+    rec.close();
+    assert(rec.records() == 8 + 4 + 1 + 80 + 3 && recorded.tx_sdus == 40 && recorded.unknown_ue == 1);
+    // Same config out of the header, same TBs per UE, same counters.
+    for (TracePacing pacing : {TracePacing::MAX_SPEED, TracePacing::RECORDED}) {
+        UeTraceReplayer rp;
+        assert(rp.open(path) == Status::OK && !rp.truncated() && rp.records() == rec.records());
+        UeManagerConfig rcfg = rp.config();
+        assert(rcfg.num_workers == 2 && !rcfg.auto_harq_ack && rcfg.auto_rlc_ack && rcfg.phy.num_prbs == cfg.phy.num_prbs);
+        UeTbDigest replayed;
+        rcfg.tb_sink = replayed.sink();
+        UeManager mgr(rcfg);
+        mgr.start();
+        UeTraceReplayStats rs;
+        assert(rp.replay(mgr, pacing, rs) == Status::OK);
+        mgr.stop();
+        UeManagerStats st = mgr.stats();
+        assert(rs.records == rec.records() && rs.sdus == 41);
+        assert(replayed.combined() == live.combined() && replayed.of(3) == live.of(3) && live.of(3) != UeTbDigest().of(3));
+        assert(st.ues == recorded.ues && st.tx_sdus == recorded.tx_sdus && st.tx_bytes == recorded.tx_bytes &&
+               st.errors == recorded.errors && st.unknown_ue == recorded.unknown_ue);
+        if (pacing == TracePacing::RECORDED) assert(rs.elapsed_ns >= 30000000);
+    }
+    // A torn tail is dropped, not misread.
+    std::ifstream in(path, std::ios::binary);
+    std::string   data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(path, std::ios::binary).write(data.data(), (std::streamsize)data.size() - 5);
+    UeTraceReplayer torn;
+    assert(torn.open(path) == Status::OK && torn.truncated() && torn.records() < rec.records());
+    std::remove(path.c_str());
+    UeTraceReplayer missing;
+    assert(missing.open(path) == Status::ERROR);
+}
 
 int main() {
     std::cout << "╔══════════════════════════╗\n";
     std::cout << "║  Protocol Stack Tests     ║\n";
     std::cout << "╚══════════════════════════╝\n\n";
-    std::cout << "[ PHY ]\n";  RUN(phy_throughput);
-    std::cout << "[ MAC ]\n";  RUN(mac_roundtrip); RUN(mac_harq);
-    std::cout << "[ RLC ]\n";  RUN(rlc_am); RUN(rlc_tm);
-    std::cout << "[ PDCP ]\n"; RUN(pdcp_roundtrip); RUN(pdcp_integrity);
-    std::cout << "[ RRC ]\n";  RUN(rrc_connection); RUN(rrc_inactive);
-    std::cout << "[ NAS ]\n";  RUN(nas_registration); RUN(nas_pdu_session); RUN(nas_deregistration);
+    Logger::instance().set_async(false);
+    std::cout << "[ LOG ]\n";  RUN(logger_deferred); RUN(metrics); RUN(pcap_capture);
+    std::cout << "[ BUF ]\n";  RUN(pdu_headroom); RUN(pdu_zero_copy_stack);
+    std::cout << "[ PHY ]\n";  RUN(phy_throughput); RUN(channel_model); RUN(crc); RUN(modulation);
+    std::cout << "[ MAC ]\n";  RUN(mac_roundtrip); RUN(mac_harq); RUN(mac_mux); RUN(mac_scheduler);
+    std::cout << "[ RLC ]\n";  RUN(rlc_am); RUN(rlc_am_reorder); RUN(rlc_t_reassembly); RUN(rlc_am_arq); RUN(rlc_am_poll_window); RUN(rlc_segmentation); RUN(rlc_tm);
+    std::cout << "[ PDCP ]\n"; RUN(pdcp_roundtrip); RUN(pdcp_reordering); RUN(pdcp_integrity); RUN(security_vectors); RUN(pdcp_security); RUN(rohc);
+    std::cout << "[ BURST ]\n"; RUN(burst_roundtrip);
+    std::cout << "[ RRC ]\n";  RUN(rrc_connection); RUN(rrc_inactive); RUN(msg_codec);
+    std::cout << "[ NAS ]\n";  RUN(aka); RUN(nas_registration); RUN(nas_pdu_session); RUN(nas_deregistration); RUN(nas_engine);
+    std::cout << "[ UE ]\n";   RUN(ue_manager_sharding); RUN(bearer_pipeline); RUN(latency_histogram); RUN(loopback); RUN(trace_replay);
     std::cout << "\nResults: " << tests_passed << "/" << tests_run << " passed\n";
     return (tests_passed == tests_run) ? 0 : 1;
 }